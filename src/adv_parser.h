@@ -0,0 +1,111 @@
+/**
+ * Advertisement Parser
+ *
+ * Handles:
+ * - Walking raw AD structures (length/type/value) in place
+ * - Integer matching of 16-bit service UUIDs
+ * - Local name matching without building strings
+ *
+ * Everything here works on the raw advertisement payload (advert data
+ * followed by scan response data) and has no Arduino dependencies.
+ */
+
+#ifndef ADV_PARSER_H
+#define ADV_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// AD types (Bluetooth Core Specification Supplement, Part A)
+const uint8_t AD_TYPE_FLAGS = 0x01;
+const uint8_t AD_TYPE_NAME_SHORT = 0x08;
+const uint8_t AD_TYPE_NAME_COMPLETE = 0x09;
+const uint8_t AD_TYPE_SERVICE_DATA_16 = 0x16;
+const uint8_t AD_TYPE_MANUFACTURER_DATA = 0xFF;
+
+const uint16_t UUID16_ENVIRONMENTAL_SENSING = 0x181A;
+
+// Read little-endian / big-endian integers from a byte pointer
+uint16_t readLE16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint16_t readBE16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// One AD structure: type byte plus a pointer to its value bytes
+struct ADStructure {
+    uint8_t type;
+    const uint8_t* value;
+    uint8_t length;
+};
+
+// Advance to the next AD structure starting at `pos`.
+// Stops at a zero length (padding) or at a structure that would run past
+// the end of the payload. Returns false when there are no more structures.
+bool nextADStructure(const uint8_t* payload, size_t length, size_t& pos, ADStructure& ad) {
+    if (payload == nullptr || pos + 1 >= length) {
+        return false;
+    }
+    uint8_t fieldLen = payload[pos];
+    if (fieldLen == 0 || pos + 1 + fieldLen > length) {
+        return false;
+    }
+    ad.type = payload[pos + 1];
+    ad.value = payload + pos + 2;
+    ad.length = fieldLen - 1;
+    pos += 1 + fieldLen;
+    return true;
+}
+
+// Find the first AD structure of the given type.
+// Returns a pointer to the value bytes (after the type byte) and sets valueLen,
+// or nullptr if the type is not present.
+const uint8_t* findADStructure(const uint8_t* payload, size_t length, uint8_t type, uint8_t& valueLen) {
+    size_t pos = 0;
+    ADStructure ad;
+    while (nextADStructure(payload, length, pos, ad)) {
+        if (ad.type == type) {
+            valueLen = ad.length;
+            return ad.value;
+        }
+    }
+    return nullptr;
+}
+
+// Find the service data for a 16-bit service UUID.
+// Returns a pointer to the data following the UUID and sets dataLen,
+// or nullptr if no service data with that UUID is present.
+const uint8_t* findServiceData16(const uint8_t* payload, size_t length, uint16_t uuid, uint8_t& dataLen) {
+    size_t pos = 0;
+    ADStructure ad;
+    while (nextADStructure(payload, length, pos, ad)) {
+        if (ad.type == AD_TYPE_SERVICE_DATA_16 && ad.length >= 2 && readLE16(ad.value) == uuid) {
+            dataLen = ad.length - 2;
+            return ad.value + 2;
+        }
+    }
+    return nullptr;
+}
+
+// Find the complete local name, falling back to the shortened one.
+// Returns nullptr if the payload carries no name.
+const uint8_t* findLocalName(const uint8_t* payload, size_t length, uint8_t& nameLen) {
+    const uint8_t* value = findADStructure(payload, length, AD_TYPE_NAME_COMPLETE, nameLen);
+    if (value == nullptr) {
+        value = findADStructure(payload, length, AD_TYPE_NAME_SHORT, nameLen);
+    }
+    return value;
+}
+
+// Check whether the complete or shortened local name equals `name`
+bool hasLocalName(const uint8_t* payload, size_t length, const char* name) {
+    size_t nameLen = strlen(name);
+    uint8_t valueLen = 0;
+    const uint8_t* value = findLocalName(payload, length, valueLen);
+    return value != nullptr && valueLen == nameLen && memcmp(value, name, nameLen) == 0;
+}
+
+#endif // ADV_PARSER_H
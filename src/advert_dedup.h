@@ -0,0 +1,138 @@
+/**
+ * Advert Dedup
+ *
+ * Handles:
+ * - Dropping byte-identical adverts from the same MAC inside a time window
+ * - Smoothed RSSI and advertising period, updated by every advert (including dropped ones)
+ * - Hit/miss counters
+ * - Runtime window changes over MQTT, persisted in NVS via config_manager.h
+ *
+ * With wantDuplicates=true a sensor advertising once a second, on all three
+ * advertising channels, produces a callback per packet. Most carry exactly
+ * the same bytes, so only the first one per window is decoded and queued.
+ *
+ * The cache is direct-mapped: a collision evicts the older MAC, whose next
+ * advert then counts as a miss. Only the BLE callback writes it.
+ */
+
+#ifndef ADVERT_DEDUP_H
+#define ADVERT_DEDUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <ArduinoJson.h>
+#include "scan_scheduler.h"
+
+const size_t DEDUP_CACHE_BITS = 8;
+const size_t DEDUP_CACHE_SIZE = 1 << DEDUP_CACHE_BITS;  // 8 KB
+const uint32_t DEDUP_WINDOW_DEFAULT_MS = 5000;           // Matches the tracker publish cycle
+const uint32_t DEDUP_WINDOW_MAX_MS = 60000;
+const char* DEDUP_NVS_WINDOW = "dedup_ms";
+
+// RSSI is averaged in 1/16 dBm with weight 1/4 for each new advert
+const int RSSI_EWMA_SCALE = 16;
+const int RSSI_EWMA_SHIFT = 2;
+
+struct DedupEntry {
+    uint64_t mac;            // 0 = empty slot
+    uint32_t payloadHash;    // FNV-1a of the last forwarded payload
+    uint32_t lastForwarded;  // Tick of the last forwarded advert
+    uint32_t lastHeard;      // Tick of the last advert, forwarded or not
+    uint32_t periodMs;       // Learned advertising period
+    int16_t rssiAvg;         // 1/16 dBm
+    uint8_t longGaps;
+};
+
+// What the tracker gets with each forwarded advert
+struct AdvertStats {
+    int8_t rssi;        // Smoothed over every advert heard
+    uint16_t periodMs;  // Learned from every advert heard (0 = not yet known)
+};
+
+uint32_t fnv1aHash(const uint8_t* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+class AdvertDedup {
+public:
+    // Record one advert. Returns false if it is a duplicate of the last
+    // forwarded payload inside the window and should be dropped.
+    bool admit(uint64_t mac, const uint8_t* payload, size_t length, int8_t rssi, uint32_t now, AdvertStats& stats) {
+        DedupEntry& entry = table_[(size_t)((mac * 0x9E3779B97F4A7C15ull) >> (64 - DEDUP_CACHE_BITS))];
+        uint32_t hash = fnv1aHash(payload, length);
+
+        if (entry.mac != mac) {
+            entry.mac = mac;
+            entry.periodMs = 0;
+            entry.longGaps = 0;
+            entry.rssiAvg = rssi * RSSI_EWMA_SCALE;
+            entry.lastHeard = now;
+            return forward(entry, hash, now, stats);
+        }
+
+        learnAdvertPeriod(entry.periodMs, entry.longGaps, now - entry.lastHeard);
+        entry.lastHeard = now;
+        entry.rssiAvg += (rssi * RSSI_EWMA_SCALE - entry.rssiAvg) >> RSSI_EWMA_SHIFT;
+
+        if (entry.payloadHash == hash && now - entry.lastForwarded < windowMs_.load(std::memory_order_relaxed)) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return forward(entry, hash, now, stats);
+    }
+
+    void setWindowMs(uint32_t windowMs) { windowMs_.store(windowMs, std::memory_order_relaxed); }
+    uint32_t windowMs() const { return windowMs_.load(std::memory_order_relaxed); }
+    uint32_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint32_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    bool forward(DedupEntry& entry, uint32_t hash, uint32_t now, AdvertStats& stats) {
+        entry.payloadHash = hash;
+        entry.lastForwarded = now;
+        stats.rssi = (int8_t)((entry.rssiAvg - RSSI_EWMA_SCALE / 2) / RSSI_EWMA_SCALE);  // Nearest dBm (RSSI is negative)
+        stats.periodMs = entry.periodMs > 0xFFFF ? 0xFFFF : (uint16_t)entry.periodMs;
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    DedupEntry table_[DEDUP_CACHE_SIZE] = {};
+    std::atomic<uint32_t> windowMs_{DEDUP_WINDOW_DEFAULT_MS};
+    std::atomic<uint32_t> hits_{0};    // Adverts dropped as duplicates
+    std::atomic<uint32_t> misses_{0};  // Adverts forwarded to the decoder
+};
+
+AdvertDedup advertDedup;
+
+void loadDedupConfig() {
+    uint32_t windowMs = getConfigUInt(DEDUP_NVS_WINDOW, DEDUP_WINDOW_DEFAULT_MS);
+    if (windowMs > DEDUP_WINDOW_MAX_MS) {
+        windowMs = DEDUP_WINDOW_MAX_MS;
+    }
+    advertDedup.setWindowMs(windowMs);
+    Serial.printf("✓ Advert dedup window: %ums\n", windowMs);
+}
+
+// Handle {"command":"dedup","windowMs":5000} (0 disables dedup)
+void handleDedupCommand(const JsonDocument& doc) {
+    if (!doc["windowMs"].is<uint32_t>()) {
+        Serial.println("⚠️  dedup command needs a windowMs value");
+        return;
+    }
+    uint32_t windowMs = doc["windowMs"].as<uint32_t>();
+    if (windowMs > DEDUP_WINDOW_MAX_MS) {
+        Serial.printf("❌ Dedup window too long (%ums, max %ums)\n", windowMs, DEDUP_WINDOW_MAX_MS);
+        return;
+    }
+    advertDedup.setWindowMs(windowMs);
+    bool ok = saveConfigUInt(DEDUP_NVS_WINDOW, windowMs);
+    Serial.printf("%s Advert dedup window set to %ums\n", ok ? "✓" : "✗", windowMs);
+}
+
+#endif // ADVERT_DEDUP_H
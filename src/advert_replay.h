@@ -0,0 +1,161 @@
+/**
+ * Advert Replay
+ *
+ * Handles:
+ * - Parsing recorded advert traces stored on SPIFFS
+ * - Feeding them through the real ingest path in place of the radio
+ *
+ * Trace format, one advert per line ('#' starts a comment):
+ *   <ms since trace start>,<MAC>,<RSSI>,<raw payload as hex>
+ *   1200,E0:7D:EA:12:34:56,-67,0201060709 4C4F50303031...
+ * The payload is the advert data followed by any scan response, exactly as
+ * BLEAdvertisedDevice::getPayload() returns it.
+ */
+
+#ifndef ADVERT_REPLAY_H
+#define ADVERT_REPLAY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <SPIFFS.h>
+#include "mac_filter.h"
+#include "advert_ring.h"
+#include "scanner_backend.h"
+
+const size_t REPLAY_PAYLOAD_MAX = 62;  // 31 bytes advert + 31 bytes scan response
+
+// Longest valid line: 10-digit offset, MAC, 4-char RSSI, three commas and a
+// full payload written as spaced hex ("02 01 06 ..."), plus CR and NUL.
+// Longer lines are rejected whole rather than parsed truncated.
+const size_t REPLAY_LINE_MAX = 10 + 1 + 17 + 1 + 4 + 1 + REPLAY_PAYLOAD_MAX * 3 + 1 + 1;
+
+struct TraceAdvert {
+    uint32_t offsetMs;
+    uint64_t mac;
+    int8_t rssi;
+    uint8_t length;
+    uint8_t payload[REPLAY_PAYLOAD_MAX];
+};
+
+struct ReplayResult {
+    uint32_t lines;
+    uint32_t adverts;
+    uint32_t queued;      // Adverts that made it through filter, dedup and decode
+    uint32_t rejected;    // Lines that failed to parse
+    uint32_t elapsedMs;
+};
+
+int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Parse one trace line in place. Returns false for comments and malformed lines.
+bool parseTraceLine(char* line, TraceAdvert& advert) {
+    if (line[0] == '#' || line[0] == '\0') {
+        return false;
+    }
+
+    char* fields[4];
+    int fieldCount = 0;
+    fields[fieldCount++] = line;
+    for (char* p = line; *p && fieldCount < 4; p++) {
+        if (*p == ',') {
+            *p = '\0';
+            fields[fieldCount++] = p + 1;
+        }
+    }
+    if (fieldCount != 4) {
+        return false;
+    }
+
+    advert.offsetMs = strtoul(fields[0], nullptr, 10);
+    advert.rssi = (int8_t)atoi(fields[2]);
+    if (!parseMacString(fields[1], 6, advert.mac)) {
+        return false;
+    }
+
+    advert.length = 0;
+    int high = -1;
+    for (const char* p = fields[3]; *p && *p != '\r' && *p != '\n'; p++) {
+        if (*p == ' ') {
+            continue;
+        }
+        int nibble = hexNibble(*p);
+        if (nibble < 0) {
+            return false;
+        }
+        if (high < 0) {
+            high = nibble;
+        } else {
+            if (advert.length >= REPLAY_PAYLOAD_MAX) {
+                return false;
+            }
+            advert.payload[advert.length++] = (uint8_t)((high << 4) | nibble);
+            high = -1;
+        }
+    }
+    return high < 0 && advert.length > 0;
+}
+
+// Replay a trace through `ingest`. Adverts are stamped with startTick plus
+// their trace offset; in realtime mode the replay also waits for that moment.
+ReplayResult replayTrace(File& file, bool realtime, AdvertIngestFn ingest) {
+    ReplayResult result = {};
+    char line[REPLAY_LINE_MAX];
+    TraceAdvert advert;
+    unsigned long startTick = millis();
+
+    while (file.available()) {
+        size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[len] = '\0';
+        result.lines++;
+
+        // A full buffer means the newline was not reached: consume it if it
+        // is next, otherwise skip the rest of the overlong line
+        if (len == sizeof(line) - 1 && file.available()) {
+            if (file.peek() == '\n') {
+                file.read();
+            } else {
+                int c;
+                do {
+                    c = file.read();
+                } while (c >= 0 && c != '\n');
+                result.rejected++;
+                continue;
+            }
+        }
+
+        if (!parseTraceLine(line, advert)) {
+            if (line[0] != '#' && line[0] != '\0') {
+                result.rejected++;
+            }
+            continue;
+        }
+
+        uint32_t tick = startTick + advert.offsetMs;
+        if (realtime) {
+            long wait = (long)(tick - millis());
+            if (wait > 0) {
+                vTaskDelay(pdMS_TO_TICKS(wait));
+            }
+        } else {
+            // Full speed still can't outrun the tracker: hold off while the ring is half full
+            while (advertRing.size() > ADVERT_RING_SIZE / 2) {
+                vTaskDelay(1);
+            }
+        }
+
+        if (ingest(advert.mac, advert.rssi, advert.payload, advert.length, tick)) {
+            result.queued++;
+        }
+        result.adverts++;
+    }
+
+    result.elapsedMs = millis() - startTick;
+    return result;
+}
+
+#endif // ADVERT_REPLAY_H
@@ -0,0 +1,119 @@
+/**
+ * Advert Ring
+ *
+ * Handles:
+ * - Lock-free single-producer/single-consumer ring buffer
+ * - Fixed-size advert records handed from the BLE callback to the tracker
+ * - Drop counter and high-water mark
+ *
+ * The BLE stack callback is the only producer and the device tracker task
+ * the only consumer, so the ring needs no locks: each side owns one index
+ * and publishes it with release/acquire ordering.
+ */
+
+#ifndef ADVERT_RING_H
+#define ADVERT_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    // Producer side. Returns false (and counts a drop) when the ring is full.
+    bool push(const T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        if (head - tail >= N) {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        buffer_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+
+        uint32_t used = head + 1 - tail;
+        if (used > highWater_.load(std::memory_order_relaxed)) {
+            highWater_.store(used, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer side. Copies up to maxItems records into out, returns the count.
+    size_t popBatch(T* out, size_t maxItems) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        size_t count = head - tail;
+        if (count > maxItems) {
+            count = maxItems;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            out[i] = buffer_[(tail + i) & (N - 1)];
+        }
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return N; }
+    uint32_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+    uint32_t highWaterMark() const { return highWater_.load(std::memory_order_relaxed); }
+
+private:
+    T buffer_[N];
+    std::atomic<uint32_t> head_{0};       // Next slot to write (producer)
+    std::atomic<uint32_t> tail_{0};       // Next slot to read (consumer)
+    std::atomic<uint32_t> dropped_{0};    // Pushes rejected because the ring was full
+    std::atomic<uint32_t> highWater_{0};  // Most records ever queued at once
+};
+
+// Flags for AdvertRecord::flags
+const uint8_t ADVERT_HAS_TEMPERATURE = 0x01;
+const uint8_t ADVERT_HAS_HUMIDITY = 0x02;
+const uint8_t ADVERT_HAS_BATTERY = 0x04;
+
+// One decoded advert as handed from the BLE callback to the tracker
+struct AdvertRecord {
+    uint64_t mac;              // 48-bit address, first octet most significant
+    uint32_t tick;             // millis() when the advert was received
+    int16_t temperatureCenti;  // 0.01°C
+    uint16_t humidityCenti;    // 0.01%RH
+    uint16_t batteryMv;
+    uint16_t periodMs;         // Advertising period learned at ingest (0 = not yet known)
+    int8_t rssi;               // Smoothed over every advert heard, including duplicates
+    uint8_t format;            // BeaconFormat
+    uint8_t flags;             // ADVERT_HAS_*
+};
+
+const size_t ADVERT_RING_SIZE = 512;  // ~8 KB of records
+
+SpscRing<AdvertRecord, ADVERT_RING_SIZE> advertRing;
+
+// Pack a 6-byte address (as printed, first octet first) into a uint64
+uint64_t packMac(const uint8_t* addr) {
+    uint64_t mac = 0;
+    for (int i = 0; i < 6; i++) {
+        mac = (mac << 8) | addr[i];
+    }
+    return mac;
+}
+
+// Format a packed address as "AA:BB:CC:DD:EE:FF" into a buffer of at least 18 bytes
+void formatMac(uint64_t mac, char* out) {
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+    for (int i = 0; i < 6; i++) {
+        uint8_t octet = (uint8_t)(mac >> (8 * (5 - i)));
+        out[i * 3] = HEX_DIGITS[octet >> 4];
+        out[i * 3 + 1] = HEX_DIGITS[octet & 0x0F];
+        out[i * 3 + 2] = (i < 5) ? ':' : '\0';
+    }
+}
+
+#endif // ADVERT_RING_H
@@ -0,0 +1,364 @@
+/**
+ * Beacon Decoders
+ *
+ * Handles:
+ * - Compile-time dispatch table keyed by service UUID / company ID / frame type
+ * - O(1) routing of each advert to exactly one decoder
+ * - Decoding LOP001, MOKO T&H, iBeacon and Eddystone UID/URL/TLM frames
+ *
+ * Frame layouts follow "MOKO Beacon - ADV Format Summary Sheet.xlsx" and the
+ * Apple iBeacon / Google Eddystone specifications. Multi-byte MOKO and
+ * Eddystone fields are big-endian; UUIDs and company IDs are little-endian.
+ */
+
+#ifndef BEACON_DECODERS_H
+#define BEACON_DECODERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "adv_parser.h"
+
+const uint16_t UUID16_EDDYSTONE = 0xFEAA;
+const uint16_t UUID16_MOKO = 0xFEAB;
+const uint16_t COMPANY_ID_APPLE = 0x004C;
+
+const uint8_t EDDYSTONE_FRAME_UID = 0x00;
+const uint8_t EDDYSTONE_FRAME_URL = 0x10;
+const uint8_t EDDYSTONE_FRAME_TLM = 0x20;
+const uint8_t MOKO_FRAME_TH = 0x70;
+const uint8_t IBEACON_SUBTYPE = 0x02;
+
+enum BeaconFormat : uint8_t {
+    BEACON_UNKNOWN = 0,
+    BEACON_LOP001,
+    BEACON_MOKO_TH,
+    BEACON_IBEACON,
+    BEACON_EDDYSTONE_UID,
+    BEACON_EDDYSTONE_URL,
+    BEACON_EDDYSTONE_TLM,
+    BEACON_FORMAT_COUNT
+};
+
+// Sensor type strings reported to ThingsBoard, indexed by BeaconFormat
+const char* const BEACON_FORMAT_NAMES[BEACON_FORMAT_COUNT] = {
+    "BLE_DEVICE",
+    "LOP001",
+    "MOKO_TH",
+    "IBEACON",
+    "EDDYSTONE_UID",
+    "EDDYSTONE_URL",
+    "EDDYSTONE_TLM"
+};
+
+const char* beaconFormatName(uint8_t format) {
+    return format < BEACON_FORMAT_COUNT ? BEACON_FORMAT_NAMES[format] : BEACON_FORMAT_NAMES[BEACON_UNKNOWN];
+}
+
+// How a decoder recognised the advert's format
+enum BeaconIdentity : uint8_t {
+    BEACON_IDENTITY_FRAME = 0,  // Frame type is self-describing (MOKO, iBeacon, Eddystone)
+    BEACON_IDENTITY_NAME,       // Confirmed by the local name
+    BEACON_IDENTITY_SHAPE       // Inferred from service UUID and payload length only
+};
+
+// Decoded advert. Values are kept in fixed-point units, no heap allocation.
+struct BeaconReading {
+    BeaconFormat format;
+    BeaconIdentity identity;
+    bool hasTemperature;
+    bool hasHumidity;
+    bool hasBattery;
+    int16_t temperatureCenti;  // 0.01°C
+    uint16_t humidityCenti;    // 0.01%RH
+    uint16_t batteryMv;
+    int8_t txPower;            // Calibrated power (dBm) if the frame carries one
+    uint8_t idLength;
+    uint8_t id[20];            // iBeacon UUID+major+minor, Eddystone namespace+instance or scheme+URL
+};
+
+// Decoder signature: `data` points just past the service UUID / company ID.
+// The full payload is passed too for decoders that need other AD structures.
+typedef bool (*BeaconDecoderFn)(const uint8_t* data, uint8_t dataLen,
+                                const uint8_t* payload, size_t length,
+                                BeaconReading& reading);
+
+void setBeaconId(BeaconReading& reading, const uint8_t* src, uint8_t len) {
+    if (len > sizeof(reading.id)) {
+        len = sizeof(reading.id);
+    }
+    memcpy(reading.id, src, len);
+    reading.idLength = len;
+}
+
+// LOP001 Temperature Beacon
+// Device Name: LOP001
+// Service UUID: 0x181A (Environmental Sensing Service)
+// Service Data Format (after the UUID):
+//   Bytes 0-1: Temperature (sint16, little-endian, 0.01°C resolution)
+//   Bytes 2-3: Humidity (uint16, little-endian, 0.01%RH resolution)
+//
+// The name only arrives in the scan response, so a passive scan never sees
+// it. Without a name the advert is accepted on shape alone (exactly 4 bytes
+// of 0x181A data) and the caller decides whether to trust it.
+bool decodeLOP001(const uint8_t* data, uint8_t dataLen, const uint8_t* payload, size_t length, BeaconReading& reading) {
+    if (dataLen < 4) {
+        return false;
+    }
+
+    uint8_t nameLen = 0;
+    const uint8_t* name = findLocalName(payload, length, nameLen);
+    if (name != nullptr) {
+        if (nameLen != 6 || memcmp(name, "LOP001", 6) != 0) {
+            return false;
+        }
+        reading.identity = BEACON_IDENTITY_NAME;
+    } else {
+        if (dataLen != 4) {
+            return false;
+        }
+        reading.identity = BEACON_IDENTITY_SHAPE;
+    }
+
+    int16_t temp_raw = (int16_t)readLE16(data);
+    uint16_t hum_raw = readLE16(data + 2);
+
+    // Sanity checks (SHT40 sensor ranges)
+    if (temp_raw < -4000 || temp_raw > 12500 || hum_raw > 10000) {
+        return false;
+    }
+
+    reading.hasTemperature = true;
+    reading.hasHumidity = true;
+    reading.temperatureCenti = temp_raw;
+    reading.humidityCenti = hum_raw;
+    return true;
+}
+
+// MOKO T&H frame (service UUID 0xFEAB, frame type 0x70)
+//   Byte 0: Frame type 0x70
+//   Byte 1: Ranging data (dBm)
+//   Byte 2: Advertising interval (100 ms units)
+//   Bytes 3-4: Temperature (sint16, 0.1°C)
+//   Bytes 5-6: Humidity (uint16, 0.1%RH)
+//   Bytes 7-8: Battery voltage (mV)
+//   Byte 9: Device type, Bytes 10-15: MAC address
+bool decodeMokoTH(const uint8_t* data, uint8_t dataLen, const uint8_t* /*payload*/, size_t /*length*/, BeaconReading& reading) {
+    if (dataLen < 9) {
+        return false;
+    }
+
+    int16_t temp_raw = (int16_t)readBE16(data + 3);
+    uint16_t hum_raw = readBE16(data + 5);
+    if (temp_raw < -400 || temp_raw > 1250 || hum_raw > 1000) {
+        return false;
+    }
+
+    reading.hasTemperature = true;
+    reading.hasHumidity = true;
+    reading.hasBattery = true;
+    reading.temperatureCenti = temp_raw * 10;
+    reading.humidityCenti = hum_raw * 10;
+    reading.batteryMv = readBE16(data + 7);
+    reading.txPower = (int8_t)data[1];
+    return true;
+}
+
+// iBeacon (manufacturer data, company 0x004C, subtype 0x02, length 0x15)
+//   Bytes 0-1: Subtype/length, Bytes 2-17: UUID, Bytes 18-19: Major,
+//   Bytes 20-21: Minor, Byte 22: RSSI@1m
+bool decodeIBeacon(const uint8_t* data, uint8_t dataLen, const uint8_t* /*payload*/, size_t /*length*/, BeaconReading& reading) {
+    if (dataLen < 23 || data[1] != 0x15) {
+        return false;
+    }
+
+    setBeaconId(reading, data + 2, 20);
+    reading.txPower = (int8_t)data[22];
+    return true;
+}
+
+// Eddystone-UID: Byte 1: TX power, Bytes 2-11: Namespace, Bytes 12-17: Instance
+bool decodeEddystoneUID(const uint8_t* data, uint8_t dataLen, const uint8_t* /*payload*/, size_t /*length*/, BeaconReading& reading) {
+    if (dataLen < 18) {
+        return false;
+    }
+
+    setBeaconId(reading, data + 2, 16);
+    reading.txPower = (int8_t)data[1];
+    return true;
+}
+
+// Eddystone-URL: Byte 1: TX power, Byte 2: scheme prefix, Bytes 3+: encoded URL (max 17)
+bool decodeEddystoneURL(const uint8_t* data, uint8_t dataLen, const uint8_t* /*payload*/, size_t /*length*/, BeaconReading& reading) {
+    if (dataLen < 3 || dataLen > 20 || data[2] > 0x03) {
+        return false;
+    }
+
+    setBeaconId(reading, data + 2, dataLen - 2);
+    reading.txPower = (int8_t)data[1];
+    return true;
+}
+
+// Eddystone-TLM (unencrypted): Byte 1: version 0x00, Bytes 2-3: battery mV,
+// Bytes 4-5: temperature (signed 8.8, 0x8000 = not supported),
+// Bytes 6-9: ADV_CNT, Bytes 10-13: SEC_CNT
+bool decodeEddystoneTLM(const uint8_t* data, uint8_t dataLen, const uint8_t* /*payload*/, size_t /*length*/, BeaconReading& reading) {
+    if (dataLen < 14 || data[1] != 0x00) {
+        return false;
+    }
+
+    uint16_t batt = readBE16(data + 2);
+    if (batt != 0) {
+        reading.hasBattery = true;
+        reading.batteryMv = batt;
+    }
+
+    int16_t temp_raw = (int16_t)readBE16(data + 4);
+    if (temp_raw != (int16_t)0x8000) {
+        // 8.8 fixed point to 0.01°C, rounded half away from zero
+        int32_t scaled = (int32_t)temp_raw * 100;
+        reading.hasTemperature = true;
+        reading.temperatureCenti = (int16_t)((scaled + (scaled >= 0 ? 128 : -128)) / 256);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Dispatch table
+// ---------------------------------------------------------------------------
+
+enum BeaconKeyKind : uint8_t {
+    BEACON_KEY_SERVICE_DATA = 0,  // 16-bit service UUID (AD type 0x16)
+    BEACON_KEY_COMPANY_ID = 1     // Bluetooth SIG company ID (AD type 0xFF)
+};
+
+const int16_t BEACON_FRAME_ANY = -1;
+
+struct BeaconDecoderEntry {
+    BeaconKeyKind kind;
+    uint16_t id;
+    int16_t frame;  // First byte after the UUID/company ID, or BEACON_FRAME_ANY
+    BeaconFormat format;
+    BeaconDecoderFn decode;
+};
+
+constexpr BeaconDecoderEntry BEACON_DECODERS[] = {
+    { BEACON_KEY_SERVICE_DATA, UUID16_ENVIRONMENTAL_SENSING, BEACON_FRAME_ANY,    BEACON_LOP001,        decodeLOP001 },
+    { BEACON_KEY_SERVICE_DATA, UUID16_MOKO,                  MOKO_FRAME_TH,       BEACON_MOKO_TH,       decodeMokoTH },
+    { BEACON_KEY_COMPANY_ID,   COMPANY_ID_APPLE,             IBEACON_SUBTYPE,     BEACON_IBEACON,       decodeIBeacon },
+    { BEACON_KEY_SERVICE_DATA, UUID16_EDDYSTONE,             EDDYSTONE_FRAME_UID, BEACON_EDDYSTONE_UID, decodeEddystoneUID },
+    { BEACON_KEY_SERVICE_DATA, UUID16_EDDYSTONE,             EDDYSTONE_FRAME_URL, BEACON_EDDYSTONE_URL, decodeEddystoneURL },
+    { BEACON_KEY_SERVICE_DATA, UUID16_EDDYSTONE,             EDDYSTONE_FRAME_TLM, BEACON_EDDYSTONE_TLM, decodeEddystoneTLM },
+};
+
+constexpr size_t BEACON_DECODER_COUNT = sizeof(BEACON_DECODERS) / sizeof(BEACON_DECODERS[0]);
+constexpr size_t BEACON_SLOT_BITS = 5;
+constexpr size_t BEACON_SLOT_COUNT = 1 << BEACON_SLOT_BITS;
+constexpr size_t BEACON_MAX_PROBES = 2;
+
+static_assert(BEACON_DECODER_COUNT * 2 <= BEACON_SLOT_COUNT, "Beacon slot table too small");
+
+// Multiplicative hash of (kind, frame, id) into a slot index
+constexpr size_t beaconKeySlot(BeaconKeyKind kind, uint16_t id, int16_t frame) {
+    return (size_t)((((uint32_t)kind << 25) | ((uint32_t)(frame + 1) << 16) | id) * 2654435761u) >> (32 - BEACON_SLOT_BITS);
+}
+
+struct BeaconSlotTable {
+    int8_t slots[BEACON_SLOT_COUNT];  // Index into BEACON_DECODERS, -1 = empty
+    size_t maxProbes;
+};
+
+// Built by the compiler: open addressing with linear probing
+constexpr BeaconSlotTable buildBeaconSlotTable() {
+    BeaconSlotTable table = {};
+    for (size_t i = 0; i < BEACON_SLOT_COUNT; i++) {
+        table.slots[i] = -1;
+    }
+    table.maxProbes = 0;
+    for (size_t e = 0; e < BEACON_DECODER_COUNT; e++) {
+        size_t slot = beaconKeySlot(BEACON_DECODERS[e].kind, BEACON_DECODERS[e].id, BEACON_DECODERS[e].frame);
+        size_t probes = 1;
+        while (table.slots[slot] != -1) {
+            slot = (slot + 1) & (BEACON_SLOT_COUNT - 1);
+            probes++;
+        }
+        table.slots[slot] = (int8_t)e;
+        if (probes > table.maxProbes) {
+            table.maxProbes = probes;
+        }
+    }
+    return table;
+}
+
+constexpr BeaconSlotTable BEACON_SLOTS = buildBeaconSlotTable();
+
+static_assert(BEACON_SLOTS.maxProbes <= BEACON_MAX_PROBES, "Beacon dispatch keys collide too often - adjust the hash");
+
+const BeaconDecoderEntry* findBeaconDecoderExact(BeaconKeyKind kind, uint16_t id, int16_t frame) {
+    size_t slot = beaconKeySlot(kind, id, frame);
+    for (size_t probe = 0; probe < BEACON_MAX_PROBES; probe++) {
+        int8_t e = BEACON_SLOTS.slots[slot];
+        if (e < 0) {
+            return nullptr;
+        }
+        const BeaconDecoderEntry& entry = BEACON_DECODERS[e];
+        if (entry.kind == kind && entry.id == id && entry.frame == frame) {
+            return &entry;
+        }
+        slot = (slot + 1) & (BEACON_SLOT_COUNT - 1);
+    }
+    return nullptr;
+}
+
+// Frame-specific entries win over ones registered for any frame type
+const BeaconDecoderEntry* findBeaconDecoder(BeaconKeyKind kind, uint16_t id, int16_t frame) {
+    const BeaconDecoderEntry* entry = nullptr;
+    if (frame != BEACON_FRAME_ANY) {
+        entry = findBeaconDecoderExact(kind, id, frame);
+    }
+    if (entry == nullptr) {
+        entry = findBeaconDecoderExact(kind, id, BEACON_FRAME_ANY);
+    }
+    return entry;
+}
+
+// Route an advert to its decoder. Walks the AD structures once and stops at
+// the first service data / manufacturer data structure with a registered key whose
+// decoder accepts it. Returns false for adverts no decoder accepts.
+bool decodeBeacon(const uint8_t* payload, size_t length, BeaconReading& reading) {
+    memset(&reading, 0, sizeof(reading));
+
+    size_t pos = 0;
+    ADStructure ad;
+    while (nextADStructure(payload, length, pos, ad)) {
+        BeaconKeyKind kind;
+        if (ad.type == AD_TYPE_SERVICE_DATA_16) {
+            kind = BEACON_KEY_SERVICE_DATA;
+        } else if (ad.type == AD_TYPE_MANUFACTURER_DATA) {
+            kind = BEACON_KEY_COMPANY_ID;
+        } else {
+            continue;
+        }
+        if (ad.length < 2) {
+            continue;
+        }
+
+        const uint8_t* data = ad.value + 2;
+        uint8_t dataLen = ad.length - 2;
+        int16_t frame = dataLen > 0 ? data[0] : BEACON_FRAME_ANY;
+
+        const BeaconDecoderEntry* entry = findBeaconDecoder(kind, readLE16(ad.value), frame);
+        if (entry == nullptr) {
+            continue;
+        }
+
+        if (entry->decode(data, dataLen, payload, length, reading)) {
+            reading.format = entry->format;
+            return true;
+        }
+        memset(&reading, 0, sizeof(reading));
+    }
+    return false;
+}
+
+#endif // BEACON_DECODERS_H
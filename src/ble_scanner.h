@@ -2,152 +2,306 @@
  * BLE Scanner
  * 
  * Handles:
- * - Continuous BLE scanning
+ * - Continuous streaming BLE scanning through a pluggable host stack backend
+ * - Per-minute adverts-heard statistics
+ * - Adaptive scan window from learned advertising periods
+ * - Passive scanning with short active bursts to discover new sensors
+ * - MAC allowlist/prefix filtering on the raw address
+ * - Duplicate payload suppression per MAC
+ * - Replaying recorded advert traces through the same ingest path
  * - Advertisement parsing
- * - Sensor data extraction (LOP001 Temperature Beacon)
+ * - Sensor data extraction (LOP001, MOKO T&H, iBeacon, Eddystone)
  * - Device detection and buffering
  */
 
 #ifndef BLE_SCANNER_H
 #define BLE_SCANNER_H
 
-#include <BLEDevice.h>
-#include <BLEScan.h>
-#include <BLEAdvertisedDevice.h>
+#include <esp_timer.h>
+#include "beacon_decoders.h"
+#include "advert_ring.h"
+#include "scan_scheduler.h"
+#include "identity_cache.h"
+#include "pipeline_profiler.h"
+#include "advert_replay.h"
+#include "mac_filter.h"
+#include "advert_dedup.h"
 #include "device_tracker.h"
+#include "scanner_backend.h"
 
-extern SemaphoreHandle_t deviceMapMutex;
-
-BLEScan* pBLEScan = nullptr;
-const int SCAN_TIME = 20; // seconds - increased to match LOP001 advertising interval
-const int SCAN_INTERVAL = 5; // seconds between scans - reduced to catch more advertisements
-
-// Parse LOP001 Temperature Beacon data
-// Device Name: LOP001
-// Service UUID: 0x181A (Environmental Sensing Service)
-// Service Data Format:
-//   Bytes 0-1: Service UUID 0x181A (little-endian)
-//   Bytes 2-3: Temperature (sint16, little-endian, 0.01°C resolution)
-//   Bytes 4-5: Humidity (uint16, little-endian, 0.01%RH resolution)
-bool parseLOP001(BLEAdvertisedDevice advertisedDevice, float& temperature, float& humidity) {
-    // Check device name
-    if (!advertisedDevice.haveName() || advertisedDevice.getName() != "LOP001") {
+#if defined(SCANNER_BACKEND_NIMBLE)
+#include "scanner_nimble.h"
+NimBLEScanner scannerBackend;
+#elif defined(SCANNER_BACKEND_FAKE)
+#include "scanner_fake.h"
+FakeScanner scannerBackend;
+#else
+#include "scanner_bluedroid.h"
+BluedroidScanner scannerBackend;
+#endif
+
+ScannerBackend& scanner = scannerBackend;
+
+const unsigned long SCAN_STATS_INTERVAL = 60000; // 1 minute
+const unsigned long SCAN_SUPERVISE_INTERVAL = 1000; // ms between scan health checks
+const unsigned long REPLAY_SETTLE_MS = 6000; // One tracker publish cycle after a replay
+
+ScanScheduler scanScheduler;
+
+// Passive scanning: sensors are identified from the primary advert alone and
+// only get scan requests during short discovery bursts. Set PASSIVE_SCAN to
+// false to always scan actively.
+const bool PASSIVE_SCAN = true;
+const unsigned long DISCOVERY_BURST_MS = 20000;      // Covers one LOP001 advertising period
+const unsigned long DISCOVERY_COOLDOWN_MS = 300000;  // At most one burst every 5 minutes
+
+IdentityCache identityCache;                  // Only touched by the BLE callback
+volatile bool scanActive = true;              // Boot starts with a discovery burst
+std::atomic<uint32_t> discoveryPending{0};    // New nameless MACs seen while passive
+uint32_t discoveryBursts = 0;
+
+// Written by the BLE callback, swapped out once a minute by bleScanTask
+std::atomic<uint32_t> advertsHeard{0};
+std::atomic<uint32_t> advertsDecoded{0};
+
+// Totals for the last complete minute (reported in gateway status)
+uint32_t advertsHeardLastMinute = 0;
+uint32_t advertsDecodedLastMinute = 0;
+
+// Heap taken by bringing up the scanner backend's host stack
+uint32_t scannerStackHeap = 0;
+
+// Ingest one raw advert: filter, dedup, decode and queue it for the tracker.
+// Called from the BLE callback, and from the replay path while the live scan
+// is stopped, so the ring keeps a single producer. Returns true if queued.
+bool ingestAdvert(uint64_t mac, int8_t rssi, const uint8_t* payload, size_t payloadLength, uint32_t now) {
+    // Filter on the raw 6-byte address before doing any other work
+    if (!macFilterAllows(mac)) {
         return false;
     }
     
-    // Check for service data with Environmental Sensing Service UUID (0x181A)
-    if (!advertisedDevice.haveServiceData()) {
+    // Drop repeats of the same bytes (every channel, every interval) before decoding
+    AdvertStats stats;
+    if (!advertDedup.admit(mac, payload, payloadLength, rssi, now, stats)) {
         return false;
     }
     
-    // Verify service UUID is 0x181A (Environmental Sensing Service)
-    BLEUUID svcUUID = advertisedDevice.getServiceDataUUID();
-    String svcUUIDStr = String(svcUUID.toString().c_str());
-    if (!svcUUIDStr.startsWith("0000181a")) {
-        return false;
+    // Route the raw payload to its decoder - nothing is allocated for adverts we reject
+    BeaconReading reading;
+    if (!decodeBeacon(payload, payloadLength, reading)) {
+        identityCache.noteUndecoded(mac, payload, payloadLength);
+        return false;  // Ignore devices no decoder understands
     }
     
-    std::string serviceData = advertisedDevice.getServiceData();
-    
-    // ESP32 BLE library strips the UUID, so we expect 4 bytes: temp (2) + humidity (2)
-    if (serviceData.length() < 4) {
+    // Nameless adverts are trusted unless the MAC's name said otherwise
+    IdentityVerdict verdict = identityCache.classify(mac, reading);
+    if (verdict == IDENTITY_REJECT) {
         return false;
     }
+    if (verdict == IDENTITY_NEW && !scanActive) {
+        discoveryPending.fetch_add(1, std::memory_order_relaxed);
+    }
     
-    uint8_t* data = (uint8_t*)serviceData.c_str();
+    advertsDecoded.fetch_add(1, std::memory_order_relaxed);
     
-    // Temperature (bytes 0-1, sint16, little-endian, 0.01°C resolution)
-    int16_t temp_raw = (int16_t)((uint8_t)data[1] << 8 | (uint8_t)data[0]);
-    temperature = temp_raw / 100.0;
+    AdvertRecord record;
+    record.mac = mac;
+    record.tick = now;
+    record.temperatureCenti = reading.temperatureCenti;
+    record.humidityCenti = reading.humidityCenti;
+    record.batteryMv = reading.batteryMv;
+    record.periodMs = stats.periodMs;
+    record.rssi = stats.rssi;
+    record.format = reading.format;
+    record.flags = (reading.hasTemperature ? ADVERT_HAS_TEMPERATURE : 0) |
+                   (reading.hasHumidity ? ADVERT_HAS_HUMIDITY : 0) |
+                   (reading.hasBattery ? ADVERT_HAS_BATTERY : 0);
     
-    // Humidity (bytes 2-3, uint16, little-endian, 0.01%RH resolution)
-    uint16_t hum_raw = (uint16_t)((uint8_t)data[3] << 8 | (uint8_t)data[2]);
-    humidity = hum_raw / 100.0;
+    // Hand a fixed-size record to the tracker task; never block the BLE stack
+    return advertRing.push(record);  // Full ring is counted in advertRing.droppedCount()
+}
+
+// ingestAdvert() with its latency recorded in the ingest stage histogram
+bool profiledIngestAdvert(uint64_t mac, int8_t rssi, const uint8_t* payload, size_t payloadLength, uint32_t now) {
+    int64_t start = esp_timer_get_time();
+    bool queued = ingestAdvert(mac, rssi, payload, payloadLength, now);
+    pipelineLatency[STAGE_INGEST].record((uint32_t)(esp_timer_get_time() - start));
+    return queued;
+}
+
+// Every advert from the scanner backend, duplicates included, lands here
+bool onScannedAdvert(uint64_t mac, int8_t rssi, const uint8_t* payload, size_t length, uint32_t now) {
+    advertsHeard.fetch_add(1, std::memory_order_relaxed);
     
-    // Sanity checks (SHT40 sensor ranges)
-    if (temperature < -40.0 || temperature > 125.0) {
-        return false;
+    // Debug: Log that BLE advertisements are arriving
+    static unsigned long lastDebug = 0;
+    if (now - lastDebug > 10000) { // Every 10 seconds
+        char macStr[18];
+        formatMac(mac, macStr);
+        Serial.printf("📡 BLE callback active - seeing advertisements (last: %s)\n", macStr);
+        lastDebug = now;
     }
     
-    if (humidity < 0.0 || humidity > 100.0) {
-        return false;
+    return profiledIngestAdvert(mac, rssi, payload, length, now);
+}
+
+void initBLEScanner() {
+    Serial.println("Initializing BLE scanner...");
+    
+    loadMacFilter();
+    loadDedupConfig();
+    
+    uint32_t heapBefore = ESP.getFreeHeap();
+    if (!scanner.begin(onScannedAdvert)) {
+        Serial.printf("✗ Failed to start %s scanner backend\n", scanner.name());
     }
+    scannerStackHeap = heapBefore - ESP.getFreeHeap();
+    
+    // Start at the maximum duty for discovery; the scheduler trims it once periods are learned
+    ScanParams params = scanScheduler.params();
+    scanner.configure(scanActive, params);
     
-    return true;
+    Serial.printf("✓ BLE scanner initialized (%s backend, %u bytes heap, window %dms/%dms, %s)\n",
+                 scanner.name(), scannerStackHeap, params.windowMs, params.intervalMs,
+                 PASSIVE_SCAN ? "passive with discovery bursts" : "active");
 }
 
-class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
-    void onResult(BLEAdvertisedDevice advertisedDevice) {
-        String macAddress = advertisedDevice.getAddress().toString().c_str();
-        macAddress.toUpperCase();
-        
-        int rssi = advertisedDevice.getRSSI();
-        String name = advertisedDevice.haveName() ? advertisedDevice.getName().c_str() : "Unknown";
-        
-        // Debug: Log all BLE advertisements we receive
-        static unsigned long lastDebug = 0;
-        if (millis() - lastDebug > 10000) { // Every 10 seconds
-            Serial.printf("📡 BLE callback active - seeing advertisements (last: %s)\n", macAddress.c_str());
-            lastDebug = millis();
+// Scan parameters only take effect on a fresh scan
+void restartScan() {
+    scanner.stop();
+    scanner.configure(scanActive, scanScheduler.params());
+    scanner.start();
+}
+
+// Switch to an active scan while new nameless MACs are waiting to be
+// confirmed, and back to passive once the burst has run
+void superviseDiscovery(unsigned long now) {
+    static unsigned long burstStarted = 0;
+    static unsigned long lastBurstEnd = 0;
+    static bool bootBurst = true;
+    
+    if (scanActive) {
+        if (bootBurst) {
+            burstStarted = now;
+            bootBurst = false;
         }
-        
-        float temperature = 0.0;
-        float humidity = 0.0;
-        int battery = 0;
-        String sensorType = "BLE_DEVICE";
-        bool isLOP001 = false;
-        
-        // Try to parse as LOP001 Temperature Beacon
-        if (parseLOP001(advertisedDevice, temperature, humidity)) {
-            sensorType = "LOP001";
-            isLOP001 = true;
-            
-            Serial.printf("🔍 LOP001 detected: %s RSSI=%d T=%.2f H=%.2f\n", 
-                         macAddress.c_str(), rssi, temperature, humidity);
-            
-            // Only update device tracker for LOP001 sensors
-            updateDevice(macAddress, name, sensorType, temperature, humidity, battery, rssi, isLOP001);
+        if (now - burstStarted >= DISCOVERY_BURST_MS) {
+            scanActive = false;
+            lastBurstEnd = now;
+            Serial.printf("BLE discovery burst done (%u MACs known, %u forgotten) - back to passive scan\n",
+                         (unsigned)identityCache.entries(), (unsigned)identityCache.overwrites());
+            restartScan();
         }
-        // Ignore all non-LOP001 devices
+        return;
+    }
+    
+    if (discoveryPending.load(std::memory_order_relaxed) > 0 &&
+        now - lastBurstEnd >= DISCOVERY_COOLDOWN_MS) {
+        uint32_t pending = discoveryPending.exchange(0, std::memory_order_relaxed);
+        scanActive = true;
+        burstStarted = now;
+        discoveryBursts++;
+        Serial.printf("BLE discovery burst: %u new MACs, active scan for %lus\n",
+                     pending, DISCOVERY_BURST_MS / 1000);
+        restartScan();
     }
-};
+}
 
-void initBLEScanner() {
-    Serial.println("Initializing BLE scanner...");
+// Replay a trace from SPIFFS in place of the radio and publish a profile report.
+// The live scan is stopped first so this task is the ring's only producer.
+void runAdvertReplay() {
+    ReplayRequest request = replayRequest;
+    File file = SPIFFS.open(request.path, "r");
+    if (!file) {
+        Serial.printf("❌ Replay trace not found: %s\n", request.path);
+        replayRequest.pending = false;
+        return;
+    }
+    
+    Serial.printf("▶️  Replaying %s (%d bytes)...\n", request.path, (int)file.size());
+    scanner.stop();
     
-    BLEDevice::init("BLE-Gateway");
-    pBLEScan = BLEDevice::getScan();
+    resetPipelineProfile();
+    publishSink.enabled = request.sinkOnly;
+    uint32_t ringDropsBefore = advertRing.droppedCount();
+    uint32_t heapBefore = ESP.getFreeHeap();
     
-    // Set callbacks with wantDuplicates=true to get all advertisements
-    pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks(), true);
-    pBLEScan->setActiveScan(true);
-    pBLEScan->setInterval(100);
-    pBLEScan->setWindow(99);
+    ReplayResult result = replayTrace(file, request.realtime, profiledIngestAdvert);
+    file.close();
+    
+    // Let the tracker drain the ring and run one publish cycle
+    while (advertRing.size() > 0) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    vTaskDelay(pdMS_TO_TICKS(REPLAY_SETTLE_MS));
+    publishSink.enabled = false;
     
-    Serial.println("✓ BLE scanner initialized (duplicates enabled)");
+    JsonDocument report;
+    report["file"] = request.path;
+    report["adverts"] = result.adverts;
+    report["badLines"] = result.rejected;
+    report["elapsedMs"] = result.elapsedMs;
+    report["advertsPerSec"] = result.elapsedMs ? result.adverts * 1000.0 / result.elapsedMs : 0;
+    report["queued"] = result.queued;
+    report["ringDrops"] = advertRing.droppedCount() - ringDropsBefore;
+    report["sinkMessages"] = publishSink.messages;
+    report["sinkBytes"] = publishSink.bytes;
+    report["heapDelta"] = (int32_t)(ESP.getFreeHeap() - heapBefore);
+    report["minFreeHeap"] = ESP.getMinFreeHeap();
+    addPipelineProfile(report);
+    
+    publishReplayReport(report);
+    replayRequest.pending = false;
 }
 
 void bleScanTask(void* parameter) {
     Serial.println("BLE Scan Task started");
     
+    unsigned long lastStats = millis();
+    
     while (true) {
-        Serial.println("Starting BLE scan...");
-        
-        // Stop any previous scan and clear results to fully reset duplicate filter
-        pBLEScan->stop();
-        pBLEScan->clearResults();
+        if (replayRequest.pending) {
+            runAdvertReplay();
+        }
         
-        // Small delay to ensure BLE stack is ready
-        vTaskDelay(pdMS_TO_TICKS(100));
+        // (Re)start the streaming scan if the stack stopped it
+        if (!scanner.isRunning()) {
+            Serial.println("Starting continuous BLE scan...");
+            if (!scanner.start()) {
+                Serial.println("⚠️  Failed to start BLE scan, retrying...");
+            }
+        }
         
-        // Start scan - second parameter false means don't delete results after scan
-        BLEScanResults foundDevices = pBLEScan->start(SCAN_TIME, false);
-        int deviceCount = foundDevices.getCount();
+        unsigned long now = millis();
+        if (PASSIVE_SCAN) {
+            superviseDiscovery(now);
+        }
         
-        Serial.printf("BLE scan complete. Found %d devices.\n", deviceCount);
+        if (now - lastStats >= SCAN_STATS_INTERVAL) {
+            advertsHeardLastMinute = advertsHeard.exchange(0, std::memory_order_relaxed);
+            advertsDecodedLastMinute = advertsDecoded.exchange(0, std::memory_order_relaxed);
+            
+            // One line per minute with everything the backend comparison needs
+            Serial.printf("BLE scan (%s): %u adverts heard, %u decoded in the last minute (%.1f/s), "
+                         "stack heap %u, free heap %u\n",
+                         scanner.name(), advertsHeardLastMinute, advertsDecodedLastMinute,
+                         advertsHeardLastMinute * 1000.0 / (now - lastStats),
+                         scannerStackHeap, ESP.getFreeHeap());
+            lastStats = now;
+            
+            // Re-plan the scan window from the periods the tracker has learned
+            scanScheduler.beginEpoch();
+            collectAdvertPeriods(scanScheduler);
+            if (scanScheduler.decide()) {
+                ScanParams params = scanScheduler.params();
+                Serial.printf("BLE scan window -> %dms/%dms (duty %.0f%%, slowest period %ums over %u devices)\n",
+                             params.windowMs, params.intervalMs, scanScheduler.duty() * 100,
+                             scanScheduler.slowestPeriodMs(), scanScheduler.devices());
+                restartScan();
+            }
+        }
         
-        // Wait before next scan
-        vTaskDelay(pdMS_TO_TICKS(SCAN_INTERVAL * 1000));
+        vTaskDelay(pdMS_TO_TICKS(SCAN_SUPERVISE_INTERVAL));
     }
 }
 
@@ -0,0 +1,261 @@
+/**
+ * Compression Policy
+ *
+ * Handles:
+ * - Per sensor type (BeaconFormat) and per MAC choice of change-detection algorithm
+ * - Absolute deadband, percentage deadband, swinging-door trending, heartbeat only
+ * - Persisting the policy table in NVS
+ *
+ * A policy decides whether a new reading differs enough from the last
+ * published one to be worth a message. Parameters are per channel, in the
+ * readings' fixed-point units (temperature centi-°C, humidity centi-%,
+ * battery mV): the band for the deadbands, the compression deviation for
+ * swinging door. Percent bands are in hundredths of a percent, and never
+ * narrower than the default deadband for the channel: a percentage of a
+ * last value at or near zero (0 °C, a dry 0 % RH) would be a band of zero,
+ * letting every reading through until one moved the value away. Battery
+ * always uses an absolute deadband except under heartbeat. maxIntervalMs
+ * overrides the tracker keepalive for devices under the policy (0 = tracker
+ * keepalive); heartbeat publishes on that interval alone.
+ *
+ * Swinging door runs online: the doors pivot on the last published value
+ * and the reading that closes them is published and becomes the new pivot.
+ * Door slopes are kept as integer fractions and compared by cross-multiplying.
+ */
+
+#ifndef COMPRESSION_POLICY_H
+#define COMPRESSION_POLICY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "beacon_decoders.h"
+
+enum CompressionAlgorithm : uint8_t {
+    COMPRESS_DEADBAND = 0,   // |new - published| >= band
+    COMPRESS_PERCENT,        // |new - published| >= band % of |published|
+    COMPRESS_SWINGING_DOOR,  // New reading leaves every line within ±deviation of the readings since publish
+    COMPRESS_HEARTBEAT,      // Ignore values, publish every maxIntervalMs
+    COMPRESS_ALGORITHM_COUNT
+};
+
+const char* const COMPRESSION_ALGORITHM_NAMES[COMPRESS_ALGORITHM_COUNT] = {
+    "deadband", "percent", "swinging_door", "heartbeat"
+};
+
+struct CompressionPolicy {
+    uint8_t algorithm;       // CompressionAlgorithm
+    int32_t temperature;     // Centi-°C (centi-percent of reading for COMPRESS_PERCENT)
+    int32_t humidity;        // Centi-% RH (centi-percent of reading for COMPRESS_PERCENT)
+    int32_t battery;         // mV or %, absolute
+    uint32_t maxIntervalMs;  // Keepalive override, 0 = tracker keepalive
+};
+
+// 0.1 °C, 0.5 % RH, 5 - the thresholds the tracker used before policies existed
+const CompressionPolicy DEFAULT_COMPRESSION_POLICY = { COMPRESS_DEADBAND, 10, 50, 5, 0 };
+
+const size_t COMPRESSION_MAX_MAC_POLICIES = 16;
+
+struct MacCompressionPolicy {
+    uint64_t mac;
+    CompressionPolicy policy;
+};
+
+const char* COMPRESSION_NVS_FORMATS = "cmp_formats_fx";  // Fixed-point layout
+const char* COMPRESSION_NVS_MACS = "cmp_macs_fx";
+
+// Policy index kept per device: BeaconFormat, or BEACON_FORMAT_COUNT + MAC slot
+CompressionPolicy formatPolicies[BEACON_FORMAT_COUNT];
+MacCompressionPolicy macPolicies[COMPRESSION_MAX_MAC_POLICIES];
+size_t macPolicyCount = 0;
+
+uint8_t resolveCompressionPolicy(uint64_t mac, uint8_t format) {
+    for (size_t i = 0; i < macPolicyCount; i++) {
+        if (macPolicies[i].mac == mac) {
+            return (uint8_t)(BEACON_FORMAT_COUNT + i);
+        }
+    }
+    return format < BEACON_FORMAT_COUNT ? format : (uint8_t)BEACON_UNKNOWN;
+}
+
+const CompressionPolicy& compressionPolicyAt(uint8_t index) {
+    return index < BEACON_FORMAT_COUNT ? formatPolicies[index] : macPolicies[index - BEACON_FORMAT_COUNT].policy;
+}
+
+// True if any format or MAC uses swinging door (the tracker only keeps door
+// state while one does)
+bool anySwingingDoorPolicy() {
+    for (size_t i = 0; i < BEACON_FORMAT_COUNT; i++) {
+        if (formatPolicies[i].algorithm == COMPRESS_SWINGING_DOOR) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < macPolicyCount; i++) {
+        if (macPolicies[i].policy.algorithm == COMPRESS_SWINGING_DOOR) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Swinging-door state for one channel: the tightest door slopes seen since
+// the pivot, as fractions (centi-units per ms)
+struct DoorState {
+    int32_t upperRise;  // Max slope from the upper pivot (published + deviation)
+    uint32_t upperRun;  // 0 = no reading since the pivot
+    int32_t lowerRise;  // Min slope from the lower pivot (published - deviation)
+    uint32_t lowerRun;
+
+    void reset() {
+        upperRun = 0;
+        lowerRun = 0;
+    }
+
+    // True once no line through the pivot band stays within ±deviation of
+    // every reading, i.e. the doors have closed
+    bool closes(int32_t published, int32_t value, int32_t deviation, uint32_t elapsedMs) {
+        if (elapsedMs < 1) {
+            elapsedMs = 1;
+        }
+        int32_t toUpper = value - (published + deviation);
+        int32_t toLower = value - (published - deviation);
+        if (upperRun == 0 || (int64_t)toUpper * upperRun > (int64_t)upperRise * elapsedMs) {
+            upperRise = toUpper;
+            upperRun = elapsedMs;
+        }
+        if (lowerRun == 0 || (int64_t)toLower * lowerRun < (int64_t)lowerRise * elapsedMs) {
+            lowerRise = toLower;
+            lowerRun = elapsedMs;
+        }
+        return (int64_t)upperRise * lowerRun > (int64_t)lowerRise * upperRun;
+    }
+};
+
+bool exceedsDeadband(int32_t published, int32_t value, int32_t band) {
+    return abs(value - published) >= band;
+}
+
+// band in centi-percent of the published value, but at least `floor`
+// (absolute, same units as the values) so a published 0 still has a band
+bool exceedsPercentBand(int32_t published, int32_t value, int32_t band, int32_t floor) {
+    int64_t delta = abs(value - published);
+    if (delta < floor) {
+        return false;
+    }
+    return delta * 10000 >= (int64_t)abs(published) * band;
+}
+
+// Command parameters arrive in display units (°C, %); keep them as centi-units
+int32_t toCenti(JsonVariantConst value, int32_t current) {
+    return value.is<float>() ? (int32_t)lroundf(value.as<float>() * 100) : current;
+}
+
+void resetCompressionPolicies() {
+    for (size_t i = 0; i < BEACON_FORMAT_COUNT; i++) {
+        formatPolicies[i] = DEFAULT_COMPRESSION_POLICY;
+    }
+    macPolicyCount = 0;
+}
+
+void saveCompressionPolicies() {
+    bool ok = saveConfigBlob(COMPRESSION_NVS_FORMATS, formatPolicies, sizeof(formatPolicies)) &&
+              saveConfigBlob(COMPRESSION_NVS_MACS, macPolicies, macPolicyCount * sizeof(MacCompressionPolicy));
+    Serial.printf("%s Compression policies saved to flash (%d MAC overrides)\n",
+                 ok ? "✓" : "✗", (int)macPolicyCount);
+}
+
+// Load at boot; a blob from a different layout falls back to the defaults
+void loadCompressionPolicies() {
+    resetCompressionPolicies();
+    if (getConfigBlobLength(COMPRESSION_NVS_FORMATS) == sizeof(formatPolicies)) {
+        loadConfigBlob(COMPRESSION_NVS_FORMATS, formatPolicies, sizeof(formatPolicies));
+    }
+    size_t macBytes = getConfigBlobLength(COMPRESSION_NVS_MACS);
+    if (macBytes % sizeof(MacCompressionPolicy) == 0 && macBytes <= sizeof(macPolicies)) {
+        macPolicyCount = loadConfigBlob(COMPRESSION_NVS_MACS, macPolicies, macBytes) / sizeof(MacCompressionPolicy);
+    }
+    for (size_t i = 0; i < BEACON_FORMAT_COUNT; i++) {
+        if (formatPolicies[i].algorithm >= COMPRESS_ALGORITHM_COUNT) {
+            formatPolicies[i] = DEFAULT_COMPRESSION_POLICY;
+        }
+    }
+    Serial.printf("✓ Compression policies loaded (%d MAC overrides)\n", (int)macPolicyCount);
+}
+
+// Apply {"command":"compression", ...} to the table. Returns false if nothing changed.
+//   {"format":"LOP001","algorithm":"swinging_door","temperature":0.2,"humidity":1,"battery":5,"maxIntervalMs":0}
+//   {"mac":"AA:BB:CC:DD:EE:FF","algorithm":"heartbeat","maxIntervalMs":600000}
+//   {"mac":"AA:BB:CC:DD:EE:FF","action":"remove"}  or  {"action":"reset"}
+// Omitted parameters keep the policy's current values.
+bool applyCompressionCommand(const JsonDocument& doc) {
+    String action = doc["action"] | "set";
+    if (action == "reset") {
+        resetCompressionPolicies();
+        return true;
+    }
+
+    CompressionPolicy* policy = nullptr;
+    const char* macText = doc["mac"] | "";
+    const char* formatName = doc["format"] | "";
+    if (macText[0] != '\0') {
+        uint64_t mac;
+        if (!parseMacString(macText, 6, mac)) {
+            Serial.printf("❌ Invalid MAC in compression command: %s\n", macText);
+            return false;
+        }
+        size_t slot = 0;
+        while (slot < macPolicyCount && macPolicies[slot].mac != mac) {
+            slot++;
+        }
+        if (action == "remove") {
+            if (slot == macPolicyCount) {
+                return false;
+            }
+            macPolicies[slot] = macPolicies[--macPolicyCount];
+            return true;
+        }
+        if (slot == macPolicyCount) {
+            if (macPolicyCount == COMPRESSION_MAX_MAC_POLICIES) {
+                Serial.printf("❌ Too many MAC compression policies (max %d)\n", (int)COMPRESSION_MAX_MAC_POLICIES);
+                return false;
+            }
+            macPolicies[macPolicyCount].mac = mac;
+            macPolicies[macPolicyCount].policy = DEFAULT_COMPRESSION_POLICY;
+            macPolicyCount++;
+        }
+        policy = &macPolicies[slot].policy;
+    } else {
+        uint8_t format = BEACON_UNKNOWN;
+        while (format < BEACON_FORMAT_COUNT && strcmp(BEACON_FORMAT_NAMES[format], formatName) != 0) {
+            format++;
+        }
+        if (format == BEACON_FORMAT_COUNT) {
+            Serial.printf("❌ Compression command needs a known format or a mac (got \"%s\")\n", formatName);
+            return false;
+        }
+        policy = &formatPolicies[format];
+    }
+
+    if (doc["algorithm"].is<const char*>()) {
+        const char* name = doc["algorithm"];
+        uint8_t algorithm = 0;
+        while (algorithm < COMPRESS_ALGORITHM_COUNT && strcmp(COMPRESSION_ALGORITHM_NAMES[algorithm], name) != 0) {
+            algorithm++;
+        }
+        if (algorithm == COMPRESS_ALGORITHM_COUNT) {
+            Serial.printf("❌ Unknown compression algorithm: %s\n", name);
+            return false;
+        }
+        policy->algorithm = algorithm;
+    }
+    policy->temperature = toCenti(doc["temperature"], policy->temperature);
+    policy->humidity = toCenti(doc["humidity"], policy->humidity);
+    policy->battery = doc["battery"] | policy->battery;
+    policy->maxIntervalMs = doc["maxIntervalMs"] | policy->maxIntervalMs;
+    if (policy->algorithm == COMPRESS_HEARTBEAT && policy->maxIntervalMs == 0) {
+        Serial.println("⚠️  Heartbeat policy without maxIntervalMs uses the tracker keepalive");
+    }
+    return true;
+}
+
+#endif // COMPRESSION_POLICY_H
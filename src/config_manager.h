@@ -4,6 +4,7 @@
  * Handles:
  * - Flash storage (Preferences API)
  * - Configuration load/save
+ * - Binary settings blobs (e.g. MAC filter lists) and numeric tunables
  * - Encryption (if needed)
  */
 
@@ -96,6 +97,42 @@ void provisionMQTT(const String& user, const String& pass, const String& token)
     Serial.println("✓ MQTT credentials and device token provisioned to flash");
 }
 
+// Store a binary settings blob (empty blob removes the key)
+bool saveConfigBlob(const char* key, const void* data, size_t length) {
+    if (length == 0) {
+        preferences.remove(key);
+        return true;
+    }
+    return preferences.putBytes(key, data, length) == length;
+}
+
+// Length of a stored settings blob (0 if missing)
+size_t getConfigBlobLength(const char* key) {
+    if (!preferences.isKey(key)) {
+        return 0;
+    }
+    return preferences.getBytesLength(key);
+}
+
+// Load a binary settings blob into buffer. Returns the stored length, or 0 if
+// the key is missing or larger than maxLength.
+size_t loadConfigBlob(const char* key, void* buffer, size_t maxLength) {
+    size_t length = getConfigBlobLength(key);
+    if (length == 0 || length > maxLength) {
+        return 0;
+    }
+    return preferences.getBytes(key, buffer, length);
+}
+
+// Numeric tunables set at runtime over MQTT
+uint32_t getConfigUInt(const char* key, uint32_t defaultValue) {
+    return preferences.getUInt(key, defaultValue);
+}
+
+bool saveConfigUInt(const char* key, uint32_t value) {
+    return preferences.putUInt(key, value) == sizeof(value);
+}
+
 void clearConfig() {
     preferences.clear();
     Serial.println("✓ Configuration cleared from flash");
@@ -0,0 +1,372 @@
+/**
+ * Device Message
+ *
+ * Handles:
+ * - The per-reading snapshot the tracker hands to the MQTT layer
+ * - JSON (ThingsBoard connector) and MessagePack encodings of a reading,
+ *   single or as a batch entry
+ * - Writing into a caller-owned buffer: no JsonDocument, no String, no heap
+ *
+ * Encoders write straight into a PayloadWriter over a fixed buffer; when it
+ * runs out of room it stops writing and reports overflowed(), and the caller
+ * rolls back with truncate(). JSON fields keep the names and order of the
+ * JsonDocument version, and numbers print as its floats did ("20", "26.1").
+ * The only differences are computed values - compressionRatio and the
+ * window means and deviations - which are rounded to hundredths.
+ */
+
+#ifndef DEVICE_MESSAGE_H
+#define DEVICE_MESSAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include "beacon_decoders.h"
+#include "advert_ring.h"
+#include "running_stats.h"
+#include "fixed_point.h"
+
+// Copy of the fields a device message needs, taken under the tracker lock
+struct PublishSnapshot {
+    uint64_t mac;
+    uint8_t format;
+    bool isSensor;
+    bool changed;
+    int16_t temperatureCenti;
+    uint16_t humidityCenti;
+    int battery;
+    int rssi;
+    uint64_t timestampMs;           // Unix ms, filled in just before encoding
+
+    uint32_t compressionRatioCenti; // Readings per message x100, this one included
+
+    // Window summary (window mode only)
+    bool summary;
+    uint32_t windowMs;
+    RunningStats temperatureStats;
+    RunningStats humidityStats;
+    RunningStats rssiStats;
+};
+
+// Device message encoding, per gateway
+//   json:    sensor/data and sensor/data/batch, as documented for the ThingsBoard connector
+//   msgpack: msgpack/<gateway>/data and msgpack/<gateway>/batch, MessagePack arrays with
+//            positional fields (MSGPACK_FIELD_*); a batch is an array of readings
+enum PayloadFormat : uint8_t {
+    PAYLOAD_JSON = 0,
+    PAYLOAD_MSGPACK,
+    PAYLOAD_FORMAT_COUNT
+};
+
+const char* const PAYLOAD_FORMAT_NAMES[PAYLOAD_FORMAT_COUNT] = { "json", "msgpack" };
+
+// MessagePack reading schema, version 1. Trailing absent fields are dropped;
+// absent fields before a present one are nil.
+enum MsgPackField : uint8_t {
+    MSGPACK_FIELD_VERSION = 0,     // 1
+    MSGPACK_FIELD_MAC,             // uint, 48-bit address (AA:BB:.. = 0xAABB..)
+    MSGPACK_FIELD_TIMESTAMP,       // uint, Unix ms
+    MSGPACK_FIELD_TYPE,            // uint, BeaconFormat (beacon_decoders.h)
+    MSGPACK_FIELD_RSSI,            // int, dBm
+    MSGPACK_FIELD_COMPRESSION,     // uint, compressionRatio x 100
+    MSGPACK_FIELD_TEMPERATURE,     // int, 0.01 °C (sensors)
+    MSGPACK_FIELD_HUMIDITY,        // uint, 0.01 % RH (sensors)
+    MSGPACK_FIELD_BATTERY,         // uint (sensors with a battery)
+    MSGPACK_FIELD_WINDOW           // [count, windowMs, [rssi x6], [temp x6], [hum x6]] (window mode)
+};
+
+const uint8_t MSGPACK_SCHEMA_VERSION = 1;
+
+// Window stats are written as these six values, in this order
+const size_t WINDOW_STAT_COUNT = 6;
+const char* const WINDOW_STAT_SUFFIXES[WINDOW_STAT_COUNT] = { "Min", "Max", "Mean", "Std", "First", "Last" };
+
+class PayloadWriter {
+public:
+    PayloadWriter(uint8_t* buffer, size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+    const uint8_t* data() const { return buffer_; }
+    size_t length() const { return length_; }
+    bool overflowed() const { return overflow_; }
+
+    // Roll back to an earlier length (and clear the overflow)
+    void truncate(size_t length) {
+        length_ = length;
+        overflow_ = false;
+    }
+
+    void byte(uint8_t value) {
+        if (length_ < capacity_) {
+            buffer_[length_++] = value;
+        } else {
+            overflow_ = true;
+        }
+    }
+
+    void patch(size_t at, uint8_t value) {
+        if (at < length_) {
+            buffer_[at] = value;
+        }
+    }
+
+    // --- JSON ---
+
+    void raw(const char* text) {
+        while (*text) {
+            byte((uint8_t)*text++);
+        }
+    }
+
+    void quoted(const char* text) {
+        byte('"');
+        for (; *text; text++) {
+            uint8_t c = (uint8_t)*text;
+            if (c == '"' || c == '\\') {
+                byte('\\');
+                byte(c);
+            } else if (c < 0x20) {
+                static const char HEX_DIGITS[] = "0123456789abcdef";
+                raw("\\u00");
+                byte(HEX_DIGITS[c >> 4]);
+                byte(HEX_DIGITS[c & 0x0F]);
+            } else {
+                byte(c);
+            }
+        }
+        byte('"');
+    }
+
+    // "name": with the separating comma unless it opens an object
+    void key(const char* name) {
+        if (length_ > 0 && buffer_[length_ - 1] != '{') {
+            byte(',');
+        }
+        quoted(name);
+        byte(':');
+    }
+
+    void unsignedInt(uint64_t value) {
+        char digits[20];
+        size_t count = 0;
+        do {
+            digits[count++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (count > 0) {
+            byte((uint8_t)digits[--count]);
+        }
+    }
+
+    void signedInt(int64_t value) {
+        if (value < 0) {
+            byte('-');
+            unsignedInt(0 - (uint64_t)value);
+        } else {
+            unsignedInt((uint64_t)value);
+        }
+    }
+
+    void centi(int32_t value) {
+        char text[CENTI_STRING_SIZE];
+        formatCentiShort(value, text);
+        raw(text);
+    }
+
+    // --- MessagePack (smallest encoding, as ArduinoJson's serializeMsgPack) ---
+
+    void mpNil() {
+        byte(0xC0);
+    }
+
+    void mpUnsigned(uint64_t value) {
+        if (value < 0x80) {
+            byte((uint8_t)value);
+        } else if (value <= 0xFF) {
+            byte(0xCC);
+            bigEndian(value, 1);
+        } else if (value <= 0xFFFF) {
+            byte(0xCD);
+            bigEndian(value, 2);
+        } else if (value <= 0xFFFFFFFF) {
+            byte(0xCE);
+            bigEndian(value, 4);
+        } else {
+            byte(0xCF);
+            bigEndian(value, 8);
+        }
+    }
+
+    void mpSigned(int64_t value) {
+        if (value >= 0) {
+            mpUnsigned((uint64_t)value);
+        } else if (value >= -32) {
+            byte((uint8_t)value);
+        } else if (value >= -128) {
+            byte(0xD0);
+            bigEndian((uint64_t)value, 1);
+        } else if (value >= -32768) {
+            byte(0xD1);
+            bigEndian((uint64_t)value, 2);
+        } else if (value >= INT32_MIN) {
+            byte(0xD2);
+            bigEndian((uint64_t)value, 4);
+        } else {
+            byte(0xD3);
+            bigEndian((uint64_t)value, 8);
+        }
+    }
+
+    void mpArray(size_t count) {
+        if (count < 16) {
+            byte((uint8_t)(0x90 | count));
+        } else {
+            byte(0xDC);
+            bigEndian(count, 2);
+        }
+    }
+
+private:
+    void bigEndian(uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; i--) {
+            byte((uint8_t)(value >> (8 * i)));
+        }
+    }
+
+    uint8_t* buffer_;
+    size_t capacity_;
+    size_t length_ = 0;
+    bool overflow_ = false;
+};
+
+void writeJsonWindowStats(PayloadWriter& out, const char* channel, const RunningStats& stats) {
+    int32_t values[WINDOW_STAT_COUNT] = {
+        stats.min, stats.max, stats.mean(), (int32_t)stats.stddev(), stats.first, stats.last
+    };
+    for (size_t i = 0; i < WINDOW_STAT_COUNT; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "%s%s", channel, WINDOW_STAT_SUFFIXES[i]);
+        out.key(key);
+        out.centi(values[i]);
+    }
+}
+
+// Telemetry fields of one reading, inside an open JSON object
+void writeJsonTelemetry(PayloadWriter& out, const PublishSnapshot& reading) {
+    // Only sensors carry temp/hum (field names from the connector config),
+    // and battery only when non-zero (LOP001 has none)
+    if (reading.isSensor) {
+        out.key("temp");
+        out.centi(reading.temperatureCenti);
+        out.key("hum");
+        out.centi(reading.humidityCenti);
+        if (reading.battery > 0) {
+            out.key("battery");
+            out.signedInt(reading.battery);
+        }
+    }
+    out.key("rssi");
+    out.signedInt(reading.rssi);
+    out.key("compressionRatio");
+    out.centi((int32_t)reading.compressionRatioCenti);
+
+    // Window summary fields go in flat, like the readings (tempMin, rssiMean, ...)
+    if (reading.summary) {
+        out.key("count");
+        out.unsignedInt(reading.rssiStats.count);
+        out.key("windowMs");
+        out.unsignedInt(reading.windowMs);
+        if (reading.isSensor) {
+            writeJsonWindowStats(out, "temp", reading.temperatureStats);
+            writeJsonWindowStats(out, "hum", reading.humidityStats);
+        }
+        writeJsonWindowStats(out, "rssi", reading.rssiStats);
+    }
+}
+
+// One sensor/data message
+void writeJsonReading(PayloadWriter& out, const PublishSnapshot& reading, const char* gatewayId) {
+    char macStr[18];
+    formatMac(reading.mac, macStr);
+    const char* type = beaconFormatName(reading.format);
+    out.byte('{');
+    out.key("serialNumber");
+    out.quoted(macStr);
+    out.key("sensorType");
+    out.quoted(type);
+    out.key("sensorModel");
+    out.quoted(type);
+    writeJsonTelemetry(out, reading);
+    out.key("gateway");
+    out.quoted(gatewayId);
+    out.key("timestamp");
+    out.unsignedInt(reading.timestampMs);
+    out.byte('}');
+}
+
+// One "<serialNumber>":[{"ts":..,"values":{..}}] member of a batch object
+void writeJsonBatchEntry(PayloadWriter& out, const PublishSnapshot& reading) {
+    char macStr[18];
+    formatMac(reading.mac, macStr);
+    out.key(macStr);
+    out.raw("[{\"ts\":");
+    out.unsignedInt(reading.timestampMs);
+    out.raw(",\"values\":{");
+    writeJsonTelemetry(out, reading);
+    out.raw("}}]");
+}
+
+void writeMsgPackWindowStats(PayloadWriter& out, const RunningStats& stats) {
+    out.mpArray(WINDOW_STAT_COUNT);
+    out.mpSigned(stats.min);
+    out.mpSigned(stats.max);
+    out.mpSigned(stats.mean());
+    out.mpUnsigned(stats.stddev());
+    out.mpSigned(stats.first);
+    out.mpSigned(stats.last);
+}
+
+// One reading as a MessagePack schema array (see MsgPackField)
+void writeMsgPackReading(PayloadWriter& out, const PublishSnapshot& reading) {
+    bool hasBattery = reading.isSensor && reading.battery > 0;
+    size_t fields = reading.summary ? MSGPACK_FIELD_WINDOW + 1 :
+                    hasBattery ? MSGPACK_FIELD_BATTERY + 1 :
+                    reading.isSensor ? MSGPACK_FIELD_HUMIDITY + 1 : MSGPACK_FIELD_COMPRESSION + 1;
+    out.mpArray(fields);
+    out.mpUnsigned(MSGPACK_SCHEMA_VERSION);
+    out.mpUnsigned(reading.mac);
+    out.mpUnsigned(reading.timestampMs);
+    out.mpUnsigned(reading.format);
+    out.mpSigned(reading.rssi);
+    out.mpUnsigned(reading.compressionRatioCenti);
+    if (fields <= MSGPACK_FIELD_TEMPERATURE) {
+        return;
+    }
+    if (reading.isSensor) {
+        out.mpSigned(reading.temperatureCenti);
+        out.mpUnsigned(reading.humidityCenti);
+    } else {
+        out.mpNil();
+        out.mpNil();
+    }
+    if (fields <= MSGPACK_FIELD_BATTERY) {
+        return;
+    }
+    if (hasBattery) {
+        out.mpSigned(reading.battery);
+    } else {
+        out.mpNil();
+    }
+    if (reading.summary) {
+        out.mpArray(reading.isSensor ? 5 : 3);
+        out.mpUnsigned(reading.rssiStats.count);
+        out.mpUnsigned(reading.windowMs);
+        writeMsgPackWindowStats(out, reading.rssiStats);
+        if (reading.isSensor) {
+            writeMsgPackWindowStats(out, reading.temperatureStats);
+            writeMsgPackWindowStats(out, reading.humidityStats);
+        }
+    }
+}
+
+#endif // DEVICE_MESSAGE_H
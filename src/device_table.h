@@ -0,0 +1,236 @@
+/**
+ * Device Table
+ *
+ * Handles:
+ * - Fixed-capacity, preallocated hash table keyed by the packed 48-bit MAC
+ * - Stable entry storage (entries never move while they are in the table)
+ * - Insert/find/erase with no heap allocation
+ * - Least-recently-used order per eviction tier
+ *
+ * Layout: an open-addressing index of uint16 slots (linear probing, at most
+ * 50% full) pointing into a pool of POD entries, with a free list of unused
+ * pool entries. Erase uses backward-shift deletion, so there are no
+ * tombstones and probe sequences stay short however long the table runs.
+ *
+ * Every entry belongs to one of DEVICE_TIER_COUNT intrusive LRU lists
+ * (uint16 links beside the pool), or to none if it is pinned. touch() moves an
+ * entry to the most-recent end of its list and oldest() returns the least
+ * recent, both O(1).
+ *
+ * Entry must be a POD with a `uint64_t mac` member; mac 0 marks a free entry
+ * (00:00:00:00:00:00 is never a valid advertiser address).
+ */
+
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+constexpr size_t deviceTableSlotBits(size_t capacity) {
+    size_t bits = 1;
+    while (((size_t)1 << bits) < capacity * 2) {
+        bits++;
+    }
+    return bits;
+}
+
+// Eviction tiers: evict from the lowest tier first, never evict pinned entries
+enum DeviceTier : uint8_t {
+    DEVICE_TIER_EVICTABLE = 0,
+    DEVICE_TIER_PROTECTED,
+    DEVICE_TIER_COUNT,
+    DEVICE_TIER_PINNED = DEVICE_TIER_COUNT
+};
+
+template <typename Entry, size_t Capacity>
+class DeviceTable {
+    static_assert(Capacity > 0 && Capacity < 0xFFFF, "DeviceTable capacity must fit a uint16 index");
+
+public:
+    static constexpr size_t SLOT_BITS = deviceTableSlotBits(Capacity);
+    static constexpr size_t SLOT_COUNT = (size_t)1 << SLOT_BITS;
+
+    DeviceTable() {
+        clear();
+    }
+
+    void clear() {
+        memset(slots_, 0, sizeof(slots_));
+        memset(entries_, 0, sizeof(entries_));
+        for (size_t i = 0; i < Capacity; i++) {
+            free_[i] = (uint16_t)(Capacity - 1 - i);  // Hand out low indices first
+        }
+        freeCount_ = Capacity;
+        for (size_t t = 0; t < DEVICE_TIER_COUNT; t++) {
+            head_[t] = NIL;
+            tail_[t] = NIL;
+        }
+    }
+
+    Entry* find(uint64_t mac) {
+        size_t slot = findSlot(mac);
+        return slot < SLOT_COUNT ? &entries_[slots_[slot] - 1] : nullptr;
+    }
+
+    // Add a zeroed entry for `mac` as the most recent of its tier (or return
+    // the existing one). Returns nullptr when the table is full.
+    Entry* insert(uint64_t mac, DeviceTier tier) {
+        size_t slot = home(mac);
+        while (slots_[slot] != 0) {
+            Entry& entry = entries_[slots_[slot] - 1];
+            if (entry.mac == mac) {
+                return &entry;
+            }
+            slot = (slot + 1) & (SLOT_COUNT - 1);
+        }
+        if (freeCount_ == 0) {
+            return nullptr;
+        }
+
+        uint16_t index = free_[--freeCount_];
+        Entry& entry = entries_[index];
+        memset(&entry, 0, sizeof(Entry));
+        entry.mac = mac;
+        slots_[slot] = index + 1;
+        tier_[index] = tier;
+        link(index);
+        return &entry;
+    }
+
+    bool erase(uint64_t mac) {
+        size_t hole = findSlot(mac);
+        if (hole >= SLOT_COUNT) {
+            return false;
+        }
+
+        uint16_t index = slots_[hole] - 1;
+        unlink(index);
+        entries_[index].mac = 0;
+        free_[freeCount_++] = index;
+        slots_[hole] = 0;
+
+        // Backward-shift: pull later entries of the probe run into the hole
+        // unless that would move them before their home slot
+        size_t next = hole;
+        while (true) {
+            next = (next + 1) & (SLOT_COUNT - 1);
+            if (slots_[next] == 0) {
+                break;
+            }
+            size_t homeSlot = home(entries_[slots_[next] - 1].mac);
+            if (((next - homeSlot) & (SLOT_COUNT - 1)) >= ((next - hole) & (SLOT_COUNT - 1))) {
+                slots_[hole] = slots_[next];
+                slots_[next] = 0;
+                hole = next;
+            }
+        }
+        return true;
+    }
+
+    // Visit every entry in the table. fn may erase the entry it is given.
+    template <typename Fn>
+    void forEach(Fn fn) {
+        for (size_t i = 0; i < Capacity; i++) {
+            if (entries_[i].mac != 0) {
+                fn(entries_[i]);
+            }
+        }
+    }
+
+    // Mark an entry as just used
+    void touch(Entry* entry) {
+        uint16_t index = (uint16_t)(entry - entries_);
+        unlink(index);
+        link(index);
+    }
+
+    void setTier(Entry* entry, DeviceTier tier) {
+        uint16_t index = (uint16_t)(entry - entries_);
+        unlink(index);
+        tier_[index] = tier;
+        link(index);
+    }
+
+    DeviceTier tierOf(const Entry* entry) const {
+        return (DeviceTier)tier_[entry - entries_];
+    }
+
+    // Least recently used entry of a tier, or nullptr if the tier is empty
+    Entry* oldest(DeviceTier tier) {
+        return (tier < DEVICE_TIER_COUNT && head_[tier] != NIL) ? &entries_[head_[tier]] : nullptr;
+    }
+
+    // Pool index of an entry, stable while it stays in the table (for side tables)
+    uint16_t indexOf(const Entry* entry) const { return (uint16_t)(entry - entries_); }
+    Entry& at(uint16_t index) { return entries_[index]; }
+
+    size_t size() const { return Capacity - freeCount_; }
+    size_t capacity() const { return Capacity; }
+
+private:
+    static const uint16_t NIL = 0xFFFF;
+
+    // Append to the most-recent end of the entry's tier list (pinned entries have no list)
+    void link(uint16_t index) {
+        uint8_t tier = tier_[index];
+        prev_[index] = NIL;
+        next_[index] = NIL;
+        if (tier >= DEVICE_TIER_COUNT) {
+            return;
+        }
+        prev_[index] = tail_[tier];
+        if (tail_[tier] != NIL) {
+            next_[tail_[tier]] = index;
+        } else {
+            head_[tier] = index;
+        }
+        tail_[tier] = index;
+    }
+
+    void unlink(uint16_t index) {
+        uint8_t tier = tier_[index];
+        if (tier >= DEVICE_TIER_COUNT) {
+            return;
+        }
+        if (prev_[index] != NIL) {
+            next_[prev_[index]] = next_[index];
+        } else {
+            head_[tier] = next_[index];
+        }
+        if (next_[index] != NIL) {
+            prev_[next_[index]] = prev_[index];
+        } else {
+            tail_[tier] = prev_[index];
+        }
+    }
+
+    static size_t home(uint64_t mac) {
+        return (size_t)((mac * 0x9E3779B97F4A7C15ull) >> (64 - SLOT_BITS));
+    }
+
+    // Slot holding `mac`, or SLOT_COUNT if absent
+    size_t findSlot(uint64_t mac) const {
+        size_t slot = home(mac);
+        while (slots_[slot] != 0) {
+            if (entries_[slots_[slot] - 1].mac == mac) {
+                return slot;
+            }
+            slot = (slot + 1) & (SLOT_COUNT - 1);
+        }
+        return SLOT_COUNT;
+    }
+
+    uint16_t slots_[SLOT_COUNT];  // Entry index + 1, 0 = empty
+    Entry entries_[Capacity];
+    uint16_t free_[Capacity];     // Stack of unused entry indices
+    size_t freeCount_;
+    uint16_t prev_[Capacity];     // LRU links (towards older)
+    uint16_t next_[Capacity];     // LRU links (towards newer)
+    uint8_t tier_[Capacity];      // DeviceTier of each entry
+    uint16_t head_[DEVICE_TIER_COUNT];  // Least recently used
+    uint16_t tail_[DEVICE_TIER_COUNT];  // Most recently used
+};
+
+#endif // DEVICE_TABLE_H
@@ -2,40 +2,84 @@
  * Device Tracker
  * 
  * Handles:
- * - Tracking discovered BLE devices
+ * - Tracking discovered BLE devices in a fixed-capacity table keyed by packed MAC
+ * - Memory budget with least-recently-seen eviction (sensors protected, formats pinnable)
+ * - Draining adverts queued by the BLE callback in batches
  * - 12-hour change detection
- * - Device data comparison
- * - Automatic device expiry
- * - MQTT publishing queue
+ * - Device data comparison through per-type/per-MAC compression policies
+ * - Keepalive and expiry deadlines on a timer wheel (no full-table sweeps)
+ * - Dirty queues of devices to publish (changes ahead of keepalives and summaries);
+ *   messages are built and sent with no lock held, paced by a token bucket with jitter
+ * - Window aggregate publish mode (one min/max/mean/stddev summary per device per window;
+ *   a summary that could not be sent is folded back into the next window)
+ * - Window aggregates and swinging-door state in side pools sized by the budget,
+ *   allocated only while window mode / a swinging_door policy is in use
+ * - Periodic SPIFFS snapshot of per-device baselines, restored at boot (warm restart)
+ *
+ * Eviction: when the budget is used up, a new device replaces the least
+ * recently seen presence-only device, then the least recently seen sensor.
+ * Devices of a pinned format are never evicted; if only pinned devices are
+ * left the new one is turned away (deviceTableFull).
  */
 
 #ifndef DEVICE_TRACKER_H
 #define DEVICE_TRACKER_H
 
-#include <map>
 #include <ArduinoJson.h>
+#include <esp_timer.h>
+#include <SPIFFS.h>
+#include <atomic>
+#include "beacon_decoders.h"
+#include "advert_ring.h"
+#include "scan_scheduler.h"
+#include "pipeline_profiler.h"
+#include "device_table.h"
+#include "side_pool.h"
+#include "timer_wheel.h"
+#include "dirty_queue.h"
+#include "running_stats.h"
+#include "compression_policy.h"
+#include "tracker_snapshot.h"
+#include "publish_limiter.h"
 
 extern SemaphoreHandle_t deviceMapMutex;
 extern unsigned long current_timestamp;
 
-// Device tracking structure
+#ifndef MAX_TRACKED_DEVICES
+#define MAX_TRACKED_DEVICES 512  // ~38 KB preallocated (75 B per device on ESP32, index and links included)
+#endif
+
+// Device tracking structure (POD - no heap). The name and sensor type are
+// the interned BeaconFormat; see deviceTypeName().
 struct TrackedDevice {
-    String macAddress;
-    String name;
-    String sensorType;
-    bool isSensor;  // True if sensor beacon with parsed temp/humidity
-    
-    // Current values
-    float temperature;
-    float humidity;
+    uint64_t mac;      // Packed 48-bit address, table key
+    uint8_t format;    // BeaconFormat
+    bool isSensor;     // True if sensor beacon with parsed temp/humidity
+    uint8_t policy;    // Compression policy index, see resolveCompressionPolicy()
+    
+    // Current values, fixed-point as decoded
+    int16_t temperatureCenti;   // 0.01 °C
+    uint16_t humidityCenti;     // 0.01 % RH
     int battery;
     int rssi;
     
     // Previous values for change detection
-    float lastTemperature;
-    float lastHumidity;
+    int16_t lastTemperatureCenti;
+    uint16_t lastHumidityCenti;
     int lastBattery;
     
+    // Compression ratio = readings / publishes
+    uint32_t readings;
+    uint32_t publishes;
+    
+    // Advertising period learned at ingest, before dedup (0 = not yet known)
+    uint32_t advPeriod;
+    
+    // Side pool entries, SIDE_POOL_NONE if none: the open window (window
+    // mode) and the swinging doors (swinging_door policy)
+    uint16_t window;
+    uint16_t doors;
+    
     // Timestamps
     unsigned long lastUpdate;      // Last time we saw this device
     unsigned long lastPublish;     // Last time we published data
@@ -46,209 +90,1294 @@ struct TrackedDevice {
     bool hasChanged;
 };
 
-std::map<String, TrackedDevice> deviceMap;
+DeviceTable<TrackedDevice, MAX_TRACKED_DEVICES> deviceTable;
+uint32_t deviceTableFull = 0;  // New devices turned away because the table was full
+uint32_t devicesEvicted = 0;   // Devices dropped to make room, all tiers
+uint32_t devicesDiscovered = 0; // New devices added to the table
+uint32_t sensorsEvicted = 0;   // ...of which protected sensors
+uint32_t trackerReadings = 0;  // Readings applied to the table, all devices
+uint32_t trackerPublishes = 0; // Device messages settled (sent or stored offline)
 
-const unsigned long SIX_HOURS = 6 * 60 * 60 * 1000; // 6 hours in milliseconds
-const float TEMP_THRESHOLD = 0.1; // °C - minimum change to consider significant (reduced for testing)
-const float HUM_THRESHOLD = 0.5;  // % - minimum change to consider significant (reduced for testing)
-const int BATTERY_THRESHOLD = 5;  // % or mV - minimum change to consider significant
+// Table memory per tracked device, index and LRU links included
+const size_t TRACKED_DEVICE_BYTES = sizeof(deviceTable) / MAX_TRACKED_DEVICES;
 
-bool hasSignificantChange(const TrackedDevice& device, float newTemp, float newHum, int newBatt) {
-    bool tempChanged = abs(newTemp - device.lastTemperature) >= TEMP_THRESHOLD;
-    bool humChanged = abs(newHum - device.lastHumidity) >= HUM_THRESHOLD;
-    bool battChanged = abs(newBatt - device.lastBattery) >= BATTERY_THRESHOLD;
-    
-    return tempChanged || humChanged || battChanged;
+// Aggregates since the window opened (window mode only)
+struct DeviceWindow {
+    RunningStats temperatureStats;
+    RunningStats humidityStats;
+    RunningStats rssiStats;
+    unsigned long windowStart;
+};
+
+// Swinging-door state since the last reported change
+struct DeviceDoors {
+    DoorState temperature;
+    DoorState humidity;
+};
+
+// Sized to trackerDeviceLimit while in use, so every device can hold one
+SidePool<DeviceWindow> deviceWindows;  // Window mode only
+SidePool<DeviceDoors> deviceDoors;     // While any policy uses swinging_door
+
+// One pending deadline per table entry (keepalive or expiry, whichever is next)
+TimerWheel<MAX_TRACKED_DEVICES> deviceTimers;
+const uint32_t DEVICE_TIMER_TICK_MS = 1000;
+
+// Devices with needsPublish set, in the order they became dirty: new and
+// changed devices first, keepalives and window summaries when they are empty
+DirtyQueue<MAX_TRACKED_DEVICES> dirtyDevices;
+DirtyQueue<MAX_TRACKED_DEVICES> routineDevices;
+
+// Gateway-wide device message rate (tracker task only)
+PublishLimiter publishLimiter;
+uint32_t publishesDeferred = 0;  // Publish passes cut short by the limiter
+
+// New publish_rate settings from the MQTT task, written under deviceMapMutex
+// and applied by the tracker task at the start of its next publish pass
+struct PublishRateRequest {
+    uint32_t ratePerMin;
+    uint32_t burst;
+    uint32_t jitterMs;
+};
+PublishRateRequest publishRateRequest;
+std::atomic<bool> publishRatePending{false};
+
+// deviceMapMutex with its hold time recorded in deviceMapLockHold
+bool lockDeviceMap(int64_t& lockedAt) {
+    if (xSemaphoreTake(deviceMapMutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return false;
+    }
+    lockedAt = esp_timer_get_time();
+    return true;
+}
+
+void unlockDeviceMap(int64_t lockedAt) {
+    deviceMapLockHold.record((uint32_t)(esp_timer_get_time() - lockedAt));
+    xSemaphoreGive(deviceMapMutex);
 }
 
-void updateDevice(const String& mac, const String& name, const String& type, 
-                  float temp, float hum, int batt, int rssi, bool isSensor = false) {
+const char* TRACKER_NVS_BUDGET = "trk_budget";
+const char* TRACKER_NVS_PINNED = "trk_pinned";
+const char* TRACKER_NVS_KEEPALIVE = "trk_keepalive";
+const char* TRACKER_NVS_EXPIRY = "trk_expiry";
+const char* TRACKER_NVS_PUBLISH_MODE = "trk_mode";
+const char* TRACKER_NVS_WINDOW = "trk_window";
+const char* TRACKER_NVS_PUBLISH_RATE = "pub_rate";
+const char* TRACKER_NVS_PUBLISH_BURST = "pub_burst";
+const char* TRACKER_NVS_PUBLISH_JITTER = "pub_jitter";
+
+size_t trackerDeviceLimit = MAX_TRACKED_DEVICES;  // Budget in devices, <= table capacity
+uint32_t trackerPinnedFormats = 0;                // Bit per BeaconFormat
+
+size_t getTrackedDeviceCount() {
+    return deviceTable.size();
+}
+
+size_t getTrackedDeviceCapacity() {
+    return trackerDeviceLimit;
+}
+
+size_t getTrackerBudgetBytes() {
+    return trackerDeviceLimit * TRACKED_DEVICE_BYTES;
+}
+
+size_t getPublishQueueLength() {
+    return dirtyDevices.size() + routineDevices.size();
+}
+
+const char* deviceTypeName(const TrackedDevice& device) {
+    return beaconFormatName(device.format);
+}
+
+const uint32_t DEVICE_KEEPALIVE_DEFAULT_MS = 6 * 60 * 60 * 1000;  // Republish stable devices every 6 hours
+const uint32_t DEVICE_EXPIRY_DEFAULT_MS = 6 * 60 * 60 * 1000;     // Forget devices not heard for 6 hours
+const uint32_t DEVICE_TIMER_MIN_MS = 60 * 1000;
+const uint32_t DEVICE_TIMER_MAX_MS = 7 * 24 * 60 * 60 * 1000;
+uint32_t deviceKeepaliveMs = DEVICE_KEEPALIVE_DEFAULT_MS;
+uint32_t deviceExpiryMs = DEVICE_EXPIRY_DEFAULT_MS;
+
+uint32_t clampDeviceTimerMs(uint32_t ms) {
+    return ms < DEVICE_TIMER_MIN_MS ? DEVICE_TIMER_MIN_MS : (ms > DEVICE_TIMER_MAX_MS ? DEVICE_TIMER_MAX_MS : ms);
+}
+
+// How device messages are triggered
+enum PublishMode : uint8_t {
+    PUBLISH_MODE_CHANGE = 0,  // On significant change, new device and keepalive
+    PUBLISH_MODE_WINDOW       // One aggregate summary per window in which the device was heard
+};
+
+const char* const PUBLISH_MODE_NAMES[] = { "change", "window" };
+
+const uint32_t AGGREGATE_WINDOW_DEFAULT_MS = 5 * 60 * 1000;
+const uint32_t AGGREGATE_WINDOW_MIN_MS = 10 * 1000;
+const uint32_t AGGREGATE_WINDOW_MAX_MS = 60 * 60 * 1000;
+PublishMode trackerPublishMode = PUBLISH_MODE_CHANGE;
+uint32_t aggregateWindowMs = AGGREGATE_WINDOW_DEFAULT_MS;
+
+// The device's open window, nullptr if it has none (change mode)
+DeviceWindow* deviceWindowLocked(TrackedDevice& device) {
+    return device.window != SIDE_POOL_NONE ? &deviceWindows.at(device.window) : nullptr;
+}
+
+// The device's swinging doors, taken from the pool on first use (reset);
+// nullptr if the pool is not allocated. Caller must hold deviceMapMutex.
+DeviceDoors* deviceDoorsLocked(TrackedDevice& device) {
+    if (device.doors == SIDE_POOL_NONE) {
+        device.doors = deviceDoors.acquire();
+        if (device.doors == SIDE_POOL_NONE) {
+            return nullptr;
+        }
+        deviceDoors.at(device.doors).temperature.reset();
+        deviceDoors.at(device.doors).humidity.reset();
+    }
+    return &deviceDoors.at(device.doors);
+}
+
+// Restart the device's swinging doors from its published values
+void resetDeviceDoorsLocked(TrackedDevice& device) {
+    deviceDoors.recycle(device.doors);
+    device.doors = SIDE_POOL_NONE;
+}
+
+// Ask the device's compression policy whether a reading differs enough
+// from the last reported values to publish. Updates swinging-door state.
+bool hasSignificantChange(TrackedDevice& device, int16_t newTemp, uint16_t newHum, int newBatt, unsigned long seenAt) {
+    const CompressionPolicy& policy = compressionPolicyAt(device.policy);
+    bool battChanged = abs(newBatt - device.battery) >= policy.battery;
     
-    if (xSemaphoreTake(deviceMapMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    switch (policy.algorithm) {
+        case COMPRESS_PERCENT:
+            return exceedsPercentBand(device.temperatureCenti, newTemp, policy.temperature,
+                                      DEFAULT_COMPRESSION_POLICY.temperature) ||
+                   exceedsPercentBand(device.humidityCenti, newHum, policy.humidity,
+                                      DEFAULT_COMPRESSION_POLICY.humidity) || battChanged;
+        case COMPRESS_HEARTBEAT:
+            return false;
+        case COMPRESS_SWINGING_DOOR: {
+            DeviceDoors* doors = deviceDoorsLocked(device);
+            if (doors != nullptr) {
+                long elapsed = (long)(seenAt - device.lastChange);
+                uint32_t elapsedMs = elapsed > 0 ? (uint32_t)elapsed : 0;
+                // Feed both doors every time so neither misses a reading
+                bool tempChanged = doors->temperature.closes(device.temperatureCenti, newTemp, policy.temperature, elapsedMs);
+                bool humChanged = doors->humidity.closes(device.humidityCenti, newHum, policy.humidity, elapsedMs);
+                return tempChanged || humChanged || battChanged;
+            }
+            // No door pool (it could not be allocated): compare as a deadband
+            return exceedsDeadband(device.temperatureCenti, newTemp, policy.temperature) ||
+                   exceedsDeadband(device.humidityCenti, newHum, policy.humidity) || battChanged;
+        }
+        default:
+            return exceedsDeadband(device.temperatureCenti, newTemp, policy.temperature) ||
+                   exceedsDeadband(device.humidityCenti, newHum, policy.humidity) || battChanged;
+    }
+}
+
+// Keepalive interval for a device: its policy's maxIntervalMs, else the tracker's
+uint32_t deviceKeepaliveFor(const TrackedDevice& device) {
+    uint32_t intervalMs = compressionPolicyAt(device.policy).maxIntervalMs;
+    return intervalMs ? clampDeviceTimerMs(intervalMs) : deviceKeepaliveMs;
+}
+
+DeviceTier deviceTierFor(uint8_t format, bool isSensor) {
+    if (format < 32 && (trackerPinnedFormats & (1u << format))) {
+        return DEVICE_TIER_PINNED;
+    }
+    return isSensor ? DEVICE_TIER_PROTECTED : DEVICE_TIER_EVICTABLE;
+}
+
+// Monotonic wheel clock (millis() wraps after 49 days, esp_timer does not)
+uint32_t deviceTimerNow() {
+    return (uint32_t)(esp_timer_get_time() / (DEVICE_TIMER_TICK_MS * 1000));
+}
+
+// File the device's next deadline: expiry, or whichever comes first of its
+// keepalive (once published) or window end (window mode, while not already
+// queued). Caller must hold deviceMapMutex.
+void scheduleDeviceTimerLocked(TrackedDevice& device, unsigned long now) {
+    long due = (long)(device.lastUpdate + deviceExpiryMs - now);
+    if (trackerPublishMode == PUBLISH_MODE_WINDOW) {
+        DeviceWindow* window = deviceWindowLocked(device);
+        if (window != nullptr && !device.needsPublish) {
+            long windowDue = (long)(window->windowStart + aggregateWindowMs - now);
+            if (windowDue < due) {
+                due = windowDue;
+            }
+        }
+    } else if (device.lastPublish != 0 && !device.needsPublish) {
+        long keepaliveDue = (long)(device.lastPublish + deviceKeepaliveFor(device) - now);
+        if (keepaliveDue < due) {
+            due = keepaliveDue;
+        }
+    }
+    uint32_t ticks = due > 0 ? (uint32_t)((due + DEVICE_TIMER_TICK_MS - 1) / DEVICE_TIMER_TICK_MS) : 0;
+    deviceTimers.schedule(deviceTable.indexOf(&device), deviceTimerNow() + ticks);
+}
+
+// Start a new aggregate window, taking the device's entry from the pool
+// first. No-op outside window mode. Caller must hold deviceMapMutex.
+void resetDeviceWindowLocked(TrackedDevice& device, unsigned long now) {
+    if (device.window == SIDE_POOL_NONE) {
+        device.window = deviceWindows.acquire();
+    }
+    DeviceWindow* window = deviceWindowLocked(device);
+    if (window != nullptr) {
+        window->temperatureStats.reset();
+        window->humidityStats.reset();
+        window->rssiStats.reset();
+        window->windowStart = now;
+    }
+}
+
+// Undo resetDeviceWindowLocked for a snapshot taken at `takenAt` that was not
+// published. Caller must hold deviceMapMutex.
+void restoreDeviceWindowLocked(TrackedDevice& device, const PublishSnapshot& snapshot, unsigned long takenAt) {
+    DeviceWindow* window = deviceWindowLocked(device);
+    if (window == nullptr) {
+        return;
+    }
+    RunningStats temperature = snapshot.temperatureStats;
+    RunningStats humidity = snapshot.humidityStats;
+    RunningStats rssi = snapshot.rssiStats;
+    temperature.merge(window->temperatureStats);
+    humidity.merge(window->humidityStats);
+    rssi.merge(window->rssiStats);
+    window->temperatureStats = temperature;
+    window->humidityStats = humidity;
+    window->rssiStats = rssi;
+    window->windowStart = takenAt - snapshot.windowMs;
+}
+
+// Fold one reading into the open window (RSSI as centi-dB). Caller must hold deviceMapMutex.
+void addDeviceSampleLocked(TrackedDevice& device, bool isSensor, int16_t tempCenti, uint16_t humCenti, int rssi) {
+    DeviceWindow* window = deviceWindowLocked(device);
+    if (window == nullptr) {
+        return;
+    }
+    if (isSensor) {
+        window->temperatureStats.add(tempCenti);
+        window->humidityStats.add(humCenti);
+    }
+    window->rssiStats.add(rssi * 100);
+}
+
+// Queue a device for the next publish pass. Caller must hold deviceMapMutex.
+void markDirtyLocked(TrackedDevice& device) {
+    device.needsPublish = true;
+    bool urgent = device.hasChanged || device.lastPublish == 0;
+    (urgent ? dirtyDevices : routineDevices).push(deviceTable.indexOf(&device));
+}
+
+// Remove a device and its deadline. Caller must hold deviceMapMutex.
+void forgetDeviceLocked(TrackedDevice& device) {
+    deviceTimers.cancel(deviceTable.indexOf(&device));
+    deviceWindows.recycle(device.window);
+    deviceDoors.recycle(device.doors);
+    deviceTable.erase(device.mac);
+}
+
+// Drop the least recently seen unpinned device. Caller must hold deviceMapMutex.
+bool evictOneDeviceLocked() {
+    TrackedDevice* victim = deviceTable.oldest(DEVICE_TIER_EVICTABLE);
+    if (victim == nullptr) {
+        victim = deviceTable.oldest(DEVICE_TIER_PROTECTED);
+        if (victim == nullptr) {
+            return false;
+        }
+        sensorsEvicted++;
+    }
+    if (devicesEvicted++ % 100 == 0) {
+        char macStr[18];
+        formatMac(victim->mac, macStr);
+        Serial.printf("⚠️  Device budget full (%d devices) - evicting %s (%s)\n",
+                     (int)trackerDeviceLimit, macStr, deviceTypeName(*victim));
+    }
+    forgetDeviceLocked(*victim);
+    return true;
+}
+
+// Shrink to the budget after it is lowered. Caller must hold deviceMapMutex.
+void enforceDeviceBudgetLocked() {
+    while (deviceTable.size() > trackerDeviceLimit && evictOneDeviceLocked()) {
+    }
+}
+
+// Size the window pool to `capacity` (0 frees it), carrying every open
+// window across. Returns false, pool unchanged, if the memory is not there.
+// Caller must hold deviceMapMutex.
+bool resizeDeviceWindowsLocked(size_t capacity) {
+    if (capacity == deviceWindows.capacity()) {
+        return true;
+    }
+    SidePool<DeviceWindow> resized;
+    if (capacity > 0 && !resized.allocate(capacity)) {
+        return false;
+    }
+    deviceTable.forEach([&](TrackedDevice& device) {
+        DeviceWindow* window = deviceWindowLocked(device);
+        device.window = resized.acquire();
+        if (window != nullptr && device.window != SIDE_POOL_NONE) {
+            resized.at(device.window) = *window;
+        }
+    });
+    deviceWindows.swap(resized);  // The old pool is freed with `resized`
+    return true;
+}
+
+// Size the door pool to `capacity` (0 frees it). Every device's doors
+// restart from its published values. Caller must hold deviceMapMutex.
+void resizeDeviceDoorsLocked(size_t capacity) {
+    deviceTable.forEach([&](TrackedDevice& device) {
+        device.doors = SIDE_POOL_NONE;
+    });
+    if (capacity == deviceDoors.capacity()) {
+        deviceDoors.clear();
+    } else if (capacity == 0 || !deviceDoors.allocate(capacity)) {
+        deviceDoors.release();
+        if (capacity > 0) {
+            Serial.printf("⚠️  No memory for swinging-door state (%d devices) - using deadbands\n", (int)capacity);
+        }
+    }
+}
+
+// Fit the side pools to the device limit and configuration. If the window
+// pool cannot grow, the limit stays at what it holds (window mode falls back
+// to change mode if there is no pool at all). Caller must hold deviceMapMutex.
+void resizeDevicePoolsLocked() {
+    if (trackerPublishMode == PUBLISH_MODE_WINDOW && !resizeDeviceWindowsLocked(trackerDeviceLimit)) {
+        if (deviceWindows.capacity() > 0) {
+            trackerDeviceLimit = deviceWindows.capacity();
+            enforceDeviceBudgetLocked();
+            Serial.printf("⚠️  No memory for more windows - device budget kept at %d\n", (int)trackerDeviceLimit);
+        } else {
+            trackerPublishMode = PUBLISH_MODE_CHANGE;
+            Serial.println("⚠️  No memory for window mode - publishing on change");
+        }
+    }
+    size_t doors = anySwingingDoorPolicy() ? trackerDeviceLimit : 0;
+    if (doors != deviceDoors.capacity()) {
+        resizeDeviceDoorsLocked(doors);
+    }
+}
+
+void setTrackerBudgetBytes(uint32_t budgetBytes) {
+    size_t limit = budgetBytes / TRACKED_DEVICE_BYTES;
+    trackerDeviceLimit = limit < 1 ? 1 : (limit > MAX_TRACKED_DEVICES ? MAX_TRACKED_DEVICES : limit);
+}
+
+void loadTrackerConfig() {
+    setTrackerBudgetBytes(getConfigUInt(TRACKER_NVS_BUDGET, sizeof(deviceTable)));
+    trackerPinnedFormats = getConfigUInt(TRACKER_NVS_PINNED, 0);
+    deviceKeepaliveMs = clampDeviceTimerMs(getConfigUInt(TRACKER_NVS_KEEPALIVE, DEVICE_KEEPALIVE_DEFAULT_MS));
+    deviceExpiryMs = clampDeviceTimerMs(getConfigUInt(TRACKER_NVS_EXPIRY, DEVICE_EXPIRY_DEFAULT_MS));
+    Serial.printf("✓ Device budget: %d devices (%d bytes each), pinned formats 0x%02x\n",
+                 (int)trackerDeviceLimit, (int)TRACKED_DEVICE_BYTES, (unsigned)trackerPinnedFormats);
+    Serial.printf("✓ Device keepalive: %us, expiry: %us\n",
+                 (unsigned)(deviceKeepaliveMs / 1000), (unsigned)(deviceExpiryMs / 1000));
+}
+
+// Handle {"command":"tracker","budgetBytes":16384,"pinned":["LOP001"],
+//         "keepaliveMs":21600000,"expiryMs":21600000} (every field optional).
+// budgetBytes caps the device count and sizes the window/door pools; the
+// table itself stays reserved at MAX_TRACKED_DEVICES (a build-time setting)
+void handleTrackerCommand(const JsonDocument& doc) {
+    bool hasBudget = doc["budgetBytes"].is<uint32_t>();
+    bool hasPinned = doc["pinned"].is<JsonArrayConst>();
+    bool hasKeepalive = doc["keepaliveMs"].is<uint32_t>();
+    bool hasExpiry = doc["expiryMs"].is<uint32_t>();
+    if (!hasBudget && !hasPinned && !hasKeepalive && !hasExpiry) {
+        Serial.println("⚠️  tracker command needs budgetBytes, pinned, keepaliveMs and/or expiryMs");
+        return;
+    }
+
+    uint32_t keepaliveMs = hasKeepalive ? doc["keepaliveMs"].as<uint32_t>() : deviceKeepaliveMs;
+    uint32_t expiryMs = hasExpiry ? doc["expiryMs"].as<uint32_t>() : deviceExpiryMs;
+    if (clampDeviceTimerMs(keepaliveMs) != keepaliveMs || clampDeviceTimerMs(expiryMs) != expiryMs) {
+        Serial.printf("❌ Keepalive/expiry must be %u-%ums\n", DEVICE_TIMER_MIN_MS, DEVICE_TIMER_MAX_MS);
+        return;
+    }
+
+    uint32_t pinned = trackerPinnedFormats;
+    if (hasPinned) {
+        pinned = 0;
+        for (JsonVariantConst name : doc["pinned"].as<JsonArrayConst>()) {
+            const char* formatName = name | "";
+            uint8_t format = BEACON_UNKNOWN;
+            while (format < BEACON_FORMAT_COUNT && strcmp(BEACON_FORMAT_NAMES[format], formatName) != 0) {
+                format++;
+            }
+            if (format == BEACON_FORMAT_COUNT) {
+                Serial.printf("❌ Unknown beacon format to pin: %s\n", formatName);
+                return;
+            }
+            pinned |= 1u << format;
+        }
+    }
+
+    int64_t lockedAt;
+    if (!lockDeviceMap(lockedAt)) {
+        Serial.println("❌ Device map busy - tracker command not applied");
+        return;
+    }
+    if (hasBudget) {
+        setTrackerBudgetBytes(doc["budgetBytes"].as<uint32_t>());
+    }
+    if (keepaliveMs != deviceKeepaliveMs || expiryMs != deviceExpiryMs) {
+        // Deadlines may move earlier, so refile every device
+        deviceKeepaliveMs = keepaliveMs;
+        deviceExpiryMs = expiryMs;
         unsigned long now = millis();
+        deviceTable.forEach([&](TrackedDevice& device) {
+            scheduleDeviceTimerLocked(device, now);
+        });
+    }
+    if (pinned != trackerPinnedFormats) {
+        trackerPinnedFormats = pinned;
+        deviceTable.forEach([&](TrackedDevice& device) {
+            deviceTable.setTier(&device, deviceTierFor(device.format, device.isSensor));
+        });
+    }
+    enforceDeviceBudgetLocked();
+    resizeDevicePoolsLocked();
+    size_t limit = trackerDeviceLimit;
+    unlockDeviceMap(lockedAt);
+
+    bool ok = saveConfigUInt(TRACKER_NVS_BUDGET, (uint32_t)(limit * TRACKED_DEVICE_BYTES)) &&
+              saveConfigUInt(TRACKER_NVS_PINNED, pinned) &&
+              saveConfigUInt(TRACKER_NVS_KEEPALIVE, keepaliveMs) &&
+              saveConfigUInt(TRACKER_NVS_EXPIRY, expiryMs);
+    Serial.printf("%s Device budget set to %d devices, pinned formats 0x%02x, keepalive %us, expiry %us\n",
+                 ok ? "✓" : "✗", (int)limit, (unsigned)pinned,
+                 (unsigned)(keepaliveMs / 1000), (unsigned)(expiryMs / 1000));
+}
+
+// Handle {"command":"compression", ...}; see applyCompressionCommand()
+void handleCompressionCommand(const JsonDocument& doc) {
+    int64_t lockedAt;
+    if (!lockDeviceMap(lockedAt)) {
+        Serial.println("❌ Device map busy - compression command not applied");
+        return;
+    }
+    bool changed = applyCompressionCommand(doc);
+    if (changed) {
+        // Re-resolve every device (MAC slots may have moved) and restart its doors
+        unsigned long now = millis();
+        resizeDeviceDoorsLocked(anySwingingDoorPolicy() ? trackerDeviceLimit : 0);
+        deviceTable.forEach([&](TrackedDevice& device) {
+            device.policy = resolveCompressionPolicy(device.mac, device.format);
+            scheduleDeviceTimerLocked(device, now);
+        });
+    }
+    unlockDeviceMap(lockedAt);
+    
+    if (changed) {
+        saveCompressionPolicies();
+    }
+}
+
+float getCompressionRatio() {
+    return trackerPublishes ? (float)trackerReadings / trackerPublishes : 0;
+}
+
+void loadPublishModeConfig() {
+    uint32_t mode = getConfigUInt(TRACKER_NVS_PUBLISH_MODE, PUBLISH_MODE_CHANGE);
+    trackerPublishMode = mode == PUBLISH_MODE_WINDOW ? PUBLISH_MODE_WINDOW : PUBLISH_MODE_CHANGE;
+    uint32_t windowMs = getConfigUInt(TRACKER_NVS_WINDOW, AGGREGATE_WINDOW_DEFAULT_MS);
+    aggregateWindowMs = windowMs < AGGREGATE_WINDOW_MIN_MS ? AGGREGATE_WINDOW_MIN_MS :
+                        (windowMs > AGGREGATE_WINDOW_MAX_MS ? AGGREGATE_WINDOW_MAX_MS : windowMs);
+    Serial.printf("✓ Publish mode: %s (window %us)\n",
+                 PUBLISH_MODE_NAMES[trackerPublishMode], (unsigned)(aggregateWindowMs / 1000));
+}
+
+// Switch publish mode; every device starts a fresh window and refiles its
+// deadline. Window mode needs its pool first: returns false, mode unchanged,
+// if that does not fit. Caller must hold deviceMapMutex.
+bool setPublishModeLocked(PublishMode mode) {
+    if (!resizeDeviceWindowsLocked(mode == PUBLISH_MODE_WINDOW ? trackerDeviceLimit : 0)) {
+        return false;
+    }
+    trackerPublishMode = mode;
+    unsigned long now = millis();
+    deviceTable.forEach([&](TrackedDevice& device) {
+        resetDeviceWindowLocked(device, now);
+        scheduleDeviceTimerLocked(device, now);
+    });
+    return true;
+}
+
+// Handle {"command":"publish_mode","mode":"change|window","windowMs":300000}
+void handlePublishModeCommand(const JsonDocument& doc) {
+    const char* modeName = doc["mode"] | PUBLISH_MODE_NAMES[trackerPublishMode];
+    PublishMode mode;
+    if (strcmp(modeName, "change") == 0) {
+        mode = PUBLISH_MODE_CHANGE;
+    } else if (strcmp(modeName, "window") == 0) {
+        mode = PUBLISH_MODE_WINDOW;
+    } else {
+        Serial.printf("❌ Unknown publish mode: %s\n", modeName);
+        return;
+    }
+    uint32_t windowMs = doc["windowMs"] | aggregateWindowMs;
+    if (windowMs < AGGREGATE_WINDOW_MIN_MS || windowMs > AGGREGATE_WINDOW_MAX_MS) {
+        Serial.printf("❌ Aggregate window must be %u-%ums\n", AGGREGATE_WINDOW_MIN_MS, AGGREGATE_WINDOW_MAX_MS);
+        return;
+    }
+
+    int64_t lockedAt;
+    if (!lockDeviceMap(lockedAt)) {
+        Serial.println("❌ Device map busy - publish mode not applied");
+        return;
+    }
+    aggregateWindowMs = windowMs;
+    if (!setPublishModeLocked(mode)) {
+        unlockDeviceMap(lockedAt);
+        Serial.printf("❌ No memory for %d device windows - publish mode not changed\n", (int)trackerDeviceLimit);
+        return;
+    }
+    unlockDeviceMap(lockedAt);
+
+    bool ok = saveConfigUInt(TRACKER_NVS_PUBLISH_MODE, mode) && saveConfigUInt(TRACKER_NVS_WINDOW, windowMs);
+    Serial.printf("%s Publish mode set to %s (window %us)\n",
+                 ok ? "✓" : "✗", PUBLISH_MODE_NAMES[mode], (unsigned)(windowMs / 1000));
+}
+
+void loadPublishRateConfig() {
+    uint32_t ratePerMin = getConfigUInt(TRACKER_NVS_PUBLISH_RATE, PUBLISH_RATE_DEFAULT_PER_MIN);
+    uint32_t burst = getConfigUInt(TRACKER_NVS_PUBLISH_BURST, PUBLISH_BURST_DEFAULT);
+    uint32_t jitterMs = getConfigUInt(TRACKER_NVS_PUBLISH_JITTER, PUBLISH_JITTER_DEFAULT_MS);
+    publishLimiter.configure(ratePerMin > PUBLISH_RATE_MAX_PER_MIN ? PUBLISH_RATE_MAX_PER_MIN : ratePerMin,
+                             burst > PUBLISH_BURST_MAX ? PUBLISH_BURST_MAX : burst,
+                             jitterMs > PUBLISH_JITTER_MAX_MS ? PUBLISH_JITTER_MAX_MS : jitterMs);
+    publishLimiter.reset(millis());
+    Serial.printf("✓ Publish rate: %u/min, burst %u, jitter %ums\n", (unsigned)publishLimiter.ratePerMin(),
+                 (unsigned)publishLimiter.burst(), (unsigned)publishLimiter.jitterMs());
+}
+
+// Hand new limiter settings to the tracker task (any task)
+bool requestPublishRate(uint32_t ratePerMin, uint32_t burst, uint32_t jitterMs) {
+    int64_t lockedAt;
+    if (!lockDeviceMap(lockedAt)) {
+        return false;
+    }
+    publishRateRequest = { ratePerMin, burst, jitterMs };
+    publishRatePending.store(true);
+    unlockDeviceMap(lockedAt);
+    return true;
+}
+
+// Apply a pending publish_rate command (tracker task only)
+void applyPublishRateRequest() {
+    if (!publishRatePending.load()) {
+        return;
+    }
+    int64_t lockedAt;
+    if (!lockDeviceMap(lockedAt)) {
+        return;  // Still pending: next pass
+    }
+    PublishRateRequest request = publishRateRequest;
+    publishRatePending.store(false);
+    unlockDeviceMap(lockedAt);
+    publishLimiter.configure(request.ratePerMin, request.burst, request.jitterMs);
+}
+
+// Handle {"command":"publish_rate","ratePerMin":600,"burst":20,"jitterMs":2000}
+// ratePerMin 0 turns the limiter off
+void handlePublishRateCommand(const JsonDocument& doc) {
+    uint32_t ratePerMin = doc["ratePerMin"] | publishLimiter.ratePerMin();
+    uint32_t burst = doc["burst"] | publishLimiter.burst();
+    uint32_t jitterMs = doc["jitterMs"] | publishLimiter.jitterMs();
+    if (ratePerMin > PUBLISH_RATE_MAX_PER_MIN || burst < 1 || burst > PUBLISH_BURST_MAX ||
+        jitterMs > PUBLISH_JITTER_MAX_MS) {
+        Serial.printf("❌ Publish rate must be 0-%u/min, burst 1-%u, jitter 0-%ums\n",
+                     PUBLISH_RATE_MAX_PER_MIN, PUBLISH_BURST_MAX, PUBLISH_JITTER_MAX_MS);
+        return;
+    }
+    
+    if (!requestPublishRate(ratePerMin, burst, jitterMs)) {
+        Serial.println("❌ Device map busy - publish rate not applied");
+        return;
+    }
+    
+    bool ok = saveConfigUInt(TRACKER_NVS_PUBLISH_RATE, ratePerMin) &&
+              saveConfigUInt(TRACKER_NVS_PUBLISH_BURST, burst) &&
+              saveConfigUInt(TRACKER_NVS_PUBLISH_JITTER, jitterMs);
+    Serial.printf("%s Publish rate set to %u/min, burst %u, jitter %ums\n",
+                 ok ? "✓" : "✗", (unsigned)ratePerMin, (unsigned)burst, (unsigned)jitterMs);
+}
+
+const size_t ADVERT_BATCH_SIZE = 32;
+uint32_t trackerDroppedAdverts = 0;  // Drained from the ring but lost to a mutex timeout
+
+// Apply one advert to the device table. Caller must hold deviceMapMutex.
+void updateDeviceLocked(uint64_t mac, uint8_t format, 
+                        int16_t tempCenti, uint16_t humCenti, int batt, int rssi, bool isSensor,
+                        unsigned long seenAt, uint32_t advPeriod) {
+    unsigned long now = millis();
+    
+    // Check if device exists in the table
+    TrackedDevice* existing = deviceTable.find(mac);
+    
+    if (existing == nullptr) {
+        // New device - make room within the budget, then add to table
+        TrackedDevice* newDevice = nullptr;
+        if (deviceTable.size() < trackerDeviceLimit || evictOneDeviceLocked()) {
+            newDevice = deviceTable.insert(mac, deviceTierFor(format, isSensor));
+        }
+        if (newDevice == nullptr) {
+            if (deviceTableFull++ % 100 == 0) {
+                char macStr[18];
+                formatMac(mac, macStr);
+                Serial.printf("⚠️  Device table full of pinned devices (%d) - ignoring %s\n",
+                             (int)deviceTable.size(), macStr);
+            }
+            return;
+        }
+        newDevice->format = format;
+        newDevice->isSensor = isSensor;
+        newDevice->policy = resolveCompressionPolicy(mac, format);
+        newDevice->window = SIDE_POOL_NONE;
+        newDevice->doors = SIDE_POOL_NONE;
+        newDevice->readings = 1;
+        trackerReadings++;
+        newDevice->temperatureCenti = tempCenti;
+        newDevice->humidityCenti = humCenti;
+        newDevice->battery = batt;
+        newDevice->rssi = rssi;
+        newDevice->lastTemperatureCenti = tempCenti;
+        newDevice->lastHumidityCenti = humCenti;
+        newDevice->lastBattery = batt;
+        newDevice->advPeriod = advPeriod;
+        newDevice->lastUpdate = seenAt;
+        newDevice->lastPublish = 0;
+        newDevice->lastChange = now;
+        newDevice->hasChanged = false;
+        resetDeviceWindowLocked(*newDevice, now);
+        addDeviceSampleLocked(*newDevice, isSensor, tempCenti, humCenti, rssi);
+        markDirtyLocked(*newDevice);  // Always publish new devices
+        scheduleDeviceTimerLocked(*newDevice, now);
         
-        // Check if device exists in map
-        auto it = deviceMap.find(mac);
-        
-        if (it == deviceMap.end()) {
-            // New device - add to map
-            TrackedDevice newDevice;
-            newDevice.macAddress = mac;
-            newDevice.name = name;
-            newDevice.sensorType = type;
-            newDevice.isSensor = isSensor;
-            newDevice.temperature = temp;
-            newDevice.humidity = hum;
-            newDevice.battery = batt;
-            newDevice.rssi = rssi;
-            newDevice.lastTemperature = temp;
-            newDevice.lastHumidity = hum;
-            newDevice.lastBattery = batt;
-            newDevice.lastUpdate = now;
-            newDevice.lastPublish = 0;
-            newDevice.lastChange = now;
-            newDevice.needsPublish = true;  // Always publish new devices
-            newDevice.hasChanged = false;
-            
-            deviceMap[mac] = newDevice;
-            
-            Serial.printf("New device discovered: %s (%s)\n", mac.c_str(), name.c_str());
+        // The first and every 100th only: a MAC storm would otherwise hold
+        // the device map lock while Serial drains
+        if (devicesDiscovered++ % 100 == 0) {
+            char macStr[18];
+            formatMac(mac, macStr);
+            const char* type = deviceTypeName(*newDevice);
+            Serial.printf("New device discovered: %s (%s), %u so far\n", macStr, type, (unsigned)devicesDiscovered);
             if (isSensor) {
-                Serial.printf("  Type: %s, Temp: %.2f°C, Humidity: %.2f%%, Battery: %d, RSSI: %d\n",
-                             type.c_str(), temp, hum, batt, rssi);
+                char tempStr[CENTI_STRING_SIZE], humStr[CENTI_STRING_SIZE];
+                formatCenti(tempCenti, tempStr);
+                formatCenti(humCenti, humStr);
+                Serial.printf("  Type: %s, Temp: %s°C, Humidity: %s%%, Battery: %d, RSSI: %d\n",
+                             type, tempStr, humStr, batt, rssi);
             } else {
-                Serial.printf("  Type: %s, RSSI: %d\n", type.c_str(), rssi);
+                Serial.printf("  Type: %s, RSSI: %d\n", type, rssi);
             }
-        } else {
-            // Existing device - update data
-            TrackedDevice& device = it->second;
-            device.lastUpdate = now;
-            device.rssi = rssi; // Always update RSSI
-            
-            // Only check for changes if it's a sensor device with sensor data
-            if (isSensor && hasSignificantChange(device, temp, hum, batt)) {
-                Serial.printf("Device changed: %s (%s)\n", mac.c_str(), name.c_str());
-                Serial.printf("  Old: Temp=%.2f°C, Hum=%.2f%%, Batt=%d\n", 
-                             device.temperature, device.humidity, device.battery);
-                Serial.printf("  New: Temp=%.2f°C, Hum=%.2f%%, Batt=%d\n", 
-                             temp, hum, batt);
-                
-                // Update stored values
-                device.lastTemperature = device.temperature;
-                device.lastHumidity = device.humidity;
-                device.lastBattery = device.battery;
-                
-                device.temperature = temp;
-                device.humidity = hum;
+        }
+    } else {
+        // Existing device - update data
+        TrackedDevice& device = *existing;
+        deviceTable.touch(existing);
+        device.advPeriod = advPeriod;
+        device.lastUpdate = seenAt;
+        device.rssi = rssi; // Always update RSSI
+        addDeviceSampleLocked(device, isSensor, tempCenti, humCenti, rssi);
+        device.readings++;
+        trackerReadings++;
+        
+        if (trackerPublishMode == PUBLISH_MODE_WINDOW) {
+            // Every reading goes into the window summary instead of its own message
+            if (isSensor) {
+                device.temperatureCenti = tempCenti;
+                device.humidityCenti = humCenti;
                 device.battery = batt;
-                
-                device.lastChange = now;
-                device.needsPublish = true;
-                device.hasChanged = true;
-            } else {
-                // No significant change - check if 6h elapsed
-                if (now - device.lastPublish >= SIX_HOURS) {
-                    Serial.printf("6h keepalive for: %s (%s)\n", mac.c_str(), name.c_str());
-                    device.needsPublish = true;
-                    device.hasChanged = false;
-                }
             }
+        } else if (isSensor && compressionPolicyAt(device.policy).algorithm == COMPRESS_HEARTBEAT) {
+            // Never a change, but the next heartbeat sends the latest reading
+            device.temperatureCenti = tempCenti;
+            device.humidityCenti = humCenti;
+            device.battery = batt;
+        } else if (isSensor && hasSignificantChange(device, tempCenti, humCenti, batt, seenAt)) {
+            // Only check for changes if it's a sensor device with sensor data
+            char macStr[18];
+            formatMac(mac, macStr);
+            char oldTemp[CENTI_STRING_SIZE], oldHum[CENTI_STRING_SIZE];
+            char newTemp[CENTI_STRING_SIZE], newHum[CENTI_STRING_SIZE];
+            formatCenti(device.temperatureCenti, oldTemp);
+            formatCenti(device.humidityCenti, oldHum);
+            formatCenti(tempCenti, newTemp);
+            formatCenti(humCenti, newHum);
+            Serial.printf("Device changed: %s (%s)\n", macStr, deviceTypeName(device));
+            Serial.printf("  Old: Temp=%s°C, Hum=%s%%, Batt=%d\n", oldTemp, oldHum, device.battery);
+            Serial.printf("  New: Temp=%s°C, Hum=%s%%, Batt=%d\n", newTemp, newHum, batt);
+            
+            // Update stored values
+            device.lastTemperatureCenti = device.temperatureCenti;
+            device.lastHumidityCenti = device.humidityCenti;
+            device.lastBattery = device.battery;
+            
+            device.temperatureCenti = tempCenti;
+            device.humidityCenti = humCenti;
+            device.battery = batt;
+            
+            device.lastChange = now;
+            device.hasChanged = true;
+            resetDeviceDoorsLocked(device);
+            markDirtyLocked(device);
+        }
+        // Keepalive and expiry come from the timer wheel, see onDeviceTimerLocked()
+    }
+}
+
+// Drain adverts queued by the BLE callback, one mutex take per batch
+int drainAdvertRing() {
+    AdvertRecord batch[ADVERT_BATCH_SIZE];
+    int drained = 0;
+    size_t count;
+    
+    while ((count = advertRing.popBatch(batch, ADVERT_BATCH_SIZE)) > 0) {
+        int64_t trackStart;
+        if (!lockDeviceMap(trackStart)) {
+            trackerDroppedAdverts += count;
+            Serial.printf("⚠️  Device map busy - dropped %d queued adverts\n", (int)count);
+            break;
+        }
+        
+        for (size_t i = 0; i < count; i++) {
+            const AdvertRecord& record = batch[i];
+            
+            // Sensors carry temperature and humidity; everything else is tracked for presence
+            const uint8_t sensorFlags = ADVERT_HAS_TEMPERATURE | ADVERT_HAS_HUMIDITY;
+            bool isSensor = (record.flags & sensorFlags) == sensorFlags;
+            int battery = (record.flags & ADVERT_HAS_BATTERY) ? record.batteryMv : 0;
+            
+            updateDeviceLocked(record.mac, record.format,
+                               record.temperatureCenti, record.humidityCenti,
+                               battery, record.rssi, isSensor, record.tick, record.periodMs);
         }
         
-        xSemaphoreGive(deviceMapMutex);
+        unlockDeviceMap(trackStart);
+        pipelineLatency[STAGE_TRACK].record((uint32_t)((esp_timer_get_time() - trackStart) / count));
+        drained += count;
+    }
+    
+    return drained;
+}
+
+// Feed every learned advertising period to the scan scheduler
+void collectAdvertPeriods(ScanScheduler& scheduler) {
+    int64_t lockedAt;
+    if (lockDeviceMap(lockedAt)) {
+        deviceTable.forEach([&](TrackedDevice& device) {
+            scheduler.observePeriod(device.advPeriod);
+        });
+        unlockDeviceMap(lockedAt);
+    }
+}
+
+// A device's deadline came up: expire it, or flag its keepalive / window
+// summary, and file the next deadline
+void onDeviceTimerLocked(uint16_t index, unsigned long now) {
+    TrackedDevice& device = deviceTable.at(index);
+    char macStr[18];
+    
+    // Signed: replayed adverts can be stamped slightly ahead of millis()
+    if ((long)(now - device.lastUpdate) >= (long)deviceExpiryMs) {
+        formatMac(device.mac, macStr);
+        Serial.printf("Removing expired device: %s (%s)\n", macStr, deviceTypeName(device));
+        forgetDeviceLocked(device);
+        return;
+    }
+    DeviceWindow* window = deviceWindowLocked(device);
+    if (trackerPublishMode == PUBLISH_MODE_WINDOW) {
+        if (window != nullptr && !device.needsPublish &&
+            (long)(now - window->windowStart) >= (long)aggregateWindowMs) {
+            if (window->rssiStats.count > 0) {
+                device.hasChanged = false;
+                markDirtyLocked(device);  // The publish pass closes the window
+            } else {
+                resetDeviceWindowLocked(device, now);  // Not heard - nothing to summarize
+            }
+        }
+    } else if (device.lastPublish != 0 && !device.needsPublish &&
+        (long)(now - device.lastPublish) >= (long)deviceKeepaliveFor(device)) {
+        formatMac(device.mac, macStr);
+        Serial.printf("Keepalive for: %s (%s)\n", macStr, deviceTypeName(device));
+        device.hasChanged = false;
+        markDirtyLocked(device);
+    }
+    scheduleDeviceTimerLocked(device, now);
+}
+
+// Fire every keepalive/expiry deadline that has passed - O(due devices), not O(table)
+void serviceDeviceTimers() {
+    uint32_t tick = deviceTimerNow();
+    if ((int32_t)(tick - deviceTimers.currentTick()) < 0) {
+        return;  // Already processed this tick
+    }
+    int64_t lockedAt;
+    if (lockDeviceMap(lockedAt)) {
+        unsigned long now = millis();
+        deviceTimers.advance(tick, [&](uint16_t index) {
+            onDeviceTimerLocked(index, now);
+        });
+        unlockDeviceMap(lockedAt);
+    }
+}
+
+const size_t PUBLISH_BATCH_SIZE = 32;
+
+// Build and send one device message. Returns true once the reading is
+// delivered or stored offline; no tracker lock may be held here.
+bool publishSnapshot(PublishSnapshot& snapshot) {
+    int64_t publishStart = esp_timer_get_time();
+    
+    // Calculate timestamp - use current synced time IN MILLISECONDS for ThingsBoard
+    // current_timestamp is already the current time from NTP, no need to add uptime
+    // Must use unsigned long long (64-bit) to avoid overflow
+    snapshot.timestampMs = (unsigned long long)current_timestamp * 1000ULL;
+    
+    // Publish to MQTT
+    bool settled = true;
+    char macStr[18];
+    formatMac(snapshot.mac, macStr);
+    if (publishDeviceData(snapshot)) {
+        Serial.printf("Published device: %s\n", macStr);
+    } else if (mqtt_connected) {
+        settled = false;  // Telemetry outbox full: kept dirty and retried on the next pass
+    } else if (snapshot.isSensor) {
+        // If MQTT publish failed and it's a sensor (LOP001), store offline
+        // Still treated as published so we don't keep trying
+        storeOfflineDetection(String(macStr), snapshot.temperatureCenti, snapshot.humidityCenti, 
+                            snapshot.rssi, current_timestamp);
+    } else {
+        settled = false;  // Presence-only devices are retried on the next pass
     }
+    
+    pipelineLatency[STAGE_PUBLISH].record((uint32_t)(esp_timer_get_time() - publishStart));
+    return settled;
+}
+
+// Random extra delay for a publish pass, up to the configured jitter
+uint32_t publishJitterMs() {
+    uint32_t jitterMs = publishLimiter.jitterMs();
+    return jitterMs ? esp_random() % (jitterMs + 1) : 0;
 }
 
-void removeExpiredDevices() {
-    if (xSemaphoreTake(deviceMapMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+// Publish the dirty queues: snapshot a batch under the lock, send it with
+// the lock released, then record the outcome under the lock again. Stops
+// when the limiter runs out of tokens; returns true if devices were left
+// waiting for tokens.
+bool publishPendingDevices() {
+    static PublishSnapshot batch[PUBLISH_BATCH_SIZE];  // Tracker task only
+    static bool settled[PUBLISH_BATCH_SIZE];
+    
+    applyPublishRateRequest();
+    while (true) {
+        if (getPublishQueueLength() == 0) {
+            return false;
+        }
+        uint32_t tokens = publishLimiter.available(millis());
+        if (tokens == 0) {
+            publishesDeferred++;
+            return true;
+        }
+        size_t limit = tokens < PUBLISH_BATCH_SIZE ? tokens : PUBLISH_BATCH_SIZE;
+        
+        size_t count = 0;
+        int64_t lockedAt;
+        if (!lockDeviceMap(lockedAt)) {
+            return false;
+        }
         unsigned long now = millis();
+        unsigned long snapshotAt = now;
+        uint16_t index;
+        while (count < limit && (dirtyDevices.pop(index) || routineDevices.pop(index))) {
+            TrackedDevice& device = deviceTable.at(index);
+            if (device.mac == 0 || !device.needsPublish) {
+                continue;  // Erased or already published since it was queued
+            }
+            PublishSnapshot& snapshot = batch[count++];
+            snapshot.mac = device.mac;
+            snapshot.format = device.format;
+            snapshot.isSensor = device.isSensor;
+            snapshot.changed = device.hasChanged;
+            snapshot.temperatureCenti = device.temperatureCenti;
+            snapshot.humidityCenti = device.humidityCenti;
+            snapshot.battery = device.battery;
+            snapshot.rssi = device.rssi;
+            snapshot.compressionRatioCenti = (uint32_t)(((uint64_t)device.readings * 100 + (device.publishes + 1) / 2) / (device.publishes + 1));
+            DeviceWindow* window = deviceWindowLocked(device);
+            snapshot.summary = trackerPublishMode == PUBLISH_MODE_WINDOW && window != nullptr;
+            if (snapshot.summary) {
+                snapshot.windowMs = now - window->windowStart;
+                snapshot.temperatureStats = window->temperatureStats;
+                snapshot.humidityStats = window->humidityStats;
+                snapshot.rssiStats = window->rssiStats;
+                resetDeviceWindowLocked(device, now);
+            } else {
+                snapshot.windowMs = 0;
+                snapshot.temperatureStats.reset();
+                snapshot.humidityStats.reset();
+                snapshot.rssiStats.reset();
+            }
+            device.needsPublish = false;
+            device.hasChanged = false;
+        }
+        unlockDeviceMap(lockedAt);
         
-        auto it = deviceMap.begin();
-        while (it != deviceMap.end()) {
-            if (now - it->second.lastUpdate >= SIX_HOURS) {
-                Serial.printf("Removing expired device: %s (%s)\n", 
-                             it->second.macAddress.c_str(), 
-                             it->second.name.c_str());
-                it = deviceMap.erase(it);
+        if (count == 0) {
+            return false;
+        }
+        publishLimiter.take(count);  // Attempts cost tokens whether or not they land
+        
+        bool anyFailed = false;
+        for (size_t i = 0; i < count; i++) {
+            settled[i] = publishSnapshot(batch[i]);
+            anyFailed |= !settled[i];
+            // Keep the advert ring moving while the broker is slow
+            drainAdvertRing();
+        }
+        
+        if (!lockDeviceMap(lockedAt)) {
+            return false;
+        }
+        now = millis();
+        for (size_t i = 0; i < count; i++) {
+            TrackedDevice* device = deviceTable.find(batch[i].mac);
+            if (device == nullptr) {
+                continue;  // Evicted or expired while we were publishing
+            }
+            if (settled[i]) {
+                device->lastPublish = now;
+                device->publishes++;
+                trackerPublishes++;
+                scheduleDeviceTimerLocked(*device, now);
             } else {
-                ++it;
+                // Not sent: put the window taken into the snapshot back in
+                // front of the readings that arrived since, so it is not lost
+                restoreDeviceWindowLocked(*device, batch[i], snapshotAt);
+                device->hasChanged |= batch[i].changed;
+                markDirtyLocked(*device);
             }
         }
+        unlockDeviceMap(lockedAt);
         
-        xSemaphoreGive(deviceMapMutex);
+        if (anyFailed) {
+            return false;  // Broker unavailable - retry on the next pass
+        }
     }
 }
 
-void publishPendingDevices() {
-    if (xSemaphoreTake(deviceMapMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (auto& pair : deviceMap) {
-            TrackedDevice& device = pair.second;
-            
-            if (device.needsPublish) {
-                // Create JSON payload
-                JsonDocument doc;
-                doc["mac"] = device.macAddress;
-                doc["name"] = device.name;
-                doc["type"] = device.sensorType;
-                doc["rssi"] = device.rssi;
-                
-                // Calculate timestamp - use current synced time IN MILLISECONDS for ThingsBoard
-                // current_timestamp is already the current time from NTP, no need to add uptime
-                // Must use unsigned long long (64-bit) to avoid overflow
-                unsigned long long ts_millis = (unsigned long long)current_timestamp * 1000ULL;
-                doc["timestamp"] = ts_millis;
-                doc["changed"] = device.hasChanged;
-                
-                // Only include sensor data for sensor devices
-                if (device.isSensor) {
-                    doc["temperature"] = device.temperature;
-                    doc["humidity"] = device.humidity;
-                    // Only include battery if it's non-zero (LOP001 has no battery)
-                    if (device.battery > 0) {
-                        doc["battery"] = device.battery;
-                    }
-                }
-                // Don't include null values for non-sensor devices
-                
-                // Publish to MQTT
-                if (publishDeviceData(device.macAddress, doc, device.isSensor)) {
-                    device.lastPublish = millis();
-                    device.needsPublish = false;
-                    device.hasChanged = false;
-                    
-                    Serial.printf("Published device: %s\n", device.macAddress.c_str());
-                } else if (device.isSensor) {
-                    // If MQTT publish failed and it's a sensor (LOP001), store offline
-                    storeOfflineDetection(device.macAddress, device.temperature, device.humidity, 
-                                        device.rssi, current_timestamp);
-                    // Still mark as published so we don't keep trying
-                    device.lastPublish = millis();
-                    device.needsPublish = false;
-                }
+const unsigned long TRACKER_SNAPSHOT_INTERVAL_MS = 10 * 60 * 1000;
+const size_t SNAPSHOT_BATCH_SIZE = 32;
+
+// Age of a past millis() stamp, 0 if it is ahead of now (replayed adverts)
+uint32_t snapshotAge(unsigned long stamp, unsigned long now) {
+    long age = (long)(now - stamp);
+    return age > 0 ? (uint32_t)age : 0;
+}
+
+// Serializes saves: the tracker task saves periodically, the MQTT task on
+// "restart" and OTA, the loop task on a serial REBOOT. Created once the
+// tracker task has restored the last snapshot, so while it is NULL (config
+// mode, or still booting) there is nothing to save, and saving the empty
+// table would replace a good snapshot.
+SemaphoreHandle_t trackerSnapshotMutex = NULL;
+
+// Write every device's baselines to SPIFFS. The table is copied a batch at a
+// time under the lock and written with the lock released; the new file
+// replaces the old one only once complete. Caller must hold trackerSnapshotMutex.
+bool writeTrackerSnapshotLocked() {
+    int64_t saveStart = esp_timer_get_time();
+    File file = SPIFFS.open(TRACKER_SNAPSHOT_TEMP, "w");
+    if (!file) {
+        Serial.println("⚠️  Failed to create tracker snapshot");
+        return false;
+    }
+
+    SnapshotHeader header = { TRACKER_SNAPSHOT_MAGIC, TRACKER_SNAPSHOT_VERSION,
+                              (uint16_t)sizeof(SnapshotRecord), time_synced ? (uint32_t)current_timestamp : 0 };
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    uint32_t crc = snapshotCrc32(0, &header, sizeof(header));
+    uint32_t count = 0;
+
+    static SnapshotRecord batch[SNAPSHOT_BATCH_SIZE];
+    for (size_t start = 0; ok && start < MAX_TRACKED_DEVICES; start += SNAPSHOT_BATCH_SIZE) {
+        int64_t lockedAt;
+        if (!lockDeviceMap(lockedAt)) {
+            ok = false;
+            break;
+        }
+        unsigned long now = millis();
+        size_t filled = 0;
+        for (size_t index = start; index < start + SNAPSHOT_BATCH_SIZE && index < MAX_TRACKED_DEVICES; index++) {
+            const TrackedDevice& device = deviceTable.at((uint16_t)index);
+            if (device.mac == 0) {
+                continue;  // Free entry
             }
+            SnapshotRecord& record = batch[filled++];
+            memset(&record, 0, sizeof(record));
+            record.mac = device.mac;
+            record.format = device.format;
+            record.flags = device.isSensor ? SNAPSHOT_FLAG_SENSOR : 0;
+            record.temperatureCenti = device.temperatureCenti;
+            record.humidityCenti = device.humidityCenti;
+            record.battery = (int16_t)device.battery;
+            record.rssi = (int16_t)device.rssi;
+            record.advPeriod = device.advPeriod;
+            record.seenAgeMs = snapshotAge(device.lastUpdate, now);
+            record.publishAgeMs = device.lastPublish != 0 ? snapshotAge(device.lastPublish, now) : SNAPSHOT_NEVER;
+            record.changeAgeMs = snapshotAge(device.lastChange, now);
+            record.readings = device.readings;
+            record.publishes = device.publishes;
         }
-        
-        xSemaphoreGive(deviceMapMutex);
+        unlockDeviceMap(lockedAt);
+
+        size_t bytes = filled * sizeof(SnapshotRecord);
+        ok = file.write((const uint8_t*)batch, bytes) == bytes;
+        crc = snapshotCrc32(crc, batch, bytes);
+        count += filled;
     }
+
+    SnapshotTrailer trailer = { count, crc };
+    ok = ok && file.write((const uint8_t*)&trailer, sizeof(trailer)) == sizeof(trailer);
+    file.close();
+    if (!ok) {
+        Serial.println("⚠️  Tracker snapshot write failed - keeping the previous one");
+        SPIFFS.remove(TRACKER_SNAPSHOT_TEMP);
+        return false;
+    }
+    SPIFFS.remove(TRACKER_SNAPSHOT_FILE);
+    if (!SPIFFS.rename(TRACKER_SNAPSHOT_TEMP, TRACKER_SNAPSHOT_FILE)) {
+        Serial.println("⚠️  Failed to replace tracker snapshot");
+        return false;
+    }
+    Serial.printf("💾 Tracker snapshot saved: %u devices in %ums\n",
+                 (unsigned)count, (unsigned)((esp_timer_get_time() - saveStart) / 1000));
+    return true;
+}
+
+// Save the tracker snapshot from any task. Returns false if the tracker
+// never started or the save failed.
+bool saveTrackerSnapshot() {
+    if (trackerSnapshotMutex == NULL) {
+        return false;
+    }
+    xSemaphoreTake(trackerSnapshotMutex, portMAX_DELAY);
+    bool saved = writeTrackerSnapshotLocked();
+    xSemaphoreGive(trackerSnapshotMutex);
+    return saved;
+}
+
+// Allow saves, once the last snapshot is restored (tracker task)
+void enableTrackerSnapshots() {
+    if (trackerSnapshotMutex == NULL) {
+        trackerSnapshotMutex = xSemaphoreCreateMutex();
+    }
+}
+
+// Re-create one device from its snapshot record, quiet: it is not queued
+// for publish, its keepalive and expiry carry on from where they were.
+// `offlineMs` is time known to have passed while the gateway was down.
+// Caller must hold deviceMapMutex.
+bool restoreDeviceLocked(const SnapshotRecord& record, unsigned long now, uint32_t offlineMs) {
+    bool isSensor = (record.flags & SNAPSHOT_FLAG_SENSOR) != 0;
+    if (record.mac == 0 || record.format >= BEACON_FORMAT_COUNT ||
+        (uint64_t)record.seenAgeMs + offlineMs >= deviceExpiryMs ||
+        deviceTable.size() >= trackerDeviceLimit) {
+        return false;
+    }
+    TrackedDevice* device = deviceTable.insert(record.mac, deviceTierFor(record.format, isSensor));
+    if (device == nullptr) {
+        return false;
+    }
+    device->format = record.format;
+    device->isSensor = isSensor;
+    device->policy = resolveCompressionPolicy(record.mac, record.format);
+    device->window = SIDE_POOL_NONE;
+    device->doors = SIDE_POOL_NONE;
+    device->temperatureCenti = record.temperatureCenti;
+    device->humidityCenti = record.humidityCenti;
+    device->battery = record.battery;
+    device->rssi = record.rssi;
+    device->lastTemperatureCenti = record.temperatureCenti;
+    device->lastHumidityCenti = record.humidityCenti;
+    device->lastBattery = record.battery;
+    device->readings = record.readings;
+    device->publishes = record.publishes;
+    device->advPeriod = record.advPeriod;
+    device->lastUpdate = now - record.seenAgeMs - offlineMs;
+    device->lastChange = now - record.changeAgeMs - offlineMs;
+    if (record.publishAgeMs == SNAPSHOT_NEVER) {
+        device->lastPublish = 0;
+        markDirtyLocked(*device);  // Never made it out before the reboot
+    } else {
+        device->lastPublish = now - record.publishAgeMs - offlineMs;
+        if (device->lastPublish == 0) {
+            device->lastPublish = 1;  // 0 means never published
+        }
+    }
+    device->hasChanged = false;
+    resetDeviceWindowLocked(*device, now);
+    scheduleDeviceTimerLocked(*device, now);
+    return true;
+}
+
+// Load the snapshot written before the last reboot. A missing, truncated,
+// foreign or corrupt file leaves the table empty (cold start).
+void restoreTrackerSnapshot() {
+    if (!SPIFFS.exists(TRACKER_SNAPSHOT_FILE)) {
+        Serial.println("Tracker snapshot: none found - cold start");
+        return;
+    }
+    int64_t restoreStart = esp_timer_get_time();
+    File file = SPIFFS.open(TRACKER_SNAPSHOT_FILE, "r");
+    if (!file) {
+        Serial.println("⚠️  Failed to open tracker snapshot - cold start");
+        return;
+    }
+
+    SnapshotHeader header;
+    size_t size = file.size();
+    bool valid = size >= sizeof(SnapshotHeader) + sizeof(SnapshotTrailer) &&
+                 file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == TRACKER_SNAPSHOT_MAGIC &&
+                 header.version == TRACKER_SNAPSHOT_VERSION &&
+                 header.recordSize == sizeof(SnapshotRecord);
+    size_t recordBytes = valid ? size - sizeof(SnapshotHeader) - sizeof(SnapshotTrailer) : 0;
+    size_t count = recordBytes / sizeof(SnapshotRecord);
+    valid = valid && recordBytes % sizeof(SnapshotRecord) == 0 && count <= MAX_TRACKED_DEVICES;
+
+    // First pass: check the CRC before touching the table
+    static SnapshotRecord batch[SNAPSHOT_BATCH_SIZE];
+    uint32_t crc = snapshotCrc32(0, &header, sizeof(header));
+    for (size_t done = 0; valid && done < count; ) {
+        size_t n = count - done < SNAPSHOT_BATCH_SIZE ? count - done : SNAPSHOT_BATCH_SIZE;
+        size_t bytes = n * sizeof(SnapshotRecord);
+        valid = file.read((uint8_t*)batch, bytes) == bytes;
+        crc = snapshotCrc32(crc, batch, bytes);
+        done += n;
+    }
+    SnapshotTrailer trailer;
+    valid = valid && file.read((uint8_t*)&trailer, sizeof(trailer)) == sizeof(trailer) &&
+            trailer.count == count && trailer.crc == crc;
+    if (!valid) {
+        file.close();
+        Serial.println("⚠️  Tracker snapshot invalid (version, size or CRC) - cold start");
+        SPIFFS.remove(TRACKER_SNAPSHOT_FILE);
+        return;
+    }
+
+    // Downtime is only known if both the save and this boot have NTP time;
+    // otherwise ages resume from the save (a reboot takes seconds)
+    uint32_t offlineMs = 0;
+    if (header.savedAt != 0 && time_synced && current_timestamp > header.savedAt) {
+        unsigned long offlineS = current_timestamp - header.savedAt;
+        offlineMs = offlineS < deviceExpiryMs / 1000 ? offlineS * 1000 : deviceExpiryMs;
+    }
+
+    int64_t lockedAt;
+    if (!lockDeviceMap(lockedAt)) {
+        file.close();
+        Serial.println("❌ Device map busy - tracker snapshot not restored");
+        return;
+    }
+    file.seek(sizeof(SnapshotHeader));
+    unsigned long now = millis();
+    size_t restored = 0;
+    for (size_t done = 0; done < count; ) {
+        size_t n = count - done < SNAPSHOT_BATCH_SIZE ? count - done : SNAPSHOT_BATCH_SIZE;
+        file.read((uint8_t*)batch, n * sizeof(SnapshotRecord));
+        for (size_t i = 0; i < n; i++) {
+            restored += restoreDeviceLocked(batch[i], now, offlineMs) ? 1 : 0;
+        }
+        done += n;
+    }
+    unlockDeviceMap(lockedAt);
+    file.close();
+
+    Serial.printf("✓ Tracker snapshot restored: %d of %d devices in %ums\n",
+                 (int)restored, (int)count, (unsigned)((esp_timer_get_time() - restoreStart) / 1000));
 }
 
 void deviceTrackerTask(void* parameter) {
     Serial.println("Device Tracker Task started");
+    deviceTimers.reset(deviceTimerNow());
+    loadTrackerConfig();
+    loadPublishModeConfig();
+    loadCompressionPolicies();
+    loadPublishRateConfig();
+    loadBatchConfig();
+    loadPayloadFormatConfig();
+    int64_t lockedAt;
+    if (lockDeviceMap(lockedAt)) {
+        resizeDevicePoolsLocked();
+        unlockDeviceMap(lockedAt);
+    }
+    restoreTrackerSnapshot();
+    enableTrackerSnapshots();
     
-    unsigned long lastCleanup = 0;
-    const unsigned long CLEANUP_INTERVAL = 60000; // 1 minute
+    unsigned long lastTimestampUpdate = 0;
+    unsigned long lastSnapshot = millis();
+    uint32_t snapshotReadings = trackerReadings;
+    const unsigned long PUBLISH_INTERVAL = 5000; // 5 seconds
+    const unsigned long DRAIN_INTERVAL = 50; // ms - keeps the advert ring well below capacity
+    // First pass after boot at a random offset, so gateways restarted together drift apart
+    unsigned long nextPublishPass = millis() + publishJitterMs();
     
     while (true) {
-        // Publish any devices that need publishing
-        publishPendingDevices();
+        // Pull everything the BLE callback queued since the last pass
+        drainAdvertRing();
         
-        // Periodically remove expired devices
-        if (millis() - lastCleanup > CLEANUP_INTERVAL) {
-            removeExpiredDevices();
-            lastCleanup = millis();
+        if ((long)(millis() - nextPublishPass) >= 0) {
+            // Publish any devices that need publishing. A backlog left by the
+            // limiter continues as soon as a token is due, otherwise the next
+            // pass is a jittered interval away.
+            bool deferred = publishPendingDevices();
+            unsigned long now = millis();
+            nextPublishPass = now + (deferred ? publishLimiter.msUntilToken(now)
+                                              : PUBLISH_INTERVAL + publishJitterMs());
         }
         
-        // Update timestamp (if time is synced)
-        if (time_synced) {
-            unsigned long old_ts = current_timestamp;
-            current_timestamp = time(nullptr);
+        if (millis() - lastTimestampUpdate >= PUBLISH_INTERVAL) {
+            lastTimestampUpdate = millis();
             
-            // Debug output every minute to verify time sync is working
-            static unsigned long last_debug = 0;
-            if (millis() - last_debug > 60000) {
-                Serial.printf("🕐 Time sync: current_timestamp=%lu (was %lu)\n", current_timestamp, old_ts);
-                last_debug = millis();
+            // Update timestamp (if time is synced)
+            if (time_synced) {
+                unsigned long old_ts = current_timestamp;
+                current_timestamp = time(nullptr);
+                
+                // Debug output every minute to verify time sync is working
+                static unsigned long last_debug = 0;
+                if (millis() - last_debug > 60000) {
+                    Serial.printf("🕐 Time sync: current_timestamp=%lu (was %lu)\n", current_timestamp, old_ts);
+                    last_debug = millis();
+                }
+            } else {
+                // Warning if time is not synced
+                static unsigned long last_warning = 0;
+                if (millis() - last_warning > 60000) {
+                    Serial.println("⚠️  WARNING: Time not synced! Timestamps will be incorrect.");
+                    last_warning = millis();
+                }
             }
-        } else {
-            // Warning if time is not synced
-            static unsigned long last_warning = 0;
-            if (millis() - last_warning > 60000) {
-                Serial.println("⚠️  WARNING: Time not synced! Timestamps will be incorrect.");
-                last_warning = millis();
+        }
+        
+        // Keepalives and expiry for devices whose deadline has passed
+        serviceDeviceTimers();
+        
+        // Batch mode: send the open batch once its flush deadline passes
+        flushPublishBatchIfDue();
+        
+        // Baselines for a warm restart (skipped while nothing is heard)
+        if (millis() - lastSnapshot >= TRACKER_SNAPSHOT_INTERVAL_MS) {
+            if (trackerReadings != snapshotReadings && saveTrackerSnapshot()) {
+                snapshotReadings = trackerReadings;
             }
+            lastSnapshot = millis();
         }
         
-        vTaskDelay(pdMS_TO_TICKS(5000)); // Run every 5 seconds
+        vTaskDelay(pdMS_TO_TICKS(DRAIN_INTERVAL));
     }
 }
 
@@ -0,0 +1,75 @@
+/**
+ * Dirty Queue
+ *
+ * Handles:
+ * - FIFO of table entry indices waiting to be published, no heap allocation
+ * - O(1) push (ignored if already queued) and pop
+ *
+ * Intrusive singly linked list over uint16 links indexed like the
+ * DeviceTable pool. Entries are not unlinked when a device is erased; the
+ * consumer checks each popped index is still live and still dirty, so a
+ * reused index is simply published for its new device.
+ */
+
+#ifndef DIRTY_QUEUE_H
+#define DIRTY_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+template <size_t Capacity>
+class DirtyQueue {
+    static_assert(Capacity > 0 && Capacity < 0xFFFF, "DirtyQueue capacity must fit a uint16 index");
+
+public:
+    DirtyQueue() {
+        head_ = NIL;
+        tail_ = NIL;
+        size_ = 0;
+        for (size_t i = 0; i < Capacity; i++) {
+            queued_[i] = false;
+        }
+    }
+
+    void push(uint16_t index) {
+        if (queued_[index]) {
+            return;
+        }
+        queued_[index] = true;
+        next_[index] = NIL;
+        if (tail_ != NIL) {
+            next_[tail_] = index;
+        } else {
+            head_ = index;
+        }
+        tail_ = index;
+        size_++;
+    }
+
+    bool pop(uint16_t& index) {
+        if (head_ == NIL) {
+            return false;
+        }
+        index = head_;
+        head_ = next_[index];
+        if (head_ == NIL) {
+            tail_ = NIL;
+        }
+        queued_[index] = false;
+        size_--;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    static const uint16_t NIL = 0xFFFF;
+
+    uint16_t next_[Capacity];
+    bool queued_[Capacity];
+    uint16_t head_;
+    uint16_t tail_;
+    size_t size_;
+};
+
+#endif // DIRTY_QUEUE_H
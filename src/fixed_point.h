@@ -0,0 +1,84 @@
+/**
+ * Fixed Point
+ *
+ * Handles:
+ * - Decimal text for integer hundredths (centi-degrees, centi-percent) without floats
+ * - Rounded integer division and integer square root for aggregates
+ *
+ * formatCenti() writes exactly what printf("%.2f", value / 100.0) would for
+ * every int32 value, so sensor readings are emitted as they were decoded,
+ * with no float round trip. formatCentiShort() drops trailing zeros the way
+ * ArduinoJson prints a float ("20", "26.1"), for JSON numbers.
+ */
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+const size_t CENTI_STRING_SIZE = 14;  // "-21474836.48" plus terminator
+
+// Write value/100 with two decimals ("-0.05", "26.11"). Returns the length.
+size_t formatCenti(int32_t value, char* out) {
+    char digits[12];
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0 || count < 3);  // At least "0.dd"
+
+    size_t length = 0;
+    if (value < 0) {
+        out[length++] = '-';
+    }
+    while (count > 2) {
+        out[length++] = digits[--count];
+    }
+    out[length++] = '.';
+    out[length++] = digits[1];
+    out[length++] = digits[0];
+    out[length] = '\0';
+    return length;
+}
+
+// As formatCenti, without trailing zeros or a bare point ("-0.05", "26.1", "20")
+size_t formatCentiShort(int32_t value, char* out) {
+    size_t length = formatCenti(value, out);
+    if (out[length - 1] == '0') {
+        length--;
+        if (out[length - 1] == '0') {
+            length -= 2;  // And the point
+        }
+        out[length] = '\0';
+    }
+    return length;
+}
+
+// numerator / denominator rounded half away from zero (denominator > 0)
+int64_t divideRounded(int64_t numerator, int64_t denominator) {
+    return numerator >= 0 ? (numerator + denominator / 2) / denominator
+                          : -((-numerator + denominator / 2) / denominator);
+}
+
+// floor(sqrt(value))
+uint32_t integerSqrt(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+#endif // FIXED_POINT_H
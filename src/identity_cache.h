@@ -0,0 +1,99 @@
+/**
+ * Identity Cache
+ *
+ * Handles:
+ * - Remembering which beacon format each MAC turned out to be
+ * - Trusting passive (nameless) adverts only for MACs not known to be something else
+ * - Flagging first-time MACs that need an active scan to confirm their name
+ *
+ * Direct-mapped and fixed-size: a collision simply forgets the older MAC,
+ * which then gets re-confirmed by a later discovery burst. Only the BLE
+ * callback reads or writes it.
+ */
+
+#ifndef IDENTITY_CACHE_H
+#define IDENTITY_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "beacon_decoders.h"
+
+const size_t IDENTITY_CACHE_BITS = 8;
+const size_t IDENTITY_CACHE_SIZE = 1 << IDENTITY_CACHE_BITS;  // 4 KB
+
+enum IdentityVerdict : uint8_t {
+    IDENTITY_ACCEPT = 0,   // Known (or self-describing) format, use the advert
+    IDENTITY_NEW,          // First sighting of a nameless advert: use it, but confirm by name
+    IDENTITY_REJECT        // MAC was confirmed as a different device
+};
+
+struct IdentityEntry {
+    uint64_t mac;        // 0 = empty slot
+    uint8_t format;      // BeaconFormat, BEACON_UNKNOWN = confirmed not a sensor
+    bool confirmed;      // Seen with a name (or rejected by name)
+};
+
+class IdentityCache {
+public:
+    // Classify a decoded advert and update the cache
+    IdentityVerdict classify(uint64_t mac, const BeaconReading& reading) {
+        IdentityEntry& entry = slot(mac);
+
+        if (reading.identity == BEACON_IDENTITY_FRAME) {
+            return IDENTITY_ACCEPT;
+        }
+        if (reading.identity == BEACON_IDENTITY_NAME) {
+            set(entry, mac, reading.format, true);
+            return IDENTITY_ACCEPT;
+        }
+
+        // Shape-only match: trust whatever the name said last time
+        if (entry.mac == mac) {
+            return (entry.format == reading.format) ? IDENTITY_ACCEPT : IDENTITY_REJECT;
+        }
+        set(entry, mac, reading.format, false);
+        return IDENTITY_NEW;
+    }
+
+    // No decoder accepted this advert. If it carries a name (scan response)
+    // and we had only guessed the MAC's format from the payload shape, the
+    // guess was wrong: stop trusting its nameless adverts.
+    void noteUndecoded(uint64_t mac, const uint8_t* payload, size_t length) {
+        IdentityEntry& entry = slot(mac);
+        if (entry.mac != mac || entry.confirmed) {
+            return;
+        }
+        uint8_t nameLen = 0;
+        if (findLocalName(payload, length, nameLen) != nullptr) {
+            set(entry, mac, BEACON_UNKNOWN, true);
+        }
+    }
+
+    // Slots holding a MAC. A slot is never emptied, only taken over by a
+    // colliding MAC, so this only grows, up to IDENTITY_CACHE_SIZE.
+    size_t entries() const { return occupied_; }
+    // MACs forgotten because another MAC took their slot
+    uint32_t overwrites() const { return overwrites_; }
+
+private:
+    IdentityEntry& slot(uint64_t mac) {
+        return table_[(size_t)((mac * 0x9E3779B97F4A7C15ull) >> (64 - IDENTITY_CACHE_BITS))];
+    }
+
+    void set(IdentityEntry& entry, uint64_t mac, uint8_t format, bool confirmed) {
+        if (entry.mac == 0) {
+            occupied_++;
+        } else if (entry.mac != mac) {
+            overwrites_++;
+        }
+        entry.mac = mac;
+        entry.format = format;
+        entry.confirmed = confirmed;
+    }
+
+    IdentityEntry table_[IDENTITY_CACHE_SIZE] = {};
+    size_t occupied_ = 0;
+    uint32_t overwrites_ = 0;
+};
+
+#endif // IDENTITY_CACHE_H
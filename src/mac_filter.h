@@ -0,0 +1,390 @@
+/**
+ * MAC Filter
+ *
+ * Handles:
+ * - Allowlist of full MAC addresses and OUI (24-bit vendor) prefixes
+ * - Lookup on the raw packed address before any allocation in the scan callback
+ * - Runtime updates over MQTT, persisted to SPIFFS (older NVS lists are still read)
+ * - Rejected advert counters
+ *
+ * Both lists are sorted arrays searched by bisection, so 10k entries cost
+ * ~14 comparisons per advert. An empty filter accepts every advert.
+ *
+ * The scan callback never locks: readers announce themselves in
+ * macFilterReaders and then load the table pointer. The MQTT task swaps in a
+ * new table and frees the old one only once no reader is left, so a lookup
+ * always finishes on the table it started with.
+ */
+
+#ifndef MAC_FILTER_H
+#define MAC_FILTER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+#include "advert_ring.h"
+
+#ifdef BOARD_HAS_PSRAM
+const size_t MAC_FILTER_MAX_MACS = 10000;    // 80 KB in PSRAM, 60 KB on SPIFFS
+#else
+// 32 KB in internal RAM. An "add" holds the old and the merged table at once,
+// which must fit in the largest free block with MAC_FILTER_HEAP_RESERVE to spare.
+const size_t MAC_FILTER_MAX_MACS = 4000;
+#endif
+const size_t MAC_FILTER_MAX_PREFIXES = 1024;
+const size_t MAC_FILTER_HEAP_RESERVE = 16 * 1024;  // Left for WiFi/MQTT after building a table
+const char* MAC_FILTER_FILE = "/mac_filter.bin";
+const char* MAC_FILTER_TEMP_FILE = "/mac_filter.tmp";
+const char* MAC_FILTER_NVS_MACS = "mac_filter";    // Before the list moved to SPIFFS
+const char* MAC_FILTER_NVS_PREFIXES = "oui_filter";
+
+struct MacFilterTable {
+    size_t macCount;
+    size_t prefixCount;
+    uint64_t* macs;      // Sorted packed 48-bit addresses
+    uint32_t* prefixes;  // Sorted packed 24-bit OUIs
+};
+
+std::atomic<MacFilterTable*> macFilter{nullptr};  // nullptr = filter disabled
+std::atomic<uint32_t> macFilterReaders{0};        // Lookups in progress
+std::atomic<uint32_t> macFilterRejected{0};
+
+template <typename T>
+bool sortedContains(const T* values, size_t count, T value) {
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (values[mid] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && values[lo] == value;
+}
+
+bool macFilterTableAllows(const MacFilterTable* table, uint64_t mac) {
+    return sortedContains(table->macs, table->macCount, mac) ||
+           sortedContains(table->prefixes, table->prefixCount, (uint32_t)(mac >> 24));
+}
+
+// Called from the BLE callback for every advert, before anything is allocated
+bool macFilterAllows(uint64_t mac) {
+    macFilterReaders.fetch_add(1);
+    const MacFilterTable* table = macFilter.load();
+    bool allowed = table == nullptr || macFilterTableAllows(table, mac);
+    macFilterReaders.fetch_sub(1);
+
+    if (!allowed) {
+        macFilterRejected.fetch_add(1, std::memory_order_relaxed);
+    }
+    return allowed;
+}
+
+size_t getMacFilterEntryCount() {
+    macFilterReaders.fetch_add(1);
+    const MacFilterTable* table = macFilter.load();
+    size_t count = table ? table->macCount + table->prefixCount : 0;
+    macFilterReaders.fetch_sub(1);
+    return count;
+}
+
+template <typename T>
+void sortUniqueFilterEntries(std::vector<T>& values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+// Entries in the sorted list `values` plus the sorted, duplicate-free `added`
+template <typename T>
+size_t filterUnionCount(const T* values, size_t count, const std::vector<T>& added) {
+    size_t total = count;
+    for (T value : added) {
+        total += sortedContains(values, count, value) ? 0 : 1;
+    }
+    return total;
+}
+
+// One allocation holding the header and both lists. Without PSRAM the
+// largest free block is checked first, so a big list on a fragmented heap
+// fails here instead of leaving WiFi and MQTT nothing to allocate from.
+MacFilterTable* allocMacFilterTable(size_t macCount, size_t prefixCount) {
+    size_t bytes = sizeof(MacFilterTable) + macCount * sizeof(uint64_t) + prefixCount * sizeof(uint32_t);
+    MacFilterTable* table;
+    if (psramFound()) {
+        table = (MacFilterTable*)ps_malloc(bytes);
+    } else if (ESP.getMaxAllocHeap() >= bytes + MAC_FILTER_HEAP_RESERVE) {
+        table = (MacFilterTable*)malloc(bytes);
+    } else {
+        table = nullptr;
+    }
+    if (table == nullptr) {
+        return nullptr;
+    }
+    table->macCount = macCount;
+    table->prefixCount = prefixCount;
+    table->macs = (uint64_t*)(table + 1);
+    table->prefixes = (uint32_t*)(table->macs + macCount);
+    return table;
+}
+
+// Merge `active` (may be nullptr) with sorted, duplicate-free additions
+// straight into one exactly-sized table. Returns nullptr if the result is
+// empty or does not fit in memory.
+MacFilterTable* mergeMacFilterTable(const MacFilterTable* active,
+                                    const std::vector<uint64_t>& macs, const std::vector<uint32_t>& prefixes) {
+    size_t activeMacs = active ? active->macCount : 0;
+    size_t activePrefixes = active ? active->prefixCount : 0;
+    size_t macCount = active ? filterUnionCount(active->macs, activeMacs, macs) : macs.size();
+    size_t prefixCount = active ? filterUnionCount(active->prefixes, activePrefixes, prefixes) : prefixes.size();
+    if (macCount == 0 && prefixCount == 0) {
+        return nullptr;
+    }
+
+    MacFilterTable* table = allocMacFilterTable(macCount, prefixCount);
+    if (table == nullptr) {
+        return nullptr;
+    }
+    const uint64_t* oldMacs = active ? active->macs : nullptr;
+    const uint32_t* oldPrefixes = active ? active->prefixes : nullptr;
+    std::set_union(oldMacs, oldMacs + activeMacs, macs.begin(), macs.end(), table->macs);
+    std::set_union(oldPrefixes, oldPrefixes + activePrefixes, prefixes.begin(), prefixes.end(), table->prefixes);
+    return table;
+}
+
+// Build a table (single allocation) from unsorted lists; sorts and removes duplicates.
+// Returns nullptr if both lists are empty.
+MacFilterTable* createMacFilterTable(std::vector<uint64_t>& macs, std::vector<uint32_t>& prefixes) {
+    sortUniqueFilterEntries(macs);
+    sortUniqueFilterEntries(prefixes);
+    return mergeMacFilterTable(nullptr, macs, prefixes);
+}
+
+// Swap in a new table (nullptr disables the filter) and free the old one.
+// MQTT task (and boot) only: waits for lookups still reading the old table.
+void installMacFilter(MacFilterTable* table) {
+    MacFilterTable* old = macFilter.exchange(table);
+    if (old == nullptr) {
+        return;
+    }
+    // A reader counted after the exchange loads the new table, so once the
+    // count reaches zero nobody can still hold the old one
+    while (macFilterReaders.load() != 0) {
+        vTaskDelay(1);
+    }
+    free(old);
+}
+
+// Parse "AA:BB:CC:DD:EE:FF", "AA-BB-..." or "AABBCC..." with the given number of octets
+bool parseMacString(const char* text, int octets, uint64_t& out) {
+    if (text == nullptr) {
+        return false;
+    }
+    uint64_t value = 0;
+    int digits = 0;
+    for (const char* p = text; *p; p++) {
+        char c = *p;
+        int nibble;
+        if (c >= '0' && c <= '9') nibble = c - '0';
+        else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+        else if (c == ':' || c == '-') continue;
+        else return false;
+        value = (value << 4) | nibble;
+        digits++;
+    }
+    if (digits != octets * 2) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+void packFilterOctets(uint64_t value, int octets, uint8_t* out) {
+    for (int b = 0; b < octets; b++) {
+        out[b] = (uint8_t)(value >> (8 * (octets - 1 - b)));
+    }
+}
+
+uint64_t unpackFilterOctets(const uint8_t* in, int octets) {
+    uint64_t value = 0;
+    for (int b = 0; b < octets; b++) {
+        value = (value << 8) | in[b];
+    }
+    return value;
+}
+
+// Persist the active filter: a "<macs> <prefixes>\n" count line, then the
+// packed big-endian octets. Written to a temporary file and renamed over the
+// old one, so a reset mid-write keeps the previous list.
+void saveMacFilter() {
+    // Only the MQTT task replaces the table, so it is stable while we read it here
+    const MacFilterTable* table = macFilter.load();
+    size_t macCount = table ? table->macCount : 0;
+    size_t prefixCount = table ? table->prefixCount : 0;
+
+    bool ok;
+    if (table == nullptr) {
+        SPIFFS.remove(MAC_FILTER_FILE);
+        ok = true;
+    } else {
+        File file = SPIFFS.open(MAC_FILTER_TEMP_FILE, "w");
+        ok = (bool)file;
+        if (ok) {
+            file.printf("%u %u\n", (unsigned)macCount, (unsigned)prefixCount);
+            uint8_t octets[6];
+            for (size_t i = 0; i < macCount && ok; i++) {
+                packFilterOctets(table->macs[i], 6, octets);
+                ok = file.write(octets, 6) == 6;
+            }
+            for (size_t i = 0; i < prefixCount && ok; i++) {
+                packFilterOctets(table->prefixes[i], 3, octets);
+                ok = file.write(octets, 3) == 3;
+            }
+            file.close();
+        }
+        if (ok) {
+            SPIFFS.remove(MAC_FILTER_FILE);
+            ok = SPIFFS.rename(MAC_FILTER_TEMP_FILE, MAC_FILTER_FILE);
+        } else {
+            SPIFFS.remove(MAC_FILTER_TEMP_FILE);
+        }
+    }
+
+    if (ok) {
+        // Drop the NVS copy so it cannot come back if the file is removed
+        saveConfigBlob(MAC_FILTER_NVS_MACS, nullptr, 0);
+        saveConfigBlob(MAC_FILTER_NVS_PREFIXES, nullptr, 0);
+    }
+    Serial.printf("%s MAC filter saved to flash (%d MACs, %d prefixes)\n",
+                 ok ? "✓" : "✗", (int)macCount, (int)prefixCount);
+}
+
+// Read the list saved by saveMacFilter(). Returns false if there is none.
+bool readMacFilterFile(std::vector<uint64_t>& macs, std::vector<uint32_t>& prefixes) {
+    File file = SPIFFS.open(MAC_FILTER_FILE, "r");
+    if (!file) {
+        return false;
+    }
+    unsigned macCount = 0;
+    unsigned prefixCount = 0;
+    String counts = file.readStringUntil('\n');
+    sscanf(counts.c_str(), "%u %u", &macCount, &prefixCount);
+    macCount = std::min(macCount, (unsigned)MAC_FILTER_MAX_MACS);
+    prefixCount = std::min(prefixCount, (unsigned)MAC_FILTER_MAX_PREFIXES);
+
+    uint8_t octets[6];
+    macs.reserve(macCount);
+    for (unsigned i = 0; i < macCount && file.read(octets, 6) == 6; i++) {
+        macs.push_back(unpackFilterOctets(octets, 6));
+    }
+    prefixes.reserve(prefixCount);
+    for (unsigned i = 0; i < prefixCount && file.read(octets, 3) == 3; i++) {
+        prefixes.push_back((uint32_t)unpackFilterOctets(octets, 3));
+    }
+    file.close();
+    return true;
+}
+
+// Lists stored in NVS by earlier firmware (up to 1000 MACs / 64 prefixes)
+void readLegacyMacFilter(std::vector<uint64_t>& macs, std::vector<uint32_t>& prefixes) {
+    std::vector<uint8_t> macBytes(getConfigBlobLength(MAC_FILTER_NVS_MACS));
+    std::vector<uint8_t> prefixBytes(getConfigBlobLength(MAC_FILTER_NVS_PREFIXES));
+    loadConfigBlob(MAC_FILTER_NVS_MACS, macBytes.data(), macBytes.size());
+    loadConfigBlob(MAC_FILTER_NVS_PREFIXES, prefixBytes.data(), prefixBytes.size());
+
+    for (size_t i = 0; i + 6 <= macBytes.size() && macs.size() < MAC_FILTER_MAX_MACS; i += 6) {
+        macs.push_back(unpackFilterOctets(&macBytes[i], 6));
+    }
+    for (size_t i = 0; i + 3 <= prefixBytes.size() && prefixes.size() < MAC_FILTER_MAX_PREFIXES; i += 3) {
+        prefixes.push_back((uint32_t)unpackFilterOctets(&prefixBytes[i], 3));
+    }
+}
+
+// Load the persisted filter at boot (after SPIFFS is mounted)
+void loadMacFilter() {
+    std::vector<uint64_t> macs;
+    std::vector<uint32_t> prefixes;
+    if (!readMacFilterFile(macs, prefixes)) {
+        readLegacyMacFilter(macs, prefixes);
+    }
+
+    installMacFilter(createMacFilterTable(macs, prefixes));
+
+    if (macs.empty() && prefixes.empty()) {
+        Serial.println("✓ MAC filter disabled (no entries stored)");
+    } else {
+        Serial.printf("✓ MAC filter loaded: %d MACs, %d prefixes\n", (int)macs.size(), (int)prefixes.size());
+    }
+}
+
+// Handle {"command":"mac_filter","action":"replace|add|clear","macs":[...],"prefixes":[...]}
+void handleMacFilterCommand(const JsonDocument& doc) {
+    String action = doc["action"] | "replace";
+
+    // Only the new entries are collected; "add" merges them with the active
+    // table (only this task replaces it) as the new table is filled
+    std::vector<uint64_t> macs;
+    std::vector<uint32_t> prefixes;
+    const MacFilterTable* active = nullptr;
+
+    if (action == "add") {
+        active = macFilter.load();
+    } else if (action != "replace" && action != "clear") {
+        Serial.printf("⚠️  Unknown mac_filter action: %s\n", action.c_str());
+        return;
+    }
+
+    if (action != "clear") {
+        for (JsonVariantConst entry : doc["macs"].as<JsonArrayConst>()) {
+            uint64_t mac;
+            if (parseMacString(entry.as<const char*>(), 6, mac)) {
+                macs.push_back(mac);
+            } else {
+                Serial.printf("⚠️  Ignoring invalid MAC: %s\n", entry.as<const char*>());
+            }
+        }
+        for (JsonVariantConst entry : doc["prefixes"].as<JsonArrayConst>()) {
+            uint64_t prefix;
+            if (parseMacString(entry.as<const char*>(), 3, prefix)) {
+                prefixes.push_back((uint32_t)prefix);
+            } else {
+                Serial.printf("⚠️  Ignoring invalid prefix: %s\n", entry.as<const char*>());
+            }
+        }
+    }
+    sortUniqueFilterEntries(macs);
+    sortUniqueFilterEntries(prefixes);
+
+    size_t macCount = active ? filterUnionCount(active->macs, active->macCount, macs) : macs.size();
+    size_t prefixCount = active ? filterUnionCount(active->prefixes, active->prefixCount, prefixes) : prefixes.size();
+    if (macCount > MAC_FILTER_MAX_MACS || prefixCount > MAC_FILTER_MAX_PREFIXES) {
+        Serial.printf("❌ MAC filter too large (%d MACs / %d prefixes, max %d / %d)\n",
+                     (int)macCount, (int)prefixCount,
+                     (int)MAC_FILTER_MAX_MACS, (int)MAC_FILTER_MAX_PREFIXES);
+        return;
+    }
+
+    MacFilterTable* table = mergeMacFilterTable(active, macs, prefixes);
+    if (table == nullptr && macCount + prefixCount > 0) {
+        Serial.printf("❌ Out of memory building MAC filter (largest free block %u bytes)\n",
+                     (unsigned)ESP.getMaxAllocHeap());
+        return;
+    }
+
+    installMacFilter(table);
+    saveMacFilter();
+
+    if (table == nullptr) {
+        Serial.println("✓ MAC filter cleared - accepting all adverts");
+    } else {
+        Serial.printf("✓ MAC filter active: %d MACs, %d prefixes\n", (int)table->macCount, (int)table->prefixCount);
+    }
+}
+
+#endif // MAC_FILTER_H
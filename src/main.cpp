@@ -16,14 +16,10 @@
 #include <Preferences.h>
 #include <WebServer.h>
 #include <DNSServer.h>
-#include <BLEDevice.h>
-#include <BLEScan.h>
-#include <BLEAdvertisedDevice.h>
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
 #include <Update.h>
 #include <time.h>
-#include <map>
 
 // Firmware version
 #define FIRMWARE_VERSION "2.0.0"
@@ -71,12 +67,12 @@ TaskHandle_t mqttTaskHandle = NULL;
 TaskHandle_t wifiTaskHandle = NULL;
 TaskHandle_t trackerTaskHandle = NULL;
 
-// Mutexes for thread safety
+// Mutexes for thread safety (mqttClient is owned by the MQTT task, which
+// others reach through the outbox)
 SemaphoreHandle_t deviceMapMutex = NULL;
-SemaphoreHandle_t mqttMutex = NULL;
 
 // WiFi clients
-WiFiClient mqttPlainClient;  // Use plain client for testing port 1883
+MqttAckTap<WiFiClient> mqttPlainClient;  // Use plain client for testing port 1883 (PUBACKs read here)
 PubSubClient mqttClient(mqttPlainClient);
 WebServer webServer(80);
 DNSServer dnsServer;
@@ -151,19 +147,9 @@ void setup() {
                 Serial.println("NTP sync failed, continuing without time sync");
             }
             
-            // Try to connect to MQTT
-            if (connectMQTT()) {
-                mqtt_connected = true;
-                Serial.println("MQTT connected successfully\n");
-                // LED: Solid ON = MQTT connected and operational
-                digitalWrite(LED_PIN, HIGH);
-                
-                // Start multi-threaded operation
-                startTasks();
-            } else {
-                Serial.println("MQTT connection failed, will retry in loop");
-                // Don't start config portal - WiFi is working, just keep retrying MQTT
-            }
+            // Start multi-threaded operation; the MQTT task connects to the
+            // broker and owns every reconnect from here on
+            startTasks();
         } else {
             // WiFi connection failed - go back to AP mode to fix credentials
             Serial.println("WiFi connection failed!");
@@ -187,31 +173,10 @@ void loop() {
         dnsServer.processNextRequest();
         delay(10);
     } else {
-        // Main loop - WiFi monitoring is now handled by wifiMonitorTask
-        // Just handle MQTT reconnection here
-        static unsigned long last_mqtt_retry = 0;
-        unsigned long now = millis();
-        
-        // Check MQTT connection
-        if (wifi_connected && !mqtt_connected) {
-            if (now - last_mqtt_retry > 10000) {  // Retry every 10 seconds
-                Serial.println("\n🔄 ========== MQTT RETRY ATTEMPT ==========");
-                Serial.printf("⏱  Uptime: %lu seconds\n", millis() / 1000);
-                Serial.printf("   MQTT User: %s\n", mqtt_user.c_str());
-                Serial.printf("   MQTT Password: %s\n", mqtt_password.length() > 0 ? "***SET***" : "MISSING");
-                
-                // Try MQTT connection
-                if (connectMQTT()) {
-                    mqtt_connected = true;
-                    Serial.println("✅ MQTT connected - starting tasks...");
-                    startTasks();
-                } else {
-                    Serial.println("❌ MQTT connection failed - will retry in 10 seconds");
-                }
-                Serial.println("==========================================\n");
-                last_mqtt_retry = now;
-            }
-        }
+        // Main loop - WiFi monitoring is handled by wifiMonitorTask and MQTT
+        // (re)connection by mqttMaintenanceTask
+        // LED: Solid ON = MQTT connected and operational
+        digitalWrite(LED_PIN, mqtt_connected ? HIGH : LOW);
         
         delay(1000);
     }
@@ -225,9 +190,8 @@ void startTasks() {
     
     // Create mutexes
     deviceMapMutex = xSemaphoreCreateMutex();
-    mqttMutex = xSemaphoreCreateMutex();
     
-    if (deviceMapMutex == NULL || mqttMutex == NULL) {
+    if (deviceMapMutex == NULL) {
         Serial.println("ERROR: Failed to create mutexes!");
         return;
     }
@@ -0,0 +1,133 @@
+/**
+ * MQTT Connection State
+ *
+ * Handles:
+ * - Connection phases stepped one at a time by the MQTT task (DNS, TCP,
+ *   CONNACK, subscribe)
+ * - Exponential reconnect backoff with jitter, so a fleet that lost the
+ *   broker together does not reconnect in lockstep
+ * - The broker address cache (reused for MQTT_DNS_TTL_MS, stale entry kept
+ *   as the fallback when a lookup fails)
+ * - Time spent in each phase of the last connect, for the gateway status
+ *
+ * DNS and TCP are started once and then polled on every pass (net_async.h),
+ * so they never hold the task; they give up after MQTT_DNS_TIMEOUT_MS and
+ * MQTT_TCP_TIMEOUT_MS. CONNACK is the one phase that blocks: PubSubClient
+ * sends CONNECT and waits up to MQTT_CONNACK_TIMEOUT_SEC for the answer.
+ * Subscribe only writes to the socket. The longest a single pass can hold
+ * the MQTT task is therefore MQTT_CONNACK_TIMEOUT_SEC (5 s).
+ *
+ * The backoff doubles from MQTT_BACKOFF_MIN_MS per consecutive failure up to
+ * MQTT_BACKOFF_MAX_MS, and each wait is drawn from the upper half of that
+ * ceiling ("equal jitter"), so it never collapses to zero. It only resets
+ * once a connection has stayed up for MQTT_STABLE_MS: a broker that accepts
+ * and then drops the session keeps backing off.
+ */
+
+#ifndef MQTT_CONNECTION_H
+#define MQTT_CONNECTION_H
+
+#include <stdint.h>
+
+const uint32_t MQTT_BACKOFF_MIN_MS = 1000;
+const uint32_t MQTT_BACKOFF_MAX_MS = 60000;
+const uint32_t MQTT_STABLE_MS = 60000;        // Up this long before the backoff resets
+const uint32_t MQTT_DNS_TTL_MS = 600000;      // Broker address reused for 10 minutes
+const uint32_t MQTT_DNS_TIMEOUT_MS = 10000;
+const uint32_t MQTT_TCP_TIMEOUT_MS = 3000;
+const uint16_t MQTT_CONNACK_TIMEOUT_SEC = 5;  // Also PubSubClient's read timeout afterwards
+const uint32_t MQTT_WIFI_POLL_MS = 1000;      // Wait between checks while WiFi is down
+const uint32_t MQTT_NET_POLL_MS = 10;         // Wait between polls of a pending DNS or TCP step
+
+enum MqttConnState : uint8_t {
+    MQTT_STATE_BACKOFF = 0,  // Waiting for the next attempt (or for WiFi)
+    MQTT_STATE_DNS,
+    MQTT_STATE_TCP,
+    MQTT_STATE_CONNACK,
+    MQTT_STATE_SUBSCRIBE,
+    MQTT_STATE_ONLINE,
+    MQTT_STATE_COUNT
+};
+
+const char* const MQTT_STATE_NAMES[MQTT_STATE_COUNT] = {
+    "backoff", "dns", "tcp", "connack", "subscribe", "online"
+};
+
+class ReconnectBackoff {
+public:
+    // A failed attempt at `nowMs`. `random` is any 32-bit random value.
+    // Returns the wait before the next attempt.
+    uint32_t fail(uint32_t nowMs, uint32_t random) {
+        uint32_t ceiling = MQTT_BACKOFF_MAX_MS;
+        if (failures_ < 16 && (MQTT_BACKOFF_MIN_MS << failures_) < MQTT_BACKOFF_MAX_MS) {
+            ceiling = MQTT_BACKOFF_MIN_MS << failures_;
+        }
+        failures_++;
+        uint32_t wait = ceiling / 2 + random % (ceiling / 2 + 1);
+        nextAttempt_ = nowMs + wait;
+        return wait;
+    }
+
+    void reset() { failures_ = 0; }
+
+    // Milliseconds until the next attempt may start (0 if it may now)
+    uint32_t msUntilReady(uint32_t nowMs) const {
+        int32_t remaining = (int32_t)(nextAttempt_ - nowMs);
+        return remaining > 0 ? (uint32_t)remaining : 0;
+    }
+
+    uint32_t failures() const { return failures_; }
+
+private:
+    uint32_t failures_ = 0;
+    uint32_t nextAttempt_ = 0;
+};
+
+// Broker address from the last successful lookup (IPv4, network byte order)
+class BrokerAddressCache {
+public:
+    // Still within MQTT_DNS_TTL_MS of the lookup
+    bool fresh(uint32_t nowMs) const {
+        return valid_ && !expired_ && nowMs - storedAt_ < MQTT_DNS_TTL_MS;
+    }
+
+    // Any address at all, fresh or not: the fallback when a lookup fails
+    bool valid() const { return valid_; }
+
+    uint32_t address() const { return address_; }
+
+    void store(uint32_t address, uint32_t nowMs) {
+        address_ = address;
+        storedAt_ = nowMs;
+        valid_ = true;
+        expired_ = false;
+    }
+
+    // Look the name up again next time (e.g. the address refused a
+    // connection), but keep the address as the fallback
+    void expire() { expired_ = true; }
+
+private:
+    uint32_t address_ = 0;
+    uint32_t storedAt_ = 0;
+    bool valid_ = false;
+    bool expired_ = false;
+};
+
+// Timings of the last successful connect and counters since boot
+struct MqttConnectStats {
+    uint32_t attempts = 0;
+    uint32_t failures = 0;
+    uint32_t dnsLookups = 0;      // Actual lookups; the rest were served from cache
+    uint32_t dnsCacheHits = 0;
+    uint32_t dnsFailures = 0;
+    uint32_t lastDnsMs = 0;       // 0 on a cache hit
+    uint32_t lastTcpMs = 0;
+    uint32_t lastConnackMs = 0;
+    uint32_t lastSubscribeMs = 0;
+    uint32_t lastConnectMs = 0;   // Start of DNS to online
+    MqttConnState lastFailedPhase = MQTT_STATE_BACKOFF;  // BACKOFF if none failed yet
+    int lastMqttState = 0;        // PubSubClient state() after the last failure
+};
+
+#endif // MQTT_CONNECTION_H
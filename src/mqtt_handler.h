@@ -2,8 +2,14 @@
  * MQTT Handler
  * 
  * Handles:
- * - MQTTS (TLS) connection and reconnection
- * - Message publishing
+ * - Connection as a state machine stepped by mqttMaintenanceTask (DNS with a
+ *   cached broker address, TCP, CONNACK, subscribe), reconnecting with
+ *   exponential backoff and jitter (mqtt_connection.h); DNS and TCP are
+ *   polled, not waited on (net_async.h)
+ * - Message publishing through a prioritized outbox; mqttMaintenanceTask is
+ *   the only task that touches mqttClient
+ * - QoS 1 for telemetry and offline replay: a window of messages in flight,
+ *   released by PUBACK and resent after a reconnect (mqtt_qos.h)
  * - Subscription handling
  * - Keepalive maintenance
  * - OTA update notifications
@@ -14,24 +20,129 @@
 
 #include <PubSubClient.h>
 #include <WiFiClientSecure.h>
+#include "advert_ring.h"
+#include "scan_scheduler.h"
+#include "pipeline_profiler.h"
+#include "mac_filter.h"
+#include "advert_dedup.h"
+#include "scanner_backend.h"
+#include "fixed_point.h"
+#include "device_message.h"
+#include "mqtt_outbox.h"
+#include "mqtt_qos.h"
+#include "mqtt_connection.h"
+#include "net_async.h"
 
-extern WiFiClient mqttPlainClient;
+extern MqttAckTap<WiFiClient> mqttPlainClient;
 extern PubSubClient mqttClient;
 extern String mqtt_host;
 extern String mqtt_user;
 extern String mqtt_password;
 extern String device_id;
 extern bool mqtt_connected;
-extern SemaphoreHandle_t mqttMutex;
+extern TaskHandle_t mqttTaskHandle;
+extern uint32_t trackerDroppedAdverts;
+extern uint32_t advertsHeardLastMinute;
+extern uint32_t advertsDecodedLastMinute;
+extern ScanScheduler scanScheduler;
+extern volatile bool scanActive;
+extern uint32_t discoveryBursts;
+extern uint32_t scannerStackHeap;
+extern ScannerBackend& scanner;
+extern uint32_t deviceTableFull;
+extern uint32_t devicesEvicted;
+extern uint32_t devicesDiscovered;
+extern uint32_t sensorsEvicted;
+extern uint32_t publishesDeferred;
+
+// Forward declarations for device table stats (device_tracker.h)
+size_t getTrackedDeviceCount();
+size_t getTrackedDeviceCapacity();
+size_t getTrackerBudgetBytes();
+size_t getPublishQueueLength();
+float getCompressionRatio();
 
 const int MQTT_PORT = 1883;  // Plain MQTT port (testing)
 const int MQTT_KEEPALIVE_SEC = 60;
 
-bool publishConnectMessage() {
-    if (!mqtt_connected) {
+const char* MQTT_NVS_OUTBOX_POLICY = "outbox_drop";
+const char* MQTT_NVS_OUTBOX_QOS = "outbox_qos";
+const char* MQTT_NVS_OUTBOX_WINDOW = "outbox_window";
+
+// Outbox byte budgets per class (powers of two). A device batch needs up to
+// ~4 KB, so telemetry holds at least a few of them.
+const uint32_t OUTBOX_CONTROL_BYTES = 8192;
+const uint32_t OUTBOX_TELEMETRY_BYTES = 16384;
+const uint32_t OUTBOX_BULK_BYTES = 4096;
+const size_t OUTBOX_MESSAGE_MAX = 4096;        // Topic with its NUL plus payload
+const size_t OUTBOX_SEND_BUDGET = 16;          // Messages per pass before mqttClient.loop() runs again
+const uint32_t OUTBOX_IDLE_WAIT_MS = 50;       // Publisher wakes at least this often for loop()
+const int OFFLINE_REPLAY_CHUNK = 8;            // Stored detections queued per pass
+const uint32_t OUTBOX_WINDOW_DEFAULT = 8;      // QoS 1 messages awaiting PUBACK, all classes
+const uint32_t OUTBOX_WINDOW_MAX = 32;
+const uint32_t OUTBOX_ACK_TIMEOUT_MS = 20000;  // No PUBACK progress for this long: reconnect and resend
+
+uint8_t outboxControlBuffer[OUTBOX_CONTROL_BYTES];
+uint8_t outboxTelemetryBuffer[OUTBOX_TELEMETRY_BYTES];
+uint8_t outboxBulkBuffer[OUTBOX_BULK_BYTES];
+
+// Status and RPC replies supersede older ones; telemetry and replay are
+// refused when full so the producer keeps them (offline store, retry).
+// Readings go at QoS 1 so a broker restart cannot silently lose them.
+OutboxLane mqttOutbox[OUTBOX_CLASS_COUNT] = {
+    OutboxLane(outboxControlBuffer, OUTBOX_CONTROL_BYTES, OUTBOX_DROP_OLDEST, 0),
+    OutboxLane(outboxTelemetryBuffer, OUTBOX_TELEMETRY_BYTES, OUTBOX_DROP_NEWEST, 1),
+    OutboxLane(outboxBulkBuffer, OUTBOX_BULK_BYTES, OUTBOX_DROP_NEWEST, 1)
+};
+portMUX_TYPE mqttOutboxMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t outboxWindow = OUTBOX_WINDOW_DEFAULT;
+
+// Publisher task only
+LatencyHistogram outboxLatency[OUTBOX_CLASS_COUNT];  // Enqueue to wire, µs
+uint8_t outboxSendBuffer[OUTBOX_MESSAGE_MAX];
+uint32_t outboxSendFailures = 0;
+uint32_t outboxResent = 0;           // QoS 1 messages sent again (DUP) after a reconnect
+uint32_t outboxAckTimeouts = 0;      // Reconnects forced by missing PUBACKs
+uint32_t outboxUnmatchedAcks = 0;    // PUBACKs for messages already evicted or acknowledged
+uint16_t outboxNextPacketId = 1;
+unsigned long outboxAckProgressAt = 0;  // Last PUBACK, or when the window was last empty
+
+// Queue a message for the publisher task. Never blocks; returns false if the
+// class is full under its drop policy or the message is too large.
+bool enqueueMqttMessage(OutboxClass outboxClass, const char* topic, const uint8_t* payload, size_t length) {
+    size_t topicLength = strlen(topic);
+    if (topicLength + 1 + length > OUTBOX_MESSAGE_MAX) {
+        Serial.printf("❌ Message to %s too large for the outbox (%d bytes)\n", topic, (int)length);
         return false;
     }
+    uint32_t nowUs = micros();
+    portENTER_CRITICAL(&mqttOutboxMux);
+    bool queued = mqttOutbox[outboxClass].push(topic, topicLength, payload, length, nowUs);
+    portEXIT_CRITICAL(&mqttOutboxMux);
     
+    if (queued && mqttTaskHandle != NULL && xTaskGetCurrentTaskHandle() != mqttTaskHandle) {
+        xTaskNotifyGive(mqttTaskHandle);
+    }
+    return queued;
+}
+
+bool enqueueMqttMessage(OutboxClass outboxClass, const char* topic, const char* payload) {
+    return enqueueMqttMessage(outboxClass, topic, (const uint8_t*)payload, strlen(payload));
+}
+
+uint32_t getOutboxDepth(int outboxClass = -1) {
+    uint32_t depth = 0;
+    portENTER_CRITICAL(&mqttOutboxMux);
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        if (outboxClass < 0 || outboxClass == i) {
+            depth += mqttOutbox[i].count();
+        }
+    }
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    return depth;
+}
+
+bool publishConnectMessage() {
     String topic = "sensor/connect";
     
     JsonDocument doc;
@@ -43,14 +154,9 @@ bool publishConnectMessage() {
     String payload;
     serializeJson(doc, payload);
     
-    bool success = false;
-    if (xSemaphoreTake(mqttMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        success = mqttClient.publish(topic.c_str(), payload.c_str());
-        xSemaphoreGive(mqttMutex);
-    }
-    
+    bool success = enqueueMqttMessage(OUTBOX_CONTROL, topic.c_str(), payload.c_str());
     if (success) {
-        Serial.printf("📤 Published connect message to %s\n", topic.c_str());
+        Serial.printf("📤 Queued connect message to %s\n", topic.c_str());
     }
     
     return success;
@@ -69,13 +175,7 @@ bool publishDisconnectMessage() {
     String payload;
     serializeJson(doc, payload);
     
-    bool success = false;
-    if (xSemaphoreTake(mqttMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        success = mqttClient.publish(topic.c_str(), payload.c_str());
-        xSemaphoreGive(mqttMutex);
-    }
-    
-    return success;
+    return enqueueMqttMessage(OUTBOX_CONTROL, topic.c_str(), payload.c_str());
 }
 
 const char* getMQTTStateString(int state) {
@@ -94,217 +194,839 @@ const char* getMQTTStateString(int state) {
     }
 }
 
-bool connectMQTT() {
-    Serial.println("\n========== MQTT CONNECTION ATTEMPT ==========");
-    Serial.printf("⏱  Timestamp: %lu\n", millis());
-    Serial.printf("📡 MQTT Broker: %s:%d\n", mqtt_host.c_str(), MQTT_PORT);
-    Serial.printf("🆔 Device ID: %s\n", device_id.c_str());
-    Serial.printf("👤 MQTT User: %s\n", mqtt_user.length() > 0 ? mqtt_user.c_str() : "(none - anonymous)");
-    Serial.printf("🔑 MQTT Pass: %s\n", mqtt_password.length() > 0 ? "***SET***" : "(none)");
-    Serial.printf("📶 WiFi Status: %s\n", WiFi.status() == WL_CONNECTED ? "Connected" : "DISCONNECTED!");
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.printf("📍 Local IP: %s\n", WiFi.localIP().toString().c_str());
-        Serial.printf("📊 WiFi RSSI: %d dBm\n", WiFi.RSSI());
+uint32_t getOutboxInFlight() {
+    uint32_t inFlight = 0;
+    portENTER_CRITICAL(&mqttOutboxMux);
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        inFlight += mqttOutbox[i].inFlight();
     }
-    Serial.printf("💾 Free Heap: %d bytes\n", ESP.getFreeHeap());
-    
-    // DNS resolution test
-    Serial.printf("\n🔍 Resolving hostname: %s...\n", mqtt_host.c_str());
-    IPAddress resolvedIP;
-    if (WiFi.hostByName(mqtt_host.c_str(), resolvedIP)) {
-        Serial.printf("✓ DNS resolved to: %s\n", resolvedIP.toString().c_str());
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    return inFlight;
+}
+
+// PUBACK from the broker (called by the socket tap, publisher task)
+void onOutboxPubAck(uint16_t packetId) {
+    bool matched = false;
+    portENTER_CRITICAL(&mqttOutboxMux);
+    for (int i = 0; i < OUTBOX_CLASS_COUNT && !matched; i++) {
+        matched = mqttOutbox[i].acknowledge(packetId);
+    }
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    if (matched) {
+        outboxAckProgressAt = millis();
     } else {
-        Serial.println("✗ DNS resolution FAILED!");
-        Serial.println("   Check: 1) DNS servers 2) Internet connectivity 3) Hostname spelling");
+        outboxUnmatchedAcks++;
+    }
+}
+
+// After a reconnect every unacknowledged QoS 1 message is sent again
+void rewindMqttOutbox() {
+    portENTER_CRITICAL(&mqttOutboxMux);
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        mqttOutbox[i].rewind();
+    }
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    outboxAckProgressAt = millis();
+}
+
+// Send the next message of the highest-priority class that has one and,
+// for QoS 1, room in the in-flight window. Publisher task only: the message
+// is copied out under the outbox lock and written to the socket without it.
+// Returns false if nothing was sent.
+bool sendNextOutboxMessage() {
+    OutboxRecord record;
+    int outboxClass = 0;
+    uint8_t qos = 0;
+    const OutboxRecord* next = nullptr;
+    portENTER_CRITICAL(&mqttOutboxMux);
+    uint32_t inFlight = 0;
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        inFlight += mqttOutbox[i].inFlight();
+    }
+    for (; outboxClass < OUTBOX_CLASS_COUNT; outboxClass++) {
+        qos = mqttOutbox[outboxClass].qos();
+        if (qos > 0 && inFlight >= outboxWindow) {
+            continue;  // Window full: lower QoS 0 classes may still go
+        }
+        next = mqttOutbox[outboxClass].nextToSend();
+        if (next != nullptr) {
+            break;
+        }
+    }
+    if (next != nullptr) {
+        record = *next;
+        memcpy(outboxSendBuffer, next + 1, record.topicLength + record.payloadLength);
+    }
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    if (next == nullptr) {
         return false;
     }
     
-    // Stop any existing connection
-    Serial.println("\n📴 Stopping any existing connection...");
-    mqttPlainClient.stop();
-    delay(100);
-    
-    // Configure MQTT client
-    Serial.println("\n⚙️  Configuring MQTT client...");
-    mqttClient.setServer(mqtt_host.c_str(), MQTT_PORT);
-    mqttClient.setKeepAlive(MQTT_KEEPALIVE_SEC);
-    mqttClient.setBufferSize(4096);
-    mqttClient.setCallback(mqttCallback);
-    Serial.printf("   Keep-alive: %d seconds\n", MQTT_KEEPALIVE_SEC);
-    Serial.println("   Buffer size: 4096 bytes");
-    
-    String clientId = "BLE-Gateway-" + device_id;
-    Serial.printf("\n🔌 Attempting connection with Client ID: %s\n", clientId.c_str());
-    
-    bool connected = false;
-    if (mqtt_user.length() > 0 && mqtt_password.length() > 0) {
-        Serial.println("   Using authenticated connection...");
-        connected = mqttClient.connect(clientId.c_str(), mqtt_user.c_str(), mqtt_password.c_str());
+    const char* topic = (const char*)outboxSendBuffer;
+    const uint8_t* payload = outboxSendBuffer + record.topicLength;
+    bool resend = record.flags & OUTBOX_SENT;
+    uint16_t packetId = 0;
+    bool success;
+    if (qos > 0) {
+        // A resend keeps its packet id; 0 is not a valid id
+        packetId = resend ? record.packetId : outboxNextPacketId;
+        if (!resend && ++outboxNextPacketId == 0) {
+            outboxNextPacketId = 1;
+        }
+        success = writeQos1Publish(mqttPlainClient, topic, record.topicLength - 1, payload,
+                                   record.payloadLength, packetId, resend);
     } else {
-        Serial.println("   Using anonymous connection...");
-        connected = mqttClient.connect(clientId.c_str());
+        success = mqttClient.beginPublish(topic, record.payloadLength, false) &&
+                  mqttClient.write(payload, record.payloadLength) == record.payloadLength &&
+                  mqttClient.endPublish() == 1;
     }
-    
-    if (connected) {
-        Serial.println("\n✅ ✅ ✅ MQTT CONNECTED SUCCESSFULLY! ✅ ✅ ✅");
-        Serial.printf("   Client ID: %s\n", clientId.c_str());
-        
-        // Subscribe to ThingsBoard-compatible control topics
-        String cmdTopic = "gateway/" + device_id + "/command";
-        String otaTopic = "gateway/" + device_id + "/ota";
-        String rpcRequestTopic = "sensor/" + device_id + "/request/+/+";
-        // ThingsBoard attribute updates for OTA (matches your config)
-        String attrUpdateTopic = "sensor/" + device_id + "/firmwareVersion";
-        
-        Serial.println("\n📬 Subscribing to topics...");
-        bool cmdSub = mqttClient.subscribe(cmdTopic.c_str(), 1);  // QoS 1
-        bool otaSub = mqttClient.subscribe(otaTopic.c_str(), 1);  // QoS 1
-        bool rpcSub = mqttClient.subscribe(rpcRequestTopic.c_str(), 1);  // QoS 1
-        bool attrSub = mqttClient.subscribe(attrUpdateTopic.c_str(), 1);  // QoS 1
-        
-        Serial.printf("   %s %s (QoS 1)\n", cmdSub ? "[OK]" : "[FAIL]", cmdTopic.c_str());
-        Serial.printf("   %s %s (QoS 1)\n", otaSub ? "[OK]" : "[FAIL]", otaTopic.c_str());
-        Serial.printf("   %s %s (QoS 1)\n", rpcSub ? "[OK]" : "[FAIL]", rpcRequestTopic.c_str());
-        Serial.printf("   %s %s (QoS 1, ThingsBoard OTA)\n", attrSub ? "[OK]" : "[FAIL]", attrUpdateTopic.c_str());
-        
-        // Publish connect message to ThingsBoard
-        publishConnectMessage();
-        
-        // Publish any offline detections that were stored while disconnected
-        int offlineCount = publishOfflineDetections();
-        if (offlineCount > 0) {
-            Serial.printf("✓ Published %d offline LOP001 detections\n", offlineCount);
+    if (!success) {
+        outboxSendFailures++;
+        Serial.printf("❌ Failed to publish to %s\n", topic);
+        Serial.printf("   MQTT state: %d (%s)\n", mqttClient.state(), getMQTTStateString(mqttClient.state()));
+        Serial.printf("   Payload size: %d bytes\n", (int)record.payloadLength);
+        if (!mqttClient.connected()) {
+            return false;  // Left queued, sent again once reconnected
         }
-        
-        Serial.println("==========================================\n");
-        return true;
+        // Still connected, so retrying would only fail again: drop it
+        portENTER_CRITICAL(&mqttOutboxMux);
+        mqttOutbox[outboxClass].discard(record.sequence);
+        portEXIT_CRITICAL(&mqttOutboxMux);
+        return false;
+    }
+    
+    if (qos > 0 && inFlight == 0) {
+        outboxAckProgressAt = millis();  // Window was empty: the ack timeout starts now
+    }
+    portENTER_CRITICAL(&mqttOutboxMux);
+    mqttOutbox[outboxClass].sent(record.sequence, packetId);
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    if (resend) {
+        outboxResent++;
     } else {
-        int state = mqttClient.state();
-        Serial.println("\n❌ ❌ ❌ MQTT CONNECTION FAILED! ❌ ❌ ❌");
-        Serial.printf("   Error Code: %d\n", state);
-        Serial.printf("   Error: %s\n", getMQTTStateString(state));
-        
-        Serial.println("\n🔧 TROUBLESHOOTING STEPS:");
-        switch(state) {
-            case -4:
-                Serial.println("   → Server not responding. Check:");
-                Serial.println("      1. Is the MQTT broker running?");
-                Serial.println("      2. Can you ping the server?");
-                Serial.println("      3. Is there a firewall blocking port 1883?");
-                break;
-            case -3:
-            case -2:
-                Serial.println("   → Network issue. Check:");
-                Serial.println("      1. Is WiFi connected? (see status above)");
-                Serial.println("      2. Can the device reach the internet?");
-                Serial.println("      3. Check DNS resolution");
-                break;
-            case 1:
-                Serial.println("   → Protocol mismatch. Check:");
-                Serial.println("      1. Broker MQTT version (should be 3.1.1)");
-                Serial.println("      2. Update PubSubClient library if old");
-                break;
-            case 2:
-                Serial.println("   → Client ID rejected. Check:");
-                Serial.println("      1. Is another client using the same ID?");
-                Serial.println("      2. Does broker allow this client ID format?");
-                break;
-            case 3:
-                Serial.println("   → Server unavailable. Check:");
-                Serial.println("      1. Is MQTT service running on the broker?");
-                Serial.println("      2. Check broker logs for errors");
-                Serial.println("      3. Is broker at capacity?");
-                break;
-            case 4:
-                Serial.println("   → Bad credentials! Check:");
-                Serial.println("      1. Username is correct");
-                Serial.println("      2. Password is correct");
-                Serial.println("      3. User has permission to connect");
-                Serial.println("      4. Try fetching config from server again");
-                break;
-            case 5:
-                Serial.println("   → Not authorized. Check:");
-                Serial.println("      1. User account is active");
-                Serial.println("      2. ACL rules allow this device");
-                Serial.println("      3. Device is registered on server");
+        outboxLatency[outboxClass].record(micros() - record.enqueuedUs);
+    }
+    return true;
+}
+
+// Publisher task: send up to `budget` queued messages
+size_t drainMqttOutbox(size_t budget) {
+    mqttPlainClient.pollPubAcks();
+    if (getOutboxInFlight() > 0 && millis() - outboxAckProgressAt > OUTBOX_ACK_TIMEOUT_MS) {
+        // TCP delivered the messages but the broker never acknowledged them:
+        // start a new session, which resends them
+        outboxAckTimeouts++;
+        Serial.printf("⚠️  No PUBACK for %us, reconnecting\n", (unsigned)(OUTBOX_ACK_TIMEOUT_MS / 1000));
+        mqttClient.disconnect();
+        return 0;
+    }
+    size_t sent = 0;
+    while (sent < budget && mqttClient.connected() && sendNextOutboxMessage()) {
+        sent++;
+    }
+    return sent;
+}
+
+// Wait up to timeoutMs for the outbox to empty, e.g. before a reboot. Called
+// on the publisher task (or before it exists) the messages are sent here,
+// since nothing else would send them.
+bool flushMqttOutbox(uint32_t timeoutMs) {
+    bool onPublisher = mqttTaskHandle == NULL || xTaskGetCurrentTaskHandle() == mqttTaskHandle;
+    unsigned long start = millis();
+    while (getOutboxDepth() > 0 && millis() - start < timeoutMs) {
+        if (onPublisher) {
+            if (!mqttClient.connected()) {
                 break;
+            }
+            // Once all is sent, wait for the PUBACKs of what is in flight
+            if (!sendNextOutboxMessage()) {
+                mqttPlainClient.pollPubAcks();
+                delay(1);
+            }
+        } else {
+            xTaskNotifyGive(mqttTaskHandle);
+            vTaskDelay(pdMS_TO_TICKS(10));
         }
-        
-        Serial.println("==========================================\n");
-        return false;
     }
+    return getOutboxDepth() == 0;
+}
+
+// Connection state: MQTT task only, apart from the status report
+MqttConnState mqttConnState = MQTT_STATE_BACKOFF;
+ReconnectBackoff mqttBackoff;
+MqttConnectStats mqttConnectStats;
+BrokerAddressCache mqttBrokerAddress;
+unsigned long mqttAttemptStartedAt = 0;
+unsigned long mqttPhaseStartedAt = 0;
+bool mqttPhaseStarted = false;  // DNS/TCP: the lookup or connect is in flight
+unsigned long mqttOnlineSince = 0;
+
+void printMQTTConnectFailure(int state) {
+    Serial.printf("   Error Code: %d\n", state);
+    Serial.printf("   Error: %s\n", getMQTTStateString(state));
+    
+    Serial.println("\n🔧 TROUBLESHOOTING STEPS:");
+    switch(state) {
+        case -4:
+            Serial.println("   → Server not responding. Check:");
+            Serial.println("      1. Is the MQTT broker running?");
+            Serial.println("      2. Can you ping the server?");
+            Serial.println("      3. Is there a firewall blocking port 1883?");
+            break;
+        case -3:
+        case -2:
+            Serial.println("   → Network issue. Check:");
+            Serial.println("      1. Is WiFi connected? (see status above)");
+            Serial.println("      2. Can the device reach the internet?");
+            Serial.println("      3. Check DNS resolution");
+            break;
+        case 1:
+            Serial.println("   → Protocol mismatch. Check:");
+            Serial.println("      1. Broker MQTT version (should be 3.1.1)");
+            Serial.println("      2. Update PubSubClient library if old");
+            break;
+        case 2:
+            Serial.println("   → Client ID rejected. Check:");
+            Serial.println("      1. Is another client using the same ID?");
+            Serial.println("      2. Does broker allow this client ID format?");
+            break;
+        case 3:
+            Serial.println("   → Server unavailable. Check:");
+            Serial.println("      1. Is MQTT service running on the broker?");
+            Serial.println("      2. Check broker logs for errors");
+            Serial.println("      3. Is broker at capacity?");
+            break;
+        case 4:
+            Serial.println("   → Bad credentials! Check:");
+            Serial.println("      1. Username is correct");
+            Serial.println("      2. Password is correct");
+            Serial.println("      3. User has permission to connect");
+            Serial.println("      4. Try fetching config from server again");
+            break;
+        case 5:
+            Serial.println("   → Not authorized. Check:");
+            Serial.println("      1. User account is active");
+            Serial.println("      2. ACL rules allow this device");
+            Serial.println("      3. Device is registered on server");
+            break;
+    }
+}
+
+// Give up on the current attempt (or lost session) and schedule the next one
+void failMQTTConnect(MqttConnState phase) {
+    mqtt_connected = false;
+    mqttConnectStats.failures++;
+    mqttConnectStats.lastFailedPhase = phase;
+    mqttConnectStats.lastMqttState = mqttClient.state();
+    mqttPlainClient.stop();
+    cancelTcpConnect();
+    mqttPhaseStarted = false;
+    uint32_t wait = mqttBackoff.fail(millis(), esp_random());
+    mqttConnState = MQTT_STATE_BACKOFF;
+    Serial.printf("❌ MQTT %s failed, retrying in %.1f s (failure %u in a row)\n",
+                 MQTT_STATE_NAMES[phase], wait / 1000.0, (unsigned)mqttBackoff.failures());
+}
+
+void enterMqttPhase(MqttConnState phase, unsigned long now) {
+    mqttConnState = phase;
+    mqttPhaseStartedAt = now;
+    mqttPhaseStarted = false;
+}
+
+// Advance the connection by at most one phase, or poll the pending DNS/TCP
+// step. MQTT task only, the single owner of (re)connects. Returns true
+// while the session is up.
+bool mqttConnectionStep() {
+    unsigned long now = millis();
+    switch (mqttConnState) {
+        case MQTT_STATE_ONLINE:
+            if (mqttClient.connected()) {
+                return true;
+            }
+            Serial.printf("\n⚠️  MQTT connection lost: %d (%s) after %lu s\n", mqttClient.state(),
+                         getMQTTStateString(mqttClient.state()), (now - mqttOnlineSince) / 1000);
+            if (now - mqttOnlineSince >= MQTT_STABLE_MS) {
+                mqttBackoff.reset();
+            }
+            failMQTTConnect(MQTT_STATE_ONLINE);
+            return false;
+            
+        case MQTT_STATE_BACKOFF:
+            if (mqttBackoff.msUntilReady(now) > 0 || WiFi.status() != WL_CONNECTED) {
+                return false;
+            }
+            mqttConnectStats.attempts++;
+            mqttAttemptStartedAt = now;
+            Serial.println("\n========== MQTT CONNECTION ATTEMPT ==========");
+            Serial.printf("⏱  Timestamp: %lu (attempt %u)\n", now, (unsigned)mqttConnectStats.attempts);
+            Serial.printf("📡 MQTT Broker: %s:%d\n", mqtt_host.c_str(), MQTT_PORT);
+            Serial.printf("🆔 Device ID: %s\n", device_id.c_str());
+            Serial.printf("👤 MQTT User: %s\n", mqtt_user.length() > 0 ? mqtt_user.c_str() : "(none - anonymous)");
+            Serial.printf("🔑 MQTT Pass: %s\n", mqtt_password.length() > 0 ? "***SET***" : "(none)");
+            Serial.printf("📍 Local IP: %s, RSSI %d dBm\n", WiFi.localIP().toString().c_str(), WiFi.RSSI());
+            Serial.printf("💾 Free Heap: %d bytes\n", ESP.getFreeHeap());
+            enterMqttPhase(MQTT_STATE_DNS, now);
+            return false;
+            
+        case MQTT_STATE_DNS: {
+            // The broker address is cached; an expired entry is still used if
+            // the lookup fails
+            if (!mqttPhaseStarted) {
+                if (mqttBrokerAddress.fresh(now)) {
+                    mqttConnectStats.dnsCacheHits++;
+                    mqttConnectStats.lastDnsMs = 0;
+                    Serial.printf("✓ Broker address (cached): %s\n",
+                                 IPAddress(mqttBrokerAddress.address()).toString().c_str());
+                    enterMqttPhase(MQTT_STATE_TCP, now);
+                    return false;
+                }
+                mqttConnectStats.dnsLookups++;
+                startDnsLookup(mqtt_host.c_str(), now);
+                mqttPhaseStarted = true;
+            }
+            uint32_t address;
+            NetStep step = pollDnsLookup(now, MQTT_DNS_TIMEOUT_MS, address);
+            if (step == NET_PENDING) {
+                return false;
+            }
+            mqttConnectStats.lastDnsMs = now - mqttPhaseStartedAt;
+            if (step == NET_DONE) {
+                mqttBrokerAddress.store(address, now);
+                Serial.printf("✓ DNS resolved to: %s (%u ms)\n", IPAddress(address).toString().c_str(),
+                             (unsigned)mqttConnectStats.lastDnsMs);
+            } else if (mqttBrokerAddress.valid()) {
+                mqttConnectStats.dnsFailures++;
+                Serial.printf("⚠️  DNS resolution failed, using last address %s\n",
+                             IPAddress(mqttBrokerAddress.address()).toString().c_str());
+            } else {
+                mqttConnectStats.dnsFailures++;
+                Serial.println("✗ DNS resolution FAILED!");
+                Serial.println("   Check: 1) DNS servers 2) Internet connectivity 3) Hostname spelling");
+                failMQTTConnect(MQTT_STATE_DNS);
+                return false;
+            }
+            enterMqttPhase(MQTT_STATE_TCP, now);
+            return false;
+        }
+            
+        case MQTT_STATE_TCP: {
+            if (!mqttPhaseStarted) {
+                mqttPlainClient.stop();
+                if (!startTcpConnect(mqttBrokerAddress.address(), MQTT_PORT, now)) {
+                    failMQTTConnect(MQTT_STATE_TCP);
+                    return false;
+                }
+                mqttPhaseStarted = true;
+            }
+            int fd;
+            NetStep step = pollTcpConnect(now, MQTT_TCP_TIMEOUT_MS, MQTT_TCP_TIMEOUT_MS, fd);
+            if (step == NET_PENDING) {
+                return false;
+            }
+            if (step == NET_FAILED) {
+                // The broker may have moved: look it up again next time
+                mqttBrokerAddress.expire();
+                failMQTTConnect(MQTT_STATE_TCP);
+                return false;
+            }
+            // Hand the connected socket to the client PubSubClient reads through
+            static_cast<WiFiClient&>(mqttPlainClient) = WiFiClient(fd);
+            mqttConnectStats.lastTcpMs = now - mqttPhaseStartedAt;
+            Serial.printf("✓ TCP connected (%u ms)\n", (unsigned)mqttConnectStats.lastTcpMs);
+            enterMqttPhase(MQTT_STATE_CONNACK, now);
+            return false;
+        }
+            
+        case MQTT_STATE_CONNACK: {
+            // The socket is already open, so PubSubClient only sends CONNECT
+            // and waits (at most MQTT_CONNACK_TIMEOUT_SEC) for the CONNACK
+            mqttClient.setServer(IPAddress(mqttBrokerAddress.address()), MQTT_PORT);
+            mqttClient.setKeepAlive(MQTT_KEEPALIVE_SEC);
+            mqttClient.setSocketTimeout(MQTT_CONNACK_TIMEOUT_SEC);
+            mqttClient.setBufferSize(4096);
+            mqttClient.setCallback(mqttCallback);
+            mqttPlainClient.onPubAck(onOutboxPubAck);
+            
+            String clientId = "BLE-Gateway-" + device_id;
+            bool connected = false;
+            if (mqtt_user.length() > 0 && mqtt_password.length() > 0) {
+                connected = mqttClient.connect(clientId.c_str(), mqtt_user.c_str(), mqtt_password.c_str());
+            } else {
+                connected = mqttClient.connect(clientId.c_str());
+            }
+            if (!connected) {
+                Serial.println("\n❌ ❌ ❌ MQTT CONNECTION FAILED! ❌ ❌ ❌");
+                printMQTTConnectFailure(mqttClient.state());
+                failMQTTConnect(MQTT_STATE_CONNACK);
+                return false;
+            }
+            mqttConnectStats.lastConnackMs = millis() - now;
+            Serial.println("\n✅ ✅ ✅ MQTT CONNECTED SUCCESSFULLY! ✅ ✅ ✅");
+            Serial.printf("   Client ID: %s (CONNACK in %u ms)\n", clientId.c_str(),
+                         (unsigned)mqttConnectStats.lastConnackMs);
+            enterMqttPhase(MQTT_STATE_SUBSCRIBE, millis());
+            return false;
+        }
+            
+        case MQTT_STATE_SUBSCRIBE: {
+            // Subscribe to ThingsBoard-compatible control topics
+            String cmdTopic = "gateway/" + device_id + "/command";
+            String otaTopic = "gateway/" + device_id + "/ota";
+            String rpcRequestTopic = "sensor/" + device_id + "/request/+/+";
+            // ThingsBoard attribute updates for OTA (matches your config)
+            String attrUpdateTopic = "sensor/" + device_id + "/firmwareVersion";
+            
+            Serial.println("\n📬 Subscribing to topics...");
+            bool cmdSub = mqttClient.subscribe(cmdTopic.c_str(), 1);  // QoS 1
+            bool otaSub = mqttClient.subscribe(otaTopic.c_str(), 1);  // QoS 1
+            bool rpcSub = mqttClient.subscribe(rpcRequestTopic.c_str(), 1);  // QoS 1
+            bool attrSub = mqttClient.subscribe(attrUpdateTopic.c_str(), 1);  // QoS 1
+            
+            Serial.printf("   %s %s (QoS 1)\n", cmdSub ? "[OK]" : "[FAIL]", cmdTopic.c_str());
+            Serial.printf("   %s %s (QoS 1)\n", otaSub ? "[OK]" : "[FAIL]", otaTopic.c_str());
+            Serial.printf("   %s %s (QoS 1)\n", rpcSub ? "[OK]" : "[FAIL]", rpcRequestTopic.c_str());
+            Serial.printf("   %s %s (QoS 1, ThingsBoard OTA)\n", attrSub ? "[OK]" : "[FAIL]", attrUpdateTopic.c_str());
+            if (!(cmdSub && otaSub && rpcSub && attrSub)) {
+                failMQTTConnect(MQTT_STATE_SUBSCRIBE);
+                return false;
+            }
+            mqttConnectStats.lastSubscribeMs = millis() - now;
+            
+            mqtt_connected = true;
+            mqttOnlineSince = millis();
+            mqttConnectStats.lastConnectMs = mqttOnlineSince - mqttAttemptStartedAt;
+            enterMqttPhase(MQTT_STATE_ONLINE, mqttOnlineSince);
+            
+            // QoS 1 messages the broker never acknowledged go out again first
+            rewindMqttOutbox();
+            
+            // Publish connect message to ThingsBoard
+            publishConnectMessage();
+            
+            // Offline detections stored while disconnected are replayed by the
+            // publisher task at bulk priority
+            startOfflineReplay();
+            
+            Serial.printf("✓ MQTT online in %u ms (dns %u, tcp %u, connack %u, subscribe %u)\n",
+                         (unsigned)mqttConnectStats.lastConnectMs, (unsigned)mqttConnectStats.lastDnsMs,
+                         (unsigned)mqttConnectStats.lastTcpMs, (unsigned)mqttConnectStats.lastConnackMs,
+                         (unsigned)mqttConnectStats.lastSubscribeMs);
+            Serial.println("==========================================\n");
+            return true;
+        }
+            
+        default:
+            mqttConnState = MQTT_STATE_BACKOFF;
+            return false;
+    }
+}
+
+// How long the MQTT task may sleep before the next connection step
+uint32_t mqttConnectionWaitMs() {
+    if (mqttConnState == MQTT_STATE_DNS || mqttConnState == MQTT_STATE_TCP) {
+        return mqttPhaseStarted ? MQTT_NET_POLL_MS : 0;
+    }
+    if (mqttConnState != MQTT_STATE_BACKOFF) {
+        return 0;
+    }
+    uint32_t wait = mqttBackoff.msUntilReady(millis());
+    return wait > 0 && wait < MQTT_WIFI_POLL_MS ? wait : MQTT_WIFI_POLL_MS;
+}
+
+void addConnectionStats(JsonObject connection) {
+    connection["state"] = MQTT_STATE_NAMES[mqttConnState];
+    connection["attempts"] = mqttConnectStats.attempts;
+    connection["failures"] = mqttConnectStats.failures;
+    connection["consecutiveFailures"] = mqttBackoff.failures();
+    connection["nextAttemptMs"] = mqttConnState == MQTT_STATE_BACKOFF ? mqttBackoff.msUntilReady(millis()) : 0;
+    if (mqttConnectStats.failures > 0) {
+        connection["lastFailedPhase"] = MQTT_STATE_NAMES[mqttConnectStats.lastFailedPhase];
+        connection["lastMqttState"] = mqttConnectStats.lastMqttState;
+    }
+    connection["dnsLookups"] = mqttConnectStats.dnsLookups;
+    connection["dnsCacheHits"] = mqttConnectStats.dnsCacheHits;
+    connection["dnsFailures"] = mqttConnectStats.dnsFailures;
+    connection["dnsMs"] = mqttConnectStats.lastDnsMs;
+    connection["tcpMs"] = mqttConnectStats.lastTcpMs;
+    connection["connackMs"] = mqttConnectStats.lastConnackMs;
+    connection["subscribeMs"] = mqttConnectStats.lastSubscribeMs;
+    connection["connectMs"] = mqttConnectStats.lastConnectMs;
+    connection["uptimeSec"] = mqtt_connected ? (millis() - mqttOnlineSince) / 1000 : 0;
+}
+
+const char* MQTT_NVS_BATCH_ENABLED = "batch_on";
+const char* MQTT_NVS_BATCH_READINGS = "batch_count";
+const char* MQTT_NVS_BATCH_BYTES = "batch_bytes";
+const char* MQTT_NVS_BATCH_FLUSH = "batch_flush";
+const char* MQTT_NVS_PAYLOAD_FORMAT = "pub_format";
+
+const uint32_t BATCH_READINGS_MAX = 100;
+const uint32_t BATCH_BYTES_MIN = 256;
+const uint32_t BATCH_BYTES_MAX = 4000;      // Leaves room for the topic in the 4096-byte MQTT buffer
+const uint32_t BATCH_FLUSH_MIN_MS = 100;
+const uint32_t BATCH_FLUSH_MAX_MS = 60000;
+
+PayloadFormat payloadFormat = PAYLOAD_JSON;
+
+// Batch mode: readings are packed into one message. JSON batches use the
+// ThingsBoard gateway telemetry format, {"<serialNumber>":[{"ts":..,"values":{..}}],..}
+bool batchEnabled = false;
+uint32_t batchMaxReadings = 20;
+uint32_t batchMaxBytes = 3072;
+uint32_t batchFlushMs = 2000;
+
+// Device message buffers and topics (tracker task only). Readings are
+// encoded in place and streamed to the broker, with no heap allocation.
+uint8_t publishScratch[BATCH_BYTES_MAX];
+uint8_t publishBatchBuffer[BATCH_BYTES_MAX];
+PayloadWriter publishBatch(publishBatchBuffer, sizeof(publishBatchBuffer));
+const char* TOPIC_JSON_DATA = "sensor/data";
+const char* TOPIC_JSON_BATCH = "sensor/data/batch";
+char topicMsgPackData[48];
+char topicMsgPackBatch[48];
+
+// Open batch (tracker task only)
+PayloadFormat publishBatchFormat = PAYLOAD_JSON;
+uint32_t publishBatchReadings = 0;
+uint64_t publishBatchMacs[BATCH_READINGS_MAX];  // A JSON batch holds one reading per device
+unsigned long publishBatchOpenedAt = 0;
+uint32_t batchMessages = 0;        // Batch messages sent
+uint32_t batchReadings = 0;        // Readings they carried
+uint32_t batchReadingsDropped = 0; // Readings lost to a failed batch publish
+
+// Per-gateway topics, built once device_id is known
+void initPublishTopics() {
+    snprintf(topicMsgPackData, sizeof(topicMsgPackData), "msgpack/%s/data", device_id.c_str());
+    snprintf(topicMsgPackBatch, sizeof(topicMsgPackBatch), "msgpack/%s/batch", device_id.c_str());
 }
 
-bool publishDeviceData(const String& deviceMac, const JsonDocument& data, bool isSensor) {
+// Queue one device payload for the publisher task, or count it when a trace
+// replay is measuring the pipeline
+bool publishPayload(const char* topic, const uint8_t* payload, size_t length) {
+    // Trace replays measure everything up to the wire without sending
+    if (publishSink.enabled) {
+        publishSink.messages++;
+        publishSink.bytes += length;
+        return true;
+    }
+    
     if (!mqtt_connected) {
         Serial.println("⚠️  Cannot publish: MQTT not connected");
         return false;
     }
     
-    // Publish to sensor/data topic (matches your ThingsBoard connector)
-    String topic = "sensor/data";
-    
-    // Build ThingsBoard-compatible JSON payload
-    JsonDocument doc;
-    
-    // Device identification (used by ThingsBoard to identify the device)
-    doc["serialNumber"] = deviceMac;
-    // Use the type from data (e.g., "LOP001") for both sensorType and sensorModel
-    String deviceType = data["type"].as<String>();
-    doc["sensorType"] = deviceType;
-    doc["sensorModel"] = deviceType;
-    
-    // Telemetry data - only include temp/humidity/battery for sensor devices
-    if (isSensor) {
-        // Use exact field names from your connector config: temp and hum
-        doc["temp"] = data["temperature"];
-        doc["hum"] = data["humidity"];
-        // Only include battery if present in data (LOP001 has no battery)
-        if (data["battery"].is<int>() && data["battery"].as<int>() > 0) {
-            doc["battery"] = data["battery"];
+    // Full telemetry class: the caller treats it like a failed publish
+    return enqueueMqttMessage(OUTBOX_TELEMETRY, topic, payload, length);
+}
+
+// Start an empty batch in the current payload format
+void openPublishBatch() {
+    publishBatch.truncate(0);
+    publishBatchFormat = payloadFormat;
+    if (publishBatchFormat == PAYLOAD_MSGPACK) {
+        publishBatch.mpArray(0xFFFF);  // array16 header, count patched in at flush
+    } else {
+        publishBatch.byte('{');
+    }
+}
+
+// Send the open batch, if any. Readings in a batch that fails are dropped.
+bool flushPublishBatch() {
+    if (publishBatchReadings == 0) {
+        return true;
+    }
+    const char* topic;
+    if (publishBatchFormat == PAYLOAD_MSGPACK) {
+        publishBatch.patch(1, (uint8_t)(publishBatchReadings >> 8));
+        publishBatch.patch(2, (uint8_t)publishBatchReadings);
+        topic = topicMsgPackBatch;
+    } else {
+        publishBatch.byte('}');
+        topic = TOPIC_JSON_BATCH;
+    }
+    bool success = publishPayload(topic, publishBatch.data(), publishBatch.length());
+    if (success) {
+        batchMessages++;
+        batchReadings += publishBatchReadings;
+        Serial.printf("📤 Queued %s batch: %u readings, %d bytes\n",
+                     PAYLOAD_FORMAT_NAMES[publishBatchFormat], (unsigned)publishBatchReadings,
+                     (int)publishBatch.length());
+    } else {
+        batchReadingsDropped += publishBatchReadings;
+    }
+    publishBatchReadings = 0;
+    return success;
+}
+
+// Flush once the oldest reading in the batch reaches the deadline, or batch
+// mode was switched off or changed format. Called from the tracker loop.
+void flushPublishBatchIfDue() {
+    if (publishBatchReadings > 0 &&
+        (!batchEnabled || publishBatchFormat != payloadFormat || millis() - publishBatchOpenedAt >= batchFlushMs)) {
+        flushPublishBatch();
+    }
+}
+
+bool publishBatchHasDevice(uint64_t mac) {
+    for (uint32_t i = 0; i < publishBatchReadings; i++) {
+        if (publishBatchMacs[i] == mac) {
+            return true;
         }
     }
-    // Note: For non-sensor devices, we don't include temp/hum/battery at all
-    
-    doc["rssi"] = data["rssi"];
-    
-    // Additional metadata
-    doc["gateway"] = device_id;
-    doc["timestamp"] = data["timestamp"];
+    return false;
+}
+
+// Append a reading to the open batch, flushing first if it would go over the
+// reading or byte limit, change format, or repeat a device in a JSON batch
+bool addToPublishBatch(const PublishSnapshot& reading) {
+    if (!mqtt_connected && !publishSink.enabled) {
+        return false;  // Caller stores sensor readings offline
+    }
+    if (publishBatchReadings > 0 &&
+        (publishBatchReadings >= batchMaxReadings || publishBatchFormat != payloadFormat ||
+         (payloadFormat == PAYLOAD_JSON && publishBatchHasDevice(reading.mac)))) {
+        flushPublishBatch();
+    }
     
-    String payload;
-    serializeJson(doc, payload);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (publishBatchReadings == 0) {
+            openPublishBatch();
+        }
+        size_t before = publishBatch.length();
+        if (publishBatchFormat == PAYLOAD_MSGPACK) {
+            writeMsgPackReading(publishBatch, reading);
+        } else {
+            writeJsonBatchEntry(publishBatch, reading);
+        }
+        // Room for the closing brace of a JSON batch
+        size_t closing = publishBatchFormat == PAYLOAD_JSON ? 1 : 0;
+        if (!publishBatch.overflowed() && publishBatch.length() + closing <= batchMaxBytes) {
+            publishBatchMacs[publishBatchReadings] = reading.mac;
+            if (publishBatchReadings++ == 0) {
+                publishBatchOpenedAt = millis();
+            }
+            return true;
+        }
+        // Over the byte limit: take the reading back out, send the rest, retry
+        publishBatch.truncate(before);
+        if (publishBatchReadings == 0) {
+            Serial.println("❌ Reading larger than the batch byte limit");
+            return false;
+        }
+        flushPublishBatch();
+    }
+    return false;
+}
+
+bool publishDeviceData(const PublishSnapshot& reading) {
+    if (batchEnabled) {
+        return addToPublishBatch(reading);
+    }
     
-    bool success = false;
-    if (xSemaphoreTake(mqttMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        success = mqttClient.publish(topic.c_str(), payload.c_str());
-        xSemaphoreGive(mqttMutex);
+    PayloadWriter payload(publishScratch, sizeof(publishScratch));
+    const char* topic;
+    if (payloadFormat == PAYLOAD_MSGPACK) {
+        writeMsgPackReading(payload, reading);
+        topic = topicMsgPackData;
     } else {
-        Serial.println("⚠️  Failed to acquire MQTT mutex for publish");
+        // sensor/data matches the ThingsBoard connector
+        writeJsonReading(payload, reading, device_id.c_str());
+        topic = TOPIC_JSON_DATA;
+    }
+    if (payload.overflowed()) {
+        Serial.println("❌ Device message larger than the publish buffer");
         return false;
     }
     
-    if (success) {
-        Serial.printf("📤 Published to %s (size: %d bytes)\n", topic.c_str(), payload.length());
-        if (isSensor) {
-            Serial.printf("   Device: %s, Temp: %.2f°C, Hum: %.2f%%\n", 
-                         deviceMac.c_str(), 
-                         data["temperature"].as<float>(), 
-                         data["humidity"].as<float>());
+    bool success = publishPayload(topic, payload.data(), payload.length());
+    if (success && !publishSink.enabled) {
+        char macStr[18];
+        formatMac(reading.mac, macStr);
+        Serial.printf("📤 Queued for %s (size: %d bytes)\n", topic, (int)payload.length());
+        if (reading.isSensor) {
+            char tempStr[CENTI_STRING_SIZE], humStr[CENTI_STRING_SIZE];
+            formatCenti(reading.temperatureCenti, tempStr);
+            formatCenti(reading.humidityCenti, humStr);
+            Serial.printf("   Device: %s, Temp: %s°C, Hum: %s%%\n", macStr, tempStr, humStr);
         } else {
-            Serial.printf("   Device: %s (non-sensor, RSSI: %d)\n", 
-                         deviceMac.c_str(), 
-                         data["rssi"].as<int>());
+            Serial.printf("   Device: %s (non-sensor, RSSI: %d)\n", macStr, reading.rssi);
         }
-    } else {
-        Serial.printf("❌ Failed to publish to %s\n", topic.c_str());
-        Serial.printf("   MQTT state: %d (%s)\n", mqttClient.state(), getMQTTStateString(mqttClient.state()));
-        Serial.printf("   Payload size: %d bytes\n", payload.length());
     }
     
     return success;
 }
 
+void loadBatchConfig() {
+    batchEnabled = getConfigUInt(MQTT_NVS_BATCH_ENABLED, 0) != 0;
+    uint32_t readings = getConfigUInt(MQTT_NVS_BATCH_READINGS, batchMaxReadings);
+    uint32_t bytes = getConfigUInt(MQTT_NVS_BATCH_BYTES, batchMaxBytes);
+    uint32_t flushMs = getConfigUInt(MQTT_NVS_BATCH_FLUSH, batchFlushMs);
+    batchMaxReadings = readings < 1 ? 1 : (readings > BATCH_READINGS_MAX ? BATCH_READINGS_MAX : readings);
+    batchMaxBytes = bytes < BATCH_BYTES_MIN ? BATCH_BYTES_MIN : (bytes > BATCH_BYTES_MAX ? BATCH_BYTES_MAX : bytes);
+    batchFlushMs = flushMs < BATCH_FLUSH_MIN_MS ? BATCH_FLUSH_MIN_MS :
+                   (flushMs > BATCH_FLUSH_MAX_MS ? BATCH_FLUSH_MAX_MS : flushMs);
+    Serial.printf("✓ Batch mode: %s (%u readings, %u bytes, flush %ums)\n", batchEnabled ? "on" : "off",
+                 (unsigned)batchMaxReadings, (unsigned)batchMaxBytes, (unsigned)batchFlushMs);
+}
+
+// Handle {"command":"batch","enabled":true,"maxReadings":20,"maxBytes":3072,"flushMs":2000}
+void handleBatchCommand(const JsonDocument& doc) {
+    bool enabled = doc["enabled"] | batchEnabled;
+    uint32_t readings = doc["maxReadings"] | batchMaxReadings;
+    uint32_t bytes = doc["maxBytes"] | batchMaxBytes;
+    uint32_t flushMs = doc["flushMs"] | batchFlushMs;
+    if (readings < 1 || readings > BATCH_READINGS_MAX || bytes < BATCH_BYTES_MIN || bytes > BATCH_BYTES_MAX ||
+        flushMs < BATCH_FLUSH_MIN_MS || flushMs > BATCH_FLUSH_MAX_MS) {
+        Serial.printf("❌ Batch limits: 1-%u readings, %u-%u bytes, flush %u-%ums\n",
+                     BATCH_READINGS_MAX, BATCH_BYTES_MIN, BATCH_BYTES_MAX, BATCH_FLUSH_MIN_MS, BATCH_FLUSH_MAX_MS);
+        return;
+    }
+    
+    // The tracker task owns the open batch and flushes it once it sees the change
+    batchMaxReadings = readings;
+    batchMaxBytes = bytes;
+    batchFlushMs = flushMs;
+    batchEnabled = enabled;
+    
+    bool ok = saveConfigUInt(MQTT_NVS_BATCH_ENABLED, enabled ? 1 : 0) &&
+              saveConfigUInt(MQTT_NVS_BATCH_READINGS, readings) &&
+              saveConfigUInt(MQTT_NVS_BATCH_BYTES, bytes) &&
+              saveConfigUInt(MQTT_NVS_BATCH_FLUSH, flushMs);
+    Serial.printf("%s Batch mode %s (%u readings, %u bytes, flush %ums)\n", ok ? "✓" : "✗",
+                 enabled ? "on" : "off", (unsigned)readings, (unsigned)bytes, (unsigned)flushMs);
+}
+
+void loadPayloadFormatConfig() {
+    initPublishTopics();
+    uint32_t format = getConfigUInt(MQTT_NVS_PAYLOAD_FORMAT, PAYLOAD_JSON);
+    payloadFormat = format < PAYLOAD_FORMAT_COUNT ? (PayloadFormat)format : PAYLOAD_JSON;
+    Serial.printf("✓ Payload format: %s\n", PAYLOAD_FORMAT_NAMES[payloadFormat]);
+}
+
+// Handle {"command":"payload_format","format":"json|msgpack"}
+void handlePayloadFormatCommand(const JsonDocument& doc) {
+    const char* name = doc["format"] | "";
+    uint8_t format = 0;
+    while (format < PAYLOAD_FORMAT_COUNT && strcmp(PAYLOAD_FORMAT_NAMES[format], name) != 0) {
+        format++;
+    }
+    if (format == PAYLOAD_FORMAT_COUNT) {
+        Serial.printf("❌ Unknown payload format: %s\n", name);
+        return;
+    }
+    // An open batch in the old format is flushed by the tracker task
+    payloadFormat = (PayloadFormat)format;
+    bool ok = saveConfigUInt(MQTT_NVS_PAYLOAD_FORMAT, format);
+    Serial.printf("%s Payload format set to %s\n", ok ? "✓" : "✗", PAYLOAD_FORMAT_NAMES[format]);
+}
+
+void addOutboxStats(JsonObject outbox) {
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        JsonObject lane = outbox[OUTBOX_CLASS_NAMES[i]].to<JsonObject>();
+        portENTER_CRITICAL(&mqttOutboxMux);
+        uint32_t depth = mqttOutbox[i].count();
+        uint32_t usedBytes = mqttOutbox[i].usedBytes();
+        uint32_t highWater = mqttOutbox[i].highWater();
+        uint32_t dropped = mqttOutbox[i].dropped();
+        OutboxDropPolicy policy = mqttOutbox[i].policy();
+        uint32_t inFlight = mqttOutbox[i].inFlight();
+        uint8_t qos = mqttOutbox[i].qos();
+        portEXIT_CRITICAL(&mqttOutboxMux);
+        lane["qos"] = qos;
+        lane["depth"] = depth;
+        lane["inFlight"] = inFlight;
+        lane["highWater"] = highWater;
+        lane["bytes"] = usedBytes;
+        lane["capacityBytes"] = mqttOutbox[i].capacityBytes();
+        lane["dropPolicy"] = OUTBOX_DROP_POLICY_NAMES[policy];
+        lane["dropped"] = dropped;
+        lane["sent"] = outboxLatency[i].count();
+        lane["p50Us"] = outboxLatency[i].percentile(50);
+        lane["p99Us"] = outboxLatency[i].percentile(99);
+        lane["maxUs"] = outboxLatency[i].max();
+    }
+}
+
+// Drop policies and QoS are stored as one bit per class (1 = drop oldest, QoS 1)
+void loadOutboxConfig() {
+    uint32_t policyDefaults = 0;
+    uint32_t qosDefaults = 0;
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        policyDefaults |= (uint32_t)mqttOutbox[i].policy() << i;
+        qosDefaults |= (uint32_t)mqttOutbox[i].qos() << i;
+    }
+    uint32_t policyBits = getConfigUInt(MQTT_NVS_OUTBOX_POLICY, policyDefaults);
+    uint32_t qosBits = getConfigUInt(MQTT_NVS_OUTBOX_QOS, qosDefaults);
+    uint32_t window = getConfigUInt(MQTT_NVS_OUTBOX_WINDOW, OUTBOX_WINDOW_DEFAULT);
+    portENTER_CRITICAL(&mqttOutboxMux);
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        mqttOutbox[i].setPolicy((OutboxDropPolicy)((policyBits >> i) & 1));
+        mqttOutbox[i].setQos((qosBits >> i) & 1);
+    }
+    outboxWindow = window < 1 ? 1 : (window > OUTBOX_WINDOW_MAX ? OUTBOX_WINDOW_MAX : window);
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        Serial.printf("✓ Outbox %s: QoS %u, drops %s when full\n", OUTBOX_CLASS_NAMES[i],
+                     (unsigned)((qosBits >> i) & 1), OUTBOX_DROP_POLICY_NAMES[(policyBits >> i) & 1]);
+    }
+    Serial.printf("✓ Outbox QoS 1 window: %u messages\n", (unsigned)outboxWindow);
+}
+
+// Handle {"command":"outbox","class":"telemetry","dropPolicy":"oldest|newest","qos":1,"window":8}
+// dropPolicy and qos apply to `class`; window (QoS 1 messages awaiting
+// PUBACK, shared by all classes) can be sent on its own
+void handleOutboxCommand(const JsonDocument& doc) {
+    const char* className = doc["class"] | "";
+    int outboxClass = 0;
+    while (outboxClass < OUTBOX_CLASS_COUNT && strcmp(OUTBOX_CLASS_NAMES[outboxClass], className) != 0) {
+        outboxClass++;
+    }
+    bool hasClass = outboxClass < OUTBOX_CLASS_COUNT;
+    
+    int policy = -1;
+    if (doc["dropPolicy"].is<const char*>()) {
+        const char* policyName = doc["dropPolicy"];
+        policy = 0;
+        while (policy < OUTBOX_DROP_POLICY_COUNT && strcmp(OUTBOX_DROP_POLICY_NAMES[policy], policyName) != 0) {
+            policy++;
+        }
+    }
+    int qos = doc["qos"] | -1;
+    uint32_t window = doc["window"] | outboxWindow;
+    if (policy == OUTBOX_DROP_POLICY_COUNT || qos > 1 || window < 1 || window > OUTBOX_WINDOW_MAX ||
+        ((policy >= 0 || qos >= 0) && !hasClass)) {
+        Serial.printf("❌ Outbox: class control|telemetry|bulk with dropPolicy newest|oldest and/or qos 0|1; "
+                     "window 1-%u\n", (unsigned)OUTBOX_WINDOW_MAX);
+        return;
+    }
+    
+    uint32_t policyBits = 0;
+    uint32_t qosBits = 0;
+    portENTER_CRITICAL(&mqttOutboxMux);
+    if (policy >= 0) {
+        mqttOutbox[outboxClass].setPolicy((OutboxDropPolicy)policy);
+    }
+    if (qos >= 0) {
+        mqttOutbox[outboxClass].setQos((uint8_t)qos);
+    }
+    outboxWindow = window;
+    for (int i = 0; i < OUTBOX_CLASS_COUNT; i++) {
+        policyBits |= (uint32_t)mqttOutbox[i].policy() << i;
+        qosBits |= (uint32_t)mqttOutbox[i].qos() << i;
+    }
+    portEXIT_CRITICAL(&mqttOutboxMux);
+    
+    bool ok = saveConfigUInt(MQTT_NVS_OUTBOX_POLICY, policyBits) &&
+              saveConfigUInt(MQTT_NVS_OUTBOX_QOS, qosBits) &&
+              saveConfigUInt(MQTT_NVS_OUTBOX_WINDOW, window);
+    if (hasClass) {
+        Serial.printf("%s Outbox %s: QoS %u, drops %s when full\n", ok ? "✓" : "✗", OUTBOX_CLASS_NAMES[outboxClass],
+                     (unsigned)((qosBits >> outboxClass) & 1),
+                     OUTBOX_DROP_POLICY_NAMES[(policyBits >> outboxClass) & 1]);
+    }
+    Serial.printf("%s Outbox QoS 1 window: %u messages\n", ok ? "✓" : "✗", (unsigned)window);
+}
+
 bool publishGatewayStatus() {
     if (!mqtt_connected) {
         Serial.println("⚠️  Cannot publish status: MQTT not connected");
@@ -323,6 +1045,62 @@ bool publishGatewayStatus() {
     doc["freeHeap"] = ESP.getFreeHeap();
     doc["wifiRssi"] = WiFi.RSSI();
     
+    // BLE host stack in use and the heap it took at startup
+    doc["scanBackend"] = scanner.name();
+    doc["scanStackHeap"] = scannerStackHeap;
+    
+    // BLE scan throughput over the last minute
+    doc["advertsPerMin"] = advertsHeardLastMinute;
+    doc["decodedPerMin"] = advertsDecodedLastMinute;
+    
+    doc["scanWindowMs"] = scanScheduler.params().windowMs;
+    doc["scanIntervalMs"] = scanScheduler.params().intervalMs;
+    doc["scanMode"] = scanActive ? "active" : "passive";
+    doc["discoveryBursts"] = discoveryBursts;
+    
+    // Adverts rejected by the MAC allowlist before decoding
+    doc["filterEntries"] = getMacFilterEntryCount();
+    doc["filterRejected"] = macFilterRejected.load();
+    
+    // Identical adverts dropped at ingest vs forwarded to the decoder
+    doc["dedupWindowMs"] = advertDedup.windowMs();
+    doc["dedupHits"] = advertDedup.hits();
+    doc["dedupMisses"] = advertDedup.misses();
+    
+    // Device table occupancy (fixed capacity, no heap)
+    doc["devices"] = getTrackedDeviceCount();
+    doc["deviceCapacity"] = getTrackedDeviceCapacity();
+    doc["deviceBudgetBytes"] = getTrackerBudgetBytes();
+    doc["deviceTableFull"] = deviceTableFull;
+    doc["devicesEvicted"] = devicesEvicted;
+    doc["devicesDiscovered"] = devicesDiscovered;
+    doc["sensorsEvicted"] = sensorsEvicted;
+    doc["publishQueue"] = getPublishQueueLength();
+    doc["batchMessages"] = batchMessages;
+    doc["batchReadings"] = batchReadings;
+    doc["batchDropped"] = batchReadingsDropped;
+    doc["payloadFormat"] = PAYLOAD_FORMAT_NAMES[payloadFormat];
+    doc["publishesDeferred"] = publishesDeferred;
+    doc["compressionRatio"] = getCompressionRatio();
+    doc["lockHoldP99Us"] = deviceMapLockHold.percentile(99);
+    doc["lockHoldMaxUs"] = deviceMapLockHold.max();
+    
+    // BLE callback -> tracker hand-off health
+    doc["advertRingDrops"] = advertRing.droppedCount() + trackerDroppedAdverts;
+    doc["advertRingHighWater"] = advertRing.highWaterMark();
+    
+    // Outbox per priority class: queued messages, drops and enqueue-to-wire latency
+    addOutboxStats(doc["outbox"].to<JsonObject>());
+    doc["outboxSendFailures"] = outboxSendFailures;
+    doc["outboxWindow"] = outboxWindow;
+    doc["pubAcks"] = mqttPlainClient.pubAcks();
+    doc["outboxResent"] = outboxResent;
+    doc["outboxAckTimeouts"] = outboxAckTimeouts;
+    doc["outboxUnmatchedAcks"] = outboxUnmatchedAcks;
+    
+    // Connection state machine: attempts, backoff and the last connect's phases
+    addConnectionStats(doc["mqttConnection"].to<JsonObject>());
+    
     // Add timestamp in milliseconds
     unsigned long long ts_millis = (unsigned long long)current_timestamp * 1000ULL;
     doc["timestamp"] = ts_millis;
@@ -330,27 +1108,35 @@ bool publishGatewayStatus() {
     String payload;
     serializeJson(doc, payload);
     
-    bool success = false;
-    if (xSemaphoreTake(mqttMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        success = mqttClient.publish(topic.c_str(), payload.c_str());
-        xSemaphoreGive(mqttMutex);
-    } else {
-        Serial.println("⚠️  Failed to acquire MQTT mutex for status publish");
-        return false;
-    }
-    
+    bool success = enqueueMqttMessage(OUTBOX_CONTROL, topic.c_str(), payload.c_str());
     if (success) {
-        Serial.printf("📊 Gateway status published (uptime: %lu sec)\n", millis() / 1000);
+        Serial.printf("📊 Gateway status queued (uptime: %lu sec)\n", millis() / 1000);
     } else {
-        Serial.printf("❌ Failed to publish gateway status\n");
-        Serial.printf("   MQTT state: %d (%s)\n", mqttClient.state(), getMQTTStateString(mqttClient.state()));
+        Serial.printf("❌ Failed to queue gateway status\n");
     }
     
     return success;
 }
 
+// Publish a trace replay profile (also printed to serial, since replays may run offline)
+bool publishReplayReport(JsonDocument& report) {
+    report["serialNumber"] = device_id;
+    
+    String payload;
+    serializeJson(report, payload);
+    Serial.printf("📈 Replay report: %s\n", payload.c_str());
+    
+    if (!mqtt_connected) {
+        return false;
+    }
+    return enqueueMqttMessage(OUTBOX_TELEMETRY, "gateway/replay", payload.c_str());
+}
+
+// The publisher task: owns mqttClient, sends the outbox in priority order
+// and wakes as soon as a producer queues something
 void mqttMaintenanceTask(void* parameter) {
     Serial.println("🔄 MQTT Maintenance Task started");
+    loadOutboxConfig();
     
     unsigned long lastStatusSend = 0;
     unsigned long lastDebugOutput = 0;
@@ -362,32 +1148,27 @@ void mqttMaintenanceTask(void* parameter) {
         
         // Periodic debug output
         if (now - lastDebugOutput > DEBUG_INTERVAL) {
-            Serial.printf("\n[MQTT Task] Status check - Connected: %s, State: %d (%s)\n", 
+            Serial.printf("\n[MQTT Task] Status check - Connected: %s (%s), State: %d (%s)\n", 
                          mqtt_connected ? "YES" : "NO", 
+                         MQTT_STATE_NAMES[mqttConnState],
                          mqttClient.state(),
                          getMQTTStateString(mqttClient.state()));
             lastDebugOutput = now;
         }
         
-        if (!mqttClient.connected()) {
-            mqtt_connected = false;
-            Serial.println("\n⚠️  MQTT disconnected, attempting reconnection...");
-            Serial.printf("   Last state: %d (%s)\n", mqttClient.state(), getMQTTStateString(mqttClient.state()));
-            
-            if (connectMQTT()) {
-                mqtt_connected = true;
-                Serial.println("✅ Reconnection successful!");
-            } else {
-                Serial.println("❌ Reconnection failed, will retry in 5 seconds...");
-                vTaskDelay(pdMS_TO_TICKS(5000)); // Wait 5s before retry
-                continue;
-            }
+        // One connection phase per pass; sleep until the next one is due
+        if (!mqttConnectionStep()) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(mqttConnectionWaitMs()));
+            continue;
         }
         
-        // Process MQTT messages
-        if (xSemaphoreTake(mqttMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            mqttClient.loop();
-            xSemaphoreGive(mqttMutex);
+        // Process MQTT messages, then send what producers have queued
+        mqttClient.loop();
+        drainMqttOutbox(OUTBOX_SEND_BUDGET);
+        
+        // Stored offline detections go out only while the bulk class is idle
+        if (offlineReplayPending && getOutboxDepth(OUTBOX_BULK) == 0) {
+            publishOfflineDetections(OFFLINE_REPLAY_CHUNK);
         }
         
         // Send gateway status periodically
@@ -397,7 +1178,8 @@ void mqttMaintenanceTask(void* parameter) {
             lastStatusSend = now;
         }
         
-        vTaskDelay(pdMS_TO_TICKS(100)); // Run every 100ms
+        // Sleep until a message is queued; just yield if a backlog remains
+        ulTaskNotifyTake(pdTRUE, getOutboxDepth() > 0 ? 1 : pdMS_TO_TICKS(OUTBOX_IDLE_WAIT_MS));
     }
     
     // Cleanup on task deletion (publish disconnect message)
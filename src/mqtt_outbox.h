@@ -0,0 +1,271 @@
+/**
+ * MQTT Outbox
+ *
+ * Handles:
+ * - Bounded in-RAM queue of MQTT messages waiting for the publisher task
+ * - Priority classes (control > telemetry > bulk), each with its own byte
+ *   budget so a replay backlog can never crowd out a status or RPC reply
+ * - Per-class drop policy when a class is full: reject the new message (the
+ *   producer keeps it and falls back) or evict the oldest queued ones
+ * - QoS 1 classes keep each message after sending until its PUBACK, and
+ *   rewind to resend the unacknowledged ones after a reconnect
+ *
+ * Each class is a byte ring of variable-length records (header, topic with
+ * its NUL, payload), 4-byte aligned. A record never wraps: if it does not
+ * fit before the end of the ring the tail is skipped as padding. Positions
+ * are free-running uint32 counters, so ring sizes must be powers of two.
+ * Three cursors walk the ring: tail (oldest kept), send (next to write to
+ * the socket) and head (next free byte); records between tail and send are
+ * in flight or acknowledged out of order.
+ * Not thread-safe: the caller serializes access (see mqtt_handler.h).
+ */
+
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+enum OutboxClass : uint8_t {
+    OUTBOX_CONTROL = 0,  // Gateway status, OTA status, RPC responses, connect
+    OUTBOX_TELEMETRY,    // Device messages and batches
+    OUTBOX_BULK,         // Offline replay
+    OUTBOX_CLASS_COUNT
+};
+
+const char* const OUTBOX_CLASS_NAMES[OUTBOX_CLASS_COUNT] = { "control", "telemetry", "bulk" };
+
+enum OutboxDropPolicy : uint8_t {
+    OUTBOX_DROP_NEWEST = 0,  // Reject the message being queued
+    OUTBOX_DROP_OLDEST,      // Evict queued messages until it fits
+    OUTBOX_DROP_POLICY_COUNT
+};
+
+const char* const OUTBOX_DROP_POLICY_NAMES[OUTBOX_DROP_POLICY_COUNT] = { "newest", "oldest" };
+
+const uint8_t OUTBOX_SENT = 0x01;   // Written to the socket at least once (resent with DUP)
+const uint8_t OUTBOX_ACKED = 0x02;  // Done: PUBACK received, or sent at QoS 0
+
+struct OutboxRecord {
+    uint32_t sequence;
+    uint32_t enqueuedUs;
+    uint16_t topicLength;    // Including the NUL, OUTBOX_PADDING for a skipped ring tail
+    uint16_t payloadLength;
+    uint16_t packetId;       // QoS 1 packet id, set when first sent
+    uint8_t flags;           // OUTBOX_SENT, OUTBOX_ACKED
+    uint8_t reserved;
+};
+
+const uint16_t OUTBOX_PADDING = 0xFFFF;
+const uint32_t OUTBOX_FLUSH_MS = 1000;  // How long to wait for the outbox to empty before a reboot
+
+class OutboxLane {
+public:
+    OutboxLane(uint8_t* buffer, uint32_t size, OutboxDropPolicy policy, uint8_t qos)
+        : buffer_(buffer), size_(size), policy_(policy), qos_(qos) {}
+
+    // Bytes a message takes in the ring
+    static uint32_t recordSize(size_t topicLength, size_t payloadLength) {
+        return (uint32_t)((sizeof(OutboxRecord) + topicLength + 1 + payloadLength + 3) & ~(size_t)3);
+    }
+
+    // Copy a message in. Returns false (and counts a drop) if it does not fit
+    // under the lane's policy.
+    bool push(const char* topic, size_t topicLength, const uint8_t* payload, size_t length, uint32_t nowUs) {
+        uint32_t need = recordSize(topicLength, length);
+        if (topicLength + 1 >= OUTBOX_PADDING || length > 0xFFFF || need > size_) {
+            dropped_++;
+            return false;
+        }
+        if (count_ == 0) {
+            head_ = tail_ = send_ = 0;  // Empty: start at the front rather than padding
+        }
+        uint32_t pos = head_ & (size_ - 1);
+        uint32_t skip = size_ - pos < need ? size_ - pos : 0;
+        while (skip + need > freeBytes()) {
+            if (policy_ != OUTBOX_DROP_OLDEST || count_ == 0) {
+                dropped_++;
+                return false;
+            }
+            discardFront();
+            dropped_++;
+            if (count_ == 0) {
+                head_ = tail_ = send_ = 0;
+                pos = 0;
+                skip = 0;
+            }
+        }
+        if (skip > 0) {
+            if (skip >= sizeof(OutboxRecord)) {
+                OutboxRecord padding = {};
+                padding.topicLength = OUTBOX_PADDING;
+                memcpy(buffer_ + pos, &padding, sizeof(padding));
+            }
+            head_ += skip;
+            pos = 0;
+        }
+
+        OutboxRecord record = {};
+        record.sequence = nextSequence_++;
+        record.enqueuedUs = nowUs;
+        record.topicLength = (uint16_t)(topicLength + 1);
+        record.payloadLength = (uint16_t)length;
+        uint8_t* out = buffer_ + pos;
+        memcpy(out, &record, sizeof(record));
+        memcpy(out + sizeof(record), topic, topicLength);
+        out[sizeof(record) + topicLength] = '\0';
+        memcpy(out + sizeof(record) + topicLength + 1, payload, length);
+        head_ += need;
+        count_++;
+        if (count_ > highWater_) {
+            highWater_ = count_;
+        }
+        return true;
+    }
+
+    // Next message to write to the socket, or nullptr if all have been sent.
+    // Topic and payload follow the returned header and stay valid until the
+    // next call that changes the lane.
+    const OutboxRecord* nextToSend() {
+        while (true) {
+            skipPadding(send_);
+            if (send_ == head_) {
+                return nullptr;
+            }
+            OutboxRecord* record = recordAt(send_);
+            if (!(record->flags & OUTBOX_ACKED)) {
+                return record;
+            }
+            send_ += sizeOf(record);  // Acknowledged before a rewind
+        }
+    }
+
+    // The message from nextToSend() went out. At QoS 0 it is done; at QoS 1
+    // it stays in flight as `packetId` until acknowledge(). Nothing happens
+    // if it was evicted while the publisher was sending it.
+    void sent(uint32_t sequence, uint16_t packetId) {
+        OutboxRecord* record = (OutboxRecord*)nextToSend();
+        if (record == nullptr || record->sequence != sequence) {
+            return;
+        }
+        record->flags |= OUTBOX_SENT;
+        send_ += sizeOf(record);
+        if (packetId == 0) {
+            record->flags |= OUTBOX_ACKED;
+        } else {
+            record->packetId = packetId;
+            inFlight_++;
+        }
+        releaseAcked();
+    }
+
+    // Drop the message from nextToSend() without sending it
+    void discard(uint32_t sequence) {
+        sent(sequence, 0);
+    }
+
+    // PUBACK for `packetId`. Returns false if no message here is waiting for it.
+    bool acknowledge(uint16_t packetId) {
+        uint32_t cursor = tail_;
+        while (true) {
+            skipPadding(cursor);
+            if ((int32_t)(send_ - cursor) <= 0) {
+                return false;  // send_ may rest on padding the cursor just skipped
+            }
+            OutboxRecord* record = recordAt(cursor);
+            if (record->packetId == packetId && (record->flags & (OUTBOX_SENT | OUTBOX_ACKED)) == OUTBOX_SENT) {
+                record->flags |= OUTBOX_ACKED;
+                inFlight_--;
+                releaseAcked();
+                return true;
+            }
+            cursor += sizeOf(record);
+        }
+    }
+
+    // Connection lost: everything not acknowledged is sent again
+    void rewind() {
+        releaseAcked();
+        send_ = tail_;
+        inFlight_ = 0;
+    }
+
+    uint32_t count() const { return count_; }
+    uint32_t inFlight() const { return inFlight_; }
+    uint32_t usedBytes() const { return head_ - tail_; }
+    uint32_t capacityBytes() const { return size_; }
+    uint32_t highWater() const { return highWater_; }
+    uint32_t dropped() const { return dropped_; }
+    OutboxDropPolicy policy() const { return policy_; }
+    void setPolicy(OutboxDropPolicy policy) { policy_ = policy; }
+    uint8_t qos() const { return qos_; }
+    void setQos(uint8_t qos) { qos_ = qos; }
+
+private:
+    uint32_t freeBytes() const { return size_ - (head_ - tail_); }
+
+    OutboxRecord* recordAt(uint32_t cursor) const {
+        return (OutboxRecord*)(buffer_ + (cursor & (size_ - 1)));
+    }
+
+    static uint32_t sizeOf(const OutboxRecord* record) {
+        return recordSize(record->topicLength - 1, record->payloadLength);
+    }
+
+    // Move a cursor past ring-end padding
+    void skipPadding(uint32_t& cursor) const {
+        while (cursor != head_) {
+            uint32_t toEnd = size_ - (cursor & (size_ - 1));
+            if (toEnd >= sizeof(OutboxRecord) && recordAt(cursor)->topicLength != OUTBOX_PADDING) {
+                return;
+            }
+            cursor += toEnd;
+        }
+    }
+
+    void discardFront() {
+        skipPadding(tail_);
+        if (count_ == 0) {
+            return;
+        }
+        OutboxRecord* record = recordAt(tail_);
+        if ((int32_t)(send_ - tail_) > 0 && (record->flags & (OUTBOX_SENT | OUTBOX_ACKED)) == OUTBOX_SENT) {
+            inFlight_--;  // Evicted while waiting for its PUBACK
+        }
+        tail_ += sizeOf(record);
+        count_--;
+        if ((int32_t)(send_ - tail_) < 0) {
+            send_ = tail_;
+        }
+    }
+
+    // Free acknowledged messages at the front of the ring
+    void releaseAcked() {
+        while (true) {
+            skipPadding(tail_);
+            if ((int32_t)(send_ - tail_) < 0) {
+                send_ = tail_;
+            }
+            if (count_ == 0 || send_ == tail_ || !(recordAt(tail_)->flags & OUTBOX_ACKED)) {
+                return;
+            }
+            discardFront();
+        }
+    }
+
+    uint8_t* buffer_;
+    uint32_t size_;
+    OutboxDropPolicy policy_;
+    uint8_t qos_;
+    uint32_t head_ = 0;
+    uint32_t tail_ = 0;
+    uint32_t send_ = 0;
+    uint32_t count_ = 0;
+    uint32_t inFlight_ = 0;
+    uint32_t highWater_ = 0;
+    uint32_t dropped_ = 0;
+    uint32_t nextSequence_ = 0;
+};
+
+#endif // MQTT_OUTBOX_H
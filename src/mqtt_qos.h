@@ -0,0 +1,181 @@
+/**
+ * MQTT QoS 1 Link
+ *
+ * Handles:
+ * - QoS 1 PUBLISH packets (packet id, DUP on resend) written to the socket
+ *   directly, since PubSubClient only publishes at QoS 0
+ * - PUBACKs picked out of the inbound stream before PubSubClient, which
+ *   ignores them, gets to read it
+ *
+ * MqttAckTap<WiFiClient> is the socket PubSubClient is given. It follows
+ * MQTT packet framing on the bytes PubSubClient reads and consumes any
+ * PUBACK found at a packet boundary. Everything else passes through, so
+ * CONNECT, SUBSCRIBE, inbound publishes and pings stay with PubSubClient.
+ * Raw reads go through Base::read(buffer, size) only, since the socket's
+ * single-byte read() may itself call the (overridden) buffer read.
+ * Used from the MQTT task only.
+ */
+
+#ifndef MQTT_QOS_H
+#define MQTT_QOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <Client.h>
+
+const uint8_t MQTT_PUBLISH_QOS1 = 0x32;  // PUBLISH, QoS 1, no retain
+const uint8_t MQTT_PUBLISH_DUP = 0x08;
+const uint8_t MQTT_PUBACK = 0x40;
+const size_t MQTT_QOS1_HEADER_MAX = 128;  // Fixed header, topic and packet id in one write
+
+template <typename Base>
+class MqttAckTap : public Base {
+public:
+    typedef void (*PubAckHandler)(uint16_t packetId);
+
+    void onPubAck(PubAckHandler handler) { handler_ = handler; }
+
+    // Consume PUBACKs waiting at the head of the stream. Returns false if a
+    // PUBACK has only partly arrived.
+    bool pollPubAcks() {
+        while (phase_ == PHASE_HEADER && Base::available() > 0 && Base::peek() == MQTT_PUBACK) {
+            if (Base::available() < 4) {
+                return false;
+            }
+            uint8_t packet[4];
+            if (Base::read(packet, sizeof(packet)) != (int)sizeof(packet)) {
+                return false;
+            }
+            pubAcks_++;
+            if (packet[1] == 2 && handler_ != nullptr) {
+                handler_((uint16_t)(packet[2] << 8 | packet[3]));
+            }
+        }
+        return true;
+    }
+
+    uint32_t pubAcks() const { return pubAcks_; }
+
+    using Base::connect;
+
+    int connect(IPAddress ip, uint16_t port) {
+        phase_ = PHASE_HEADER;
+        return Base::connect(ip, port);
+    }
+
+    int connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+        phase_ = PHASE_HEADER;
+        return Base::connect(ip, port, timeoutMs);
+    }
+
+    int connect(const char* host, uint16_t port) {
+        phase_ = PHASE_HEADER;
+        return Base::connect(host, port);
+    }
+
+    int available() {
+        if (!pollPubAcks()) {
+            return 0;  // Hold back the rest of a PUBACK until it is complete
+        }
+        return Base::available();
+    }
+
+    int read() {
+        uint8_t b;
+        return read(&b, 1) == 1 ? b : -1;
+    }
+
+    int read(uint8_t* buffer, size_t size) {
+        size_t count = 0;
+        while (count < size && pollPubAcks() && Base::available() > 0) {
+            // Never read past the end of the current packet, so the next
+            // boundary is seen before its bytes are handed over
+            size_t chunk = size - count;
+            if (phase_ == PHASE_BODY && chunk > remaining_) {
+                chunk = remaining_;
+            } else if (phase_ != PHASE_BODY) {
+                chunk = 1;
+            }
+            int n = Base::read(buffer + count, chunk);
+            if (n <= 0) {
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                track(buffer[count + i]);
+            }
+            count += n;
+        }
+        return count > 0 ? (int)count : -1;
+    }
+
+    int peek() {
+        if (!pollPubAcks()) {
+            return -1;
+        }
+        return Base::peek();
+    }
+
+    void stop() {
+        phase_ = PHASE_HEADER;
+        Base::stop();
+    }
+
+private:
+    enum Phase : uint8_t { PHASE_HEADER, PHASE_LENGTH, PHASE_BODY };
+
+    // Follow packet boundaries in the bytes handed to PubSubClient
+    void track(uint8_t b) {
+        switch (phase_) {
+            case PHASE_HEADER:
+                phase_ = PHASE_LENGTH;
+                remaining_ = 0;
+                shift_ = 0;
+                break;
+            case PHASE_LENGTH:
+                remaining_ |= (uint32_t)(b & 0x7F) << shift_;
+                shift_ += 7;
+                if (!(b & 0x80)) {
+                    phase_ = remaining_ > 0 ? PHASE_BODY : PHASE_HEADER;
+                }
+                break;
+            case PHASE_BODY:
+                if (--remaining_ == 0) {
+                    phase_ = PHASE_HEADER;
+                }
+                break;
+        }
+    }
+
+    PubAckHandler handler_ = nullptr;
+    Phase phase_ = PHASE_HEADER;
+    uint32_t remaining_ = 0;
+    uint8_t shift_ = 0;
+    uint32_t pubAcks_ = 0;
+};
+
+// Write one QoS 1 PUBLISH. `topicLength` excludes the NUL.
+bool writeQos1Publish(Client& client, const char* topic, size_t topicLength, const uint8_t* payload,
+                      size_t length, uint16_t packetId, bool dup) {
+    uint8_t header[MQTT_QOS1_HEADER_MAX];
+    size_t remaining = 2 + topicLength + 2 + length;
+    if (topicLength + 4 + 5 > sizeof(header) || remaining > 268435455) {
+        return false;
+    }
+    size_t pos = 0;
+    header[pos++] = MQTT_PUBLISH_QOS1 | (dup ? MQTT_PUBLISH_DUP : 0);
+    do {
+        uint8_t digit = remaining & 0x7F;
+        remaining >>= 7;
+        header[pos++] = remaining > 0 ? (digit | 0x80) : digit;
+    } while (remaining > 0);
+    header[pos++] = (uint8_t)(topicLength >> 8);
+    header[pos++] = (uint8_t)topicLength;
+    memcpy(header + pos, topic, topicLength);
+    pos += topicLength;
+    header[pos++] = (uint8_t)(packetId >> 8);
+    header[pos++] = (uint8_t)packetId;
+    return client.write(header, pos) == pos && client.write(payload, length) == length;
+}
+
+#endif // MQTT_QOS_H
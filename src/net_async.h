@@ -0,0 +1,167 @@
+/**
+ * Non-blocking Network Steps
+ *
+ * Handles:
+ * - Host name lookups through lwIP's dns_gethostbyname(), answered by a
+ *   callback and polled, instead of WiFi.hostByName() which waits
+ * - TCP connects on a non-blocking socket, polled with a zero-timeout
+ *   select(), instead of WiFiClient::connect() which waits
+ *
+ * Both are started once and then polled on every pass of the caller's loop;
+ * no call waits for the network. One lookup and one connect at a time (the
+ * MQTT task's). A lookup that is abandoned (timed out or restarted) may
+ * still be answered by lwIP later: answers carry the lookup's generation and
+ * stale ones are dropped.
+ */
+
+#ifndef NET_ASYNC_H
+#define NET_ASYNC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <lwip/dns.h>
+#include <lwip/sockets.h>
+#include <lwip/tcpip.h>
+
+enum NetStep : uint8_t {
+    NET_PENDING = 0,  // Poll again
+    NET_DONE,
+    NET_FAILED
+};
+
+// --- DNS ---
+
+std::atomic<uint32_t> dnsLookupGeneration{0};    // Bumped by every start/cancel
+std::atomic<uint32_t> dnsAnsweredGeneration{0};  // Generation of the answer below
+std::atomic<uint32_t> dnsAnswerAddress{0};       // 0 = not found
+uint32_t dnsLookupStartedAt = 0;                 // Caller's task only
+
+// lwIP callback (tcpip thread): publish the answer if it is still wanted
+void onDnsFound(const char* /*name*/, const ip_addr_t* ipaddr, void* arg) {
+    uint32_t generation = (uint32_t)(uintptr_t)arg;
+    if (generation != dnsLookupGeneration.load()) {
+        return;  // Abandoned lookup
+    }
+    uint32_t address = 0;
+    if (ipaddr != nullptr && IP_IS_V4(ipaddr)) {
+        address = ip4_addr_get_u32(ip_2_ip4(ipaddr));
+    }
+    dnsAnswerAddress.store(address);
+    dnsAnsweredGeneration.store(generation);
+}
+
+// Start resolving `host` (IPv4). A lookup still in flight is abandoned.
+void startDnsLookup(const char* host, uint32_t nowMs) {
+    uint32_t generation = dnsLookupGeneration.fetch_add(1) + 1;
+    dnsLookupStartedAt = nowMs;
+
+    ip_addr_t cached;
+#if LWIP_TCPIP_CORE_LOCKING
+    LOCK_TCPIP_CORE();
+#endif
+    err_t err = dns_gethostbyname(host, &cached, onDnsFound, (void*)(uintptr_t)generation);
+#if LWIP_TCPIP_CORE_LOCKING
+    UNLOCK_TCPIP_CORE();
+#endif
+
+    if (err == ERR_OK) {
+        // An address literal or lwIP's own cache: answered already
+        onDnsFound(host, &cached, (void*)(uintptr_t)generation);
+    } else if (err != ERR_INPROGRESS) {
+        onDnsFound(host, nullptr, (void*)(uintptr_t)generation);
+    }
+}
+
+// NET_DONE with the address once answered, NET_FAILED if the name did not
+// resolve or no answer came within timeoutMs
+NetStep pollDnsLookup(uint32_t nowMs, uint32_t timeoutMs, uint32_t& address) {
+    uint32_t generation = dnsLookupGeneration.load();
+    if (dnsAnsweredGeneration.load() == generation) {
+        address = dnsAnswerAddress.load();
+        return address != 0 ? NET_DONE : NET_FAILED;
+    }
+    if (nowMs - dnsLookupStartedAt >= timeoutMs) {
+        dnsLookupGeneration.fetch_add(1);  // A late answer is dropped
+        return NET_FAILED;
+    }
+    return NET_PENDING;
+}
+
+// --- TCP ---
+
+int tcpConnectSocket = -1;      // Caller's task only
+uint32_t tcpConnectStartedAt = 0;
+
+void cancelTcpConnect() {
+    if (tcpConnectSocket >= 0) {
+        close(tcpConnectSocket);
+        tcpConnectSocket = -1;
+    }
+}
+
+// Open a non-blocking socket and start connecting to `address` (IPv4,
+// network byte order). Returns false if the socket could not be started.
+bool startTcpConnect(uint32_t address, uint16_t port, uint32_t nowMs) {
+    cancelTcpConnect();
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = address;
+    server.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr*)&server, sizeof(server)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return false;
+    }
+    tcpConnectSocket = fd;
+    tcpConnectStartedAt = nowMs;
+    return true;
+}
+
+// NET_DONE once connected: `fd` is handed over in blocking mode, with the
+// options WiFiClient::connect() sets and `ioTimeoutMs` as its send/receive
+// timeout. NET_FAILED if refused or not connected within timeoutMs.
+NetStep pollTcpConnect(uint32_t nowMs, uint32_t timeoutMs, uint32_t ioTimeoutMs, int& fd) {
+    if (tcpConnectSocket < 0) {
+        return NET_FAILED;
+    }
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(tcpConnectSocket, &writable);
+    struct timeval noWait = { 0, 0 };
+    int ready = select(tcpConnectSocket + 1, nullptr, &writable, nullptr, &noWait);
+    if (ready == 0) {
+        if (nowMs - tcpConnectStartedAt >= timeoutMs) {
+            cancelTcpConnect();
+            return NET_FAILED;
+        }
+        return NET_PENDING;
+    }
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (ready < 0 || getsockopt(tcpConnectSocket, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        cancelTcpConnect();
+        return NET_FAILED;
+    }
+
+    fd = tcpConnectSocket;
+    tcpConnectSocket = -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+    struct timeval ioTimeout = { (time_t)(ioTimeoutMs / 1000), (suseconds_t)((ioTimeoutMs % 1000) * 1000) };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &ioTimeout, sizeof(ioTimeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &ioTimeout, sizeof(ioTimeout));
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+    return NET_DONE;
+}
+
+#endif // NET_ASYNC_H
@@ -3,8 +3,14 @@
  * 
  * Handles:
  * - Storing LOP001 detections to SPIFFS when offline
- * - Publishing stored detections when connection restored
+ * - Replaying stored detections through the bulk outbox class when the
+ *   connection is restored, a few per publisher pass
  * - SPIFFS file system management
+ *
+ * The tracker task stores and the MQTT task replays, both rewriting
+ * /offline/index.txt and renaming or deleting the numbered files. Every
+ * function that touches them (and the replay cursor) holds
+ * offlineStorageMutex for the whole read-modify-write.
  */
 
 #ifndef OFFLINE_STORAGE_H
@@ -13,17 +19,61 @@
 #include <FS.h>
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
-#include <PubSubClient.h>
+#include "fixed_point.h"
+#include "mqtt_outbox.h"
 
 extern bool mqtt_connected;
 extern String device_id;
-extern PubSubClient mqttClient;
+
+// Forward declaration (mqtt_handler.h)
+bool enqueueMqttMessage(OutboxClass outboxClass, const char* topic, const char* payload);
 
 const int MAX_OFFLINE_RECORDS = 7000;  // Maximum records (~630KB of 896KB SPIFFS)
 const char* OFFLINE_DIR = "/offline";
 const char* OFFLINE_INDEX = "/offline/index.txt";
 
+// Next record to replay. Kept across reconnects so a replay cut short by a
+// disconnect resumes where it stopped; records before it are already gone.
+int offlineReplayNext = 0;
+bool offlineReplayPending = false;
+
+SemaphoreHandle_t offlineStorageMutex = NULL;
+
+void lockOfflineStorage() {
+    xSemaphoreTake(offlineStorageMutex, portMAX_DELAY);
+}
+
+void unlockOfflineStorage() {
+    xSemaphoreGive(offlineStorageMutex);
+}
+
+// Records in the store per the index file (offlineStorageMutex held)
+int readOfflineCountLocked() {
+    int count = 0;
+    if (SPIFFS.exists(OFFLINE_INDEX)) {
+        File indexFile = SPIFFS.open(OFFLINE_INDEX, "r");
+        if (indexFile) {
+            count = indexFile.parseInt();
+            indexFile.close();
+        }
+    }
+    return count;
+}
+
+void writeOfflineCountLocked(int count) {
+    File indexFile = SPIFFS.open(OFFLINE_INDEX, "w");
+    if (indexFile) {
+        indexFile.println(count);
+        indexFile.close();
+    }
+}
+
 void initOfflineStorage() {
+    // Before the tasks start, so it exists even if SPIFFS fails to mount
+    if (offlineStorageMutex == NULL) {
+        offlineStorageMutex = xSemaphoreCreateMutex();
+    }
+
     // Mount SPIFFS
     if (!SPIFFS.begin(true)) {  // true = format on fail
         Serial.println("⚠️  Failed to mount SPIFFS");
@@ -36,14 +86,7 @@ void initOfflineStorage() {
     }
     
     // Count existing records
-    int count = 0;
-    if (SPIFFS.exists(OFFLINE_INDEX)) {
-        File indexFile = SPIFFS.open(OFFLINE_INDEX, "r");
-        if (indexFile) {
-            count = indexFile.parseInt();
-            indexFile.close();
-        }
-    }
+    int count = readOfflineCountLocked();  // No other task running yet
     
     // Show SPIFFS usage
     size_t totalBytes = SPIFFS.totalBytes();
@@ -54,21 +97,15 @@ void initOfflineStorage() {
     Serial.printf("  SPIFFS: %d KB used / %d KB total\n", usedBytes / 1024, totalBytes / 1024);
 }
 
-// Store a LOP001 detection to SPIFFS
-void storeOfflineDetection(const String& macAddress, float temperature, float humidity, int rssi, unsigned long timestamp) {
+// Store a LOP001 detection to SPIFFS. Returns false if it was not stored
+// (online, or the file could not be created).
+bool storeOfflineDetection(const String& macAddress, int16_t temperatureCenti, uint16_t humidityCenti, int rssi, unsigned long timestamp) {
     if (mqtt_connected) {
-        return;  // Don't store if we're online
+        return false;  // Don't store if we're online
     }
     
-    // Read current count
-    int count = 0;
-    if (SPIFFS.exists(OFFLINE_INDEX)) {
-        File indexFile = SPIFFS.open(OFFLINE_INDEX, "r");
-        if (indexFile) {
-            count = indexFile.parseInt();
-            indexFile.close();
-        }
-    }
+    lockOfflineStorage();
+    int count = readOfflineCountLocked();
     
     if (count >= MAX_OFFLINE_RECORDS) {
         Serial.println("⚠️  Offline storage full, dropping oldest record");
@@ -83,13 +120,16 @@ void storeOfflineDetection(const String& macAddress, float temperature, float hu
             SPIFFS.rename(oldName, newName);
         }
         count--;
+        if (offlineReplayNext > 0) {
+            offlineReplayNext--;
+        }
     }
     
     // Create JSON record
     JsonDocument doc;
     doc["mac"] = macAddress;
-    doc["temp"] = temperature;
-    doc["hum"] = humidity;
+    doc["tempCenti"] = temperatureCenti;
+    doc["humCenti"] = humidityCenti;
     doc["rssi"] = rssi;
     doc["ts"] = timestamp;
     
@@ -97,56 +137,54 @@ void storeOfflineDetection(const String& macAddress, float temperature, float hu
     String filename = String(OFFLINE_DIR) + "/" + String(count) + ".json";
     File file = SPIFFS.open(filename, "w");
     if (!file) {
+        unlockOfflineStorage();
         Serial.printf("⚠️  Failed to create file: %s\n", filename.c_str());
-        return;
+        return false;
     }
     
     serializeJson(doc, file);
     file.close();
+    writeOfflineCountLocked(count + 1);
+    unlockOfflineStorage();
     
-    // Update count
-    File indexFile = SPIFFS.open(OFFLINE_INDEX, "w");
-    if (indexFile) {
-        indexFile.println(count + 1);
-        indexFile.close();
-    }
-    
-    Serial.printf("💾 Stored offline: %s (%.2f°C, %.2f%%) [%d/%d records]\n", 
-                 macAddress.c_str(), temperature, humidity, count + 1, MAX_OFFLINE_RECORDS);
+    char tempStr[CENTI_STRING_SIZE], humStr[CENTI_STRING_SIZE];
+    formatCenti(temperatureCenti, tempStr);
+    formatCenti(humidityCenti, humStr);
+    Serial.printf("💾 Stored offline: %s (%s°C, %s%%) [%d/%d records]\n", 
+                 macAddress.c_str(), tempStr, humStr, count + 1, MAX_OFFLINE_RECORDS);
+    return true;
 }
 
-// Publish all stored offline detections
-int publishOfflineDetections() {
+// Queue up to maxRecords stored detections as bulk messages, deleting each
+// once queued. Stops early when the bulk outbox is full; the next call
+// carries on from there. Returns the number queued.
+int publishOfflineDetections(int maxRecords) {
     if (!mqtt_connected) {
         return 0;  // Can't publish if offline
     }
     
-    int count = 0;
-    if (SPIFFS.exists(OFFLINE_INDEX)) {
-        File indexFile = SPIFFS.open(OFFLINE_INDEX, "r");
-        if (indexFile) {
-            count = indexFile.parseInt();
-            indexFile.close();
-        }
-    }
+    // Held for the whole chunk: a store arriving meanwhile waits, at most
+    // maxRecords file reads and deletes
+    lockOfflineStorage();
+    int count = readOfflineCountLocked();
     
-    if (count == 0) {
-        return 0;  // Nothing to publish
+    if (offlineReplayNext == 0 && count > 0) {
+        Serial.printf("\n📤 Replaying %d offline detections...\n", count);
     }
+    int queued = 0;
     
-    Serial.printf("\n📤 Publishing %d offline detections...\n", count);
-    int published = 0;
-    
-    for (int i = 0; i < count; i++) {
-        String filename = String(OFFLINE_DIR) + "/" + String(i) + ".json";
+    while (offlineReplayNext < count && queued < maxRecords) {
+        String filename = String(OFFLINE_DIR) + "/" + String(offlineReplayNext) + ".json";
         
         if (!SPIFFS.exists(filename)) {
+            offlineReplayNext++;
             continue;  // Skip missing files
         }
         
         File file = SPIFFS.open(filename, "r");
         if (!file) {
-            Serial.printf("⚠️  Failed to open file %d\n", i);
+            Serial.printf("⚠️  Failed to open file %d\n", offlineReplayNext);
+            offlineReplayNext++;
             continue;
         }
         
@@ -156,26 +194,32 @@ int publishOfflineDetections() {
         file.close();
         
         if (error) {
-            Serial.printf("⚠️  Failed to parse record %d\n", i);
+            Serial.printf("⚠️  Failed to parse record %d\n", offlineReplayNext);
             SPIFFS.remove(filename);  // Remove corrupt file
+            offlineReplayNext++;
             continue;
         }
         
         // Extract data
         String macAddress = doc["mac"].as<String>();
-        float temperature = doc["temp"];
-        float humidity = doc["hum"];
+        // Records written before fixed-point carry float "temp"/"hum"
+        int32_t temperatureCenti = doc["tempCenti"].is<int>() ? doc["tempCenti"].as<int32_t>()
+                                                              : (int32_t)lroundf(doc["temp"].as<float>() * 100);
+        int32_t humidityCenti = doc["humCenti"].is<int>() ? doc["humCenti"].as<int32_t>()
+                                                          : (int32_t)lroundf(doc["hum"].as<float>() * 100);
+        char tempStr[CENTI_STRING_SIZE], humStr[CENTI_STRING_SIZE];
+        formatCenti(temperatureCenti, tempStr);
+        formatCenti(humidityCenti, humStr);
         int rssi = doc["rssi"];
         unsigned long timestamp = doc["ts"];
         
         // Publish to MQTT (same format as live detections)
-        String topic = "sensor/data";
         JsonDocument pubDoc;
         pubDoc["serialNumber"] = macAddress;
         pubDoc["sensorType"] = "LOP001";
         pubDoc["sensorModel"] = "LOP001";
-        pubDoc["temp"] = String(temperature, 2);
-        pubDoc["hum"] = String(humidity, 2);
+        pubDoc["temp"] = tempStr;
+        pubDoc["hum"] = humStr;
         pubDoc["battery"] = 0;
         pubDoc["rssi"] = rssi;
         pubDoc["gateway"] = device_id;
@@ -185,63 +229,60 @@ int publishOfflineDetections() {
         String payload;
         serializeJson(pubDoc, payload);
         
-        if (mqttClient.publish(topic.c_str(), payload.c_str())) {
-            Serial.printf("   ✓ Published: %s (%.2f°C, %.2f%%)\n", 
-                         macAddress.c_str(), temperature, humidity);
-            published++;
-            SPIFFS.remove(filename);  // Delete after successful publish
-        } else {
-            Serial.printf("   ✗ Failed: %s\n", macAddress.c_str());
-            break;  // Stop if publish fails
+        if (!enqueueMqttMessage(OUTBOX_BULK, "sensor/data", payload.c_str())) {
+            break;  // Bulk outbox full, resume on the next call
         }
-        
-        delay(100);  // Small delay between publishes
+        Serial.printf("   ✓ Queued: %s (%s°C, %s%%)\n", macAddress.c_str(), tempStr, humStr);
+        SPIFFS.remove(filename);  // Delete once queued
+        offlineReplayNext++;
+        queued++;
     }
     
-    // Clear index if all published
-    if (published > 0) {
-        // Reset index to 0
-        File indexFile = SPIFFS.open(OFFLINE_INDEX, "w");
-        if (indexFile) {
-            indexFile.println(0);
-            indexFile.close();
+    // Clear index once every record has been replayed
+    if (offlineReplayNext >= count) {
+        writeOfflineCountLocked(0);
+        if (count > 0) {
+            Serial.printf("✓ Replayed %d offline detections, storage cleared\n", count);
         }
-        Serial.printf("✓ Published %d/%d offline detections, storage cleared\n", published, count);
+        offlineReplayNext = 0;
+        offlineReplayPending = false;
     }
+    unlockOfflineStorage();
     
-    return published;
+    return queued;
 }
 
 // Get count of pending offline records
 int getOfflineRecordCount() {
-    if (!SPIFFS.exists(OFFLINE_INDEX)) {
-        return 0;
-    }
-    
-    File indexFile = SPIFFS.open(OFFLINE_INDEX, "r");
-    if (!indexFile) {
-        return 0;
-    }
-    
-    int count = indexFile.parseInt();
-    indexFile.close();
+    lockOfflineStorage();
+    int count = readOfflineCountLocked();
+    unlockOfflineStorage();
     return count;
 }
 
+// Start replaying stored detections (on MQTT connect)
+void startOfflineReplay() {
+    lockOfflineStorage();
+    int remaining = readOfflineCountLocked() - offlineReplayNext;
+    offlineReplayPending = remaining > 0;
+    unlockOfflineStorage();
+    if (remaining > 0) {
+        Serial.printf("📦 %d offline detections to replay\n", remaining);
+    }
+}
+
 // Clear all offline records (for manual cleanup)
 void clearOfflineStorage() {
-    int count = getOfflineRecordCount();
-    
+    lockOfflineStorage();
+    int count = readOfflineCountLocked();
     for (int i = 0; i < count; i++) {
         String filename = String(OFFLINE_DIR) + "/" + String(i) + ".json";
         SPIFFS.remove(filename);
     }
-    
-    File indexFile = SPIFFS.open(OFFLINE_INDEX, "w");
-    if (indexFile) {
-        indexFile.println(0);
-        indexFile.close();
-    }
+    offlineReplayNext = 0;
+    offlineReplayPending = false;
+    writeOfflineCountLocked(0);
+    unlockOfflineStorage();
     
     Serial.println("✓ Offline storage cleared");
 }
@@ -15,11 +15,28 @@
 #include <Update.h>
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
+#include "mac_filter.h"
+#include "advert_dedup.h"
+#include "pipeline_profiler.h"
+#include "mqtt_outbox.h"
 
 extern String firmware_url;
 extern String device_id;
-extern PubSubClient mqttClient;
-extern SemaphoreHandle_t mqttMutex;
+extern bool mqtt_connected;
+
+// Forward declaration (device_tracker.h)
+void handleTrackerCommand(const JsonDocument& doc);
+void handlePublishModeCommand(const JsonDocument& doc);
+void handleCompressionCommand(const JsonDocument& doc);
+void handlePublishRateCommand(const JsonDocument& doc);
+
+// Forward declaration (mqtt_handler.h)
+void handleBatchCommand(const JsonDocument& doc);
+void handlePayloadFormatCommand(const JsonDocument& doc);
+void handleOutboxCommand(const JsonDocument& doc);
+bool enqueueMqttMessage(OutboxClass outboxClass, const char* topic, const char* payload);
+bool flushMqttOutbox(uint32_t timeoutMs);
+bool saveTrackerSnapshot();
 
 enum OTAState {
     OTA_IDLE,
@@ -35,7 +52,7 @@ int otaProgress = 0;
 String otaError = "";
 
 void publishOTAStatus(const String& status, int progress = 0) {
-    if (!mqttClient.connected()) {
+    if (!mqtt_connected) {
         return;
     }
     
@@ -54,10 +71,10 @@ void publishOTAStatus(const String& status, int progress = 0) {
     String payload;
     serializeJson(doc, payload);
     
-    if (xSemaphoreTake(mqttMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        mqttClient.publish(topic.c_str(), payload.c_str(), false);
-        xSemaphoreGive(mqttMutex);
-    }
+    // OTA runs on the publisher task and holds it until it finishes, so
+    // send the status now rather than after the update
+    enqueueMqttMessage(OUTBOX_CONTROL, topic.c_str(), payload.c_str());
+    flushMqttOutbox(OUTBOX_FLUSH_MS);
 }
 
 bool performOTA(const String& firmwareUrl, int expectedSize = 0) {
@@ -224,6 +241,7 @@ bool performOTA(const String& firmwareUrl, int expectedSize = 0) {
         publishOTAStatus("success", 100);
         
         Serial.println("Rebooting in 3 seconds...");
+        saveTrackerSnapshot();
         delay(3000);
         ESP.restart();
         
@@ -360,8 +378,30 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
             
             if (cmd == "restart") {
                 Serial.println("♻️  Restart command received - rebooting in 1 second...");
+                saveTrackerSnapshot();
+                flushMqttOutbox(OUTBOX_FLUSH_MS);
                 delay(1000);
                 ESP.restart();
+            } else if (cmd == "mac_filter") {
+                handleMacFilterCommand(doc);
+            } else if (cmd == "dedup") {
+                handleDedupCommand(doc);
+            } else if (cmd == "replay") {
+                handleReplayCommand(doc);
+            } else if (cmd == "tracker") {
+                handleTrackerCommand(doc);
+            } else if (cmd == "publish_rate") {
+                handlePublishRateCommand(doc);
+            } else if (cmd == "batch") {
+                handleBatchCommand(doc);
+            } else if (cmd == "payload_format") {
+                handlePayloadFormatCommand(doc);
+            } else if (cmd == "outbox") {
+                handleOutboxCommand(doc);
+            } else if (cmd == "publish_mode") {
+                handlePublishModeCommand(doc);
+            } else if (cmd == "compression") {
+                handleCompressionCommand(doc);
             } else {
                 Serial.printf("⚠️  Unknown command: %s\n", cmd.c_str());
             }
@@ -387,16 +427,10 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
         if (methodName == "echo") {
             String responseTopic = "sensor/" + device_id + "/response/echo/" + requestId;
             
-            bool success = false;
-            if (xSemaphoreTake(mqttMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-                success = mqttClient.publish(responseTopic.c_str(), payloadStr.c_str(), false);
-                xSemaphoreGive(mqttMutex);
-            }
-            
-            if (success) {
-                Serial.printf("✅ RPC response sent to %s\n", responseTopic.c_str());
+            if (enqueueMqttMessage(OUTBOX_CONTROL, responseTopic.c_str(), payloadStr.c_str())) {
+                Serial.printf("✅ RPC response queued for %s\n", responseTopic.c_str());
             } else {
-                Serial.printf("❌ Failed to send RPC response\n");
+                Serial.printf("❌ Failed to queue RPC response\n");
             }
         }
         // Handle other RPC methods as needed
@@ -100,6 +100,8 @@ void handleSerialProvisioning() {
         // REBOOT command
         else if (command.equalsIgnoreCase("REBOOT")) {
             Serial.println("\n[PROVISION] Rebooting device in 2 seconds...\n");
+            saveTrackerSnapshot();
+            flushMqttOutbox(OUTBOX_FLUSH_MS);
             delay(2000);
             ESP.restart();
         }
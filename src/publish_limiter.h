@@ -0,0 +1,98 @@
+/**
+ * Publish Limiter
+ *
+ * Handles:
+ * - Token bucket capping the gateway's device message rate (ratePerMin, burst)
+ * - Random jitter range for publish pass timing, so a fleet rebooted together
+ *   does not publish in lockstep
+ *
+ * Credit is kept in tokens x 60000 so refills at any whole rate per minute
+ * are exact in integers. The bucket starts empty: after boot the backlog
+ * drains at the configured rate instead of as one burst.
+ */
+
+#ifndef PUBLISH_LIMITER_H
+#define PUBLISH_LIMITER_H
+
+#include <stdint.h>
+
+const uint32_t PUBLISH_RATE_DEFAULT_PER_MIN = 600;  // 10 messages/s
+const uint32_t PUBLISH_BURST_DEFAULT = 20;
+const uint32_t PUBLISH_JITTER_DEFAULT_MS = 2000;
+const uint32_t PUBLISH_RATE_MAX_PER_MIN = 60000;
+const uint32_t PUBLISH_BURST_MAX = 1000;
+const uint32_t PUBLISH_JITTER_MAX_MS = 60000;
+
+class PublishLimiter {
+public:
+    static const uint32_t UNLIMITED = 0xFFFFFFFF;
+
+    PublishLimiter() {
+        configure(PUBLISH_RATE_DEFAULT_PER_MIN, PUBLISH_BURST_DEFAULT, PUBLISH_JITTER_DEFAULT_MS);
+        reset(0);
+    }
+
+    // ratePerMin 0 disables limiting
+    void configure(uint32_t ratePerMin, uint32_t burst, uint32_t jitterMs) {
+        ratePerMin_ = ratePerMin;
+        burst_ = burst < 1 ? 1 : burst;
+        jitterMs_ = jitterMs;
+        if (credit_ > capacity()) {
+            credit_ = capacity();
+        }
+    }
+
+    // Empty the bucket and start refilling from `nowMs`
+    void reset(uint32_t nowMs) {
+        credit_ = 0;
+        lastRefill_ = nowMs;
+    }
+
+    // Whole messages that may be sent now
+    uint32_t available(uint32_t nowMs) {
+        if (ratePerMin_ == 0) {
+            return UNLIMITED;
+        }
+        refill(nowMs);
+        return (uint32_t)(credit_ / MS_PER_MIN);
+    }
+
+    void take(uint32_t messages) {
+        uint64_t cost = (uint64_t)messages * MS_PER_MIN;
+        credit_ = cost < credit_ ? credit_ - cost : 0;
+    }
+
+    // Milliseconds until the next whole token (0 if one is available)
+    uint32_t msUntilToken(uint32_t nowMs) {
+        if (available(nowMs) > 0) {
+            return 0;
+        }
+        return (uint32_t)((MS_PER_MIN - credit_ + ratePerMin_ - 1) / ratePerMin_);
+    }
+
+    uint32_t ratePerMin() const { return ratePerMin_; }
+    uint32_t burst() const { return burst_; }
+    uint32_t jitterMs() const { return jitterMs_; }
+
+private:
+    static const uint64_t MS_PER_MIN = 60000;
+
+    uint64_t capacity() const { return (uint64_t)burst_ * MS_PER_MIN; }
+
+    void refill(uint32_t nowMs) {
+        uint32_t elapsed = nowMs - lastRefill_;
+        lastRefill_ = nowMs;
+        credit_ += (uint64_t)elapsed * ratePerMin_;
+        if (credit_ > capacity()) {
+            credit_ = capacity();
+        }
+    }
+
+    uint32_t ratePerMin_;
+    uint32_t burst_;
+    uint32_t jitterMs_;
+    uint64_t credit_ = 0;
+    uint32_t lastRefill_ = 0;
+};
+
+#endif // PUBLISH_LIMITER_H
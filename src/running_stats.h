@@ -0,0 +1,91 @@
+/**
+ * Running Stats
+ *
+ * Handles:
+ * - Constant-memory count/min/max/mean/stddev/first/last over a stream of
+ *   fixed-point integers (centi-units)
+ * - Merging two consecutive windows into one
+ *
+ * Sums are kept as integers relative to the first value, so they are exact:
+ * no cancellation on long windows of near-identical readings, and no float
+ * until the caller formats the result.
+ */
+
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+struct RunningStats {
+    uint32_t count;
+    int32_t first;
+    int32_t last;
+    int32_t min;
+    int32_t max;
+    int64_t sum;         // Of (value - first)
+    int64_t sumSquares;  // Of (value - first)^2
+
+    void reset() {
+        count = 0;
+        first = last = min = max = 0;
+        sum = sumSquares = 0;
+    }
+
+    void add(int32_t value) {
+        if (count == 0) {
+            first = min = max = value;
+        }
+        count++;
+        last = value;
+        int64_t offset = (int64_t)value - first;
+        sum += offset;
+        sumSquares += offset * offset;
+        if (value < min) {
+            min = value;
+        }
+        if (value > max) {
+            max = value;
+        }
+    }
+
+    // Append the window that followed this one, as if its values had been
+    // added here. Exact: its sums are rebased onto this window's first value.
+    void merge(const RunningStats& later) {
+        if (later.count == 0) {
+            return;
+        }
+        if (count == 0) {
+            *this = later;
+            return;
+        }
+        int64_t shift = (int64_t)later.first - first;
+        sumSquares += later.sumSquares + 2 * shift * later.sum + (int64_t)later.count * shift * shift;
+        sum += later.sum + (int64_t)later.count * shift;
+        count += later.count;
+        last = later.last;
+        if (later.min < min) {
+            min = later.min;
+        }
+        if (later.max > max) {
+            max = later.max;
+        }
+    }
+
+    // Mean rounded to the nearest unit
+    int32_t mean() const {
+        return count ? (int32_t)(first + divideRounded(sum, count)) : 0;
+    }
+
+    // Population standard deviation, rounded down to whole units
+    uint32_t stddev() const {
+        if (count < 2) {
+            return 0;
+        }
+        // sqrt(n*S2 - S^2) / n, variance is unchanged by the offset
+        int64_t spread = (int64_t)count * sumSquares - sum * sum;
+        return spread > 0 ? integerSqrt((uint64_t)spread) / count : 0;
+    }
+};
+
+#endif // RUNNING_STATS_H
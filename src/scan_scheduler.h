@@ -0,0 +1,140 @@
+/**
+ * Scan Scheduler
+ *
+ * Handles:
+ * - Learning each device's advertising period from receive timestamps
+ * - Choosing the BLE scan window/interval for a target capture probability
+ * - Leaving radio time for WiFi on the shared 2.4 GHz radio
+ *
+ * Pure decision logic with no Arduino dependencies, so it can be driven by
+ * simulated advert timelines on a host.
+ *
+ * Model: the scanner listens for `window` ms out of every `interval` ms, so an
+ * advert event (sent on all three advertising channels back to back) is heard
+ * with probability duty = window / interval. Advertisers add a random delay to
+ * every event, so events are independent and a device with period P is heard
+ * at least once within the capture horizon H with probability
+ *   1 - (1 - duty)^(H / P)
+ * The scheduler picks the smallest duty that meets the target for the slowest
+ * tracked advertiser, clamped to [SCAN_DUTY_MIN, SCAN_DUTY_MAX].
+ */
+
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <stdint.h>
+#include <math.h>
+
+const float SCAN_CAPTURE_TARGET = 0.99;           // Probability of hearing each device per horizon
+const uint32_t SCAN_CAPTURE_HORIZON_MS = 60000;   // Hear every device at least once a minute
+const uint16_t SCAN_INTERVAL_MS = 100;            // Scan interval (one channel per interval)
+const float SCAN_DUTY_MIN = 0.10;                 // Never drop below 10% listening
+const float SCAN_DUTY_MAX = 0.90;                 // Always leave 10% of airtime to WiFi
+const uint16_t SCAN_WINDOW_HYSTERESIS_MS = 5;     // Ignore window changes smaller than this
+
+// Advertising period learning
+const uint32_t ADV_MIN_GAP_MS = 20;   // Closer receptions are the same event on another channel
+const uint8_t ADV_LONG_GAP_RESET = 8; // Consecutive long gaps before re-learning the period
+
+struct ScanParams {
+    uint16_t intervalMs;
+    uint16_t windowMs;
+};
+
+// Update a device's advertising period estimate with the gap between two
+// receptions. Gaps near the estimate refine it; much longer gaps are missed
+// adverts and are ignored unless they persist (the device slowed down).
+void learnAdvertPeriod(uint32_t& periodMs, uint8_t& longGaps, uint32_t gapMs) {
+    if (gapMs < ADV_MIN_GAP_MS) {
+        return;
+    }
+    if (periodMs == 0) {
+        periodMs = gapMs;
+        longGaps = 0;
+        return;
+    }
+
+    if (gapMs < periodMs) {
+        // Faster than expected: converge quickly (jitter only ever adds delay)
+        periodMs = (periodMs * 3 + gapMs) / 4;
+        longGaps = 0;
+    } else if (gapMs < periodMs + periodMs / 2) {
+        // Normal advertising jitter: drift slowly
+        periodMs += (gapMs - periodMs) / 8;
+        longGaps = 0;
+    } else if (++longGaps >= ADV_LONG_GAP_RESET) {
+        periodMs = gapMs;
+        longGaps = 0;
+    }
+}
+
+class ScanScheduler {
+public:
+    ScanScheduler() {
+        current_.intervalMs = SCAN_INTERVAL_MS;
+        current_.windowMs = (uint16_t)(SCAN_INTERVAL_MS * SCAN_DUTY_MAX);
+        beginEpoch();
+    }
+
+    // Start collecting periods for the next decision
+    void beginEpoch() {
+        slowestPeriodMs_ = 0;
+        devices_ = 0;
+    }
+
+    // Report one tracked device's learned advertising period
+    void observePeriod(uint32_t periodMs) {
+        if (periodMs == 0) {
+            return;
+        }
+        devices_++;
+        if (periodMs > slowestPeriodMs_) {
+            slowestPeriodMs_ = periodMs;
+        }
+    }
+
+    // Listening duty needed to hear a device with this period within the horizon
+    static float requiredDuty(uint32_t periodMs) {
+        if (periodMs == 0) {
+            return SCAN_DUTY_MAX;
+        }
+        float opportunities = (float)SCAN_CAPTURE_HORIZON_MS / periodMs;
+        if (opportunities < 1.0) {
+            return SCAN_DUTY_MAX;  // Can't guarantee a sighting per horizon, listen as much as allowed
+        }
+        return 1.0 - powf(1.0 - SCAN_CAPTURE_TARGET, 1.0 / opportunities);
+    }
+
+    // Choose parameters for the next epoch. Returns true if they changed
+    // enough to be worth restarting the scan.
+    bool decide() {
+        float duty = requiredDuty(slowestPeriodMs_);
+        if (duty < SCAN_DUTY_MIN) duty = SCAN_DUTY_MIN;
+        if (duty > SCAN_DUTY_MAX) duty = SCAN_DUTY_MAX;
+
+        uint16_t window = (uint16_t)(SCAN_INTERVAL_MS * duty + 0.5);
+        int delta = (int)window - (int)current_.windowMs;
+        if (delta < 0) delta = -delta;
+
+        duty_ = duty;
+        if (delta < SCAN_WINDOW_HYSTERESIS_MS) {
+            return false;
+        }
+        current_.intervalMs = SCAN_INTERVAL_MS;
+        current_.windowMs = window;
+        return true;
+    }
+
+    ScanParams params() const { return current_; }
+    float duty() const { return duty_; }
+    uint32_t slowestPeriodMs() const { return slowestPeriodMs_; }
+    uint32_t devices() const { return devices_; }
+
+private:
+    ScanParams current_;
+    float duty_ = SCAN_DUTY_MAX;
+    uint32_t slowestPeriodMs_;
+    uint32_t devices_;
+};
+
+#endif // SCAN_SCHEDULER_H
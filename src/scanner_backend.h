@@ -0,0 +1,47 @@
+/**
+ * Scanner Backend
+ *
+ * Handles:
+ * - The interface between bleScanTask() and a BLE host stack
+ * - The raw advert hand-off signature shared by every advert source
+ *
+ * A backend only has to deliver (address, RSSI, raw payload) tuples to the
+ * ingest function and start/stop a continuous scan. Decoding, dedup and
+ * tracking never see a stack-specific type, so the stacks are interchangeable.
+ *
+ * Backends (select one with a build flag, see platformio.ini):
+ * - scanner_bluedroid.h: Arduino-ESP32 BLEDevice/BLEScan (default)
+ * - scanner_nimble.h:    NimBLE-Arduino, much smaller RAM/flash footprint (SCANNER_BACKEND_NIMBLE)
+ * - scanner_fake.h:      Synthetic adverts, no radio (SCANNER_BACKEND_FAKE)
+ */
+
+#ifndef SCANNER_BACKEND_H
+#define SCANNER_BACKEND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "scan_scheduler.h"
+
+// Raw advert hand-off. `mac` is packed with the first printed octet most
+// significant (see packMac()); `now` is the millis() tick of reception.
+typedef bool (*AdvertIngestFn)(uint64_t mac, int8_t rssi, const uint8_t* payload, size_t length, uint32_t now);
+
+class ScannerBackend {
+public:
+    virtual ~ScannerBackend() {}
+
+    virtual const char* name() const = 0;
+
+    // Bring up the host stack and route every advert (duplicates included) to ingest
+    virtual bool begin(AdvertIngestFn ingest) = 0;
+
+    // Scan type and timing; applied by the next start()
+    virtual void configure(bool active, ScanParams params) = 0;
+
+    // Continuous scan that runs until stop() or until the stack ends it
+    virtual bool start() = 0;
+    virtual void stop() = 0;
+    virtual bool isRunning() const = 0;
+};
+
+#endif // SCANNER_BACKEND_H
@@ -0,0 +1,80 @@
+/**
+ * Bluedroid Scanner Backend
+ *
+ * Handles:
+ * - Continuous streaming scans with the Arduino-ESP32 BLEDevice/BLEScan classes
+ * - Handing raw adverts to the ingest function without parsing them
+ */
+
+#ifndef SCANNER_BLUEDROID_H
+#define SCANNER_BLUEDROID_H
+
+#include <BLEDevice.h>
+#include <BLEScan.h>
+#include <BLEAdvertisedDevice.h>
+#include "scanner_backend.h"
+#include "advert_ring.h"
+
+class BluedroidScanner : public ScannerBackend {
+public:
+    const char* name() const override { return "bluedroid"; }
+
+    bool begin(AdvertIngestFn ingest) override {
+        ingest_ = ingest;
+        BLEDevice::init("BLE-Gateway");
+        scan_ = BLEDevice::getScan();
+
+        // wantDuplicates=true to get all advertisements.
+        // shouldParse=false: the library only copies the raw payload, we parse it ourselves
+        scan_->setAdvertisedDeviceCallbacks(&callbacks_, true, false);
+        return scan_ != nullptr;
+    }
+
+    void configure(bool active, ScanParams params) override {
+        scan_->setActiveScan(active);
+        scan_->setInterval(params.intervalMs);
+        scan_->setWindow(params.windowMs);
+    }
+
+    // Duration 0 keeps the radio scanning continuously, and with a callback
+    // plus wantDuplicates=true the library hands every advert to onResult()
+    // without keeping it in BLEScanResults.
+    bool start() override {
+        scan_->clearResults();
+        running_ = true;
+        if (!scan_->start(0, onScanComplete, false)) {
+            running_ = false;
+        }
+        return running_;
+    }
+
+    void stop() override {
+        scan_->stop();
+        running_ = false;
+    }
+
+    bool isRunning() const override { return running_; }
+
+private:
+    class Callbacks : public BLEAdvertisedDeviceCallbacks {
+        void onResult(BLEAdvertisedDevice advertisedDevice) override {
+            ingest_(packMac(*advertisedDevice.getAddress().getNative()), (int8_t)advertisedDevice.getRSSI(),
+                    advertisedDevice.getPayload(), advertisedDevice.getPayloadLength(), millis());
+        }
+    };
+
+    // Only called if the stack ends the scan (duration 0 never completes on its own)
+    static void onScanComplete(BLEScanResults /*results*/) {
+        running_ = false;
+    }
+
+    static AdvertIngestFn ingest_;
+    static volatile bool running_;
+    BLEScan* scan_ = nullptr;
+    Callbacks callbacks_;
+};
+
+AdvertIngestFn BluedroidScanner::ingest_ = nullptr;
+volatile bool BluedroidScanner::running_ = false;
+
+#endif // SCANNER_BLUEDROID_H
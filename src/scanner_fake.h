@@ -0,0 +1,109 @@
+/**
+ * Fake Scanner Backend
+ *
+ * Handles:
+ * - Synthetic LOP001 adverts from a fixed population of MACs, no radio
+ * - Exercising the ingest/track/publish pipeline at a known load
+ *
+ * Each fake sensor advertises every FAKE_SCANNER_PERIOD_MS with a slowly
+ * drifting temperature, so dedup, change detection and the scan scheduler
+ * see realistic traffic. Build with the seeed_xiao_esp32s3_fake environment.
+ */
+
+#ifndef SCANNER_FAKE_H
+#define SCANNER_FAKE_H
+
+#include "scanner_backend.h"
+
+#ifndef FAKE_SCANNER_DEVICES
+#define FAKE_SCANNER_DEVICES 50
+#endif
+
+#ifndef FAKE_SCANNER_PERIOD_MS
+#define FAKE_SCANNER_PERIOD_MS 1000
+#endif
+
+const uint64_t FAKE_SCANNER_MAC_BASE = 0x02FA4B000000ull;  // Locally administered
+
+class FakeScanner : public ScannerBackend {
+public:
+    const char* name() const override { return "fake"; }
+
+    bool begin(AdvertIngestFn ingest) override {
+        ingest_ = ingest;
+        return true;
+    }
+
+    void configure(bool /*active*/, ScanParams params) override {
+        // Mimic the listening duty: only this share of adverts is "heard"
+        dutyPercent_ = params.intervalMs ? params.windowMs * 100 / params.intervalMs : 100;
+    }
+
+    bool start() override {
+        if (task_ == nullptr) {
+            running_ = true;
+            // Core 1, where the BLE stack callbacks would run
+            if (xTaskCreatePinnedToCore(fakeScanTask, "Fake_Scan", 4096, this, 1, (TaskHandle_t*)&task_, 1) != pdPASS) {
+                task_ = nullptr;
+                running_ = false;
+            }
+        }
+        return running_;
+    }
+
+    void stop() override {
+        running_ = false;
+        while (task_ != nullptr) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+
+    bool isRunning() const override { return running_; }
+
+private:
+    // LOP001 advert: flags, 0x181A service data (temp, humidity), no name
+    static size_t buildAdvert(uint8_t* out, int16_t tempCenti, uint16_t humCenti) {
+        const uint8_t advert[] = {
+            0x02, 0x01, 0x06,
+            0x07, 0x16, 0x1A, 0x18,
+            (uint8_t)tempCenti, (uint8_t)(tempCenti >> 8),
+            (uint8_t)humCenti, (uint8_t)(humCenti >> 8)
+        };
+        memcpy(out, advert, sizeof(advert));
+        return sizeof(advert);
+    }
+
+    static void fakeScanTask(void* parameter) {
+        FakeScanner* self = (FakeScanner*)parameter;
+        const uint32_t slotMs = FAKE_SCANNER_PERIOD_MS / FAKE_SCANNER_DEVICES > 0
+                                ? FAKE_SCANNER_PERIOD_MS / FAKE_SCANNER_DEVICES : 1;
+        uint8_t payload[31];
+        uint32_t sequence = 0;
+
+        while (self->running_) {
+            uint32_t device = sequence % FAKE_SCANNER_DEVICES;
+            uint32_t round = sequence / FAKE_SCANNER_DEVICES;
+            sequence++;
+
+            if ((esp_random() % 100) < self->dutyPercent_) {
+                // Temperature steps by 0.05°C every 10 rounds, offset per device
+                int16_t temp = 2000 + (int16_t)(device * 10) + (int16_t)((round / 10) % 100) * 5;
+                uint16_t hum = 5000 + (uint16_t)(device * 20);
+                size_t length = buildAdvert(payload, temp, hum);
+                int8_t rssi = (int8_t)(-50 - (int)(device % 40));
+                self->ingest_(FAKE_SCANNER_MAC_BASE + device, rssi, payload, length, millis());
+            }
+            vTaskDelay(pdMS_TO_TICKS(slotMs));
+        }
+
+        self->task_ = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+    AdvertIngestFn ingest_ = nullptr;
+    volatile bool running_ = false;
+    volatile uint32_t dutyPercent_ = 100;
+    TaskHandle_t volatile task_ = nullptr;
+};
+
+#endif // SCANNER_FAKE_H
@@ -0,0 +1,68 @@
+/**
+ * NimBLE Scanner Backend
+ *
+ * Handles:
+ * - Continuous streaming scans with NimBLE-Arduino (1.4.x)
+ * - Handing raw adverts to the ingest function without storing scan results
+ *
+ * NimBLE is an observer/central-only host here, so it leaves far more heap
+ * and flash than Bluedroid for the tracker and offline buffers. Build with
+ * the seeed_xiao_esp32s3_nimble environment.
+ */
+
+#ifndef SCANNER_NIMBLE_H
+#define SCANNER_NIMBLE_H
+
+#include <NimBLEDevice.h>
+#include "scanner_backend.h"
+
+class NimBLEScanner : public ScannerBackend {
+public:
+    const char* name() const override { return "nimble"; }
+
+    bool begin(AdvertIngestFn ingest) override {
+        ingest_ = ingest;
+        NimBLEDevice::init("BLE-Gateway");
+        scan_ = NimBLEDevice::getScan();
+
+        // wantDuplicates=true and no controller duplicate filter: every advert reaches the callback.
+        // Max results 0: nothing is kept in NimBLEScanResults
+        scan_->setAdvertisedDeviceCallbacks(&callbacks_, true);
+        scan_->setDuplicateFilter(false);
+        scan_->setMaxResults(0);
+        return scan_ != nullptr;
+    }
+
+    void configure(bool active, ScanParams params) override {
+        scan_->setActiveScan(active);
+        scan_->setInterval(params.intervalMs);
+        scan_->setWindow(params.windowMs);
+    }
+
+    bool start() override {
+        return scan_->start(0, nullptr, false);
+    }
+
+    void stop() override {
+        scan_->stop();
+    }
+
+    bool isRunning() const override { return scan_->isScanning(); }
+
+private:
+    class Callbacks : public NimBLEAdvertisedDeviceCallbacks {
+        void onResult(NimBLEAdvertisedDevice* advertisedDevice) override {
+            // NimBLEAddress converts to the address with the first printed octet most significant
+            ingest_((uint64_t)advertisedDevice->getAddress(), (int8_t)advertisedDevice->getRSSI(),
+                    advertisedDevice->getPayload(), advertisedDevice->getPayloadLength(), millis());
+        }
+    };
+
+    static AdvertIngestFn ingest_;
+    NimBLEScan* scan_ = nullptr;
+    Callbacks callbacks_;
+};
+
+AdvertIngestFn NimBLEScanner::ingest_ = nullptr;
+
+#endif // SCANNER_NIMBLE_H
@@ -0,0 +1,96 @@
+/**
+ * Side Pool
+ *
+ * Handles:
+ * - Per-device state that only some configurations need, kept out of the
+ *   DeviceTable entries (window aggregates, swinging-door state)
+ * - One heap allocation sized by the tracker's device limit, made when the
+ *   feature is turned on and freed when it is turned off
+ *
+ * Entries are handed out from a stack of free uint16 indices, like the
+ * DeviceTable pool; the owning device keeps its index, SIDE_POOL_NONE if it
+ * has none. Not thread safe: the tracker uses it under deviceMapMutex.
+ */
+
+#ifndef SIDE_POOL_H
+#define SIDE_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <utility>
+
+const uint16_t SIDE_POOL_NONE = 0xFFFF;
+
+template <typename Entry>
+class SidePool {
+public:
+    SidePool() {}
+    ~SidePool() { release(); }
+    SidePool(const SidePool&) = delete;
+    SidePool& operator=(const SidePool&) = delete;
+
+    // Room for `capacity` entries, all free; replaces any earlier allocation.
+    // Returns false (and holds nothing) if the memory is not there.
+    bool allocate(size_t capacity) {
+        release();
+        if (capacity == 0 || capacity >= SIDE_POOL_NONE) {
+            return false;
+        }
+        entries_ = (Entry*)malloc(capacity * (sizeof(Entry) + sizeof(uint16_t)));
+        if (entries_ == nullptr) {
+            return false;
+        }
+        free_ = (uint16_t*)(entries_ + capacity);
+        capacity_ = capacity;
+        clear();
+        return true;
+    }
+
+    void release() {
+        free(entries_);
+        entries_ = nullptr;
+        free_ = nullptr;
+        capacity_ = 0;
+        freeCount_ = 0;
+    }
+
+    // Every entry back on the free stack, memory kept
+    void clear() {
+        for (size_t i = 0; i < capacity_; i++) {
+            free_[i] = (uint16_t)(capacity_ - 1 - i);  // Hand out low indices first
+        }
+        freeCount_ = capacity_;
+    }
+
+    // An unused entry (contents undefined), SIDE_POOL_NONE if none is left
+    uint16_t acquire() {
+        return freeCount_ > 0 ? free_[--freeCount_] : SIDE_POOL_NONE;
+    }
+
+    void recycle(uint16_t index) {
+        if (index != SIDE_POOL_NONE) {
+            free_[freeCount_++] = index;
+        }
+    }
+
+    void swap(SidePool& other) {
+        std::swap(entries_, other.entries_);
+        std::swap(free_, other.free_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(freeCount_, other.freeCount_);
+    }
+
+    Entry& at(uint16_t index) { return entries_[index]; }
+    size_t capacity() const { return capacity_; }
+    size_t used() const { return capacity_ - freeCount_; }
+    size_t bytes() const { return capacity_ * (sizeof(Entry) + sizeof(uint16_t)); }
+
+private:
+    Entry* entries_ = nullptr;
+    uint16_t* free_ = nullptr;  // Stack of unused indices, after the entries
+    size_t capacity_ = 0;
+    size_t freeCount_ = 0;
+};
+
+#endif // SIDE_POOL_H
@@ -0,0 +1,176 @@
+/**
+ * Timer Wheel
+ *
+ * Handles:
+ * - One pending deadline per table entry index, no heap allocation
+ * - O(1) schedule/cancel, advance() costs O(expired) plus the ticks passed
+ *
+ * Hierarchical wheel in the style of the classic kernel timer: 256 one-tick
+ * slots, then three levels of 64 slots each 64x coarser (256 ticks, 16384
+ * ticks, 2^20 ticks), so one-second ticks reach about two years. Entries in
+ * a coarse slot are re-filed one level down when the fine wheel wraps.
+ * Nodes are intrusive uint16 links indexed like the DeviceTable pool.
+ *
+ * A fired deadline is only a hint: the callback re-checks the entry and
+ * schedules its next deadline, so deadlines that move later (a device heard
+ * again) never need touching until they fire.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+template <size_t Capacity>
+class TimerWheel {
+    static_assert(Capacity > 0 && Capacity < 0xFFFF, "TimerWheel capacity must fit a uint16 index");
+
+public:
+    static const uint32_t ROOT_BITS = 8;
+    static const uint32_t LEVEL_BITS = 6;
+    static const uint32_t LEVELS = 3;  // Above the root wheel
+    static const uint32_t MAX_DELAY = (1u << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+
+    TimerWheel() {
+        reset(0);
+    }
+
+    // Drop every deadline and restart the clock at `tick`
+    void reset(uint32_t tick) {
+        for (size_t b = 0; b <= FIRING; b++) {
+            heads_[b] = NIL;
+        }
+        for (size_t i = 0; i < Capacity; i++) {
+            bucket_[i] = NONE;
+        }
+        current_ = tick;
+        pending_ = 0;
+    }
+
+    // (Re)schedule `index` to fire at `tick`; past ticks fire on the next advance
+    void schedule(uint16_t index, uint32_t tick) {
+        cancel(index);
+        expires_[index] = (int32_t)(tick - current_) < 0 ? current_ : tick;
+        place(index);
+        pending_++;
+    }
+
+    void cancel(uint16_t index) {
+        if (bucket_[index] == NONE) {
+            return;
+        }
+        unlink(index);
+        pending_--;
+    }
+
+    bool isScheduled(uint16_t index) const { return bucket_[index] != NONE; }
+    size_t pending() const { return pending_; }
+    uint32_t currentTick() const { return current_; }
+
+    // Run the clock up to and including `tick`, calling fn(index) for each
+    // deadline reached. fn may schedule or cancel any index.
+    template <typename Fn>
+    void advance(uint32_t tick, Fn fn) {
+        while ((int32_t)(tick - current_) >= 0) {
+            uint32_t slot = current_ & (ROOT_SIZE - 1);
+            if (slot == 0) {
+                // Fine wheel wrapped: pull the next coarse slot down, level by level
+                for (uint32_t level = 0; level < LEVELS; level++) {
+                    uint32_t levelSlot = (current_ >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+                    cascade(ROOT_SIZE + level * LEVEL_SIZE + levelSlot);
+                    if (levelSlot != 0) {
+                        break;
+                    }
+                }
+            }
+
+            // Move the slot to the firing list first: fn may file entries
+            // back into the slot, or cancel entries of this tick not yet run
+            heads_[FIRING] = heads_[slot];
+            heads_[slot] = NIL;
+            for (uint16_t index = heads_[FIRING]; index != NIL; index = next_[index]) {
+                bucket_[index] = FIRING;
+            }
+            current_++;
+            while (heads_[FIRING] != NIL) {
+                uint16_t index = heads_[FIRING];
+                unlink(index);
+                pending_--;
+                fn(index);
+            }
+        }
+    }
+
+private:
+    static const uint16_t NIL = 0xFFFF;
+    static const uint16_t NONE = 0xFFFF;
+    static const uint32_t ROOT_SIZE = 1u << ROOT_BITS;
+    static const uint32_t LEVEL_SIZE = 1u << LEVEL_BITS;
+    static const size_t BUCKETS = ROOT_SIZE + LEVELS * LEVEL_SIZE;
+    static const uint16_t FIRING = BUCKETS;  // Extra list: the slot advance() is running
+
+    void place(uint16_t index) {
+        uint32_t expires = expires_[index];
+        uint32_t delay = expires - current_;
+        if (delay > MAX_DELAY) {
+            delay = MAX_DELAY;
+            expires = current_ + delay;
+            expires_[index] = expires;
+        }
+
+        uint16_t bucket;
+        if (delay < ROOT_SIZE) {
+            bucket = expires & (ROOT_SIZE - 1);
+        } else {
+            uint32_t level = 0;
+            while (delay >= (1u << (ROOT_BITS + (level + 1) * LEVEL_BITS))) {
+                level++;
+            }
+            uint32_t levelSlot = (expires >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+            bucket = (uint16_t)(ROOT_SIZE + level * LEVEL_SIZE + levelSlot);
+        }
+
+        bucket_[index] = bucket;
+        prev_[index] = NIL;
+        next_[index] = heads_[bucket];
+        if (heads_[bucket] != NIL) {
+            prev_[heads_[bucket]] = index;
+        }
+        heads_[bucket] = index;
+    }
+
+    void unlink(uint16_t index) {
+        uint16_t bucket = bucket_[index];
+        if (prev_[index] != NIL) {
+            next_[prev_[index]] = next_[index];
+        } else {
+            heads_[bucket] = next_[index];
+        }
+        if (next_[index] != NIL) {
+            prev_[next_[index]] = prev_[index];
+        }
+        bucket_[index] = NONE;
+    }
+
+    // Re-file every entry of a coarse bucket relative to the current tick
+    void cascade(size_t bucket) {
+        uint16_t index = heads_[bucket];
+        heads_[bucket] = NIL;
+        while (index != NIL) {
+            uint16_t next = next_[index];
+            place(index);
+            index = next;
+        }
+    }
+
+    uint16_t heads_[BUCKETS + 1];
+    uint16_t prev_[Capacity];
+    uint16_t next_[Capacity];
+    uint16_t bucket_[Capacity];  // Bucket holding the index, NONE if unscheduled
+    uint32_t expires_[Capacity];
+    uint32_t current_;           // Next tick to process
+    size_t pending_;
+};
+
+#endif // TIMER_WHEEL_H
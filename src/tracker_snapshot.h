@@ -0,0 +1,78 @@
+/**
+ * Tracker Snapshot
+ *
+ * Handles:
+ * - Binary record layout for per-device baselines kept across reboots
+ * - Versioned header and CRC32 trailer so a torn or stale file is rejected
+ *
+ * File layout (little endian, as the structs lie in memory):
+ *   SnapshotHeader, count x SnapshotRecord, SnapshotTrailer
+ * The trailer CRC covers the header and every record. Times are stored as
+ * ages at save time, since millis() restarts from zero after a reboot.
+ * Any change to SnapshotRecord must bump TRACKER_SNAPSHOT_VERSION.
+ */
+
+#ifndef TRACKER_SNAPSHOT_H
+#define TRACKER_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+const char* TRACKER_SNAPSHOT_FILE = "/tracker.bin";
+const char* TRACKER_SNAPSHOT_TEMP = "/tracker.tmp";  // Written first, then renamed over the file
+
+const uint32_t TRACKER_SNAPSHOT_MAGIC = 0x314B5254;  // "TRK1"
+const uint16_t TRACKER_SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_NEVER = 0xFFFFFFFF;          // Age of a device never published
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t savedAt;     // Unix seconds at save, 0 if time was not synced
+};
+
+const uint8_t SNAPSHOT_FLAG_SENSOR = 0x01;
+
+struct SnapshotRecord {
+    uint64_t mac;
+    uint8_t format;            // BeaconFormat
+    uint8_t flags;             // SNAPSHOT_FLAG_*
+    int16_t temperatureCenti;  // Change-detection baseline
+    uint16_t humidityCenti;
+    int16_t battery;
+    int16_t rssi;
+    uint16_t reserved;
+    uint32_t advPeriod;
+    uint32_t seenAgeMs;        // Since last heard
+    uint32_t publishAgeMs;     // Since last publish, SNAPSHOT_NEVER if none
+    uint32_t changeAgeMs;      // Since last reported change
+    uint32_t readings;
+    uint32_t publishes;
+};
+
+static_assert(sizeof(SnapshotRecord) == 48, "SnapshotRecord layout changed - bump TRACKER_SNAPSHOT_VERSION");
+
+struct SnapshotTrailer {
+    uint32_t count;
+    uint32_t crc;
+};
+
+// CRC-32 (IEEE 802.3, as zlib), nibble table. Start with crc = 0 and feed
+// consecutive blocks.
+uint32_t snapshotCrc32(uint32_t crc, const void* data, size_t length) {
+    static const uint32_t NIBBLE_TABLE[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t* bytes = (const uint8_t*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ NIBBLE_TABLE[crc & 0x0F];
+        crc = (crc >> 4) ^ NIBBLE_TABLE[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+#endif // TRACKER_SNAPSHOT_H
@@ -0,0 +1,87 @@
+/**
+ * Trace replay runner (native builds only)
+ *
+ * Handles:
+ * - Replaying a recorded advert trace from the development machine's disk
+ *   through ingest, tracker and publish (hostReplayIngest, sink on)
+ * - Printing the on-device replay report: the addPipelineProfile() stage
+ *   latencies plus adverts/sec and heap allocations per advert
+ *
+ *   pio run -e native_replay
+ *   .pio/build/native_replay/program trace.csv
+ *
+ * The trace format is the replay command's (README, "Replay"). Host numbers
+ * rank changes against each other; the device's own replay gives the
+ * absolute ones.
+ */
+
+#include <stdio.h>
+#include <string>
+#include "alloc_counter.h"
+#include "gateway_host.h"
+#include "advert_replay.h"
+
+const char* const REPLAY_RUNNER_TRACE = "/trace.csv";
+
+// Copy the trace into the SPIFFS stand-in, where replayTrace() reads it
+bool loadTrace(const char* hostPath) {
+    FILE* source = fopen(hostPath, "rb");
+    if (source == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", hostPath);
+        return false;
+    }
+    File trace = SPIFFS.open(REPLAY_RUNNER_TRACE, "w");
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), source)) > 0) {
+        trace.write(buffer, length);
+    }
+    fclose(source);
+    trace.close();
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace.csv>\n", argv[0]);
+        return 2;
+    }
+    resetGatewayHost();
+    if (!loadTrace(argv[1])) {
+        return 1;
+    }
+    mqtt_connected = true;
+    publishSink.enabled = true;
+    resetPipelineProfile();
+    uint32_t ringDropsBefore = advertRing.droppedCount();
+
+    File file = SPIFFS.open(REPLAY_RUNNER_TRACE, "r");
+    AllocationScope scope;
+    int64_t start = esp_timer_get_time();
+    ReplayResult result = replayTrace(file, false, hostReplayIngest);
+    runTrackerPass();
+    int64_t elapsedUs = esp_timer_get_time() - start;
+    uint64_t allocations = scope.allocations();
+    uint64_t allocatedBytes = scope.bytes();
+    file.close();
+
+    JsonDocument report;
+    report["file"] = argv[1];
+    report["adverts"] = result.adverts;
+    report["badLines"] = result.rejected;
+    report["elapsedMs"] = (uint32_t)(elapsedUs / 1000);
+    report["advertsPerSec"] = elapsedUs > 0 ? result.adverts * 1e6 / elapsedUs : 0;
+    report["queued"] = result.queued;
+    report["ringDrops"] = advertRing.droppedCount() - ringDropsBefore;
+    report["devices"] = getTrackedDeviceCount();
+    report["sinkMessages"] = publishSink.messages;
+    report["sinkBytes"] = publishSink.bytes;
+    report["allocationsPerAdvert"] = result.adverts ? (double)allocations / result.adverts : 0;
+    report["allocatedBytesPerAdvert"] = result.adverts ? (double)allocatedBytes / result.adverts : 0;
+    addPipelineProfile(report);
+
+    std::string text;
+    serializeJsonPretty(report, text);
+    printf("%s\n", text.c_str());
+    return result.adverts > 0 ? 0 : 1;
+}
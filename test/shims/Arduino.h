@@ -0,0 +1,402 @@
+/**
+ * Arduino core shim (native test builds only)
+ *
+ * Handles:
+ * - String, Print, Stream and Serial over the C++ standard library
+ * - millis()/micros() from a monotonic clock that tests can also step forward
+ * - esp_random(), ESP heap queries and the other calls the gateway headers
+ *   expect from Arduino-ESP32
+ *
+ * Only what the firmware headers use is here. Serial output is dropped unless
+ * hostSerialEcho is set, so test logs stay readable.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HEX 16
+#define DEC 10
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+
+// --- Time ---
+
+// Added to the monotonic clock so tests can jump deadlines without sleeping
+inline std::atomic<uint64_t> hostClockOffsetUs(0);
+
+inline uint64_t hostMonotonicUs() {
+    static const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() +
+           hostClockOffsetUs.load();
+}
+
+inline void hostAdvanceMs(uint32_t ms) {
+    hostClockOffsetUs += (uint64_t)ms * 1000;
+}
+
+inline unsigned long millis() { return (unsigned long)(uint32_t)(hostMonotonicUs() / 1000); }
+inline unsigned long micros() { return (unsigned long)(uint32_t)hostMonotonicUs(); }
+inline void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+inline void yield() {}
+
+// --- Random ---
+
+inline std::mt19937& hostRandomEngine() {
+    static std::mt19937 engine(12345);  // Fixed seed: reproducible runs
+    return engine;
+}
+
+inline void hostRandomSeed(uint32_t seed) { hostRandomEngine().seed(seed); }
+inline uint32_t esp_random() { return (uint32_t)hostRandomEngine()(); }
+inline long random(long howBig) { return howBig > 0 ? (long)(esp_random() % (uint32_t)howBig) : 0; }
+inline long random(long howSmall, long howBig) {
+    return howBig > howSmall ? howSmall + random(howBig - howSmall) : howSmall;
+}
+inline void randomSeed(unsigned long seed) { hostRandomSeed((uint32_t)seed); }
+
+// --- String ---
+
+class String {
+public:
+    String() {}
+    String(const char* text) : s_(text ? text : "") {}
+    String(const std::string& text) : s_(text) {}
+    String(char c) : s_(1, c) {}
+    String(int value, unsigned char base = DEC) : s_(format((long long)value, base)) {}
+    String(unsigned int value, unsigned char base = DEC) : s_(formatUnsigned(value, base)) {}
+    String(unsigned char value, unsigned char base = DEC) : s_(formatUnsigned(value, base)) {}
+    String(long value, unsigned char base = DEC) : s_(format(value, base)) {}
+    String(unsigned long value, unsigned char base = DEC) : s_(formatUnsigned(value, base)) {}
+    String(long long value, unsigned char base = DEC) : s_(format(value, base)) {}
+    String(unsigned long long value, unsigned char base = DEC) : s_(formatUnsigned(value, base)) {}
+    String(float value, unsigned int decimals = 2) : s_(formatFloat(value, decimals)) {}
+    String(double value, unsigned int decimals = 2) : s_(formatFloat(value, decimals)) {}
+
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return (unsigned int)s_.size(); }
+    bool isEmpty() const { return s_.empty(); }
+    bool reserve(unsigned int size) { s_.reserve(size); return true; }
+    char charAt(unsigned int index) const { return index < s_.size() ? s_[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    bool concat(const String& other) { s_ += other.s_; return true; }
+    bool concat(const char* text) { if (!text) return false; s_ += text; return true; }
+    bool concat(const char* text, unsigned int length) { if (!text) return false; s_.append(text, length); return true; }
+    bool concat(char c) { s_ += c; return true; }
+    String& operator+=(const String& other) { concat(other); return *this; }
+    String& operator+=(const char* text) { concat(text); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+    String& operator+=(int value) { concat(String(value)); return *this; }
+    String& operator+=(unsigned int value) { concat(String(value)); return *this; }
+    String& operator+=(long value) { concat(String(value)); return *this; }
+    String& operator+=(unsigned long value) { concat(String(value)); return *this; }
+
+    bool equals(const String& other) const { return s_ == other.s_; }
+    bool equalsIgnoreCase(const String& other) const {
+        return s_.size() == other.s_.size() &&
+               std::equal(s_.begin(), s_.end(), other.s_.begin(),
+                          [](char a, char b) { return tolower((unsigned char)a) == tolower((unsigned char)b); });
+    }
+    bool operator==(const String& other) const { return s_ == other.s_; }
+    bool operator==(const char* text) const { return s_ == (text ? text : ""); }
+    bool operator!=(const String& other) const { return s_ != other.s_; }
+    bool operator!=(const char* text) const { return !(*this == text); }
+    bool operator<(const String& other) const { return s_ < other.s_; }
+
+    bool startsWith(const String& prefix) const { return s_.compare(0, prefix.s_.size(), prefix.s_) == 0; }
+    bool endsWith(const String& suffix) const {
+        return s_.size() >= suffix.s_.size() &&
+               s_.compare(s_.size() - suffix.s_.size(), suffix.s_.size(), suffix.s_) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const { return found(s_.find(c, from)); }
+    int indexOf(const String& text, unsigned int from = 0) const { return found(s_.find(text.s_, from)); }
+    int lastIndexOf(char c) const { return found(s_.rfind(c)); }
+    String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        return from < s_.size() ? String(s_.substr(from, to - from)) : String();
+    }
+
+    void toUpperCase() { for (char& c : s_) c = (char)toupper((unsigned char)c); }
+    void toLowerCase() { for (char& c : s_) c = (char)tolower((unsigned char)c); }
+    void trim() {
+        size_t first = s_.find_first_not_of(" \t\r\n");
+        size_t last = s_.find_last_not_of(" \t\r\n");
+        s_ = first == std::string::npos ? std::string() : s_.substr(first, last - first + 1);
+    }
+    void replace(const String& from, const String& to) {
+        if (from.s_.empty()) return;
+        for (size_t at = s_.find(from.s_); at != std::string::npos; at = s_.find(from.s_, at + to.s_.size())) {
+            s_.replace(at, from.s_.size(), to.s_);
+        }
+    }
+    long toInt() const { return atol(s_.c_str()); }
+    float toFloat() const { return (float)atof(s_.c_str()); }
+
+private:
+    static int found(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+
+    static std::string formatUnsigned(unsigned long long value, unsigned char base) {
+        char text[72];
+        const char* digits = "0123456789abcdefghijklmnopqrstuvwxyz";
+        if (base < 2 || base > 36) base = DEC;
+        int at = sizeof(text) - 1;
+        text[at] = 0;
+        do {
+            text[--at] = digits[value % base];
+            value /= base;
+        } while (value > 0);
+        return std::string(text + at);
+    }
+
+    static std::string format(long long value, unsigned char base) {
+        if (value < 0 && base == DEC) {
+            return "-" + formatUnsigned(0 - (unsigned long long)value, base);
+        }
+        return formatUnsigned((unsigned long long)value, base);
+    }
+
+    static std::string formatFloat(double value, unsigned int decimals) {
+        char text[64];
+        snprintf(text, sizeof(text), "%.*f", (int)decimals, value);
+        return std::string(text);
+    }
+
+    std::string s_;
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, int b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, unsigned int b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, long b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, unsigned long b) { String r(a); r += b; return r; }
+
+// --- Print / Stream ---
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size-- && write(*buffer++)) n++;
+        return n;
+    }
+    size_t write(const char* text) { return text ? write((const uint8_t*)text, strlen(text)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    virtual void flush() {}
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char stackBuffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(stackBuffer, sizeof(stackBuffer), format, args);
+        va_end(args);
+        if (length < 0) return 0;
+        if ((size_t)length < sizeof(stackBuffer)) return write((const uint8_t*)stackBuffer, length);
+        std::string heapBuffer(length + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&heapBuffer[0], heapBuffer.size(), format, args);
+        va_end(args);
+        return write((const uint8_t*)heapBuffer.data(), length);
+    }
+
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(double value, int decimals = 2) { return print(String(value, (unsigned int)decimals)); }
+    size_t println() { return write("\r\n"); }
+    template <class T> size_t println(const T& value) { return print(value) + println(); }
+    template <class T> size_t println(const T& value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeoutMs) { timeoutMs_ = timeoutMs; }
+
+    size_t readBytes(char* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = read();
+            if (c < 0) break;
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+    size_t readBytesUntil(char terminator, char* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = read();
+            if (c < 0 || c == terminator) break;
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+
+    String readStringUntil(char terminator) {
+        String result;
+        for (int c = read(); c >= 0 && c != terminator; c = read()) {
+            result += (char)c;
+        }
+        return result;
+    }
+
+    String readString() {
+        String result;
+        for (int c = read(); c >= 0; c = read()) {
+            result += (char)c;
+        }
+        return result;
+    }
+
+    long parseInt() {
+        int c = peek();
+        while (c >= 0 && c != '-' && !isdigit(c)) {
+            read();
+            c = peek();
+        }
+        bool negative = false;
+        if (c == '-') {
+            negative = true;
+            read();
+        }
+        long value = 0;
+        for (c = peek(); c >= 0 && isdigit(c); c = peek()) {
+            value = value * 10 + (c - '0');
+            read();
+        }
+        return negative ? -value : value;
+    }
+
+protected:
+    unsigned long timeoutMs_ = 1000;
+};
+
+// Echo Serial output to stdout (off by default)
+inline bool hostSerialEcho = false;
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    operator bool() const { return true; }
+    size_t write(uint8_t c) { if (hostSerialEcho) fputc(c, stdout); return 1; }
+    size_t write(const uint8_t* buffer, size_t size) {
+        if (hostSerialEcho) fwrite(buffer, 1, size, stdout);
+        return size;
+    }
+    using Print::write;
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+};
+
+inline HardwareSerial Serial;
+
+// --- IPAddress ---
+
+class IPAddress {
+public:
+    IPAddress() : address_(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : address_((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : address_(address) {}
+
+    operator uint32_t() const { return address_; }
+    uint8_t operator[](int index) const { return (uint8_t)(address_ >> (8 * index)); }
+    bool operator==(const IPAddress& other) const { return address_ == other.address_; }
+
+    bool fromString(const char* text) {
+        unsigned a, b, c, d;
+        char extra;
+        if (sscanf(text, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+            return false;
+        }
+        *this = IPAddress((uint8_t)a, (uint8_t)b, (uint8_t)c, (uint8_t)d);
+        return true;
+    }
+
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(text);
+    }
+
+private:
+    uint32_t address_;  // Network order, as lwIP keeps it
+};
+
+// --- ESP ---
+
+// Largest free block reported by ESP.getMaxAllocHeap(); tests lower it to
+// simulate a fragmented heap
+inline uint32_t hostMaxAllocHeap = 128 * 1024;
+
+class EspClass {
+public:
+    // No fixed heap on a host: report a constant so heap deltas read as zero.
+    // Tests measure allocations with alloc_counter.h instead.
+    uint32_t getFreeHeap() { return 256 * 1024; }
+    uint32_t getMinFreeHeap() { return 256 * 1024; }
+    uint32_t getMaxAllocHeap() { return hostMaxAllocHeap; }
+    uint32_t getHeapSize() { return 320 * 1024; }
+    uint32_t getFreePsram() { return 0; }
+    uint32_t getFreeSketchSpace() { return 0; }
+    void restart() { exit(0); }
+};
+
+inline EspClass ESP;
+
+inline bool psramFound() { return false; }
+inline void* ps_malloc(size_t) { return nullptr; }
+
+typedef enum { ESP_MAC_WIFI_STA = 0 } esp_mac_type_t;
+
+inline int esp_read_mac(uint8_t* mac, esp_mac_type_t) {
+    const uint8_t hostMac[6] = { 0x02, 0x00, 0x00, 0xAB, 0xCD, 0xEF };
+    memcpy(mac, hostMac, sizeof(hostMac));
+    return 0;
+}
+
+#endif // HOST_ARDUINO_H
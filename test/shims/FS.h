@@ -0,0 +1,186 @@
+/**
+ * File system shim (native test builds only)
+ *
+ * Handles:
+ * - An in-memory flat file system with the fs::FS / fs::File calls the
+ *   gateway makes (open, exists, remove, rename, mkdir, usage)
+ * - Concurrent use from several tasks: each call is atomic, like the VFS
+ *   layer on the device
+ * - Optional flash latency per open/exists/remove/rename (hostFsLatencyUs),
+ *   so tests can widen the windows between calls that SPIFFS leaves open
+ */
+
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs {
+
+typedef std::shared_ptr<std::vector<uint8_t>> FileData;
+
+inline uint32_t hostFsLatencyUs = 0;
+
+// Stand-in for the flash access time, taken outside the FS lock
+inline void hostFsLatency() {
+    if (hostFsLatencyUs > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(hostFsLatencyUs));
+    }
+}
+
+inline std::recursive_mutex& hostFsMutex() {
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+class File : public Stream {
+public:
+    File() {}
+    File(const std::string& path, FileData data, bool writable)
+        : path_(path), data_(data), writable_(writable) {}
+
+    operator bool() const { return data_ != nullptr; }
+    const char* name() const { return path_.c_str(); }
+    const char* path() const { return path_.c_str(); }
+    bool isDirectory() const { return false; }
+    void close() { data_.reset(); }
+
+    size_t size() const {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        return data_ ? data_->size() : 0;
+    }
+    size_t position() const { return position_; }
+    bool seek(uint32_t position) {
+        if (!data_ || position > size()) return false;
+        position_ = position;
+        return true;
+    }
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        if (!data_ || !writable_) return 0;
+        if (data_->size() < position_ + size) data_->resize(position_ + size);
+        memcpy(data_->data() + position_, buffer, size);
+        position_ += size;
+        return size;
+    }
+    using Print::write;
+
+    int available() {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        return data_ && position_ < data_->size() ? (int)(data_->size() - position_) : 0;
+    }
+    int read() {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    size_t read(uint8_t* buffer, size_t size) {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        if (!data_ || position_ >= data_->size()) return 0;
+        size_t count = std::min(size, data_->size() - position_);
+        memcpy(buffer, data_->data() + position_, count);
+        position_ += count;
+        return count;
+    }
+    int peek() {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        return data_ && position_ < data_->size() ? (*data_)[position_] : -1;
+    }
+
+private:
+    std::string path_;
+    FileData data_;
+    bool writable_ = false;
+    size_t position_ = 0;
+};
+
+class FS {
+public:
+    File open(const char* path, const char* mode = "r") {
+        hostFsLatency();
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        auto entry = files_.find(path);
+        if (mode[0] == 'r') {
+            if (entry == files_.end()) return File();
+            return File(path, entry->second, mode[1] == '+');
+        }
+        if (mode[0] == 'w' || entry == files_.end()) {
+            // A writer replaces the file; readers still holding the old one keep it
+            files_[path] = std::make_shared<std::vector<uint8_t>>();
+        }
+        File file(path, files_[path], true);
+        if (mode[0] == 'a') file.seek(file.size());
+        return file;
+    }
+    File open(const String& path, const char* mode = "r") { return open(path.c_str(), mode); }
+
+    bool exists(const char* path) {
+        hostFsLatency();
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        return files_.count(path) > 0 || directories_.count(path) > 0;
+    }
+    bool exists(const String& path) { return exists(path.c_str()); }
+
+    bool remove(const char* path) {
+        hostFsLatency();
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        return files_.erase(path) > 0;
+    }
+    bool remove(const String& path) { return remove(path.c_str()); }
+
+    bool rename(const char* from, const char* to) {
+        hostFsLatency();
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        auto entry = files_.find(from);
+        if (entry == files_.end()) return false;
+        FileData data = entry->second;
+        files_.erase(entry);
+        files_[to] = data;
+        return true;
+    }
+    bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+
+    bool mkdir(const char* path) {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        directories_.insert(path);
+        return true;
+    }
+    bool mkdir(const String& path) { return mkdir(path.c_str()); }
+
+    // Test side: drop every file
+    void hostFormat() {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        files_.clear();
+        directories_.clear();
+    }
+
+    size_t fileCount() {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        return files_.size();
+    }
+
+    size_t usedBytes() {
+        std::lock_guard<std::recursive_mutex> lock(hostFsMutex());
+        size_t used = 0;
+        for (const auto& entry : files_) used += entry.second->size();
+        return used;
+    }
+
+private:
+    std::map<std::string, FileData> files_;
+    std::set<std::string> directories_;
+};
+
+} // namespace fs
+
+using fs::File;
+
+#endif // HOST_FS_H
@@ -0,0 +1,79 @@
+/**
+ * Preferences (NVS) shim (native test builds only): an in-memory key/value store.
+ */
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences {
+public:
+    bool begin(const char* name, bool = false) {
+        namespace_ = name;
+        return true;
+    }
+    void end() {}
+    bool clear() {
+        store().erase(namespace_);
+        return true;
+    }
+    bool remove(const char* key) { return values().erase(key) > 0; }
+    bool isKey(const char* key) { return values().count(key) > 0; }
+
+    size_t putBytes(const char* key, const void* data, size_t length) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        values()[key] = std::vector<uint8_t>(bytes, bytes + length);
+        return length;
+    }
+    size_t getBytesLength(const char* key) {
+        auto entry = values().find(key);
+        return entry == values().end() ? 0 : entry->second.size();
+    }
+    size_t getBytes(const char* key, void* buffer, size_t maxLength) {
+        auto entry = values().find(key);
+        if (entry == values().end() || entry->second.size() > maxLength) return 0;
+        memcpy(buffer, entry->second.data(), entry->second.size());
+        return entry->second.size();
+    }
+
+    size_t putString(const char* key, const String& value) {
+        return putBytes(key, value.c_str(), value.length() + 1) > 0 ? value.length() : 0;
+    }
+    String getString(const char* key, const String& defaultValue = String()) {
+        auto entry = values().find(key);
+        return entry == values().end() ? defaultValue : String((const char*)entry->second.data());
+    }
+
+    size_t putUInt(const char* key, uint32_t value) { return putValue(key, value); }
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+    size_t putInt(const char* key, int32_t value) { return putValue(key, value); }
+    int32_t getInt(const char* key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+    size_t putBool(const char* key, bool value) { return putValue(key, (uint8_t)value); }
+    bool getBool(const char* key, bool defaultValue = false) { return getValue(key, (uint8_t)defaultValue) != 0; }
+
+private:
+    typedef std::map<std::string, std::vector<uint8_t>> Values;
+
+    static std::map<std::string, Values>& store() {
+        static std::map<std::string, Values> namespaces;
+        return namespaces;
+    }
+    Values& values() { return store()[namespace_]; }
+
+    template <typename T> size_t putValue(const char* key, T value) { return putBytes(key, &value, sizeof(value)); }
+    template <typename T> T getValue(const char* key, T defaultValue) {
+        auto entry = values().find(key);
+        if (entry == values().end() || entry->second.size() != sizeof(T)) return defaultValue;
+        T value;
+        memcpy(&value, entry->second.data(), sizeof(T));
+        return value;
+    }
+
+    std::string namespace_;
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,131 @@
+/**
+ * PubSubClient shim (native test builds only)
+ *
+ * Handles:
+ * - The connect/subscribe/publish calls the MQTT handler makes, against an
+ *   in-process broker that always accepts (unless told otherwise)
+ * - Recording every QoS 0 publish in `published`, so tests can inspect what
+ *   went out
+ *
+ * QoS 1 publishes bypass PubSubClient (mqtt_qos.h) and show up as raw bytes
+ * in the WiFiClient's `sent` buffer instead.
+ */
+
+#ifndef HOST_PUBSUBCLIENT_H
+#define HOST_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+struct HostMqttMessage {
+    std::string topic;
+    std::vector<uint8_t> payload;
+};
+
+class PubSubClient : public Print {
+public:
+    PubSubClient() {}
+    explicit PubSubClient(Client& client) : client_(&client) {}
+
+    PubSubClient& setServer(IPAddress, uint16_t) { return *this; }
+    PubSubClient& setServer(const char*, uint16_t) { return *this; }
+    PubSubClient& setClient(Client& client) { client_ = &client; return *this; }
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) { callback_ = callback; return *this; }
+    PubSubClient& setKeepAlive(uint16_t) { return *this; }
+    PubSubClient& setSocketTimeout(uint16_t) { return *this; }
+    bool setBufferSize(uint16_t size) { bufferSize_ = size; return true; }
+    uint16_t getBufferSize() { return bufferSize_; }
+
+    bool connect(const char* id) { return connect(id, nullptr, nullptr); }
+    bool connect(const char*, const char*, const char*) {
+        if (client_ == nullptr || !client_->connected()) {
+            state_ = MQTT_CONNECT_FAILED;
+            return false;
+        }
+        state_ = connackCode;
+        return state_ == MQTT_CONNECTED;
+    }
+    void disconnect() {
+        state_ = MQTT_DISCONNECTED;
+        if (client_ != nullptr) client_->stop();
+    }
+    bool connected() {
+        if (state_ == MQTT_CONNECTED && (client_ == nullptr || !client_->connected())) {
+            state_ = MQTT_CONNECTION_LOST;
+        }
+        return state_ == MQTT_CONNECTED;
+    }
+    int state() { return state_; }
+    bool loop() { return connected(); }
+
+    bool subscribe(const char* topic, uint8_t = 0) {
+        if (!connected()) return false;
+        subscriptions.push_back(topic);
+        return true;
+    }
+    bool unsubscribe(const char*) { return connected(); }
+
+    bool publish(const char* topic, const char* payload) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), false);
+    }
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool = false) {
+        if (!connected()) return false;
+        published.push_back({ topic, std::vector<uint8_t>(payload, payload + length) });
+        return true;
+    }
+    bool beginPublish(const char* topic, unsigned int, bool) {
+        if (!connected()) return false;
+        published.push_back({ topic, {} });
+        open_ = true;
+        return true;
+    }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) {
+        if (!open_) return 0;
+        published.back().payload.insert(published.back().payload.end(), buffer, buffer + size);
+        return size;
+    }
+    using Print::write;
+    int endPublish() {
+        open_ = false;
+        return connected() ? 1 : 0;
+    }
+
+    // Test side: deliver an inbound message to the firmware's callback
+    void inject(const char* topic, const char* payload) {
+        if (callback_) {
+            std::string topicCopy(topic);
+            std::vector<uint8_t> payloadCopy(payload, payload + strlen(payload));
+            callback_(&topicCopy[0], payloadCopy.data(), (unsigned int)payloadCopy.size());
+        }
+    }
+
+    int connackCode = MQTT_CONNECTED;  // CONNACK return code the broker answers with
+    std::vector<HostMqttMessage> published;
+    std::vector<std::string> subscriptions;
+
+private:
+    Client* client_ = nullptr;
+    std::function<void(char*, uint8_t*, unsigned int)> callback_;
+    uint16_t bufferSize_ = 256;
+    int state_ = MQTT_DISCONNECTED;
+    bool open_ = false;
+};
+
+#endif // HOST_PUBSUBCLIENT_H
@@ -0,0 +1,23 @@
+/**
+ * SPIFFS shim (native test builds only): the in-memory file system from FS.h.
+ */
+
+#ifndef HOST_SPIFFS_H
+#define HOST_SPIFFS_H
+
+#include <FS.h>
+
+class SPIFFSFS : public fs::FS {
+public:
+    bool begin(bool = false) { return true; }
+    void end() {}
+    bool format() {
+        hostFormat();
+        return true;
+    }
+    size_t totalBytes() { return 896 * 1024; }  // huge_app.csv SPIFFS partition
+};
+
+inline SPIFFSFS SPIFFS;
+
+#endif // HOST_SPIFFS_H
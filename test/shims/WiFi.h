@@ -0,0 +1,136 @@
+/**
+ * WiFi shim (native test builds only)
+ *
+ * Handles:
+ * - WiFi.status() and a host name table behind WiFi.hostByName()
+ * - WiFiClient as an in-memory socket: bytes written land in `sent`, bytes
+ *   queued with deliver() are what the firmware reads
+ * - WiFiClient(fd) adopting a real socket (net_async.h), which it holds
+ *   open until stop(); reads and writes still go through the in-memory side
+ */
+
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <unistd.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+enum wl_status_t {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+};
+
+typedef enum { WIFI_OFF = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+
+class WiFiClient : public Client {
+public:
+    // Result of the next connect(); tests flip it to simulate a refused broker
+    static inline bool acceptConnections = true;
+
+    WiFiClient() {}
+    explicit WiFiClient(int fd) : connected_(true), socket_(new int(fd), closeSocket) {}
+
+    int connect(IPAddress ip, uint16_t port) { return open(ip, port); }
+    int connect(IPAddress ip, uint16_t port, int32_t) { return open(ip, port); }
+    int connect(const char*, uint16_t port) { return open(IPAddress(), port); }
+    int connect(const char*, uint16_t port, int32_t) { return open(IPAddress(), port); }
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) {
+        if (!connected_) return 0;
+        sent.insert(sent.end(), buffer, buffer + size);
+        return size;
+    }
+    int available() { return (int)inbound_.size(); }
+    int read() {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int read(uint8_t* buffer, size_t size) {
+        size_t count = 0;
+        while (count < size && !inbound_.empty()) {
+            buffer[count++] = inbound_.front();
+            inbound_.pop_front();
+        }
+        return count > 0 ? (int)count : -1;
+    }
+    int peek() { return inbound_.empty() ? -1 : inbound_.front(); }
+    void stop() {
+        connected_ = false;
+        inbound_.clear();
+        socket_.reset();
+    }
+    uint8_t connected() { return connected_; }
+    int fd() const { return socket_ ? *socket_ : -1; }
+    operator bool() { return connected_; }
+    int setNoDelay(bool) { return 0; }
+
+    // Test side: bytes the "broker" sends to the firmware
+    void deliver(const uint8_t* data, size_t length) { inbound_.insert(inbound_.end(), data, data + length); }
+
+    std::vector<uint8_t> sent;
+    IPAddress remoteIP;
+    uint16_t remotePort = 0;
+
+private:
+    int open(IPAddress ip, uint16_t port) {
+        stop();
+        remoteIP = ip;
+        remotePort = port;
+        connected_ = acceptConnections;
+        return connected_;
+    }
+
+    static void closeSocket(int* fd) {
+        close(*fd);
+        delete fd;
+    }
+
+    bool connected_ = false;
+    std::deque<uint8_t> inbound_;
+    std::shared_ptr<int> socket_;  // Shared between copies, as on the device
+};
+
+class WiFiClass {
+public:
+    wl_status_t status() { return hostStatus; }
+    int RSSI() { return -60; }
+    IPAddress localIP() { return IPAddress(192, 168, 1, 50); }
+    IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+    IPAddress dnsIP(uint8_t = 0) { return IPAddress(192, 168, 1, 1); }
+    String macAddress() { return String("02:00:00:AB:CD:EF"); }
+    String SSID() { return String("host"); }
+    bool mode(wifi_mode_t) { return true; }
+    wl_status_t begin(const char*, const char* = nullptr) { return hostStatus; }
+    bool disconnect(bool = false) { return true; }
+    void setSleep(bool) {}
+    void setAutoReconnect(bool) {}
+
+    // Looks the name up in hostNames; unknown names fail like an NXDOMAIN
+    int hostByName(const char* name, IPAddress& result) {
+        hostLookups++;
+        auto entry = hostNames.find(name);
+        if (entry == hostNames.end()) {
+            return 0;
+        }
+        result = entry->second;
+        return 1;
+    }
+
+    wl_status_t hostStatus = WL_CONNECTED;
+    std::map<std::string, IPAddress> hostNames;
+    uint32_t hostLookups = 0;
+};
+
+inline WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
@@ -0,0 +1,16 @@
+/**
+ * WiFiClientSecure shim (native test builds only): no TLS, same socket as WiFiClient.
+ */
+
+#ifndef HOST_WIFI_CLIENT_SECURE_H
+#define HOST_WIFI_CLIENT_SECURE_H
+
+#include <WiFi.h>
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setInsecure() {}
+    void setCACert(const char*) {}
+};
+
+#endif // HOST_WIFI_CLIENT_SECURE_H
@@ -0,0 +1,14 @@
+/**
+ * esp_timer shim (native test builds only): microseconds on the host clock.
+ */
+
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <Arduino.h>
+
+inline int64_t esp_timer_get_time() {
+    return (int64_t)hostMonotonicUs();
+}
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,130 @@
+/**
+ * FreeRTOS shim (native test builds only)
+ *
+ * Handles:
+ * - Tasks as detached host threads, mutexes as std::timed_mutex
+ * - portMUX critical sections as spinlocks
+ * - Ticks of 1 ms, matching the firmware's configTICK_RATE_HZ
+ *
+ * Task notifications only wake a task blocked in ulTaskNotifyTake(); there is
+ * no scheduler, priority or core affinity.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// --- Critical sections ---
+
+struct portMUX_TYPE {
+    std::atomic<bool> locked;
+};
+
+#define portMUX_INITIALIZER_UNLOCKED { false }
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+    while (mux->locked.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+    mux->locked.store(false, std::memory_order_release);
+}
+
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+
+// --- Tasks ---
+
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+};
+
+typedef HostTask* TaskHandle_t;
+
+inline HostTask*& hostCurrentTask() {
+    thread_local HostTask* current = nullptr;
+    return current;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+    HostTask*& current = hostCurrentTask();
+    if (current == nullptr) {
+        current = new HostTask();  // The test's main thread, adopted on first use
+    }
+    return current;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*code)(void*), const char*, uint32_t, void* parameter,
+                                          UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    HostTask* task = new HostTask();
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    std::thread([code, parameter, task]() {
+        hostCurrentTask() = task;
+        code(parameter);
+    }).detach();
+    return pdPASS;
+}
+
+// A task returns from its function right after deleting itself, which ends the thread
+inline void vTaskDelete(TaskHandle_t) {}
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline TickType_t xTaskGetTickCount() {
+    static const auto start = std::chrono::steady_clock::now();
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    if (task == nullptr) {
+        return pdFAIL;
+    }
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    HostTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->notified.wait_for(lock, std::chrono::milliseconds(ticks), [task]() { return task->notifications > 0; });
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 4096; }
+
+#endif // HOST_FREERTOS_H
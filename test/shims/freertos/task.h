@@ -0,0 +1,2 @@
+// FreeRTOS task API shim: see FreeRTOS.h
+#include "FreeRTOS.h"
@@ -0,0 +1,76 @@
+/**
+ * lwIP DNS shim (native test builds only)
+ *
+ * Handles:
+ * - dns_gethostbyname() answered from a host name table, asynchronously:
+ *   lookups wait in hostDnsPending until the test calls hostDnsAnswer()
+ * - Address literals answered at once (ERR_OK), as lwIP does
+ */
+
+#ifndef HOST_LWIP_DNS_H
+#define HOST_LWIP_DNS_H
+
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_INPROGRESS -5
+#define ERR_ARG -16
+
+struct ip4_addr {
+    uint32_t addr;
+};
+typedef struct ip4_addr ip4_addr_t;
+typedef ip4_addr_t ip_addr_t;  // IPv4-only build
+
+#define IP_IS_V4(ipaddr) 1
+#define ip_2_ip4(ipaddr) (ipaddr)
+#define ip4_addr_get_u32(ipaddr) ((ipaddr)->addr)
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+
+struct HostDnsQuery {
+    std::string name;
+    dns_found_callback found;
+    void* arg;
+};
+
+inline std::map<std::string, uint32_t> hostDnsRecords;  // Name -> address, network order
+inline std::vector<HostDnsQuery> hostDnsPending;
+inline uint32_t hostDnsQueries = 0;
+
+inline err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg) {
+    if (hostname == nullptr || found == nullptr) {
+        return ERR_ARG;
+    }
+    hostDnsQueries++;
+    struct in_addr literal;
+    if (inet_pton(AF_INET, hostname, &literal) == 1) {
+        addr->addr = literal.s_addr;
+        return ERR_OK;
+    }
+    hostDnsPending.push_back({ hostname, found, callback_arg });
+    return ERR_INPROGRESS;
+}
+
+// Test side: answer every pending lookup from hostDnsRecords (unknown
+// names get the not-found callback)
+inline void hostDnsAnswer() {
+    std::vector<HostDnsQuery> pending;
+    pending.swap(hostDnsPending);
+    for (const HostDnsQuery& query : pending) {
+        auto record = hostDnsRecords.find(query.name);
+        if (record == hostDnsRecords.end()) {
+            query.found(query.name.c_str(), nullptr, query.arg);
+        } else {
+            ip_addr_t address = { record->second };
+            query.found(query.name.c_str(), &address, query.arg);
+        }
+    }
+}
+
+#endif // HOST_LWIP_DNS_H
@@ -0,0 +1,10 @@
+/**
+ * lwIP tcpip shim (native test builds only): no core lock on the host
+ */
+
+#ifndef HOST_LWIP_TCPIP_H
+#define HOST_LWIP_TCPIP_H
+
+#define LWIP_TCPIP_CORE_LOCKING 0
+
+#endif // HOST_LWIP_TCPIP_H
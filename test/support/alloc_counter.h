@@ -0,0 +1,111 @@
+/**
+ * Allocation counter (native test builds only)
+ *
+ * Handles:
+ * - Counting every operator new and malloc/calloc/realloc made by the
+ *   process, so tests can assert that a code path allocates nothing
+ *
+ * Replaces the global allocation functions: include it from exactly one
+ * translation unit (each test suite is one). malloc and friends are only
+ * hooked on glibc, where they can forward to __libc_malloc; elsewhere only
+ * operator new is counted.
+ */
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+struct AllocationCounts {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+std::atomic<uint64_t> hostAllocations(0);
+std::atomic<uint64_t> hostAllocatedBytes(0);
+
+inline void countAllocation(size_t size) {
+    hostAllocations.fetch_add(1, std::memory_order_relaxed);
+    hostAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+inline AllocationCounts allocationCounts() {
+    return { hostAllocations.load(), hostAllocatedBytes.load() };
+}
+
+// Allocations made since construction
+class AllocationScope {
+public:
+    AllocationScope() : start_(allocationCounts()) {}
+
+    uint64_t allocations() const { return hostAllocations.load() - start_.allocations; }
+    uint64_t bytes() const { return hostAllocatedBytes.load() - start_.bytes; }
+
+private:
+    AllocationCounts start_;
+};
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void __libc_free(void* pointer);
+
+void* malloc(size_t size) {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer) {
+    __libc_free(pointer);
+}
+}
+#define HOST_RAW_MALLOC __libc_malloc
+#define HOST_RAW_FREE __libc_free
+#else
+#define HOST_RAW_MALLOC malloc
+#define HOST_RAW_FREE free
+#endif
+
+void* operator new(size_t size) {
+    countAllocation(size);
+    void* pointer = HOST_RAW_MALLOC(size ? size : 1);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    countAllocation(size);
+    return HOST_RAW_MALLOC(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* pointer) noexcept { HOST_RAW_FREE(pointer); }
+void operator delete[](void* pointer) noexcept { HOST_RAW_FREE(pointer); }
+void operator delete(void* pointer, size_t) noexcept { HOST_RAW_FREE(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { HOST_RAW_FREE(pointer); }
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,43 @@
+/**
+ * Micro-benchmark helpers (native test builds only)
+ *
+ * Handles:
+ * - Timing a callable over many iterations on the host's steady clock
+ * - Printing one "[bench]" line per result, so runs can be diffed
+ *
+ * Host numbers only rank alternatives against each other; absolute times on
+ * the ESP32-S3 are several times higher. Run `pio test -e native -v` to see
+ * the output.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+
+// Results are folded in here so the optimizer keeps the measured work
+volatile uint64_t benchSink = 0;
+
+template <typename Fn>
+double benchNsPerOp(const char* name, uint32_t iterations, Fn fn) {
+    // Warm caches and branch predictors first
+    for (uint32_t i = 0; i < iterations / 10 + 1; i++) {
+        fn(i);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        fn(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / iterations;
+    printf("[bench] %-44s %10.1f ns/op\n", name, ns);
+    return ns;
+}
+
+void benchReport(const char* name, double value, const char* unit) {
+    printf("[bench] %-44s %10.1f %s\n", name, value, unit);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,175 @@
+/**
+ * Gateway host harness (native test builds only)
+ *
+ * Handles:
+ * - Building the ingest -> track -> publish chain (config_manager through
+ *   ble_scanner, in main.cpp's order) against the shims in test/shims
+ * - The globals main.cpp would define, and a reset between tests
+ *
+ * The fake scanner backend is selected (SCANNER_BACKEND_FAKE in the native
+ * environment), so no BLE stack is needed. Tests call ingestAdvert() and the
+ * tracker steps (drainAdvertRing, serviceDeviceTimers, publishPendingDevices)
+ * directly instead of starting tasks.
+ */
+
+#ifndef GATEWAY_HOST_H
+#define GATEWAY_HOST_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <WiFiClientSecure.h>
+#include <Preferences.h>
+#include <ArduinoJson.h>
+#include <new>
+#include <vector>
+
+#define FIRMWARE_VERSION "host"
+#define FIRMWARE_TITLE "BLE-Gateway-Host"
+
+void startTasks() {}
+void stopTasks() {}
+
+// Commands are not under test here (ota_manager.h owns the real callback)
+void mqttCallback(char*, byte*, unsigned int) {}
+
+#include "config_manager.h"
+#include "offline_storage.h"
+#include "mqtt_handler.h"
+#include "device_tracker.h"
+#include "ble_scanner.h"
+
+String wifi_ssid = "";
+String wifi_password = "";
+String mqtt_host = "broker.test";
+String mqtt_user = "";
+String mqtt_password = "";
+String device_id = "020000ABCDEF";
+String device_token = "";
+bool wifi_connected = true;
+bool mqtt_connected = false;
+bool config_mode = false;
+bool time_synced = true;
+unsigned long current_timestamp = 1700000000;
+
+String company = "";
+String development = "";
+String firmware_url = "";
+
+TaskHandle_t bleTaskHandle = NULL;
+TaskHandle_t mqttTaskHandle = NULL;
+TaskHandle_t wifiTaskHandle = NULL;
+TaskHandle_t trackerTaskHandle = NULL;
+
+SemaphoreHandle_t deviceMapMutex = NULL;
+
+MqttAckTap<WiFiClient> mqttPlainClient;
+PubSubClient mqttClient(mqttPlainClient);
+
+// One-time setup, as setup() does before starting the tasks
+void initGatewayHost() {
+    if (deviceMapMutex == NULL) {
+        deviceMapMutex = xSemaphoreCreateMutex();
+        initConfigManager();
+        initOfflineStorage();
+        initPublishTopics();
+    }
+}
+
+template <typename T>
+void resetHostGlobal(T& object) {
+    object.~T();
+    new (&object) T();
+}
+
+// Back to a freshly booted gateway: empty table, queues, caches and
+// counters, publishing to the in-process sink with no rate limit
+void resetGatewayHost() {
+    initGatewayHost();
+
+    int64_t lockedAt;
+    lockDeviceMap(lockedAt);
+    std::vector<uint64_t> macs;
+    deviceTable.forEach([&](TrackedDevice& device) { macs.push_back(device.mac); });
+    for (uint64_t mac : macs) {
+        forgetDeviceLocked(*deviceTable.find(mac));
+    }
+    uint16_t index;
+    while (dirtyDevices.pop(index) || routineDevices.pop(index)) {
+    }
+    unlockDeviceMap(lockedAt);
+
+    AdvertRecord record;
+    while (advertRing.popBatch(&record, 1) > 0) {
+    }
+    resetHostGlobal(advertDedup);
+    resetHostGlobal(identityCache);
+    installMacFilter(nullptr);
+    resetCompressionPolicies();  // As loadCompressionPolicies() with nothing saved
+
+    deviceTableFull = 0;
+    devicesEvicted = 0;
+    devicesDiscovered = 0;
+    sensorsEvicted = 0;
+    trackerReadings = 0;
+    trackerPublishes = 0;
+    publishesDeferred = 0;
+    trackerDeviceLimit = MAX_TRACKED_DEVICES;
+    trackerPinnedFormats = 0;
+    trackerPublishMode = PUBLISH_MODE_CHANGE;
+    publishLimiter.configure(0, 1, 0);
+    publishRatePending.store(false);
+
+    for (OutboxLane& lane : mqttOutbox) {
+        const OutboxRecord* next;
+        while ((next = lane.nextToSend()) != nullptr) {
+            lane.discard(next->sequence);
+        }
+    }
+    payloadFormat = PAYLOAD_JSON;
+    batchEnabled = false;
+    publishBatchReadings = 0;
+    batchMessages = 0;
+    batchReadings = 0;
+
+    resetPipelineProfile();
+    publishSink.enabled = true;
+    publishSink.messages = 0;
+    publishSink.bytes = 0;
+    mqtt_connected = false;
+    mqttClient.published.clear();
+    SPIFFS.hostFormat();
+
+    lockDeviceMap(lockedAt);
+    resizeDevicePoolsLocked();  // Change mode, no swinging doors: both pools freed
+    unlockDeviceMap(lockedAt);
+}
+
+// Switch publish mode as the publish_mode command does (allocates the window pool)
+void setHostPublishMode(PublishMode mode) {
+    int64_t lockedAt;
+    lockDeviceMap(lockedAt);
+    setPublishModeLocked(mode);
+    unlockDeviceMap(lockedAt);
+}
+
+// Drain everything queued so far through the tracker and run one publish
+// pass, as one turn of deviceTrackerTask would
+void runTrackerPass() {
+    while (drainAdvertRing() > 0) {
+    }
+    serviceDeviceTimers();
+    publishPendingDevices();
+}
+
+// Ingest function for replays: runs the tracker whenever the ring fills up,
+// standing in for the tracker task. Ingest latency is profiled as on the device.
+bool hostReplayIngest(uint64_t mac, int8_t rssi, const uint8_t* payload, size_t length, uint32_t now) {
+    bool queued = profiledIngestAdvert(mac, rssi, payload, length, now);
+    if (advertRing.size() >= ADVERT_RING_SIZE / 4) {
+        runTrackerPass();
+    }
+    return queued;
+}
+
+#endif // GATEWAY_HOST_H
@@ -0,0 +1,349 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "alloc_counter.h"
+#include "bench.h"
+#include "beacon_decoders.h"
+
+// LOP001 advert plus scan response: flags, 0x181A service data, name
+const uint8_t LOP001_PAYLOAD[] = {
+    0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11,
+    0x07, 0x09, 'L', 'O', 'P', '0', '0', '1'
+};
+
+// An advert that is not a LOP001: flags, manufacturer data, name
+const uint8_t OTHER_PAYLOAD[] = {
+    0x02, 0x01, 0x06, 0x09, 0xFF, 0x4C, 0x00, 0x10, 0x05, 0x01, 0x18, 0x2B, 0x6A,
+    0x05, 0x09, 'P', 'h', 'o', 'n'
+};
+
+const uint8_t SCANNER_ADDRESS[6] = { 0xE0, 0x7D, 0xEA, 0x00, 0x00, 0x01 };
+
+// Structures nextADStructure() walks, as (type, length) pairs
+std::vector<std::pair<uint8_t, uint8_t>> walk(const uint8_t* payload, size_t length) {
+    std::vector<std::pair<uint8_t, uint8_t>> found;
+    size_t pos = 0;
+    ADStructure ad;
+    while (nextADStructure(payload, length, pos, ad)) {
+        // Every value returned lies inside the payload
+        TEST_ASSERT_TRUE(ad.value >= payload && ad.value + ad.length <= payload + length);
+        found.push_back({ ad.type, ad.length });
+    }
+    return found;
+}
+
+// --- The path before the raw parser, modeled on the host ---
+//
+// What the Arduino BLE library and the old ble_scanner.h callback did per
+// advert: BLEAdvertisedDevice::parseAdvertisement() copies each field into
+// a std::string, onResult() receives the device by value, and parseLOP001()
+// compares names and UUIDs as strings.
+
+struct LegacyAdvertisedDevice {
+    uint8_t address[6];
+    int rssi;
+    bool haveName = false;
+    std::string name;
+    bool haveServiceData = false;
+    uint16_t serviceDataUuid = 0;
+    std::string serviceData;
+    bool haveManufacturerData = false;
+    std::string manufacturerData;
+    std::vector<uint16_t> serviceUuids;
+    std::string payload;
+};
+
+LegacyAdvertisedDevice legacyParseAdvertisement(const uint8_t* payload, size_t length, int rssi) {
+    LegacyAdvertisedDevice device;
+    memcpy(device.address, SCANNER_ADDRESS, sizeof(device.address));
+    device.rssi = rssi;
+    device.payload.assign((const char*)payload, length);
+    size_t pos = 0;
+    while (pos + 1 < length) {
+        uint8_t fieldLen = payload[pos];
+        if (fieldLen == 0 || pos + 1 + fieldLen > length) {
+            break;
+        }
+        uint8_t type = payload[pos + 1];
+        const uint8_t* value = payload + pos + 2;
+        uint8_t valueLen = fieldLen - 1;
+        switch (type) {
+            case AD_TYPE_NAME_SHORT:
+            case AD_TYPE_NAME_COMPLETE:
+                device.haveName = true;
+                device.name = std::string((const char*)value, valueLen);
+                break;
+            case AD_TYPE_SERVICE_DATA_16:
+                if (valueLen >= 2) {
+                    device.haveServiceData = true;
+                    device.serviceDataUuid = readLE16(value);
+                    device.serviceData = std::string((const char*)value + 2, valueLen - 2);
+                }
+                break;
+            case AD_TYPE_MANUFACTURER_DATA:
+                device.haveManufacturerData = true;
+                device.manufacturerData = std::string((const char*)value, valueLen);
+                break;
+            case 0x02:
+            case 0x03:
+                for (uint8_t i = 0; i + 1 < valueLen; i += 2) {
+                    device.serviceUuids.push_back(readLE16(value + i));
+                }
+                break;
+        }
+        pos += 1 + fieldLen;
+    }
+    return device;
+}
+
+// BLEAddress::toString() and BLEUUID::toString()
+std::string legacyAddressString(const uint8_t* address) {
+    char text[18];
+    snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x",
+             address[0], address[1], address[2], address[3], address[4], address[5]);
+    return std::string(text);
+}
+
+std::string legacyUuidString(uint16_t uuid) {
+    char text[37];
+    snprintf(text, sizeof(text), "0000%04x-0000-1000-8000-00805f9b34fb", uuid);
+    return std::string(text);
+}
+
+bool legacyParseLOP001(LegacyAdvertisedDevice advertisedDevice, float& temperature, float& humidity) {
+    if (!advertisedDevice.haveName || std::string(advertisedDevice.name) != "LOP001") {
+        return false;
+    }
+    if (!advertisedDevice.haveServiceData) {
+        return false;
+    }
+    String svcUUIDStr = String(legacyUuidString(advertisedDevice.serviceDataUuid).c_str());
+    if (!svcUUIDStr.startsWith("0000181a")) {
+        return false;
+    }
+    std::string serviceData = advertisedDevice.serviceData;
+    if (serviceData.length() < 4) {
+        return false;
+    }
+    const uint8_t* data = (const uint8_t*)serviceData.c_str();
+    int16_t temp_raw = (int16_t)(data[1] << 8 | data[0]);
+    temperature = temp_raw / 100.0;
+    uint16_t hum_raw = (uint16_t)(data[3] << 8 | data[2]);
+    humidity = hum_raw / 100.0;
+    return temperature >= -40.0 && temperature <= 125.0 && humidity >= 0.0 && humidity <= 100.0;
+}
+
+// The old onResult(), up to the updateDevice() call
+bool legacyOnResult(LegacyAdvertisedDevice advertisedDevice) {
+    String macAddress = legacyAddressString(advertisedDevice.address).c_str();
+    macAddress.toUpperCase();
+    String name = advertisedDevice.haveName ? advertisedDevice.name.c_str() : "Unknown";
+    float temperature = 0.0;
+    float humidity = 0.0;
+    String sensorType = "BLE_DEVICE";
+    if (legacyParseLOP001(advertisedDevice, temperature, humidity)) {
+        sensorType = "LOP001";
+        benchSink += macAddress.length() + name.length() + (uint64_t)(temperature * 100);
+        return true;
+    }
+    return false;
+}
+
+bool legacyPath(const uint8_t* payload, size_t length) {
+    return legacyOnResult(legacyParseAdvertisement(payload, length, -60));
+}
+
+// The raw path: the callback hands the payload straight to the decoders
+bool rawPath(const uint8_t* payload, size_t length) {
+    BeaconReading reading;
+    if (!decodeBeacon(payload, length, reading)) {
+        return false;
+    }
+    benchSink += reading.temperatureCenti;
+    return reading.format == BEACON_LOP001;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_walks_every_structure() {
+    auto found = walk(LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD));
+    TEST_ASSERT_EQUAL(3, found.size());
+    TEST_ASSERT_EQUAL_HEX8(AD_TYPE_FLAGS, found[0].first);
+    TEST_ASSERT_EQUAL_UINT8(1, found[0].second);
+    TEST_ASSERT_EQUAL_HEX8(AD_TYPE_SERVICE_DATA_16, found[1].first);
+    TEST_ASSERT_EQUAL_UINT8(6, found[1].second);
+    TEST_ASSERT_EQUAL_HEX8(AD_TYPE_NAME_COMPLETE, found[2].first);
+    TEST_ASSERT_EQUAL_UINT8(6, found[2].second);
+}
+
+void test_length_past_the_end_stops_the_walk() {
+    // Second structure claims 9 bytes, only 4 follow
+    const uint8_t truncated[] = { 0x02, 0x01, 0x06, 0x09, 0x16, 0x1A, 0x18, 0xD0 };
+    auto found = walk(truncated, sizeof(truncated));
+    TEST_ASSERT_EQUAL(1, found.size());
+    TEST_ASSERT_EQUAL_HEX8(AD_TYPE_FLAGS, found[0].first);
+
+    uint8_t dataLen = 0;
+    TEST_ASSERT_NULL(findServiceData16(truncated, sizeof(truncated), UUID16_ENVIRONMENTAL_SENSING, dataLen));
+    BeaconReading reading;
+    TEST_ASSERT_FALSE(decodeBeacon(truncated, sizeof(truncated), reading));
+}
+
+void test_structure_ending_exactly_at_the_end_is_kept() {
+    // The same payload cut one byte short loses the name
+    auto full = walk(LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD));
+    auto cut = walk(LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD) - 1);
+    TEST_ASSERT_EQUAL(3, full.size());
+    TEST_ASSERT_EQUAL(2, cut.size());
+    TEST_ASSERT_FALSE(hasLocalName(LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD) - 1, "LOP001"));
+    TEST_ASSERT_TRUE(hasLocalName(LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD), "LOP001"));
+}
+
+void test_lone_length_byte_is_not_read_past() {
+    // A trailing length byte with no type byte after it
+    const uint8_t trailing[] = { 0x02, 0x01, 0x06, 0x05 };
+    TEST_ASSERT_EQUAL(1, walk(trailing, sizeof(trailing)).size());
+    TEST_ASSERT_EQUAL(0, walk(trailing, 1).size());
+    TEST_ASSERT_EQUAL(0, walk(trailing, 0).size());
+    TEST_ASSERT_EQUAL(0, walk(nullptr, 8).size());
+}
+
+void test_type_only_structure_has_an_empty_value() {
+    const uint8_t empty[] = { 0x01, AD_TYPE_NAME_COMPLETE, 0x02, 0x01, 0x06 };
+    auto found = walk(empty, sizeof(empty));
+    TEST_ASSERT_EQUAL(2, found.size());
+    TEST_ASSERT_EQUAL_UINT8(0, found[0].second);
+    TEST_ASSERT_TRUE(hasLocalName(empty, sizeof(empty), ""));
+    TEST_ASSERT_FALSE(hasLocalName(empty, sizeof(empty), "LOP001"));
+}
+
+void test_zero_length_padding_ends_the_data() {
+    // A 31-byte advert zero-padded after its last structure
+    uint8_t padded[31] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11 };
+    auto found = walk(padded, sizeof(padded));
+    TEST_ASSERT_EQUAL(2, found.size());
+    BeaconReading reading;
+    TEST_ASSERT_TRUE(decodeBeacon(padded, sizeof(padded), reading));
+    TEST_ASSERT_EQUAL_INT16(2000, reading.temperatureCenti);
+
+    // Early termination (Core Spec Vol 3 Part C 11): nothing after it is read
+    padded[11] = 0x00;
+    padded[12] = 0x07;
+    padded[13] = AD_TYPE_NAME_COMPLETE;
+    memcpy(padded + 14, "LOP001", 6);
+    TEST_ASSERT_EQUAL(2, walk(padded, sizeof(padded)).size());
+    TEST_ASSERT_FALSE(hasLocalName(padded, sizeof(padded), "LOP001"));
+}
+
+void test_short_service_data_is_skipped_not_matched() {
+    // A 1-byte service data value (no room for the UUID) before the real one
+    const uint8_t shortFirst[] = {
+        0x02, AD_TYPE_SERVICE_DATA_16, 0x1A,
+        0x07, AD_TYPE_SERVICE_DATA_16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11
+    };
+    uint8_t dataLen = 0;
+    const uint8_t* data = findServiceData16(shortFirst, sizeof(shortFirst), UUID16_ENVIRONMENTAL_SENSING, dataLen);
+    TEST_ASSERT_EQUAL_PTR(shortFirst + 7, data);
+    TEST_ASSERT_EQUAL_UINT8(4, dataLen);
+
+    // Just the UUID: matched, with no data after it
+    const uint8_t uuidOnly[] = { 0x03, AD_TYPE_SERVICE_DATA_16, 0x1A, 0x18 };
+    TEST_ASSERT_NOT_NULL(findServiceData16(uuidOnly, sizeof(uuidOnly), UUID16_ENVIRONMENTAL_SENSING, dataLen));
+    TEST_ASSERT_EQUAL_UINT8(0, dataLen);
+    BeaconReading reading;
+    TEST_ASSERT_FALSE(decodeBeacon(uuidOnly, sizeof(uuidOnly), reading));
+}
+
+void test_shortened_name_is_the_fallback() {
+    const uint8_t shortName[] = { 0x04, AD_TYPE_NAME_SHORT, 'L', 'O', 'P' };
+    TEST_ASSERT_TRUE(hasLocalName(shortName, sizeof(shortName), "LOP"));
+    TEST_ASSERT_FALSE(hasLocalName(shortName, sizeof(shortName), "LOP001"));
+    TEST_ASSERT_FALSE(hasLocalName(shortName, sizeof(shortName), "LO"));
+
+    // The complete name wins when both are present
+    const uint8_t both[] = {
+        0x04, AD_TYPE_NAME_SHORT, 'L', 'O', 'P',
+        0x07, AD_TYPE_NAME_COMPLETE, 'L', 'O', 'P', '0', '0', '1'
+    };
+    TEST_ASSERT_TRUE(hasLocalName(both, sizeof(both), "LOP001"));
+    TEST_ASSERT_FALSE(hasLocalName(both, sizeof(both), "LOP"));
+}
+
+void test_random_payloads_stay_in_bounds() {
+    // Fixed seed: any crash or out-of-range value repeats exactly
+    uint32_t state = 12345;
+    uint8_t payload[62];
+    for (int round = 0; round < 20000; round++) {
+        state = state * 1664525u + 1013904223u;
+        size_t length = (state >> 16) % (sizeof(payload) + 1);
+        for (size_t i = 0; i < length; i++) {
+            state = state * 1664525u + 1013904223u;
+            // Small values are likely lengths, so the walk goes deep
+            payload[i] = (state >> 24) % 4 == 0 ? (uint8_t)((state >> 8) % 8) : (uint8_t)(state >> 16);
+        }
+        walk(payload, length);
+        BeaconReading reading;
+        benchSink += decodeBeacon(payload, length, reading);
+        uint8_t valueLen = 0;
+        const uint8_t* name = findLocalName(payload, length, valueLen);
+        TEST_ASSERT_TRUE(name == nullptr || name + valueLen <= payload + length);
+    }
+}
+
+void test_raw_path_matches_the_legacy_path() {
+    TEST_ASSERT_TRUE(legacyPath(LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD)));
+    TEST_ASSERT_TRUE(rawPath(LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD)));
+    TEST_ASSERT_FALSE(legacyPath(OTHER_PAYLOAD, sizeof(OTHER_PAYLOAD)));
+    TEST_ASSERT_FALSE(rawPath(OTHER_PAYLOAD, sizeof(OTHER_PAYLOAD)));
+}
+
+void test_raw_path_against_the_legacy_path() {
+    struct Case {
+        const char* name;
+        const uint8_t* payload;
+        size_t length;
+    } cases[] = {
+        { "LOP001", LOP001_PAYLOAD, sizeof(LOP001_PAYLOAD) },
+        { "other", OTHER_PAYLOAD, sizeof(OTHER_PAYLOAD) },
+    };
+    char name[64];
+    for (const Case& c : cases) {
+        AllocationScope legacyScope;
+        legacyPath(c.payload, c.length);
+        uint32_t legacyAllocations = legacyScope.allocations();
+        AllocationScope rawScope;
+        rawPath(c.payload, c.length);
+        uint32_t rawAllocations = rawScope.allocations();
+
+        snprintf(name, sizeof(name), "%s advert, BLEAdvertisedDevice path", c.name);
+        double legacyNs = benchNsPerOp(name, 200000, [&](uint32_t) { benchSink += legacyPath(c.payload, c.length); });
+        snprintf(name, sizeof(name), "%s advert, raw parser path", c.name);
+        double rawNs = benchNsPerOp(name, 200000, [&](uint32_t) { benchSink += rawPath(c.payload, c.length); });
+        snprintf(name, sizeof(name), "%s advert, BLEAdvertisedDevice allocs", c.name);
+        benchReport(name, legacyAllocations, "per advert");
+        snprintf(name, sizeof(name), "%s advert, raw parser allocs", c.name);
+        benchReport(name, rawAllocations, "per advert");
+
+        TEST_ASSERT_EQUAL_UINT32(0, rawAllocations);
+        TEST_ASSERT_TRUE(legacyAllocations > 0);
+        TEST_ASSERT_TRUE(rawNs < legacyNs);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_walks_every_structure);
+    RUN_TEST(test_length_past_the_end_stops_the_walk);
+    RUN_TEST(test_structure_ending_exactly_at_the_end_is_kept);
+    RUN_TEST(test_lone_length_byte_is_not_read_past);
+    RUN_TEST(test_type_only_structure_has_an_empty_value);
+    RUN_TEST(test_zero_length_padding_ends_the_data);
+    RUN_TEST(test_short_service_data_is_skipped_not_matched);
+    RUN_TEST(test_shortened_name_is_the_fallback);
+    RUN_TEST(test_random_payloads_stay_in_bounds);
+    RUN_TEST(test_raw_path_matches_the_legacy_path);
+    RUN_TEST(test_raw_path_against_the_legacy_path);
+    return UNITY_END();
+}
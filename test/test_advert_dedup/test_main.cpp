@@ -0,0 +1,117 @@
+#include <unity.h>
+#include "gateway_host.h"
+
+const uint64_t SENSOR_MAC = 0xE07DEA000001ULL;
+const uint8_t ADVERT[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11 };
+const uint8_t CHANGED_ADVERT[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD1, 0x07, 0x94, 0x11 };
+
+AdvertDedup dedup;
+AdvertStats stats;
+
+bool admit(uint64_t mac, const uint8_t* payload, int8_t rssi, uint32_t now) {
+    return dedup.admit(mac, payload, sizeof(ADVERT), rssi, now, stats);
+}
+
+// Another MAC landing in the same direct-mapped slot as `mac`
+uint64_t collidingMac(uint64_t mac) {
+    size_t slot = (size_t)((mac * 0x9E3779B97F4A7C15ull) >> (64 - DEDUP_CACHE_BITS));
+    for (uint64_t other = mac + 1;; other++) {
+        if ((size_t)((other * 0x9E3779B97F4A7C15ull) >> (64 - DEDUP_CACHE_BITS)) == slot) {
+            return other;
+        }
+    }
+}
+
+void setUp() {
+    resetHostGlobal(dedup);
+}
+
+void tearDown() {}
+
+void test_identical_advert_is_dropped_until_the_window_expires() {
+    const uint32_t START = 1000;
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, START));
+    // The other two advertising channels, then repeats inside the window
+    TEST_ASSERT_FALSE(admit(SENSOR_MAC, ADVERT, -60, START));
+    TEST_ASSERT_FALSE(admit(SENSOR_MAC, ADVERT, -60, START + 1));
+    TEST_ASSERT_FALSE(admit(SENSOR_MAC, ADVERT, -60, START + DEDUP_WINDOW_DEFAULT_MS - 1));
+    // The window runs from the last forwarded advert, not the last heard
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, START + DEDUP_WINDOW_DEFAULT_MS));
+    TEST_ASSERT_FALSE(admit(SENSOR_MAC, ADVERT, -60, START + DEDUP_WINDOW_DEFAULT_MS + 10));
+    TEST_ASSERT_EQUAL_UINT32(4, dedup.hits());
+    TEST_ASSERT_EQUAL_UINT32(2, dedup.misses());
+}
+
+void test_changed_payload_is_forwarded_inside_the_window() {
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 0));
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, CHANGED_ADVERT, -60, 10));
+    // ...and the changed one is now what repeats are compared with
+    TEST_ASSERT_FALSE(admit(SENSOR_MAC, CHANGED_ADVERT, -60, 20));
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 30));
+}
+
+void test_window_follows_runtime_changes_and_zero_disables() {
+    dedup.setWindowMs(100);
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 0));
+    TEST_ASSERT_FALSE(admit(SENSOR_MAC, ADVERT, -60, 99));
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 100));
+
+    dedup.setWindowMs(0);
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 100));
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 100));
+    TEST_ASSERT_EQUAL_UINT32(1, dedup.hits());
+}
+
+void test_window_survives_the_tick_wrap() {
+    const uint32_t START = 0xFFFFFFFFu - 1000;
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, START));
+    TEST_ASSERT_FALSE(admit(SENSOR_MAC, ADVERT, -60, START + 2000));
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, START + DEDUP_WINDOW_DEFAULT_MS));
+}
+
+void test_rssi_is_smoothed_over_every_advert() {
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 0));
+    TEST_ASSERT_EQUAL_INT8(-60, stats.rssi);
+
+    // One reading 20 dB weaker moves the average a quarter of the way
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, CHANGED_ADVERT, -80, 10));
+    TEST_ASSERT_EQUAL_INT8(-65, stats.rssi);
+
+    // Dropped duplicates still count towards it
+    for (uint32_t i = 0; i < 30; i++) {
+        TEST_ASSERT_FALSE(admit(SENSOR_MAC, CHANGED_ADVERT, -80, 20 + i));
+    }
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -80, 100));
+    TEST_ASSERT_INT_WITHIN(1, -80, stats.rssi);
+
+    // And it climbs back just as well
+    for (uint32_t i = 0; i < 30; i++) {
+        admit(SENSOR_MAC, ADVERT, -50, 200 + i);
+    }
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, CHANGED_ADVERT, -50, 300));
+    TEST_ASSERT_INT_WITHIN(1, -50, stats.rssi);
+}
+
+void test_collision_starts_the_older_mac_over() {
+    uint64_t other = collidingMac(SENSOR_MAC);
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -60, 0));
+    TEST_ASSERT_TRUE(admit(other, ADVERT, -90, 10));
+    TEST_ASSERT_EQUAL_INT8(-90, stats.rssi);
+
+    // Its repeat is a miss, and its average restarts from this advert
+    TEST_ASSERT_TRUE(admit(SENSOR_MAC, ADVERT, -70, 20));
+    TEST_ASSERT_EQUAL_INT8(-70, stats.rssi);
+    TEST_ASSERT_EQUAL_UINT32(0, dedup.hits());
+    TEST_ASSERT_EQUAL_UINT32(3, dedup.misses());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_identical_advert_is_dropped_until_the_window_expires);
+    RUN_TEST(test_changed_payload_is_forwarded_inside_the_window);
+    RUN_TEST(test_window_follows_runtime_changes_and_zero_disables);
+    RUN_TEST(test_window_survives_the_tick_wrap);
+    RUN_TEST(test_rssi_is_smoothed_over_every_advert);
+    RUN_TEST(test_collision_starts_the_older_mac_over);
+    return UNITY_END();
+}
@@ -0,0 +1,129 @@
+#include <unity.h>
+#include <thread>
+#include "advert_ring.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_records_come_out_in_order_across_the_wrap() {
+    SpscRing<uint32_t, 8> ring;
+    uint32_t next = 0;
+    uint32_t expected = 0;
+    uint32_t out[8];
+    // Uneven push and pop counts, so the indices wrap the buffer at every offset
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < 5; i++) {
+            TEST_ASSERT_TRUE(ring.push(next++));
+        }
+        size_t count = ring.popBatch(out, 3 + round % 3);
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL_UINT32(expected++, out[i]);
+        }
+        while ((count = ring.popBatch(out, 8)) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                TEST_ASSERT_EQUAL_UINT32(expected++, out[i]);
+            }
+        }
+        TEST_ASSERT_EQUAL_UINT32(0, ring.size());
+    }
+    TEST_ASSERT_EQUAL_UINT32(next, expected);
+    TEST_ASSERT_EQUAL_UINT32(0, ring.droppedCount());
+}
+
+void test_full_ring_drops_and_counts() {
+    SpscRing<uint32_t, 8> ring;
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_FALSE(ring.push(100));
+    TEST_ASSERT_FALSE(ring.push(101));
+    TEST_ASSERT_EQUAL_UINT32(2, ring.droppedCount());
+    TEST_ASSERT_EQUAL_UINT32(8, ring.size());
+
+    // A dropped record never shows up; room opens as the consumer reads
+    uint32_t out[8];
+    TEST_ASSERT_EQUAL_UINT32(1, ring.popBatch(out, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, out[0]);
+    TEST_ASSERT_TRUE(ring.push(8));
+    TEST_ASSERT_EQUAL_UINT32(8, ring.popBatch(out, 8));
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_UINT32(i + 1, out[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, ring.droppedCount());
+}
+
+void test_high_water_mark_keeps_the_peak() {
+    SpscRing<uint32_t, 16> ring;
+    uint32_t out[16];
+    for (uint32_t i = 0; i < 5; i++) {
+        ring.push(i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, ring.highWaterMark());
+    ring.popBatch(out, 16);
+    ring.push(0);
+    ring.push(1);
+    TEST_ASSERT_EQUAL_UINT32(5, ring.highWaterMark());
+
+    for (uint32_t i = 0; i < 20; i++) {
+        ring.push(i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(16, ring.highWaterMark());
+    TEST_ASSERT_EQUAL_UINT32(6, ring.droppedCount());
+}
+
+void test_producer_and_consumer_threads_lose_nothing() {
+    // The BLE callback and the tracker task, as two host threads
+    static SpscRing<AdvertRecord, 64> ring;
+    const uint32_t RECORDS = 200000;
+    uint32_t refused = 0;
+    std::thread producer([&]() {
+        AdvertRecord record = {};
+        for (uint32_t i = 0; i < RECORDS; i++) {
+            record.mac = i;
+            record.tick = ~i;
+            while (!ring.push(record)) {
+                refused++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    AdvertRecord batch[16];
+    uint32_t expected = 0;
+    bool ordered = true;
+    while (expected < RECORDS) {
+        size_t count = ring.popBatch(batch, 16);
+        if (count == 0) {
+            std::this_thread::yield();
+        }
+        for (size_t i = 0; i < count; i++) {
+            ordered &= batch[i].mac == expected && batch[i].tick == ~expected;
+            expected++;
+        }
+    }
+    producer.join();
+
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size());
+    TEST_ASSERT_EQUAL_UINT32(refused, ring.droppedCount());
+    TEST_ASSERT_TRUE(ring.highWaterMark() <= 64);
+}
+
+void test_mac_packs_and_formats_first_octet_first() {
+    const uint8_t addr[] = { 0xE0, 0x7D, 0xEA, 0x01, 0x23, 0xFF };
+    uint64_t mac = packMac(addr);
+    TEST_ASSERT_EQUAL_UINT64(0xE07DEA0123FFULL, mac);
+    char text[18];
+    formatMac(mac, text);
+    TEST_ASSERT_EQUAL_STRING("E0:7D:EA:01:23:FF", text);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_records_come_out_in_order_across_the_wrap);
+    RUN_TEST(test_full_ring_drops_and_counts);
+    RUN_TEST(test_high_water_mark_keeps_the_peak);
+    RUN_TEST(test_producer_and_consumer_threads_lose_nothing);
+    RUN_TEST(test_mac_packs_and_formats_first_octet_first);
+    return UNITY_END();
+}
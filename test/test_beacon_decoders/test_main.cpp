@@ -0,0 +1,239 @@
+#include <unity.h>
+#include "bench.h"
+#include "beacon_decoders.h"
+
+// LOP001: 0x181A service data, with and without the name from the scan response
+const uint8_t LOP001_ADVERT[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11 };
+const uint8_t LOP001_NAMED[] = {
+    0x02, 0x01, 0x06, 0x07, 0x09, 'L', 'O', 'P', '0', '0', '1',
+    0x08, 0x16, 0x1A, 0x18, 0x2E, 0xFB, 0x94, 0x11, 0x00  // -12.34 °C, trailing byte allowed when named
+};
+
+// MOKO T&H (0xFEAB frame 0x70): 20.0 °C, 50.0 %RH, 3000 mV, -59 dBm
+const uint8_t MOKO_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x0C, 0x16, 0xAB, 0xFE, 0x70, 0xC5, 0x0A, 0x00, 0xC8, 0x01, 0xF4, 0x0B, 0xB8
+};
+
+// iBeacon: UUID E2C56DB5-..., major 1, minor 2, -59 dBm
+const uint8_t IBEACON_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15,
+    0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0,
+    0x00, 0x01, 0x00, 0x02, 0xC5
+};
+
+// Eddystone-UID: -25 dBm, namespace 00..09, instance A0..A5
+const uint8_t EDDYSTONE_UID_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x03, 0x03, 0xAA, 0xFE, 0x17, 0x16, 0xAA, 0xFE, 0x00, 0xE7,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5,
+    0x00, 0x00
+};
+
+// Eddystone-URL: -21 dBm, "https://" + "example" + ".com"
+const uint8_t EDDYSTONE_URL_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x03, 0x03, 0xAA, 0xFE, 0x0E, 0x16, 0xAA, 0xFE, 0x10, 0xEB, 0x03,
+    'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x07
+};
+
+// Eddystone-TLM: 3000 mV, 23.5 °C (8.8), counters
+const uint8_t EDDYSTONE_TLM_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x03, 0x03, 0xAA, 0xFE, 0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x20
+};
+
+// Eddystone-TLM with the given temperature word and battery
+BeaconReading decodeTlm(uint16_t temperature, uint16_t batteryMv) {
+    uint8_t advert[sizeof(EDDYSTONE_TLM_ADVERT)];
+    memcpy(advert, EDDYSTONE_TLM_ADVERT, sizeof(advert));
+    advert[13] = (uint8_t)(batteryMv >> 8);
+    advert[14] = (uint8_t)batteryMv;
+    advert[15] = (uint8_t)(temperature >> 8);
+    advert[16] = (uint8_t)temperature;
+    BeaconReading reading;
+    TEST_ASSERT_TRUE(decodeBeacon(advert, sizeof(advert), reading));
+    return reading;
+}
+
+// Copy of `advert` with one byte changed
+bool decodeAltered(const uint8_t* advert, size_t length, size_t index, uint8_t value) {
+    uint8_t altered[64];
+    memcpy(altered, advert, length);
+    altered[index] = value;
+    BeaconReading reading;
+    return decodeBeacon(altered, length, reading);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_lop001_by_shape_and_by_name() {
+    BeaconReading reading;
+    TEST_ASSERT_TRUE(decodeBeacon(LOP001_ADVERT, sizeof(LOP001_ADVERT), reading));
+    TEST_ASSERT_EQUAL(BEACON_LOP001, reading.format);
+    TEST_ASSERT_EQUAL(BEACON_IDENTITY_SHAPE, reading.identity);
+    TEST_ASSERT_EQUAL_INT16(2000, reading.temperatureCenti);
+    TEST_ASSERT_EQUAL_UINT16(4500, reading.humidityCenti);
+    TEST_ASSERT_FALSE(reading.hasBattery);
+
+    TEST_ASSERT_TRUE(decodeBeacon(LOP001_NAMED, sizeof(LOP001_NAMED), reading));
+    TEST_ASSERT_EQUAL(BEACON_IDENTITY_NAME, reading.identity);
+    TEST_ASSERT_EQUAL_INT16(-1234, reading.temperatureCenti);
+
+    // Another device's name, an unnamed odd length, or values an SHT40 cannot report
+    TEST_ASSERT_FALSE(decodeAltered(LOP001_NAMED, sizeof(LOP001_NAMED), 10, '2'));
+    const uint8_t unnamedLong[] = { 0x08, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11, 0x00 };
+    TEST_ASSERT_FALSE(decodeBeacon(unnamedLong, sizeof(unnamedLong), reading));
+    TEST_ASSERT_FALSE(decodeAltered(LOP001_ADVERT, sizeof(LOP001_ADVERT), 8, 0x40));   // 163.84 °C
+    TEST_ASSERT_FALSE(decodeAltered(LOP001_ADVERT, sizeof(LOP001_ADVERT), 10, 0x28));  // 102.60 %RH
+}
+
+void test_moko_th() {
+    BeaconReading reading;
+    TEST_ASSERT_TRUE(decodeBeacon(MOKO_ADVERT, sizeof(MOKO_ADVERT), reading));
+    TEST_ASSERT_EQUAL(BEACON_MOKO_TH, reading.format);
+    TEST_ASSERT_EQUAL(BEACON_IDENTITY_FRAME, reading.identity);
+    TEST_ASSERT_EQUAL_INT16(2000, reading.temperatureCenti);
+    TEST_ASSERT_EQUAL_UINT16(5000, reading.humidityCenti);
+    TEST_ASSERT_TRUE(reading.hasBattery);
+    TEST_ASSERT_EQUAL_UINT16(3000, reading.batteryMv);
+    TEST_ASSERT_EQUAL_INT8(-59, reading.txPower);
+
+    uint8_t freezing[sizeof(MOKO_ADVERT)];
+    memcpy(freezing, MOKO_ADVERT, sizeof(freezing));
+    freezing[10] = 0xFF;  // -5.5 °C
+    freezing[11] = 0xC9;
+    TEST_ASSERT_TRUE(decodeBeacon(freezing, sizeof(freezing), reading));
+    TEST_ASSERT_EQUAL_INT16(-550, reading.temperatureCenti);
+
+    // Other MOKO frames, a short frame and out-of-range values are not T&H
+    TEST_ASSERT_FALSE(decodeAltered(MOKO_ADVERT, sizeof(MOKO_ADVERT), 7, 0x60));
+    TEST_ASSERT_FALSE(decodeAltered(MOKO_ADVERT, sizeof(MOKO_ADVERT), 3, 0x0B));
+    TEST_ASSERT_FALSE(decodeAltered(MOKO_ADVERT, sizeof(MOKO_ADVERT), 10, 0x05));  // 128.0 °C
+    TEST_ASSERT_FALSE(decodeAltered(MOKO_ADVERT, sizeof(MOKO_ADVERT), 12, 0x04));  // 115.6 %RH
+}
+
+void test_ibeacon() {
+    BeaconReading reading;
+    TEST_ASSERT_TRUE(decodeBeacon(IBEACON_ADVERT, sizeof(IBEACON_ADVERT), reading));
+    TEST_ASSERT_EQUAL(BEACON_IBEACON, reading.format);
+    TEST_ASSERT_EQUAL_UINT8(20, reading.idLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(IBEACON_ADVERT + 9, reading.id, 20);
+    TEST_ASSERT_EQUAL_INT8(-59, reading.txPower);
+    TEST_ASSERT_FALSE(reading.hasTemperature);
+
+    TEST_ASSERT_FALSE(decodeAltered(IBEACON_ADVERT, sizeof(IBEACON_ADVERT), 8, 0x14));  // Length byte
+    TEST_ASSERT_FALSE(decodeAltered(IBEACON_ADVERT, sizeof(IBEACON_ADVERT), 5, 0x4D));  // Other company
+    TEST_ASSERT_FALSE(decodeAltered(IBEACON_ADVERT, sizeof(IBEACON_ADVERT), 3, 0x19));  // Truncated
+}
+
+void test_eddystone_uid_and_url() {
+    BeaconReading reading;
+    TEST_ASSERT_TRUE(decodeBeacon(EDDYSTONE_UID_ADVERT, sizeof(EDDYSTONE_UID_ADVERT), reading));
+    TEST_ASSERT_EQUAL(BEACON_EDDYSTONE_UID, reading.format);
+    TEST_ASSERT_EQUAL_UINT8(16, reading.idLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(EDDYSTONE_UID_ADVERT + 13, reading.id, 16);
+    TEST_ASSERT_EQUAL_INT8(-25, reading.txPower);
+    TEST_ASSERT_FALSE(decodeAltered(EDDYSTONE_UID_ADVERT, sizeof(EDDYSTONE_UID_ADVERT), 7, 0x14));  // 17 bytes
+
+    TEST_ASSERT_TRUE(decodeBeacon(EDDYSTONE_URL_ADVERT, sizeof(EDDYSTONE_URL_ADVERT), reading));
+    TEST_ASSERT_EQUAL(BEACON_EDDYSTONE_URL, reading.format);
+    TEST_ASSERT_EQUAL_UINT8(9, reading.idLength);  // Scheme byte and encoded URL
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(EDDYSTONE_URL_ADVERT + 13, reading.id, 9);
+    TEST_ASSERT_EQUAL_INT8(-21, reading.txPower);
+    TEST_ASSERT_FALSE(decodeAltered(EDDYSTONE_URL_ADVERT, sizeof(EDDYSTONE_URL_ADVERT), 13, 0x04));  // Scheme
+
+    // An encoded URL longer than 17 bytes
+    uint8_t longUrl[40];
+    memcpy(longUrl, EDDYSTONE_URL_ADVERT, sizeof(EDDYSTONE_URL_ADVERT));
+    memset(longUrl + sizeof(EDDYSTONE_URL_ADVERT), 'x', 10);
+    longUrl[7] += 10;
+    TEST_ASSERT_FALSE(decodeBeacon(longUrl, sizeof(EDDYSTONE_URL_ADVERT) + 10, reading));
+}
+
+void test_eddystone_tlm() {
+    BeaconReading reading = decodeTlm(0x1780, 3000);
+    TEST_ASSERT_EQUAL(BEACON_EDDYSTONE_TLM, reading.format);
+    TEST_ASSERT_TRUE(reading.hasTemperature);
+    TEST_ASSERT_EQUAL_INT16(2350, reading.temperatureCenti);
+    TEST_ASSERT_TRUE(reading.hasBattery);
+    TEST_ASSERT_EQUAL_UINT16(3000, reading.batteryMv);
+
+    // 8.8 fixed point rounds half away from zero in 0.01 °C
+    TEST_ASSERT_EQUAL_INT16(-150, decodeTlm(0xFE80, 3000).temperatureCenti);
+    TEST_ASSERT_EQUAL_INT16(0, decodeTlm(0x0001, 3000).temperatureCenti);   // 0.0039 °C
+    TEST_ASSERT_EQUAL_INT16(1, decodeTlm(0x0002, 3000).temperatureCenti);   // 0.0078 °C
+    TEST_ASSERT_EQUAL_INT16(-1, decodeTlm(0xFFFE, 3000).temperatureCenti);
+
+    // 0x8000 = no sensor, 0 mV = no battery reading
+    reading = decodeTlm(0x8000, 0);
+    TEST_ASSERT_FALSE(reading.hasTemperature);
+    TEST_ASSERT_FALSE(reading.hasBattery);
+
+    // Encrypted TLM (version 1) and short frames are refused
+    TEST_ASSERT_FALSE(decodeAltered(EDDYSTONE_TLM_ADVERT, sizeof(EDDYSTONE_TLM_ADVERT), 12, 0x01));
+    TEST_ASSERT_FALSE(decodeAltered(EDDYSTONE_TLM_ADVERT, sizeof(EDDYSTONE_TLM_ADVERT), 7, 0x10));
+}
+
+void test_dispatch_routes_each_key_once() {
+    for (size_t i = 0; i < BEACON_DECODER_COUNT; i++) {
+        const BeaconDecoderEntry& entry = BEACON_DECODERS[i];
+        TEST_ASSERT_EQUAL_PTR(&entry, findBeaconDecoderExact(entry.kind, entry.id, entry.frame));
+    }
+    // Any frame byte falls back to the LOP001 entry; unknown Eddystone frames go nowhere
+    TEST_ASSERT_EQUAL(BEACON_LOP001, findBeaconDecoder(BEACON_KEY_SERVICE_DATA, UUID16_ENVIRONMENTAL_SENSING, 0x42)->format);
+    TEST_ASSERT_NULL(findBeaconDecoder(BEACON_KEY_SERVICE_DATA, UUID16_EDDYSTONE, 0x30));
+    TEST_ASSERT_NULL(findBeaconDecoder(BEACON_KEY_COMPANY_ID, 0x0006, 0x01));
+}
+
+void test_rejected_structure_does_not_leak_into_the_next() {
+    // Encrypted TLM (refused) then an iBeacon: the reading is the iBeacon's alone
+    uint8_t advert[sizeof(EDDYSTONE_TLM_ADVERT) + sizeof(IBEACON_ADVERT) - 3];
+    memcpy(advert, EDDYSTONE_TLM_ADVERT, sizeof(EDDYSTONE_TLM_ADVERT));
+    advert[12] = 0x01;
+    memcpy(advert + sizeof(EDDYSTONE_TLM_ADVERT), IBEACON_ADVERT + 3, sizeof(IBEACON_ADVERT) - 3);
+    BeaconReading reading;
+    TEST_ASSERT_TRUE(decodeBeacon(advert, sizeof(advert), reading));
+    TEST_ASSERT_EQUAL(BEACON_IBEACON, reading.format);
+    TEST_ASSERT_FALSE(reading.hasBattery);
+
+    // Nothing registered at all
+    const uint8_t unknown[] = { 0x02, 0x01, 0x06, 0x05, 0x16, 0x34, 0x12, 0x01, 0x02, 0x03, 0xFF, 0x06, 0x00 };
+    TEST_ASSERT_FALSE(decodeBeacon(unknown, sizeof(unknown), reading));
+    TEST_ASSERT_EQUAL(BEACON_UNKNOWN, reading.format);
+}
+
+void test_decode_cost_per_format() {
+    struct Sample {
+        const char* name;
+        const uint8_t* advert;
+        size_t length;
+    };
+    const Sample samples[] = {
+        { "decodeBeacon LOP001 (shape)", LOP001_ADVERT, sizeof(LOP001_ADVERT) },
+        { "decodeBeacon LOP001 (named)", LOP001_NAMED, sizeof(LOP001_NAMED) },
+        { "decodeBeacon MOKO T&H", MOKO_ADVERT, sizeof(MOKO_ADVERT) },
+        { "decodeBeacon iBeacon", IBEACON_ADVERT, sizeof(IBEACON_ADVERT) },
+        { "decodeBeacon Eddystone-UID", EDDYSTONE_UID_ADVERT, sizeof(EDDYSTONE_UID_ADVERT) },
+        { "decodeBeacon Eddystone-URL", EDDYSTONE_URL_ADVERT, sizeof(EDDYSTONE_URL_ADVERT) },
+        { "decodeBeacon Eddystone-TLM", EDDYSTONE_TLM_ADVERT, sizeof(EDDYSTONE_TLM_ADVERT) },
+    };
+    for (const Sample& sample : samples) {
+        double ns = benchNsPerOp(sample.name, 1000000, [&](uint32_t) {
+            BeaconReading reading;
+            benchSink += decodeBeacon(sample.advert, sample.length, reading) + reading.temperatureCenti;
+        });
+        TEST_ASSERT_TRUE(ns < 2000);  // Generous: a few hundred ns on the ESP32-S3
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_lop001_by_shape_and_by_name);
+    RUN_TEST(test_moko_th);
+    RUN_TEST(test_ibeacon);
+    RUN_TEST(test_eddystone_uid_and_url);
+    RUN_TEST(test_eddystone_tlm);
+    RUN_TEST(test_dispatch_routes_each_key_once);
+    RUN_TEST(test_rejected_structure_does_not_leak_into_the_next);
+    RUN_TEST(test_decode_cost_per_format);
+    return UNITY_END();
+}
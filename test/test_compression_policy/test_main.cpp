@@ -0,0 +1,220 @@
+#include <unity.h>
+#include "gateway_host.h"
+
+const int32_t TEMPERATURE_FLOOR = DEFAULT_COMPRESSION_POLICY.temperature;
+
+const uint64_t SENSOR_A = 0xE07DEA000001ULL;
+const uint64_t SENSOR_B = 0xE07DEA000002ULL;
+const uint64_t SENSOR_C = 0xE07DEA000003ULL;
+
+uint32_t simState = 1;
+uint32_t simRandom() {
+    simState = simState * 1664525u + 1013904223u;
+    return simState >> 8;
+}
+
+// LOP001 (0x181A service data, no name) with the given temperature, through
+// the tracker
+void hearLop001(uint64_t mac, int16_t temperatureCenti) {
+    uint8_t advert[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0x00, 0x00, 0x94, 0x11 };
+    advert[7] = (uint8_t)temperatureCenti;
+    advert[8] = (uint8_t)(temperatureCenti >> 8);
+    TEST_ASSERT_TRUE(ingestAdvert(mac, -60, advert, sizeof(advert), millis()));
+    runTrackerPass();
+}
+
+uint32_t publishesOf(uint64_t mac) {
+    TrackedDevice* device = deviceTable.find(mac);
+    TEST_ASSERT_NOT_NULL(device);
+    return device->publishes;
+}
+
+uint8_t policyOf(uint64_t mac) {
+    TrackedDevice* device = deviceTable.find(mac);
+    TEST_ASSERT_NOT_NULL(device);
+    return device->policy;
+}
+
+void setUp() {
+    resetGatewayHost();
+    hostAdvanceMs(1000);  // Past boot: a lastPublish of 0 means never published
+    mqtt_connected = true;
+    simState = 1;
+}
+
+void tearDown() {
+    resetCompressionPolicies();
+}
+
+void test_percent_band_scales_with_the_published_value() {
+    // 5 % of 20.00 °C = 1.00 °C
+    TEST_ASSERT_FALSE(exceedsPercentBand(2000, 2099, 500, TEMPERATURE_FLOOR));
+    TEST_ASSERT_TRUE(exceedsPercentBand(2000, 2100, 500, TEMPERATURE_FLOOR));
+    TEST_ASSERT_TRUE(exceedsPercentBand(-2000, -2100, 500, TEMPERATURE_FLOOR));
+}
+
+void test_published_zero_falls_back_to_the_floor() {
+    TEST_ASSERT_FALSE(exceedsPercentBand(0, 0, 500, TEMPERATURE_FLOOR));
+    TEST_ASSERT_FALSE(exceedsPercentBand(0, TEMPERATURE_FLOOR - 1, 500, TEMPERATURE_FLOOR));
+    TEST_ASSERT_FALSE(exceedsPercentBand(0, -(TEMPERATURE_FLOOR - 1), 500, TEMPERATURE_FLOOR));
+    TEST_ASSERT_TRUE(exceedsPercentBand(0, TEMPERATURE_FLOOR, 500, TEMPERATURE_FLOOR));
+}
+
+void test_floor_applies_near_zero() {
+    // 5 % of 0.40 °C is 0.02 °C; the floor keeps it at 0.10 °C
+    TEST_ASSERT_FALSE(exceedsPercentBand(40, 49, 500, TEMPERATURE_FLOOR));
+    TEST_ASSERT_TRUE(exceedsPercentBand(40, 50, 500, TEMPERATURE_FLOOR));
+}
+
+void test_swinging_door_stays_open_on_a_linear_ramp() {
+    // 0.10 °C per second, far more than the 0.20 °C deviation over the run
+    DoorState door;
+    door.reset();
+    for (uint32_t second = 1; second <= 600; second++) {
+        TEST_ASSERT_FALSE(door.closes(2000, 2000 + 10 * second, 20, second * 1000));
+    }
+}
+
+void test_swinging_door_closes_on_a_step() {
+    DoorState door;
+    door.reset();
+    for (uint32_t second = 1; second <= 30; second++) {
+        TEST_ASSERT_FALSE(door.closes(2000, 2000, 20, second * 1000));
+    }
+    // A step within the deviation still fits the flat line; one past it
+    // leaves no line through the band that passes the flat run
+    TEST_ASSERT_FALSE(door.closes(2000, 2019, 20, 31000));
+    TEST_ASSERT_TRUE(door.closes(2000, 2100, 20, 32000));
+
+    // A ramp that then bends well off its trend closes too
+    door.reset();
+    for (uint32_t second = 1; second <= 30; second++) {
+        TEST_ASSERT_FALSE(door.closes(2000, 2000 + 10 * second, 20, second * 1000));
+    }
+    TEST_ASSERT_TRUE(door.closes(2000, 2400, 20, 31000));
+}
+
+void test_swinging_door_ignores_noise_within_the_deviation() {
+    DoorState door;
+    door.reset();
+    for (uint32_t second = 1; second <= 3600; second++) {
+        int32_t noise = (int32_t)(simRandom() % 39) - 19;  // -0.19 to +0.19 °C
+        TEST_ASSERT_FALSE(door.closes(2000, 2000 + noise, 20, second * 1000));
+    }
+    // Same and back-to-back timestamps count as 1 ms
+    TEST_ASSERT_FALSE(door.closes(2000, 2005, 20, 0));
+}
+
+void test_heartbeat_publishes_on_its_interval_only() {
+    formatPolicies[BEACON_LOP001] = { COMPRESS_HEARTBEAT, 10, 50, 5, 2 * 60 * 1000 };
+    hearLop001(SENSOR_A, 2000);
+    TEST_ASSERT_EQUAL_UINT32(1, publishesOf(SENSOR_A));  // New devices always publish
+
+    // Large swings every 10 s are not changes under heartbeat
+    int second = 0;
+    while (second < 110) {
+        second += 10;
+        hostAdvanceMs(10000);
+        hearLop001(SENSOR_A, second % 20 ? 500 : 3500);
+        TEST_ASSERT_EQUAL_UINT32(1, publishesOf(SENSOR_A));
+    }
+    // ...until maxIntervalMs has passed since the last publish (a tick of
+    // slack for the host clock)
+    while (second < 118) {
+        second++;
+        hostAdvanceMs(1000);
+        runTrackerPass();
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, publishesOf(SENSOR_A));
+    while (second < 122) {
+        second++;
+        hostAdvanceMs(1000);
+        runTrackerPass();
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, publishesOf(SENSOR_A));
+    // With the latest reading (second 110), not the one it was found with
+    TEST_ASSERT_EQUAL_INT16(500, deviceTable.find(SENSOR_A)->temperatureCenti);
+}
+
+// {"command":"compression","mac":...,"algorithm":...,"temperature":...}
+void setMacPolicy(const char* mac, const char* algorithm, float temperature) {
+    JsonDocument doc;
+    doc["mac"] = mac;
+    doc["algorithm"] = algorithm;
+    doc["temperature"] = temperature;
+    handleCompressionCommand(doc);
+}
+
+void removeMacPolicy(const char* mac) {
+    JsonDocument doc;
+    doc["mac"] = mac;
+    doc["action"] = "remove";
+    handleCompressionCommand(doc);
+}
+
+void test_mac_override_takes_precedence_over_the_format() {
+    hearLop001(SENSOR_A, 2000);
+    hearLop001(SENSOR_B, 2000);
+    TEST_ASSERT_EQUAL_UINT8(BEACON_LOP001, policyOf(SENSOR_A));
+
+    // A 5 °C deadband for A alone, applied to the device already tracked
+    setMacPolicy("E0:7D:EA:00:00:01", "deadband", 5.0);
+    TEST_ASSERT_EQUAL_UINT32(1, macPolicyCount);
+    TEST_ASSERT_EQUAL_UINT8(BEACON_FORMAT_COUNT, policyOf(SENSOR_A));
+    TEST_ASSERT_EQUAL_INT32(500, compressionPolicyAt(policyOf(SENSOR_A)).temperature);
+    TEST_ASSERT_EQUAL_UINT8(BEACON_LOP001, policyOf(SENSOR_B));
+
+    hostAdvanceMs(1000);
+    hearLop001(SENSOR_A, 2100);
+    hearLop001(SENSOR_B, 2100);
+    TEST_ASSERT_EQUAL_UINT32(1, publishesOf(SENSOR_A));
+    TEST_ASSERT_EQUAL_UINT32(2, publishesOf(SENSOR_B));
+
+    // Devices heard later resolve to it too
+    TEST_ASSERT_EQUAL_UINT8(BEACON_FORMAT_COUNT, resolveCompressionPolicy(SENSOR_A, BEACON_MOKO_TH));
+    TEST_ASSERT_EQUAL_UINT8(BEACON_MOKO_TH, resolveCompressionPolicy(SENSOR_C, BEACON_MOKO_TH));
+}
+
+void test_remove_re_resolves_the_moved_mac_slots() {
+    hearLop001(SENSOR_A, 2000);
+    hearLop001(SENSOR_B, 2000);
+    hearLop001(SENSOR_C, 2000);
+    setMacPolicy("E0:7D:EA:00:00:01", "deadband", 1.0);
+    setMacPolicy("E0:7D:EA:00:00:02", "deadband", 2.0);
+    setMacPolicy("E0:7D:EA:00:00:03", "deadband", 3.0);
+    TEST_ASSERT_EQUAL_UINT8(BEACON_FORMAT_COUNT + 2, policyOf(SENSOR_C));
+
+    // Removing the first moves the last into its slot
+    removeMacPolicy("E0:7D:EA:00:00:01");
+    TEST_ASSERT_EQUAL_UINT32(2, macPolicyCount);
+    TEST_ASSERT_EQUAL_UINT8(BEACON_LOP001, policyOf(SENSOR_A));
+    TEST_ASSERT_EQUAL_INT32(200, compressionPolicyAt(policyOf(SENSOR_B)).temperature);
+    TEST_ASSERT_EQUAL_INT32(300, compressionPolicyAt(policyOf(SENSOR_C)).temperature);
+    TEST_ASSERT_TRUE(policyOf(SENSOR_C) < BEACON_FORMAT_COUNT + macPolicyCount);
+
+    // And the tracker applies the right bands: A is back on the 0.1 °C
+    // default, C keeps its 3 °C, not the removed 1 °C
+    hostAdvanceMs(1000);
+    hearLop001(SENSOR_A, 2150);
+    hearLop001(SENSOR_C, 2150);
+    TEST_ASSERT_EQUAL_UINT32(2, publishesOf(SENSOR_A));
+    TEST_ASSERT_EQUAL_UINT32(1, publishesOf(SENSOR_C));
+
+    // Removing a MAC without an override changes nothing
+    removeMacPolicy("E0:7D:EA:00:00:01");
+    TEST_ASSERT_EQUAL_UINT32(2, macPolicyCount);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_percent_band_scales_with_the_published_value);
+    RUN_TEST(test_published_zero_falls_back_to_the_floor);
+    RUN_TEST(test_floor_applies_near_zero);
+    RUN_TEST(test_swinging_door_stays_open_on_a_linear_ramp);
+    RUN_TEST(test_swinging_door_closes_on_a_step);
+    RUN_TEST(test_swinging_door_ignores_noise_within_the_deviation);
+    RUN_TEST(test_heartbeat_publishes_on_its_interval_only);
+    RUN_TEST(test_mac_override_takes_precedence_over_the_format);
+    RUN_TEST(test_remove_re_resolves_the_moved_mac_slots);
+    return UNITY_END();
+}
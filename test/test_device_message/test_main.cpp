@@ -0,0 +1,433 @@
+#include <unity.h>
+#include <Arduino.h>
+#include "device_message.h"
+#include "bench.h"
+
+// Baselines are sensor/data payloads from the firmware before fixed-point
+// (JsonDocument with float readings), for the same readings
+const char* GATEWAY = "020000ABCDEF";
+const uint64_t TIMESTAMP_MS = 1700000000000ULL;
+
+PublishSnapshot makeReading(uint64_t mac, uint8_t format, bool isSensor) {
+    PublishSnapshot reading = {};
+    reading.mac = mac;
+    reading.format = format;
+    reading.isSensor = isSensor;
+    reading.timestampMs = TIMESTAMP_MS;
+    reading.compressionRatioCenti = 100;
+    reading.temperatureStats.reset();
+    reading.humidityStats.reset();
+    reading.rssiStats.reset();
+    return reading;
+}
+
+String encodeJson(const PublishSnapshot& reading) {
+    uint8_t buffer[1024];
+    PayloadWriter out(buffer, sizeof(buffer) - 1);
+    writeJsonReading(out, reading, GATEWAY);
+    TEST_ASSERT_FALSE(out.overflowed());
+    buffer[out.length()] = '\0';
+    return String((const char*)buffer);
+}
+
+void assertCentiShort(const char* expected, int32_t value) {
+    char text[CENTI_STRING_SIZE];
+    size_t length = formatCentiShort(value, text);
+    TEST_ASSERT_EQUAL_STRING(expected, text);
+    TEST_ASSERT_EQUAL(strlen(expected), length);
+}
+
+// Minimal MessagePack reader for the types writeMsgPackReading() emits
+struct MsgPackValue {
+    enum Kind { NIL, UINT, INT, ARRAY, INVALID } kind;
+    uint64_t uint;
+    int64_t sint;
+    size_t count;  // Elements of an ARRAY, which follow it
+};
+
+class MsgPackReader {
+public:
+    MsgPackReader(const uint8_t* data, size_t length) : data_(data), length_(length) {}
+
+    MsgPackValue next() {
+        MsgPackValue value = { MsgPackValue::INVALID, 0, 0, 0 };
+        if (position_ >= length_) {
+            return value;
+        }
+        uint8_t type = data_[position_++];
+        if (type < 0x80) {
+            return unsignedValue(type);
+        }
+        if (type >= 0xE0) {
+            return signedValue((int8_t)type);
+        }
+        if ((type & 0xF0) == 0x90) {
+            value.kind = MsgPackValue::ARRAY;
+            value.count = type & 0x0F;
+            return value;
+        }
+        switch (type) {
+            case 0xC0: value.kind = MsgPackValue::NIL; return value;
+            case 0xCC: return unsignedValue(bigEndian(1));
+            case 0xCD: return unsignedValue(bigEndian(2));
+            case 0xCE: return unsignedValue(bigEndian(4));
+            case 0xCF: return unsignedValue(bigEndian(8));
+            case 0xD0: return signedValue((int8_t)bigEndian(1));
+            case 0xD1: return signedValue((int16_t)bigEndian(2));
+            case 0xD2: return signedValue((int32_t)bigEndian(4));
+            case 0xD3: return signedValue((int64_t)bigEndian(8));
+            case 0xDC:
+                value.kind = MsgPackValue::ARRAY;
+                value.count = bigEndian(2);
+                return value;
+            default: return value;
+        }
+    }
+
+    // Any integer as a signed value (the encoder picks uint for >= 0)
+    int64_t nextInteger() {
+        MsgPackValue value = next();
+        TEST_ASSERT_TRUE(value.kind == MsgPackValue::UINT || value.kind == MsgPackValue::INT);
+        return value.kind == MsgPackValue::UINT ? (int64_t)value.uint : value.sint;
+    }
+
+    uint64_t nextUnsigned() {
+        MsgPackValue value = next();
+        TEST_ASSERT_EQUAL(MsgPackValue::UINT, value.kind);
+        return value.uint;
+    }
+
+    size_t nextArray() {
+        MsgPackValue value = next();
+        TEST_ASSERT_EQUAL(MsgPackValue::ARRAY, value.kind);
+        return value.count;
+    }
+
+    void nextNil() {
+        TEST_ASSERT_EQUAL(MsgPackValue::NIL, next().kind);
+    }
+
+    bool atEnd() const { return position_ == length_; }
+
+private:
+    MsgPackValue unsignedValue(uint64_t value) {
+        MsgPackValue result = { MsgPackValue::UINT, value, 0, 0 };
+        return result;
+    }
+
+    MsgPackValue signedValue(int64_t value) {
+        MsgPackValue result = { MsgPackValue::INT, 0, value, 0 };
+        return result;
+    }
+
+    uint64_t bigEndian(int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes && position_ < length_; i++) {
+            value = (value << 8) | data_[position_++];
+        }
+        return value;
+    }
+
+    const uint8_t* data_;
+    size_t length_;
+    size_t position_ = 0;
+};
+
+size_t encodeMsgPack(const PublishSnapshot& reading, uint8_t* buffer, size_t capacity) {
+    PayloadWriter out(buffer, capacity);
+    writeMsgPackReading(out, reading);
+    TEST_ASSERT_FALSE(out.overflowed());
+    return out.length();
+}
+
+// Fields every reading has, in MsgPackField order
+void assertMsgPackHeader(MsgPackReader& in, const PublishSnapshot& reading) {
+    TEST_ASSERT_EQUAL_UINT64(MSGPACK_SCHEMA_VERSION, in.nextUnsigned());   // MSGPACK_FIELD_VERSION
+    TEST_ASSERT_EQUAL_UINT64(reading.mac, in.nextUnsigned());              // MSGPACK_FIELD_MAC
+    TEST_ASSERT_EQUAL_UINT64(reading.timestampMs, in.nextUnsigned());      // MSGPACK_FIELD_TIMESTAMP
+    TEST_ASSERT_EQUAL_UINT64(reading.format, in.nextUnsigned());           // MSGPACK_FIELD_TYPE
+    TEST_ASSERT_EQUAL_INT(reading.rssi, (int)in.nextInteger());            // MSGPACK_FIELD_RSSI
+    TEST_ASSERT_EQUAL_UINT64(reading.compressionRatioCenti, in.nextUnsigned());  // MSGPACK_FIELD_COMPRESSION
+}
+
+void assertMsgPackWindowStats(MsgPackReader& in, const RunningStats& stats) {
+    TEST_ASSERT_EQUAL(WINDOW_STAT_COUNT, in.nextArray());
+    TEST_ASSERT_EQUAL_INT32(stats.min, (int32_t)in.nextInteger());
+    TEST_ASSERT_EQUAL_INT32(stats.max, (int32_t)in.nextInteger());
+    TEST_ASSERT_EQUAL_INT32(stats.mean(), (int32_t)in.nextInteger());
+    TEST_ASSERT_EQUAL_INT32((int32_t)stats.stddev(), (int32_t)in.nextInteger());
+    TEST_ASSERT_EQUAL_INT32(stats.first, (int32_t)in.nextInteger());
+    TEST_ASSERT_EQUAL_INT32(stats.last, (int32_t)in.nextInteger());
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_short_centi_drops_trailing_zeros() {
+    assertCentiShort("20", 2000);
+    assertCentiShort("26.1", 2610);
+    assertCentiShort("26.11", 2611);
+    assertCentiShort("0", 0);
+    assertCentiShort("-0.05", -5);
+    assertCentiShort("-0.5", -50);
+    assertCentiShort("-1", -100);
+    assertCentiShort("100.01", 10001);
+    assertCentiShort("-21474836.48", INT32_MIN);
+}
+
+void test_lop001_reading_matches_baseline() {
+    PublishSnapshot reading = makeReading(0xE07DEA000001ULL, BEACON_LOP001, true);
+    reading.temperatureCenti = 2000;
+    reading.humidityCenti = 2610;
+    reading.rssi = -60;
+
+    String json = encodeJson(reading);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"serialNumber\":\"E0:7D:EA:00:00:01\",\"sensorType\":\"LOP001\",\"sensorModel\":\"LOP001\","
+        "\"temp\":20,\"hum\":26.1,\"rssi\":-60,\"compressionRatio\":1,"
+        "\"gateway\":\"020000ABCDEF\",\"timestamp\":1700000000000}",
+        json.c_str());
+}
+
+void test_moko_reading_with_battery_matches_baseline() {
+    PublishSnapshot reading = makeReading(0xC4A1B2000002ULL, BEACON_MOKO_TH, true);
+    reading.temperatureCenti = -550;
+    reading.humidityCenti = 4525;
+    reading.battery = 3012;
+    reading.rssi = -81;
+    reading.compressionRatioCenti = 250;
+
+    String json = encodeJson(reading);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"serialNumber\":\"C4:A1:B2:00:00:02\",\"sensorType\":\"MOKO_TH\",\"sensorModel\":\"MOKO_TH\","
+        "\"temp\":-5.5,\"hum\":45.25,\"battery\":3012,\"rssi\":-81,\"compressionRatio\":2.5,"
+        "\"gateway\":\"020000ABCDEF\",\"timestamp\":1700000000000}",
+        json.c_str());
+}
+
+void test_presence_only_reading_matches_baseline() {
+    PublishSnapshot reading = makeReading(0x001122334455ULL, BEACON_IBEACON, false);
+    reading.rssi = -92;
+
+    String json = encodeJson(reading);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"serialNumber\":\"00:11:22:33:44:55\",\"sensorType\":\"IBEACON\",\"sensorModel\":\"IBEACON\","
+        "\"rssi\":-92,\"compressionRatio\":1,"
+        "\"gateway\":\"020000ABCDEF\",\"timestamp\":1700000000000}",
+        json.c_str());
+}
+
+void test_window_summary_matches_baseline() {
+    PublishSnapshot reading = makeReading(0xE07DEA000002ULL, BEACON_LOP001, true);
+    reading.temperatureCenti = 2100;
+    reading.humidityCenti = 5000;
+    reading.rssi = -70;
+    reading.compressionRatioCenti = 200;
+    reading.summary = true;
+    reading.windowMs = 300000;
+    reading.temperatureStats.add(2000);
+    reading.temperatureStats.add(2100);
+    reading.humidityStats.add(5000);
+    reading.humidityStats.add(5000);
+    reading.rssiStats.add(-6000);
+    reading.rssiStats.add(-7000);
+
+    String json = encodeJson(reading);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"serialNumber\":\"E0:7D:EA:00:00:02\",\"sensorType\":\"LOP001\",\"sensorModel\":\"LOP001\","
+        "\"temp\":21,\"hum\":50,\"rssi\":-70,\"compressionRatio\":2,\"count\":2,\"windowMs\":300000,"
+        "\"tempMin\":20,\"tempMax\":21,\"tempMean\":20.5,\"tempStd\":0.5,\"tempFirst\":20,\"tempLast\":21,"
+        "\"humMin\":50,\"humMax\":50,\"humMean\":50,\"humStd\":0,\"humFirst\":50,\"humLast\":50,"
+        "\"rssiMin\":-70,\"rssiMax\":-60,\"rssiMean\":-65,\"rssiStd\":5,\"rssiFirst\":-60,\"rssiLast\":-70,"
+        "\"gateway\":\"020000ABCDEF\",\"timestamp\":1700000000000}",
+        json.c_str());
+}
+
+void test_msgpack_sensor_with_battery_decodes_in_field_order() {
+    PublishSnapshot reading = makeReading(0xC4A1B2000002ULL, BEACON_MOKO_TH, true);
+    reading.temperatureCenti = -550;
+    reading.humidityCenti = 4525;
+    reading.battery = 3012;
+    reading.rssi = -81;
+    reading.compressionRatioCenti = 250;
+
+    uint8_t buffer[256];
+    MsgPackReader in(buffer, encodeMsgPack(reading, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(MSGPACK_FIELD_BATTERY + 1, in.nextArray());
+    assertMsgPackHeader(in, reading);
+    TEST_ASSERT_EQUAL_INT(-550, (int)in.nextInteger());   // MSGPACK_FIELD_TEMPERATURE
+    TEST_ASSERT_EQUAL_UINT64(4525, in.nextUnsigned());    // MSGPACK_FIELD_HUMIDITY
+    TEST_ASSERT_EQUAL_INT(3012, (int)in.nextInteger());   // MSGPACK_FIELD_BATTERY
+    TEST_ASSERT_TRUE(in.atEnd());
+}
+
+void test_msgpack_drops_trailing_absent_fields() {
+    PublishSnapshot sensor = makeReading(0xE07DEA000001ULL, BEACON_LOP001, true);
+    sensor.temperatureCenti = 2000;
+    sensor.humidityCenti = 2610;
+    sensor.rssi = -60;
+
+    uint8_t buffer[256];
+    MsgPackReader sensorIn(buffer, encodeMsgPack(sensor, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(MSGPACK_FIELD_HUMIDITY + 1, sensorIn.nextArray());
+    assertMsgPackHeader(sensorIn, sensor);
+    TEST_ASSERT_EQUAL_INT(2000, (int)sensorIn.nextInteger());
+    TEST_ASSERT_EQUAL_UINT64(2610, sensorIn.nextUnsigned());
+    TEST_ASSERT_TRUE(sensorIn.atEnd());
+
+    PublishSnapshot presence = makeReading(0x001122334455ULL, BEACON_IBEACON, false);
+    presence.rssi = -92;
+    MsgPackReader presenceIn(buffer, encodeMsgPack(presence, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(MSGPACK_FIELD_COMPRESSION + 1, presenceIn.nextArray());
+    assertMsgPackHeader(presenceIn, presence);
+    TEST_ASSERT_TRUE(presenceIn.atEnd());
+}
+
+void test_msgpack_window_summary_round_trips() {
+    PublishSnapshot reading = makeReading(0xE07DEA000002ULL, BEACON_LOP001, true);
+    reading.temperatureCenti = 2100;
+    reading.humidityCenti = 5000;
+    reading.rssi = -70;
+    reading.compressionRatioCenti = 200;
+    reading.summary = true;
+    reading.windowMs = 300000;
+    reading.temperatureStats.add(2000);
+    reading.temperatureStats.add(2100);
+    reading.humidityStats.add(5000);
+    reading.humidityStats.add(5000);
+    reading.rssiStats.add(-6000);
+    reading.rssiStats.add(-7000);
+
+    uint8_t buffer[256];
+    MsgPackReader in(buffer, encodeMsgPack(reading, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(MSGPACK_FIELD_WINDOW + 1, in.nextArray());
+    assertMsgPackHeader(in, reading);
+    TEST_ASSERT_EQUAL_INT(2100, (int)in.nextInteger());
+    TEST_ASSERT_EQUAL_UINT64(5000, in.nextUnsigned());
+    in.nextNil();  // No battery, but the window follows
+    TEST_ASSERT_EQUAL(5, in.nextArray());
+    TEST_ASSERT_EQUAL_UINT64(2, in.nextUnsigned());
+    TEST_ASSERT_EQUAL_UINT64(300000, in.nextUnsigned());
+    assertMsgPackWindowStats(in, reading.rssiStats);
+    assertMsgPackWindowStats(in, reading.temperatureStats);
+    assertMsgPackWindowStats(in, reading.humidityStats);
+    TEST_ASSERT_TRUE(in.atEnd());
+}
+
+void test_msgpack_presence_summary_has_nil_sensor_fields() {
+    PublishSnapshot reading = makeReading(0x001122334455ULL, BEACON_IBEACON, false);
+    reading.rssi = -92;
+    reading.summary = true;
+    reading.windowMs = 60000;
+    reading.rssiStats.add(-9000);
+    reading.rssiStats.add(-9400);
+    reading.rssiStats.add(-9200);
+
+    uint8_t buffer[256];
+    MsgPackReader in(buffer, encodeMsgPack(reading, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(MSGPACK_FIELD_WINDOW + 1, in.nextArray());
+    assertMsgPackHeader(in, reading);
+    in.nextNil();  // MSGPACK_FIELD_TEMPERATURE
+    in.nextNil();  // MSGPACK_FIELD_HUMIDITY
+    in.nextNil();  // MSGPACK_FIELD_BATTERY
+    TEST_ASSERT_EQUAL(3, in.nextArray());
+    TEST_ASSERT_EQUAL_UINT64(3, in.nextUnsigned());
+    TEST_ASSERT_EQUAL_UINT64(60000, in.nextUnsigned());
+    assertMsgPackWindowStats(in, reading.rssiStats);
+    TEST_ASSERT_TRUE(in.atEnd());
+}
+
+void test_msgpack_integers_round_trip_at_every_width() {
+    const int64_t values[] = {
+        0, 1, 127, 128, 255, 256, 65535, 65536, 4294967295LL, 4294967296LL, 0x7FFFFFFFFFFFFFFFLL,
+        -1, -32, -33, -128, -129, -32768, -32769, INT32_MIN, (int64_t)INT32_MIN - 1, INT64_MIN
+    };
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    uint8_t buffer[256];
+    PayloadWriter out(buffer, sizeof(buffer));
+    out.mpArray(count);
+    for (size_t i = 0; i < count; i++) {
+        out.mpSigned(values[i]);
+    }
+    out.mpUnsigned(UINT64_MAX);
+    TEST_ASSERT_FALSE(out.overflowed());
+
+    MsgPackReader in(buffer, out.length());
+    TEST_ASSERT_EQUAL(count, in.nextArray());
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(values[i] == in.nextInteger());
+    }
+    TEST_ASSERT_TRUE(UINT64_MAX == in.nextUnsigned());
+    TEST_ASSERT_TRUE(in.atEnd());
+}
+
+void test_msgpack_size_and_encode_time_against_json() {
+    struct Case {
+        const char* name;
+        PublishSnapshot reading;
+    } cases[3] = {
+        { "presence", makeReading(0x001122334455ULL, BEACON_IBEACON, false) },
+        { "sensor", makeReading(0xC4A1B2000002ULL, BEACON_MOKO_TH, true) },
+        { "window", makeReading(0xE07DEA000002ULL, BEACON_LOP001, true) },
+    };
+    cases[0].reading.rssi = -92;
+    cases[1].reading.temperatureCenti = -550;
+    cases[1].reading.humidityCenti = 4525;
+    cases[1].reading.battery = 3012;
+    cases[1].reading.rssi = -81;
+    cases[2].reading.temperatureCenti = 2100;
+    cases[2].reading.humidityCenti = 5000;
+    cases[2].reading.rssi = -70;
+    cases[2].reading.summary = true;
+    cases[2].reading.windowMs = 300000;
+    for (int i = 0; i < 30; i++) {
+        cases[2].reading.temperatureStats.add(2000 + i * 3);
+        cases[2].reading.humidityStats.add(5000 - i * 7);
+        cases[2].reading.rssiStats.add(-6000 - i * 50);
+    }
+
+    uint8_t buffer[1024];
+    char name[64];
+    for (const Case& c : cases) {
+        PayloadWriter json(buffer, sizeof(buffer));
+        writeJsonReading(json, c.reading, GATEWAY);
+        size_t jsonBytes = json.length();
+        size_t msgPackBytes = encodeMsgPack(c.reading, buffer, sizeof(buffer));
+        snprintf(name, sizeof(name), "%s json size", c.name);
+        benchReport(name, jsonBytes, "bytes");
+        snprintf(name, sizeof(name), "%s msgpack size", c.name);
+        benchReport(name, msgPackBytes, "bytes");
+        TEST_ASSERT_TRUE(msgPackBytes * 3 < jsonBytes);
+
+        snprintf(name, sizeof(name), "%s json encode", c.name);
+        double jsonNs = benchNsPerOp(name, 200000, [&](uint32_t) {
+            PayloadWriter out(buffer, sizeof(buffer));
+            writeJsonReading(out, c.reading, GATEWAY);
+            benchSink += out.length();
+        });
+        snprintf(name, sizeof(name), "%s msgpack encode", c.name);
+        double msgPackNs = benchNsPerOp(name, 200000, [&](uint32_t) {
+            PayloadWriter out(buffer, sizeof(buffer));
+            writeMsgPackReading(out, c.reading);
+            benchSink += out.length();
+        });
+        // No number formatting: well under the JSON encoder's time
+        TEST_ASSERT_TRUE(msgPackNs < jsonNs);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_short_centi_drops_trailing_zeros);
+    RUN_TEST(test_lop001_reading_matches_baseline);
+    RUN_TEST(test_moko_reading_with_battery_matches_baseline);
+    RUN_TEST(test_presence_only_reading_matches_baseline);
+    RUN_TEST(test_window_summary_matches_baseline);
+    RUN_TEST(test_msgpack_sensor_with_battery_decodes_in_field_order);
+    RUN_TEST(test_msgpack_drops_trailing_absent_fields);
+    RUN_TEST(test_msgpack_window_summary_round_trips);
+    RUN_TEST(test_msgpack_presence_summary_has_nil_sensor_fields);
+    RUN_TEST(test_msgpack_integers_round_trip_at_every_width);
+    RUN_TEST(test_msgpack_size_and_encode_time_against_json);
+    return UNITY_END();
+}
@@ -0,0 +1,210 @@
+#include <unity.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "bench.h"
+#include "gateway_host.h"
+
+// Scattered addresses, as from many vendors
+uint64_t deviceMac(uint32_t i) {
+    return (((uint64_t)i + 1) * 0x2545F4914F6CDD1DULL) & 0xFFFFFFFFFFFFULL;
+}
+
+uint32_t simState = 1;
+uint32_t simRandom() {
+    simState = simState * 1664525u + 1013904223u;
+    return simState >> 8;
+}
+
+template <size_t Capacity>
+struct BenchTable {
+    static DeviceTable<TrackedDevice, Capacity> table;
+};
+template <size_t Capacity>
+DeviceTable<TrackedDevice, Capacity> BenchTable<Capacity>::table;
+
+// find/insert/erase at a full table of `Capacity` devices (the 50 % slot
+// load the table is sized for), with std::unordered_map and the String-keyed
+// std::map the tracker used before as references. Host timings are only
+// reported; what is asserted is that all three end up holding the same devices.
+template <size_t Capacity>
+void benchTableAt(const char* label) {
+    DeviceTable<TrackedDevice, Capacity>& table = BenchTable<Capacity>::table;
+    char name[64];
+
+    // Fill from empty, timed without the clear() in between
+    double insertNs = 0;
+    const int ROUNDS = 2000000 / Capacity;
+    for (int round = 0; round < ROUNDS; round++) {
+        table.clear();
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < Capacity; i++) {
+            benchSink += table.insert(deviceMac(i), DEVICE_TIER_EVICTABLE) != nullptr;
+        }
+        insertNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    snprintf(name, sizeof(name), "device_table insert, %s", label);
+    benchReport(name, insertNs / ROUNDS / Capacity, "ns/op");
+    TEST_ASSERT_EQUAL_UINT32(Capacity, table.size());
+
+    snprintf(name, sizeof(name), "device_table find hit, %s", label);
+    benchNsPerOp(name, 1000000, [&](uint32_t i) {
+        benchSink += table.find(deviceMac(i % Capacity))->format;
+    });
+    snprintf(name, sizeof(name), "device_table find miss, %s", label);
+    benchNsPerOp(name, 1000000, [&](uint32_t i) {
+        benchSink += table.find(deviceMac(Capacity + i)) != nullptr;
+    });
+
+    // Steady churn at capacity: every erase backward-shifts its probe run
+    std::vector<uint64_t> present;
+    for (uint32_t i = 0; i < Capacity; i++) {
+        present.push_back(deviceMac(i));
+    }
+    std::vector<uint64_t> initial = present;
+    uint32_t churnSeed = simState;
+    uint32_t nextMac = Capacity;
+    snprintf(name, sizeof(name), "device_table erase+insert, %s", label);
+    benchNsPerOp(name, 200000, [&](uint32_t) {
+        uint32_t victim = simRandom() % Capacity;
+        benchSink += table.erase(present[victim]);
+        present[victim] = deviceMac(nextMac++);
+        benchSink += table.insert(present[victim], DEVICE_TIER_EVICTABLE) != nullptr;
+    });
+
+    std::unordered_map<uint64_t, TrackedDevice> reference;
+    reference.reserve(Capacity);
+    for (uint32_t i = 0; i < Capacity; i++) {
+        reference[deviceMac(i)].mac = deviceMac(i);
+    }
+    snprintf(name, sizeof(name), "unordered_map find hit, %s", label);
+    benchNsPerOp(name, 1000000, [&](uint32_t i) {
+        benchSink += reference.find(deviceMac(i % Capacity))->second.format;
+    });
+
+    // Keyed by the formatted MAC, which every advert had to build first
+    std::map<String, TrackedDevice> stringMap;
+    char key[18];
+    for (uint32_t i = 0; i < Capacity; i++) {
+        formatMac(deviceMac(i), key);
+        stringMap[String(key)].mac = deviceMac(i);
+    }
+    snprintf(name, sizeof(name), "map<String> find hit, %s", label);
+    benchNsPerOp(name, 200000, [&](uint32_t i) {
+        formatMac(deviceMac(i % Capacity), key);
+        benchSink += stringMap.find(String(key))->second.format;
+    });
+    snprintf(name, sizeof(name), "map<String> find miss, %s", label);
+    benchNsPerOp(name, 200000, [&](uint32_t i) {
+        formatMac(deviceMac(Capacity + i), key);
+        benchSink += stringMap.find(String(key)) != stringMap.end();
+    });
+
+    // The same churn, victim for victim
+    std::vector<uint64_t> mapPresent = initial;
+    simState = churnSeed;
+    nextMac = Capacity;
+    snprintf(name, sizeof(name), "map<String> erase+insert, %s", label);
+    benchNsPerOp(name, 200000, [&](uint32_t) {
+        uint32_t victim = simRandom() % Capacity;
+        formatMac(mapPresent[victim], key);
+        benchSink += stringMap.erase(String(key));
+        mapPresent[victim] = deviceMac(nextMac++);
+        formatMac(mapPresent[victim], key);
+        stringMap[String(key)].mac = mapPresent[victim];
+    });
+
+    // After the churn the table holds exactly what the map holds
+    TEST_ASSERT_TRUE(present == mapPresent);
+    TEST_ASSERT_EQUAL_UINT32(stringMap.size(), table.size());
+    for (const auto& entry : stringMap) {
+        TrackedDevice* device = table.find(entry.second.mac);
+        TEST_ASSERT_NOT_NULL(device);
+        formatMac(device->mac, key);
+        TEST_ASSERT_EQUAL_STRING(entry.first.c_str(), key);
+    }
+    TEST_ASSERT_NULL(table.find(deviceMac(0)));
+
+    // Erase alone, emptying the full table in random order
+    for (size_t i = Capacity - 1; i > 0; i--) {
+        std::swap(present[i], present[simRandom() % (i + 1)]);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t mac : present) {
+        benchSink += table.erase(mac);
+    }
+    double eraseNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / Capacity;
+    snprintf(name, sizeof(name), "device_table erase, %s", label);
+    benchReport(name, eraseNs, "ns/op");
+    TEST_ASSERT_EQUAL_UINT32(0, table.size());
+}
+
+void setUp() {
+    simState = 1;
+}
+
+void tearDown() {}
+
+void test_churn_matches_a_reference_map() {
+    // Random inserts and erases against std::unordered_map: backward-shift
+    // erase must never strand an entry behind an emptied slot
+    DeviceTable<TrackedDevice, 1000>& table = BenchTable<1000>::table;
+    table.clear();
+    std::unordered_map<uint64_t, bool> reference;
+    for (int step = 0; step < 200000; step++) {
+        uint64_t mac = deviceMac(simRandom() % 3000);
+        if (simRandom() % 2) {
+            TrackedDevice* entry = table.insert(mac, DEVICE_TIER_EVICTABLE);
+            if (reference.size() < 1000 || reference.count(mac)) {
+                TEST_ASSERT_NOT_NULL(entry);
+                reference[mac] = true;
+            } else {
+                TEST_ASSERT_NULL(entry);  // Full
+            }
+        } else {
+            TEST_ASSERT_EQUAL(reference.erase(mac) == 1, table.erase(mac));
+        }
+        if (step % 1000 == 0) {
+            for (uint32_t i = 0; i < 3000; i++) {
+                TEST_ASSERT_EQUAL(reference.count(deviceMac(i)) == 1, table.find(deviceMac(i)) != nullptr);
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(reference.size(), table.size());
+}
+
+void test_lru_order_survives_erase() {
+    DeviceTable<TrackedDevice, 100>& table = BenchTable<100>::table;
+    table.clear();
+    for (uint32_t i = 0; i < 5; i++) {
+        table.insert(deviceMac(i), DEVICE_TIER_EVICTABLE);
+    }
+    table.touch(table.find(deviceMac(0)));
+    table.erase(deviceMac(1));
+    TEST_ASSERT_EQUAL_UINT64(deviceMac(2), table.oldest(DEVICE_TIER_EVICTABLE)->mac);
+    table.setTier(table.find(deviceMac(2)), DEVICE_TIER_PINNED);
+    TEST_ASSERT_EQUAL_UINT64(deviceMac(3), table.oldest(DEVICE_TIER_EVICTABLE)->mac);
+    TEST_ASSERT_NULL(table.oldest(DEVICE_TIER_PROTECTED));
+}
+
+void test_cost_at_100() {
+    benchTableAt<100>("100 devices");
+}
+
+void test_cost_at_1k() {
+    benchTableAt<1000>("1k devices");
+}
+
+void test_cost_at_5k() {
+    benchTableAt<5000>("5k devices");
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_churn_matches_a_reference_map);
+    RUN_TEST(test_lru_order_survives_erase);
+    RUN_TEST(test_cost_at_100);
+    RUN_TEST(test_cost_at_1k);
+    RUN_TEST(test_cost_at_5k);
+    return UNITY_END();
+}
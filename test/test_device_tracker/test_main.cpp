@@ -0,0 +1,237 @@
+#include <unity.h>
+#include "alloc_counter.h"
+#include "gateway_host.h"
+
+// iBeacon advert: flags, then Apple manufacturer data with UUID/major/minor
+const uint8_t IBEACON_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15,
+    0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0,
+    0x00, 0x01, 0x00, 0x02, 0xC5
+};
+const uint64_t BEACON_MAC = 0xE07DEA000001ULL;
+
+// LOP001 (0x181A service data, no name) and MOKO T&H (0xFEAB frame 0x70)
+const uint8_t LOP001_ADVERT[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11 };
+const uint8_t MOKO_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x0C, 0x16, 0xAB, 0xFE, 0x70, 0xC5, 0x0A, 0x00, 0xC8, 0x01, 0xF4, 0x0B, 0xB8
+};
+
+const int STORM_PINNED = 20;     // LOP001, pinned
+const int STORM_PROTECTED = 30;  // MOKO T&H, sensors but not pinned
+const int STORM_MACS = 50000;    // Unique iBeacon addresses
+const uint64_t STORM_MAC_BASE = 0x4A0000000000ULL;
+
+// Hear the beacon once per dedup window, so every advert is a reading
+void hearBeacon(int times, int8_t rssi) {
+    for (int i = 0; i < times; i++) {
+        hostAdvanceMs(DEDUP_WINDOW_MAX_MS + 1);
+        ingestAdvert(BEACON_MAC, rssi, IBEACON_ADVERT, sizeof(IBEACON_ADVERT), millis());
+        while (drainAdvertRing() > 0) {
+        }
+    }
+}
+
+// The storm's sensors, heard once each before the storm starts
+void hearStormSensors() {
+    for (int i = 0; i < STORM_PINNED; i++) {
+        hostReplayIngest(0xE07DEA100000ULL + i, -60, LOP001_ADVERT, sizeof(LOP001_ADVERT), millis());
+    }
+    for (int i = 0; i < STORM_PROTECTED; i++) {
+        hostReplayIngest(0xC4A1B2100000ULL + i, -60, MOKO_ADVERT, sizeof(MOKO_ADVERT), millis());
+    }
+    runTrackerPass();
+}
+
+void runMacStorm() {
+    for (int i = 0; i < STORM_MACS; i++) {
+        hostReplayIngest(STORM_MAC_BASE + i, -90, IBEACON_ADVERT, sizeof(IBEACON_ADVERT), millis());
+    }
+    runTrackerPass();
+}
+
+int countDevices(uint64_t base, int count) {
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        found += deviceTable.find(base + i) != nullptr;
+    }
+    return found;
+}
+
+void setUp() {
+    resetGatewayHost();
+    setHostPublishMode(PUBLISH_MODE_WINDOW);
+}
+
+void tearDown() {}
+
+void test_merge_matches_one_long_window() {
+    const int32_t values[] = { 2000, 2150, 1990, 2400, -500, 2010, 2200 };
+    RunningStats whole, first, second;
+    whole.reset();
+    first.reset();
+    second.reset();
+    for (size_t i = 0; i < 7; i++) {
+        whole.add(values[i]);
+        (i < 3 ? first : second).add(values[i]);
+    }
+    first.merge(second);
+
+    TEST_ASSERT_EQUAL_UINT32(whole.count, first.count);
+    TEST_ASSERT_EQUAL_INT32(whole.first, first.first);
+    TEST_ASSERT_EQUAL_INT32(whole.last, first.last);
+    TEST_ASSERT_EQUAL_INT32(whole.min, first.min);
+    TEST_ASSERT_EQUAL_INT32(whole.max, first.max);
+    TEST_ASSERT_EQUAL_INT32(whole.mean(), first.mean());
+    TEST_ASSERT_EQUAL_UINT32(whole.stddev(), first.stddev());
+}
+
+void test_failed_publish_keeps_the_window() {
+    publishSink.enabled = false;  // Offline: presence-only devices stay dirty
+    hearBeacon(3, -60);
+    TrackedDevice* device = deviceTable.find(BEACON_MAC);
+    TEST_ASSERT_NOT_NULL(device);
+    DeviceWindow* window = deviceWindowLocked(*device);
+    TEST_ASSERT_NOT_NULL(window);
+    unsigned long windowStart = window->windowStart;
+
+    publishPendingDevices();
+
+    TEST_ASSERT_EQUAL_UINT32(0, trackerPublishes);
+    TEST_ASSERT_EQUAL_UINT32(3, window->rssiStats.count);
+    TEST_ASSERT_EQUAL_UINT32(windowStart, window->windowStart);
+    TEST_ASSERT_TRUE(device->needsPublish);
+}
+
+void test_published_window_is_summarized_once() {
+    publishSink.enabled = false;
+    hearBeacon(3, -60);
+    publishPendingDevices();
+    hearBeacon(2, -70);
+
+    publishSink.enabled = true;
+    uint32_t bytesBefore = publishSink.bytes;
+    DeviceWindow* window = deviceWindowLocked(*deviceTable.find(BEACON_MAC));
+    TEST_ASSERT_EQUAL_UINT32(5, window->rssiStats.count);
+    TEST_ASSERT_EQUAL_INT32(-6000, window->rssiStats.first);
+    publishPendingDevices();
+
+    TEST_ASSERT_EQUAL_UINT32(1, trackerPublishes);
+    TEST_ASSERT_GREATER_THAN_UINT32(bytesBefore, publishSink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, window->rssiStats.count);
+}
+
+// Call with the device map locked, as handleTrackerCommand() does
+void setBudgetDevicesLocked(size_t devices) {
+    setTrackerBudgetBytes(devices * TRACKED_DEVICE_BYTES);
+    enforceDeviceBudgetLocked();
+    resizeDevicePoolsLocked();
+}
+
+void test_side_pools_follow_the_mode_budget_and_policies() {
+    // Window mode: one window per budgeted device, no doors without a swinging_door policy
+    TEST_ASSERT_EQUAL_UINT32(MAX_TRACKED_DEVICES, deviceWindows.capacity());
+    TEST_ASSERT_EQUAL_UINT32(0, deviceDoors.capacity());
+    hearBeacon(3, -60);
+    TrackedDevice* beacon = deviceTable.find(BEACON_MAC);
+    TEST_ASSERT_EQUAL_UINT16(SIDE_POOL_NONE, beacon->doors);
+
+    // A smaller budget shrinks the pool and carries the open window across
+    int64_t lockedAt;
+    lockDeviceMap(lockedAt);
+    setBudgetDevicesLocked(100);
+    unlockDeviceMap(lockedAt);
+    TEST_ASSERT_EQUAL_UINT32(100, deviceWindows.capacity());
+    TEST_ASSERT_EQUAL_UINT32(1, deviceWindows.used());
+    TEST_ASSERT_EQUAL_UINT32(3, deviceWindowLocked(*beacon)->rssiStats.count);
+
+    // Doors only for devices whose policy uses them, and only once it is set
+    lockDeviceMap(lockedAt);
+    formatPolicies[BEACON_LOP001].algorithm = COMPRESS_SWINGING_DOOR;
+    resizeDevicePoolsLocked();
+    unlockDeviceMap(lockedAt);
+    TEST_ASSERT_EQUAL_UINT32(100, deviceDoors.capacity());
+    setHostPublishMode(PUBLISH_MODE_CHANGE);
+    const uint64_t sensorMac = 0xE07DEA100000ULL;
+    for (int i = 0; i < 2; i++) {
+        hostAdvanceMs(DEDUP_WINDOW_MAX_MS + 1);
+        hostReplayIngest(sensorMac, -60, LOP001_ADVERT, sizeof(LOP001_ADVERT), millis());
+        runTrackerPass();
+    }
+    TEST_ASSERT_TRUE(deviceTable.find(sensorMac)->doors != SIDE_POOL_NONE);
+    TEST_ASSERT_EQUAL_UINT32(1, deviceDoors.used());
+    TEST_ASSERT_EQUAL_UINT16(SIDE_POOL_NONE, beacon->doors);
+
+    // Change mode holds no windows at all
+    TEST_ASSERT_EQUAL_UINT32(0, deviceWindows.capacity());
+    TEST_ASSERT_EQUAL_UINT16(SIDE_POOL_NONE, beacon->window);
+    TEST_ASSERT_NULL(deviceWindowLocked(*deviceTable.find(sensorMac)));
+
+    // Forgetting a device hands its entries back
+    lockDeviceMap(lockedAt);
+    forgetDeviceLocked(*deviceTable.find(sensorMac));
+    unlockDeviceMap(lockedAt);
+    TEST_ASSERT_EQUAL_UINT32(0, deviceDoors.used());
+}
+
+void test_mac_storm_evicts_presence_only_devices_first() {
+    const int limit = 200;
+    trackerDeviceLimit = limit;
+    trackerPinnedFormats = 1u << BEACON_LOP001;
+    hearStormSensors();
+    runMacStorm();
+
+    TEST_ASSERT_EQUAL(limit, deviceTable.size());
+    TEST_ASSERT_EQUAL(STORM_PINNED, countDevices(0xE07DEA100000ULL, STORM_PINNED));
+    TEST_ASSERT_EQUAL(STORM_PROTECTED, countDevices(0xC4A1B2100000ULL, STORM_PROTECTED));
+    // The newest storm addresses are the ones left
+    TEST_ASSERT_EQUAL(limit - STORM_PINNED - STORM_PROTECTED,
+                      countDevices(STORM_MAC_BASE + STORM_MACS - (limit - STORM_PINNED - STORM_PROTECTED),
+                                   limit - STORM_PINNED - STORM_PROTECTED));
+    TEST_ASSERT_EQUAL_UINT32(STORM_MACS - (limit - STORM_PINNED - STORM_PROTECTED), devicesEvicted);
+    TEST_ASSERT_EQUAL_UINT32(0, sensorsEvicted);
+    TEST_ASSERT_EQUAL_UINT32(0, deviceTableFull);
+}
+
+void test_mac_storm_evicts_unpinned_sensors_only_when_nothing_else_is_left() {
+    trackerDeviceLimit = STORM_PINNED + STORM_PROTECTED;
+    trackerPinnedFormats = 1u << BEACON_LOP001;
+    hearStormSensors();
+    runMacStorm();
+
+    // The first storm address replaced the oldest MOKO; every later one
+    // replaced the storm address before it
+    TEST_ASSERT_EQUAL(STORM_PINNED + STORM_PROTECTED, deviceTable.size());
+    TEST_ASSERT_EQUAL(STORM_PINNED, countDevices(0xE07DEA100000ULL, STORM_PINNED));
+    TEST_ASSERT_NULL(deviceTable.find(0xC4A1B2100000ULL));
+    TEST_ASSERT_EQUAL(STORM_PROTECTED - 1, countDevices(0xC4A1B2100001ULL, STORM_PROTECTED - 1));
+    TEST_ASSERT_NOT_NULL(deviceTable.find(STORM_MAC_BASE + STORM_MACS - 1));
+    TEST_ASSERT_EQUAL_UINT32(STORM_MACS, devicesEvicted);
+    TEST_ASSERT_EQUAL_UINT32(1, sensorsEvicted);
+    TEST_ASSERT_EQUAL_UINT32(0, deviceTableFull);
+}
+
+void test_mac_storm_is_turned_away_by_a_pinned_table() {
+    trackerDeviceLimit = STORM_PINNED + STORM_PROTECTED;
+    trackerPinnedFormats = (1u << BEACON_LOP001) | (1u << BEACON_MOKO_TH);
+    hearStormSensors();
+    runMacStorm();
+
+    TEST_ASSERT_EQUAL(STORM_PINNED + STORM_PROTECTED, deviceTable.size());
+    TEST_ASSERT_EQUAL(STORM_PINNED, countDevices(0xE07DEA100000ULL, STORM_PINNED));
+    TEST_ASSERT_EQUAL(STORM_PROTECTED, countDevices(0xC4A1B2100000ULL, STORM_PROTECTED));
+    TEST_ASSERT_EQUAL_UINT32(0, devicesEvicted);
+    TEST_ASSERT_EQUAL_UINT32(0, sensorsEvicted);
+    TEST_ASSERT_EQUAL_UINT32(STORM_MACS, deviceTableFull);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_merge_matches_one_long_window);
+    RUN_TEST(test_failed_publish_keeps_the_window);
+    RUN_TEST(test_published_window_is_summarized_once);
+    RUN_TEST(test_side_pools_follow_the_mode_budget_and_policies);
+    RUN_TEST(test_mac_storm_evicts_presence_only_devices_first);
+    RUN_TEST(test_mac_storm_evicts_unpinned_sensors_only_when_nothing_else_is_left);
+    RUN_TEST(test_mac_storm_is_turned_away_by_a_pinned_table);
+    return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include <unity.h>
+#include "gateway_host.h"
+
+// iBeacon advert: presence only, so a failed publish is not stored offline
+const uint8_t IBEACON_ADVERT[] = {
+    0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15,
+    0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0,
+    0x00, 0x01, 0x00, 0x02, 0xC5
+};
+const uint64_t OLD_MAC = 0x4A0000000001ULL;
+const uint64_t NEW_MAC = 0x4A0000000002ULL;
+
+void hear(uint64_t mac) {
+    TEST_ASSERT_TRUE(ingestAdvert(mac, -70, IBEACON_ADVERT, sizeof(IBEACON_ADVERT), millis()));
+    while (drainAdvertRing() > 0) {
+    }
+}
+
+void setUp() {
+    resetGatewayHost();
+    hostAdvanceMs(1000);  // Past boot: a lastPublish of 0 means never published
+    mqtt_connected = true;
+}
+
+void tearDown() {
+    publishSink.enabled = false;
+}
+
+void test_push_is_ignored_while_queued() {
+    DirtyQueue<8> queue;
+    queue.push(3);
+    queue.push(5);
+    queue.push(3);
+    queue.push(5);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.size());
+
+    uint16_t index;
+    TEST_ASSERT_TRUE(queue.pop(index));
+    TEST_ASSERT_EQUAL_UINT16(3, index);
+    TEST_ASSERT_TRUE(queue.pop(index));
+    TEST_ASSERT_EQUAL_UINT16(5, index);
+    TEST_ASSERT_FALSE(queue.pop(index));
+    TEST_ASSERT_EQUAL_UINT32(0, queue.size());
+}
+
+void test_popped_slot_can_be_queued_again() {
+    DirtyQueue<8> queue;
+    for (uint16_t i = 0; i < 8; i++) {
+        queue.push(i);
+    }
+    uint16_t index;
+    TEST_ASSERT_TRUE(queue.pop(index));
+    TEST_ASSERT_EQUAL_UINT16(0, index);
+    // Back in behind the others, once
+    queue.push(0);
+    queue.push(0);
+    TEST_ASSERT_EQUAL_UINT32(8, queue.size());
+    for (uint16_t expected = 1; expected <= 8; expected++) {
+        TEST_ASSERT_TRUE(queue.pop(index));
+        TEST_ASSERT_EQUAL_UINT16(expected % 8, index);
+    }
+    TEST_ASSERT_FALSE(queue.pop(index));
+
+    // Emptied, the queue starts over from a fresh head
+    queue.push(7);
+    TEST_ASSERT_TRUE(queue.pop(index));
+    TEST_ASSERT_EQUAL_UINT16(7, index);
+}
+
+void test_failed_change_publish_is_queued_again() {
+    publishSink.enabled = false;
+    mqtt_connected = false;  // Presence-only messages cannot be sent or stored
+    hear(OLD_MAC);
+    TEST_ASSERT_EQUAL_UINT32(1, getPublishQueueLength());
+
+    publishPendingDevices();
+    TrackedDevice* device = deviceTable.find(OLD_MAC);
+    TEST_ASSERT_EQUAL_UINT32(0, trackerPublishes);
+    TEST_ASSERT_EQUAL_UINT32(1, getPublishQueueLength());
+    TEST_ASSERT_TRUE(device->needsPublish);
+    TEST_ASSERT_EQUAL_UINT32(0, device->publishes);
+
+    // Still queued once, not once per attempt
+    publishPendingDevices();
+    TEST_ASSERT_EQUAL_UINT32(1, getPublishQueueLength());
+
+    mqtt_connected = true;
+    publishSink.enabled = true;
+    publishPendingDevices();
+    TEST_ASSERT_EQUAL_UINT32(1, trackerPublishes);
+    TEST_ASSERT_EQUAL_UINT32(1, publishSink.messages);
+    TEST_ASSERT_EQUAL_UINT32(0, getPublishQueueLength());
+    TEST_ASSERT_FALSE(device->needsPublish);
+}
+
+void test_reused_index_is_published_under_the_new_mac_only() {
+    publishSink.enabled = true;
+    hear(OLD_MAC);
+    TrackedDevice* old = deviceTable.find(OLD_MAC);
+    uint16_t index = deviceTable.indexOf(old);
+
+    // Expired while queued: its entry goes back to the pool, and the next
+    // new device takes the same index, still in the queue
+    int64_t lockedAt;
+    lockDeviceMap(lockedAt);
+    forgetDeviceLocked(*old);
+    unlockDeviceMap(lockedAt);
+    TEST_ASSERT_EQUAL_UINT32(1, getPublishQueueLength());
+    hear(NEW_MAC);
+    TrackedDevice* device = deviceTable.find(NEW_MAC);
+    TEST_ASSERT_EQUAL_UINT16(index, deviceTable.indexOf(device));
+    TEST_ASSERT_EQUAL_UINT32(1, getPublishQueueLength());
+
+    publishPendingDevices();
+    TEST_ASSERT_NULL(deviceTable.find(OLD_MAC));
+    TEST_ASSERT_EQUAL_UINT32(1, publishSink.messages);
+    TEST_ASSERT_EQUAL_UINT32(1, trackerPublishes);
+    TEST_ASSERT_EQUAL_UINT32(1, device->publishes);
+    TEST_ASSERT_EQUAL_UINT32(0, getPublishQueueLength());
+}
+
+void test_erased_index_left_unused_is_skipped() {
+    publishSink.enabled = true;
+    hear(OLD_MAC);
+    int64_t lockedAt;
+    lockDeviceMap(lockedAt);
+    forgetDeviceLocked(*deviceTable.find(OLD_MAC));
+    unlockDeviceMap(lockedAt);
+
+    publishPendingDevices();
+    TEST_ASSERT_EQUAL_UINT32(0, publishSink.messages);
+    TEST_ASSERT_EQUAL_UINT32(0, trackerPublishes);
+    TEST_ASSERT_EQUAL_UINT32(0, getPublishQueueLength());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_push_is_ignored_while_queued);
+    RUN_TEST(test_popped_slot_can_be_queued_again);
+    RUN_TEST(test_failed_change_publish_is_queued_again);
+    RUN_TEST(test_reused_index_is_published_under_the_new_mac_only);
+    RUN_TEST(test_erased_index_left_unused_is_skipped);
+    return UNITY_END();
+}
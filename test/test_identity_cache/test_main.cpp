@@ -0,0 +1,115 @@
+#include <unity.h>
+#include <Arduino.h>
+#include "identity_cache.h"
+
+const uint64_t SENSOR_MAC = 0xE07DEA000001ULL;
+
+// Scan response carrying only a complete local name
+const uint8_t NAMED_PAYLOAD[] = { 0x07, 0x09, 'P', 'h', 'o', 'n', 'e', '1' };
+const uint8_t NAMELESS_PAYLOAD[] = { 0x02, 0x01, 0x06 };
+
+BeaconReading readingOf(BeaconFormat format, BeaconIdentity identity) {
+    BeaconReading reading = {};
+    reading.format = format;
+    reading.identity = identity;
+    return reading;
+}
+
+// Another MAC landing in the same direct-mapped slot as `mac`
+uint64_t collidingMac(uint64_t mac) {
+    size_t slot = (size_t)((mac * 0x9E3779B97F4A7C15ull) >> (64 - IDENTITY_CACHE_BITS));
+    for (uint64_t other = mac + 1;; other++) {
+        if ((size_t)((other * 0x9E3779B97F4A7C15ull) >> (64 - IDENTITY_CACHE_BITS)) == slot) {
+            return other;
+        }
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_miss_is_new_and_hit_is_accepted() {
+    IdentityCache cache;
+    BeaconReading shape = readingOf(BEACON_LOP001, BEACON_IDENTITY_SHAPE);
+    TEST_ASSERT_EQUAL(IDENTITY_NEW, cache.classify(SENSOR_MAC, shape));
+    TEST_ASSERT_EQUAL(IDENTITY_ACCEPT, cache.classify(SENSOR_MAC, shape));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.entries());
+
+    // Known as LOP001: the same MAC shaped like something else is rejected
+    BeaconReading moko = readingOf(BEACON_MOKO_TH, BEACON_IDENTITY_SHAPE);
+    TEST_ASSERT_EQUAL(IDENTITY_REJECT, cache.classify(SENSOR_MAC, moko));
+
+    // Self-describing frames bypass the cache altogether
+    BeaconReading frame = readingOf(BEACON_MOKO_TH, BEACON_IDENTITY_FRAME);
+    TEST_ASSERT_EQUAL(IDENTITY_ACCEPT, cache.classify(SENSOR_MAC + 1, frame));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.entries());
+}
+
+void test_name_overwrites_a_shape_guess() {
+    IdentityCache cache;
+    TEST_ASSERT_EQUAL(IDENTITY_NEW, cache.classify(SENSOR_MAC, readingOf(BEACON_LOP001, BEACON_IDENTITY_SHAPE)));
+    // The scan response names it something else
+    TEST_ASSERT_EQUAL(IDENTITY_ACCEPT, cache.classify(SENSOR_MAC, readingOf(BEACON_MOKO_TH, BEACON_IDENTITY_NAME)));
+    TEST_ASSERT_EQUAL(IDENTITY_REJECT, cache.classify(SENSOR_MAC, readingOf(BEACON_LOP001, BEACON_IDENTITY_SHAPE)));
+    TEST_ASSERT_EQUAL(IDENTITY_ACCEPT, cache.classify(SENSOR_MAC, readingOf(BEACON_MOKO_TH, BEACON_IDENTITY_SHAPE)));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.entries());
+    TEST_ASSERT_EQUAL_UINT32(0, cache.overwrites());
+}
+
+void test_undecoded_named_advert_rejects_the_guess() {
+    IdentityCache cache;
+    BeaconReading shape = readingOf(BEACON_LOP001, BEACON_IDENTITY_SHAPE);
+    cache.classify(SENSOR_MAC, shape);
+    cache.noteUndecoded(SENSOR_MAC, NAMELESS_PAYLOAD, sizeof(NAMELESS_PAYLOAD));
+    TEST_ASSERT_EQUAL(IDENTITY_ACCEPT, cache.classify(SENSOR_MAC, shape));
+
+    // A phone whose nameless adverts happened to look like a sensor
+    cache.noteUndecoded(SENSOR_MAC, NAMED_PAYLOAD, sizeof(NAMED_PAYLOAD));
+    TEST_ASSERT_EQUAL(IDENTITY_REJECT, cache.classify(SENSOR_MAC, shape));
+}
+
+void test_collision_overwrites_the_older_mac() {
+    IdentityCache cache;
+    uint64_t other = collidingMac(SENSOR_MAC);
+    BeaconReading shape = readingOf(BEACON_LOP001, BEACON_IDENTITY_SHAPE);
+    cache.classify(SENSOR_MAC, readingOf(BEACON_MOKO_TH, BEACON_IDENTITY_NAME));
+    TEST_ASSERT_EQUAL(IDENTITY_NEW, cache.classify(other, shape));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.entries());
+    TEST_ASSERT_EQUAL_UINT32(1, cache.overwrites());
+
+    // The first MAC is forgotten: its shape guess is trusted again
+    TEST_ASSERT_EQUAL(IDENTITY_NEW, cache.classify(SENSOR_MAC, shape));
+    TEST_ASSERT_EQUAL_UINT32(2, cache.overwrites());
+}
+
+void test_entries_count_occupied_slots() {
+    IdentityCache cache;
+    BeaconReading shape = readingOf(BEACON_LOP001, BEACON_IDENTITY_SHAPE);
+    // Far more MACs than slots: occupancy stops at the slot count, the rest
+    // shows up as overwrites
+    for (uint64_t i = 0; i < IDENTITY_CACHE_SIZE * 8; i++) {
+        cache.classify(SENSOR_MAC + i, shape);
+    }
+    TEST_ASSERT_TRUE(cache.entries() <= IDENTITY_CACHE_SIZE);
+    TEST_ASSERT_TRUE(cache.entries() > IDENTITY_CACHE_SIZE * 9 / 10);
+    TEST_ASSERT_EQUAL_UINT32(IDENTITY_CACHE_SIZE * 8 - cache.entries(), cache.overwrites());
+
+    // Hearing known MACs again changes neither
+    size_t entries = cache.entries();
+    uint32_t overwrites = cache.overwrites();
+    uint64_t last = SENSOR_MAC + IDENTITY_CACHE_SIZE * 8 - 1;
+    cache.classify(last, shape);
+    cache.classify(last, readingOf(BEACON_LOP001, BEACON_IDENTITY_NAME));
+    TEST_ASSERT_EQUAL_UINT32(entries, cache.entries());
+    TEST_ASSERT_EQUAL_UINT32(overwrites, cache.overwrites());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_miss_is_new_and_hit_is_accepted);
+    RUN_TEST(test_name_overwrites_a_shape_guess);
+    RUN_TEST(test_undecoded_named_advert_rejects_the_guess);
+    RUN_TEST(test_collision_overwrites_the_older_mac);
+    RUN_TEST(test_entries_count_occupied_slots);
+    return UNITY_END();
+}
@@ -0,0 +1,216 @@
+#include <unity.h>
+#include <thread>
+#include "alloc_counter.h"
+#include "bench.h"
+#include "gateway_host.h"
+
+// Distinct, unordered addresses: odd multiples keep the low bit set, so
+// listedMac(i) + 1 is never listed
+uint64_t listedMac(uint32_t i) {
+    return ((uint64_t)i * 0x9E3779B97F4A7C15ULL | 1) & 0xFFFFFFFFFFFFULL;
+}
+
+MacFilterTable* buildTable(size_t macCount, size_t prefixCount) {
+    std::vector<uint64_t> macs;
+    std::vector<uint32_t> prefixes;
+    for (size_t i = 0; i < macCount; i++) {
+        macs.push_back(listedMac(i));
+    }
+    for (size_t i = 0; i < prefixCount; i++) {
+        prefixes.push_back(0xE00000 + i * 2);
+    }
+    return createMacFilterTable(macs, prefixes);
+}
+
+void setUp() {
+    resetGatewayHost();
+    macFilterRejected = 0;
+    saveConfigBlob(MAC_FILTER_NVS_MACS, nullptr, 0);
+    saveConfigBlob(MAC_FILTER_NVS_PREFIXES, nullptr, 0);
+}
+
+void tearDown() {
+    installMacFilter(nullptr);
+    hostMaxAllocHeap = 128 * 1024;
+}
+
+void test_filter_holds_the_full_list() {
+    installMacFilter(buildTable(MAC_FILTER_MAX_MACS, MAC_FILTER_MAX_PREFIXES));
+    TEST_ASSERT_EQUAL_UINT32(MAC_FILTER_MAX_MACS + MAC_FILTER_MAX_PREFIXES, getMacFilterEntryCount());
+
+    for (uint32_t i = 0; i < MAC_FILTER_MAX_MACS; i++) {
+        TEST_ASSERT_TRUE(macFilterAllows(listedMac(i)));
+        TEST_ASSERT_FALSE(macFilterAllows(listedMac(i) + 1));
+    }
+    TEST_ASSERT_EQUAL_UINT32(MAC_FILTER_MAX_MACS, macFilterRejected.load());
+
+    // Any device under a listed vendor prefix, none under the gaps between
+    TEST_ASSERT_TRUE(macFilterAllows(0xE00000123456ULL));
+    TEST_ASSERT_TRUE(macFilterAllows((uint64_t)(0xE00000 + 2 * (MAC_FILTER_MAX_PREFIXES - 1)) << 24));
+    TEST_ASSERT_FALSE(macFilterAllows(0xE00001123456ULL));
+}
+
+void test_empty_filter_accepts_everything() {
+    std::vector<uint64_t> macs;
+    std::vector<uint32_t> prefixes;
+    TEST_ASSERT_NULL(createMacFilterTable(macs, prefixes));
+    installMacFilter(nullptr);
+    TEST_ASSERT_TRUE(macFilterAllows(0x112233445566ULL));
+    TEST_ASSERT_EQUAL_UINT32(0, getMacFilterEntryCount());
+}
+
+void test_saved_list_survives_a_reboot() {
+    installMacFilter(buildTable(MAC_FILTER_MAX_MACS, 16));
+    saveMacFilter();
+    File file = SPIFFS.open(MAC_FILTER_FILE, "r");
+    TEST_ASSERT_TRUE((bool)file);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(MAC_FILTER_MAX_MACS * 6 + 16 * 3 + 16, file.size());
+    file.close();
+
+    installMacFilter(nullptr);
+    loadMacFilter();
+    TEST_ASSERT_EQUAL_UINT32(MAC_FILTER_MAX_MACS + 16, getMacFilterEntryCount());
+    TEST_ASSERT_TRUE(macFilterAllows(listedMac(MAC_FILTER_MAX_MACS - 1)));
+    TEST_ASSERT_TRUE(macFilterAllows(0xE0001E000001ULL));
+
+    // Clearing removes the file, so the next boot accepts everything
+    installMacFilter(nullptr);
+    saveMacFilter();
+    TEST_ASSERT_FALSE(SPIFFS.exists(MAC_FILTER_FILE));
+    loadMacFilter();
+    TEST_ASSERT_EQUAL_UINT32(0, getMacFilterEntryCount());
+}
+
+void test_list_from_nvs_is_still_loaded_and_moved() {
+    const uint8_t macBytes[12] = { 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+    const uint8_t prefixBytes[3] = { 0xE0, 0x7D, 0xEA };
+    saveConfigBlob(MAC_FILTER_NVS_MACS, macBytes, sizeof(macBytes));
+    saveConfigBlob(MAC_FILTER_NVS_PREFIXES, prefixBytes, sizeof(prefixBytes));
+
+    loadMacFilter();
+    TEST_ASSERT_EQUAL_UINT32(3, getMacFilterEntryCount());
+    TEST_ASSERT_TRUE(macFilterAllows(0xAABBCCDDEEFFULL));
+    TEST_ASSERT_TRUE(macFilterAllows(0xE07DEA000001ULL));
+    TEST_ASSERT_FALSE(macFilterAllows(0xAABBCCDDEE00ULL));
+
+    saveMacFilter();
+    TEST_ASSERT_TRUE(SPIFFS.exists(MAC_FILTER_FILE));
+    TEST_ASSERT_EQUAL_UINT32(0, getConfigBlobLength(MAC_FILTER_NVS_MACS));
+}
+
+void test_add_merges_into_one_exact_allocation() {
+    installMacFilter(buildTable(MAC_FILTER_MAX_MACS - 10, 4));
+    // Half already listed, half new, out of order and repeated
+    std::vector<uint64_t> macs;
+    for (uint32_t i = 0; i < 20; i++) {
+        macs.push_back(listedMac(MAC_FILTER_MAX_MACS - 20 + i));
+        macs.push_back(listedMac(MAC_FILTER_MAX_MACS - 20 + i));
+    }
+    std::vector<uint32_t> prefixes = { 0xE00000, 0xF00000 };
+    sortUniqueFilterEntries(macs);
+    sortUniqueFilterEntries(prefixes);
+
+    MacFilterTable* table;
+    {
+        AllocationScope scope;
+        table = mergeMacFilterTable(macFilter.load(), macs, prefixes);
+        TEST_ASSERT_EQUAL_UINT64(1, scope.allocations());
+        TEST_ASSERT_EQUAL_UINT64(sizeof(MacFilterTable) + MAC_FILTER_MAX_MACS * 8 + 5 * 4, scope.bytes());
+    }
+    TEST_ASSERT_NOT_NULL(table);
+    TEST_ASSERT_EQUAL_UINT32(MAC_FILTER_MAX_MACS, table->macCount);
+    TEST_ASSERT_EQUAL_UINT32(5, table->prefixCount);
+    TEST_ASSERT_TRUE(std::is_sorted(table->macs, table->macs + table->macCount));
+    TEST_ASSERT_TRUE(std::adjacent_find(table->macs, table->macs + table->macCount) == table->macs + table->macCount);
+    TEST_ASSERT_TRUE(std::is_sorted(table->prefixes, table->prefixes + table->prefixCount));
+
+    installMacFilter(table);
+    for (uint32_t i = 0; i < MAC_FILTER_MAX_MACS; i++) {
+        TEST_ASSERT_TRUE(macFilterAllows(listedMac(i)));
+    }
+    TEST_ASSERT_TRUE(macFilterAllows(0xF00000000001ULL));
+}
+
+void test_table_is_not_built_without_a_large_enough_block() {
+    std::vector<uint64_t> macs;
+    for (uint32_t i = 0; i < MAC_FILTER_MAX_MACS; i++) {
+        macs.push_back(listedMac(i));
+    }
+    std::vector<uint32_t> prefixes;
+    size_t bytes = sizeof(MacFilterTable) + MAC_FILTER_MAX_MACS * sizeof(uint64_t);
+
+    hostMaxAllocHeap = bytes + MAC_FILTER_HEAP_RESERVE - 1;
+    AllocationScope scope;
+    TEST_ASSERT_NULL(createMacFilterTable(macs, prefixes));
+    TEST_ASSERT_EQUAL_UINT64(0, scope.allocations());
+
+    // The full list fits in what a no-PSRAM board has left with WiFi up
+    hostMaxAllocHeap = bytes + MAC_FILTER_HEAP_RESERVE;
+    MacFilterTable* table = createMacFilterTable(macs, prefixes);
+    TEST_ASSERT_NOT_NULL(table);
+    free(table);
+}
+
+void test_lookups_race_table_swaps() {
+    // Every table lists `member`, so a lookup that saw a freed table or a
+    // half-swapped one would show up as a rejection (or a crash)
+    const uint64_t member = listedMac(7);
+    installMacFilter(buildTable(MAC_FILTER_MAX_MACS, 0));
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint32_t> lookups{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&]() {
+            while (!stop.load()) {
+                macFilterAllows(member);
+                lookups.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (int swap = 0; swap < 200; swap++) {
+        installMacFilter(buildTable(swap % 2 ? MAC_FILTER_MAX_MACS : 100, swap % 3));
+    }
+    stop = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(0, lookups.load());
+    TEST_ASSERT_EQUAL_UINT32(0, macFilterRejected.load());
+    TEST_ASSERT_EQUAL_UINT32(0, macFilterReaders.load());
+}
+
+void test_lookup_cost_of_the_full_list() {
+    installMacFilter(buildTable(1000, 64));
+    double hit1k = benchNsPerOp("mac_filter hit, 1k MACs", 1000000, [](uint32_t i) {
+        benchSink += macFilterAllows(listedMac(i % 1000));
+    });
+    installMacFilter(buildTable(MAC_FILTER_MAX_MACS, MAC_FILTER_MAX_PREFIXES));
+    double hitFull = benchNsPerOp("mac_filter hit, full list", 1000000, [](uint32_t i) {
+        benchSink += macFilterAllows(listedMac(i % MAC_FILTER_MAX_MACS));
+    });
+    double missFull = benchNsPerOp("mac_filter miss, full lists", 1000000, [](uint32_t i) {
+        benchSink += macFilterAllows(listedMac(i % MAC_FILTER_MAX_MACS) + 1);
+    });
+    benchNsPerOp("mac_filter install full list", 100, [](uint32_t) {
+        installMacFilter(buildTable(MAC_FILTER_MAX_MACS, 0));
+    });
+
+    // Bisection: several times the entries is a few more comparisons, not
+    // several times the time
+    TEST_ASSERT_LESS_THAN(hit1k * 4 + 20, hitFull);
+    TEST_ASSERT_LESS_THAN(hit1k * 4 + 20, missFull);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_filter_holds_the_full_list);
+    RUN_TEST(test_empty_filter_accepts_everything);
+    RUN_TEST(test_saved_list_survives_a_reboot);
+    RUN_TEST(test_list_from_nvs_is_still_loaded_and_moved);
+    RUN_TEST(test_add_merges_into_one_exact_allocation);
+    RUN_TEST(test_table_is_not_built_without_a_large_enough_block);
+    RUN_TEST(test_lookups_race_table_swaps);
+    RUN_TEST(test_lookup_cost_of_the_full_list);
+    return UNITY_END();
+}
@@ -0,0 +1,284 @@
+#include <unity.h>
+#include "gateway_host.h"
+
+const uint32_t LOOPBACK = htonl(INADDR_LOOPBACK);
+
+// Listening socket on 127.0.0.1 (port 0 = any free port)
+int openListener(uint16_t port, uint16_t& boundPort) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = LOOPBACK;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    socklen_t length = sizeof(address);
+    getsockname(fd, (struct sockaddr*)&address, &length);
+    boundPort = ntohs(address.sin_port);
+    return fd;
+}
+
+NetStep pollTcpUntilSettled(int& fd) {
+    NetStep step = NET_PENDING;
+    for (int i = 0; i < 1000 && step == NET_PENDING; i++) {
+        step = pollTcpConnect(millis(), MQTT_TCP_TIMEOUT_MS, MQTT_TCP_TIMEOUT_MS, fd);
+        if (step == NET_PENDING) {
+            delay(1);
+        }
+    }
+    return step;
+}
+
+// Step the connection until it settles in `target` or a step limit,
+// checking that no single step holds the caller
+bool stepUntil(MqttConnState target, int maxSteps = 2000) {
+    for (int i = 0; i < maxSteps; i++) {
+        int64_t start = esp_timer_get_time();
+        mqttConnectionStep();
+        TEST_ASSERT_LESS_THAN_UINT32(100000, (uint32_t)(esp_timer_get_time() - start));
+        if (mqttConnState == target) {
+            return true;
+        }
+        if (mqttConnState == MQTT_STATE_DNS || mqttConnState == MQTT_STATE_TCP) {
+            delay(1);
+        }
+    }
+    return false;
+}
+
+void setUp() {
+    resetGatewayHost();
+    mqttConnState = MQTT_STATE_BACKOFF;
+    mqttBackoff = ReconnectBackoff();
+    mqttConnectStats = MqttConnectStats();
+    mqttBrokerAddress = BrokerAddressCache();
+    mqttPhaseStarted = false;
+    mqttPlainClient.stop();
+    cancelTcpConnect();
+    hostDnsRecords.clear();
+    hostDnsPending.clear();
+    hostDnsQueries = 0;
+}
+
+void tearDown() {}
+
+// --- Backoff ---
+
+// Backoff after `failures` earlier failures
+ReconnectBackoff backoffAfter(int failures) {
+    ReconnectBackoff backoff;
+    for (int i = 0; i < failures; i++) {
+        backoff.fail(0, 0);
+    }
+    return backoff;
+}
+
+void test_backoff_doubles_with_equal_jitter() {
+    uint32_t ceiling = MQTT_BACKOFF_MIN_MS;
+    for (int failures = 0; failures < 12; failures++) {
+        // Waits span the upper half of the ceiling, both ends included
+        TEST_ASSERT_EQUAL_UINT32(ceiling / 2, backoffAfter(failures).fail(0, 0));
+        TEST_ASSERT_EQUAL_UINT32(ceiling, backoffAfter(failures).fail(0, ceiling / 2));
+        ceiling = ceiling * 2 < MQTT_BACKOFF_MAX_MS ? ceiling * 2 : MQTT_BACKOFF_MAX_MS;
+    }
+    TEST_ASSERT_EQUAL_UINT32(MQTT_BACKOFF_MAX_MS, ceiling);
+}
+
+void test_backoff_is_capped_and_never_zero() {
+    ReconnectBackoff backoff;
+    for (int i = 0; i < 100; i++) {
+        uint32_t wait = backoff.fail(0, esp_random());
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(MQTT_BACKOFF_MIN_MS / 2, wait);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(MQTT_BACKOFF_MAX_MS, wait);
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, backoff.failures());
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(MQTT_BACKOFF_MAX_MS / 2, backoff.fail(0, 0));
+}
+
+void test_backoff_ready_time_and_reset() {
+    ReconnectBackoff backoff;
+    uint32_t wait = backoff.fail(UINT32_MAX - 100, 0);  // Across the millis() wrap
+    TEST_ASSERT_EQUAL_UINT32(wait, backoff.msUntilReady(UINT32_MAX - 100));
+    TEST_ASSERT_EQUAL_UINT32(wait - 200, backoff.msUntilReady(UINT32_MAX + 100u));
+    TEST_ASSERT_EQUAL_UINT32(0, backoff.msUntilReady(UINT32_MAX - 100 + wait));
+
+    backoff.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, backoff.failures());
+    TEST_ASSERT_EQUAL_UINT32(MQTT_BACKOFF_MIN_MS / 2, backoff.fail(0, 0));
+}
+
+void test_backoff_spreads_a_fleet() {
+    // 1000 gateways that lost the broker together retry over half the ceiling
+    uint32_t earliest = UINT32_MAX, latest = 0;
+    for (int gateway = 0; gateway < 1000; gateway++) {
+        ReconnectBackoff backoff;
+        for (int i = 0; i < 10; i++) {
+            backoff.fail(0, esp_random());
+        }
+        uint32_t wait = backoff.fail(0, esp_random());
+        earliest = wait < earliest ? wait : earliest;
+        latest = wait > latest ? wait : latest;
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(MQTT_BACKOFF_MAX_MS / 2 - 1000, latest - earliest);
+}
+
+// --- Broker address cache ---
+
+void test_address_cache_is_fresh_for_the_ttl() {
+    BrokerAddressCache cache;
+    TEST_ASSERT_FALSE(cache.valid());
+    TEST_ASSERT_FALSE(cache.fresh(0));
+
+    cache.store(LOOPBACK, 1000);
+    TEST_ASSERT_TRUE(cache.fresh(1000));
+    TEST_ASSERT_TRUE(cache.fresh(1000 + MQTT_DNS_TTL_MS - 1));
+    TEST_ASSERT_FALSE(cache.fresh(1000 + MQTT_DNS_TTL_MS));
+    TEST_ASSERT_TRUE(cache.valid());
+    TEST_ASSERT_EQUAL_UINT32(LOOPBACK, cache.address());
+}
+
+void test_address_cache_expire_keeps_the_fallback() {
+    BrokerAddressCache cache;
+    cache.store(LOOPBACK, UINT32_MAX - 10);  // Across the millis() wrap
+    TEST_ASSERT_TRUE(cache.fresh(5));
+    cache.expire();
+    TEST_ASSERT_FALSE(cache.fresh(5));
+    TEST_ASSERT_TRUE(cache.valid());
+    TEST_ASSERT_EQUAL_UINT32(LOOPBACK, cache.address());
+    cache.store(LOOPBACK + 1, 6);
+    TEST_ASSERT_TRUE(cache.fresh(6));
+}
+
+// --- Async DNS and TCP ---
+
+void test_dns_lookup_is_answered_by_callback() {
+    hostDnsRecords["broker.test"] = LOOPBACK;
+    uint32_t address = 0;
+    startDnsLookup("broker.test", 0);
+    TEST_ASSERT_EQUAL(NET_PENDING, pollDnsLookup(10, MQTT_DNS_TIMEOUT_MS, address));
+    hostDnsAnswer();
+    TEST_ASSERT_EQUAL(NET_DONE, pollDnsLookup(20, MQTT_DNS_TIMEOUT_MS, address));
+    TEST_ASSERT_EQUAL_UINT32(LOOPBACK, address);
+
+    startDnsLookup("missing.test", 0);
+    hostDnsAnswer();
+    TEST_ASSERT_EQUAL(NET_FAILED, pollDnsLookup(10, MQTT_DNS_TIMEOUT_MS, address));
+
+    startDnsLookup("127.0.0.1", 0);  // Literals need no query
+    TEST_ASSERT_EQUAL(NET_DONE, pollDnsLookup(0, MQTT_DNS_TIMEOUT_MS, address));
+    TEST_ASSERT_EQUAL_UINT32(LOOPBACK, address);
+}
+
+void test_dns_timeout_drops_the_late_answer() {
+    hostDnsRecords["old.test"] = LOOPBACK;
+    hostDnsRecords["new.test"] = LOOPBACK + 1;
+    uint32_t address = 0;
+    startDnsLookup("old.test", 0);
+    TEST_ASSERT_EQUAL(NET_FAILED, pollDnsLookup(MQTT_DNS_TIMEOUT_MS, MQTT_DNS_TIMEOUT_MS, address));
+
+    startDnsLookup("new.test", MQTT_DNS_TIMEOUT_MS);
+    hostDnsAnswer();  // Both answers arrive; only the current one counts
+    TEST_ASSERT_EQUAL(NET_DONE, pollDnsLookup(MQTT_DNS_TIMEOUT_MS, MQTT_DNS_TIMEOUT_MS, address));
+    TEST_ASSERT_EQUAL_UINT32(LOOPBACK + 1, address);
+}
+
+void test_tcp_connect_is_polled() {
+    uint16_t port;
+    int listener = openListener(0, port);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(0, listener);
+
+    int fd = -1;
+    TEST_ASSERT_TRUE(startTcpConnect(LOOPBACK, port, millis()));
+    TEST_ASSERT_EQUAL(NET_DONE, pollTcpUntilSettled(fd));
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(0, fd);
+    TEST_ASSERT_EQUAL_INT(0, fcntl(fd, F_GETFL, 0) & O_NONBLOCK);  // Handed over blocking
+    close(fd);
+
+    // Nothing listening any more: refused
+    close(listener);
+    if (startTcpConnect(LOOPBACK, port, millis())) {
+        TEST_ASSERT_EQUAL(NET_FAILED, pollTcpUntilSettled(fd));
+    }
+    TEST_ASSERT_EQUAL_INT(-1, tcpConnectSocket);
+}
+
+// --- Connection state machine ---
+
+void test_connect_steps_without_blocking_and_caches_the_address() {
+    uint16_t port;
+    int listener = openListener(MQTT_PORT, port);
+    if (listener < 0) {
+        TEST_IGNORE_MESSAGE("port 1883 is taken on this machine");
+    }
+    hostDnsRecords[mqtt_host.c_str()] = LOOPBACK;
+
+    // DNS stays pending until answered, one short step at a time
+    TEST_ASSERT_TRUE(stepUntil(MQTT_STATE_DNS));
+    for (int i = 0; i < 5; i++) {
+        mqttConnectionStep();
+    }
+    TEST_ASSERT_EQUAL(MQTT_STATE_DNS, mqttConnState);
+    TEST_ASSERT_EQUAL_UINT32(MQTT_NET_POLL_MS, mqttConnectionWaitMs());
+    hostDnsAnswer();
+    TEST_ASSERT_TRUE(stepUntil(MQTT_STATE_ONLINE));
+    TEST_ASSERT_TRUE(mqtt_connected);
+    TEST_ASSERT_EQUAL_UINT32(1, mqttConnectStats.dnsLookups);
+    TEST_ASSERT_EQUAL_UINT32(1, hostDnsQueries);
+
+    // Lost and reconnected within the TTL: no second lookup
+    mqttPlainClient.stop();
+    mqttConnectionStep();
+    TEST_ASSERT_EQUAL(MQTT_STATE_BACKOFF, mqttConnState);
+    hostAdvanceMs(MQTT_BACKOFF_MAX_MS);
+    TEST_ASSERT_TRUE(stepUntil(MQTT_STATE_ONLINE));
+    TEST_ASSERT_EQUAL_UINT32(1, mqttConnectStats.dnsCacheHits);
+    TEST_ASSERT_EQUAL_UINT32(1, hostDnsQueries);
+    close(listener);
+}
+
+void test_refused_connect_looks_the_broker_up_again() {
+    uint16_t port;
+    int listener = openListener(MQTT_PORT, port);
+    if (listener < 0) {
+        TEST_IGNORE_MESSAGE("port 1883 is taken on this machine");
+    }
+    close(listener);  // Nothing listening: TCP is refused
+    hostDnsRecords[mqtt_host.c_str()] = LOOPBACK;
+
+    TEST_ASSERT_TRUE(stepUntil(MQTT_STATE_DNS));
+    mqttConnectionStep();  // Lookup started
+    hostDnsAnswer();
+    TEST_ASSERT_TRUE(stepUntil(MQTT_STATE_BACKOFF));
+    TEST_ASSERT_EQUAL(MQTT_STATE_TCP, mqttConnectStats.lastFailedPhase);
+    TEST_ASSERT_FALSE(mqttBrokerAddress.fresh(millis()));
+
+    // The next attempt asks DNS again; if that fails the old address is used
+    hostDnsRecords.clear();
+    hostAdvanceMs(MQTT_BACKOFF_MAX_MS);
+    TEST_ASSERT_TRUE(stepUntil(MQTT_STATE_DNS));
+    mqttConnectionStep();  // Lookup started
+    hostDnsAnswer();
+    TEST_ASSERT_TRUE(stepUntil(MQTT_STATE_TCP));
+    TEST_ASSERT_EQUAL_UINT32(2, mqttConnectStats.dnsLookups);
+    TEST_ASSERT_EQUAL_UINT32(1, mqttConnectStats.dnsFailures);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_backoff_doubles_with_equal_jitter);
+    RUN_TEST(test_backoff_is_capped_and_never_zero);
+    RUN_TEST(test_backoff_ready_time_and_reset);
+    RUN_TEST(test_backoff_spreads_a_fleet);
+    RUN_TEST(test_address_cache_is_fresh_for_the_ttl);
+    RUN_TEST(test_address_cache_expire_keeps_the_fallback);
+    RUN_TEST(test_dns_lookup_is_answered_by_callback);
+    RUN_TEST(test_dns_timeout_drops_the_late_answer);
+    RUN_TEST(test_tcp_connect_is_polled);
+    RUN_TEST(test_connect_steps_without_blocking_and_caches_the_address);
+    RUN_TEST(test_refused_connect_looks_the_broker_up_again);
+    return UNITY_END();
+}
@@ -0,0 +1,331 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <deque>
+#include <set>
+#include <vector>
+#include "mqtt_outbox.h"
+#include "mqtt_qos.h"
+
+// In-memory socket: the test plays the broker on the other end
+class MemoryLink : public Client {
+public:
+    std::deque<uint8_t> rx;   // Broker -> gateway
+    std::vector<uint8_t> tx;  // Gateway -> broker
+    bool up = true;
+
+    int connect(IPAddress, uint16_t) { up = true; return 1; }
+    int connect(const char*, uint16_t) { up = true; return 1; }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) {
+        if (!up) return 0;
+        tx.insert(tx.end(), buffer, buffer + size);
+        return size;
+    }
+    int available() { return (int)rx.size(); }
+    int read() {
+        uint8_t b;
+        return read(&b, 1) == 1 ? b : -1;
+    }
+    int read(uint8_t* buffer, size_t size) {
+        size_t count = 0;
+        while (count < size && !rx.empty()) {
+            buffer[count++] = rx.front();
+            rx.pop_front();
+        }
+        return count > 0 ? (int)count : -1;
+    }
+    int peek() { return rx.empty() ? -1 : rx.front(); }
+    void stop() {
+        up = false;
+        rx.clear();
+        tx.clear();
+    }
+    uint8_t connected() { return up; }
+    operator bool() { return up; }
+};
+
+struct PendingAck {
+    uint16_t packetId;
+    int delay;  // Broker passes before it is sent
+};
+
+MqttAckTap<MemoryLink> link;
+OutboxLane* lane = nullptr;
+std::set<uint32_t> delivered;         // Sequence numbers the broker received
+std::vector<PendingAck> pendingAcks;
+std::vector<uint8_t> publishHeaders;  // First byte of each PUBLISH, in order
+std::vector<uint8_t> passExpected;    // Non-PUBACK bytes sent to PubSubClient ...
+std::vector<uint8_t> passRead;        // ... and what it actually read
+uint32_t acksMatched = 0;
+uint32_t acksUnmatched = 0;
+uint16_t lastPacketId = 0;
+uint32_t simState = 1;
+
+uint32_t simRandom() {
+    simState = simState * 1664525u + 1013904223u;
+    return simState >> 8;
+}
+
+void onPubAck(uint16_t packetId) {
+    if (lane->acknowledge(packetId)) {
+        acksMatched++;
+    } else {
+        acksUnmatched++;
+    }
+}
+
+// Broker side: parse the PUBLISH packets written since the last call and
+// queue a PUBACK for each (sent after up to `maxDelay` passes)
+void brokerReceive(int maxDelay) {
+    std::vector<uint8_t>& bytes = link.tx;
+    size_t pos = 0;
+    while (pos < bytes.size()) {
+        uint8_t header = bytes[pos];
+        TEST_ASSERT_EQUAL_HEX8(MQTT_PUBLISH_QOS1, header & ~MQTT_PUBLISH_DUP);
+        size_t cursor = pos + 1;
+        uint32_t remaining = 0;
+        uint8_t shift = 0;
+        uint8_t digit;
+        do {
+            digit = bytes[cursor++];
+            remaining |= (uint32_t)(digit & 0x7F) << shift;
+            shift += 7;
+        } while (digit & 0x80);
+        size_t bodyStart = cursor;
+        uint16_t topicLength = bytes[cursor] << 8 | bytes[cursor + 1];
+        cursor += 2 + topicLength;
+        uint16_t packetId = bytes[cursor] << 8 | bytes[cursor + 1];
+        cursor += 2;
+        uint32_t sequence;
+        memcpy(&sequence, &bytes[cursor], sizeof(sequence));
+
+        TEST_ASSERT_TRUE(packetId != 0);
+        publishHeaders.push_back(header);
+        delivered.insert(sequence);
+        pendingAcks.push_back({ packetId, maxDelay > 0 ? (int)(simRandom() % (maxDelay + 1)) : 0 });
+        pos = bodyStart + remaining;
+    }
+    bytes.clear();
+}
+
+// Broker side: send the PUBACKs that are due
+void brokerSendAcks() {
+    for (auto ack = pendingAcks.begin(); ack != pendingAcks.end();) {
+        if (ack->delay-- <= 0) {
+            uint8_t packet[4] = { MQTT_PUBACK, 2, (uint8_t)(ack->packetId >> 8), (uint8_t)ack->packetId };
+            link.rx.insert(link.rx.end(), packet, packet + sizeof(packet));
+            ack = pendingAcks.erase(ack);
+        } else {
+            ++ack;
+        }
+    }
+}
+
+// Broker side: a packet PubSubClient must see (PINGRESP or a command PUBLISH)
+void brokerSendPassthrough() {
+    std::vector<uint8_t> packet;
+    if (simRandom() % 2) {
+        packet = { 0xD0, 0x00 };
+    } else {
+        uint32_t length = simRandom() % 200;
+        uint32_t remaining = length + 4;
+        packet.push_back(0x30);
+        do {
+            uint8_t digit = remaining & 0x7F;
+            remaining >>= 7;
+            packet.push_back(remaining ? digit | 0x80 : digit);
+        } while (remaining);
+        packet.insert(packet.end(), { 0, 2, 'c', 'm' });
+        for (uint32_t i = 0; i < length; i++) {
+            // Bytes equal to a PUBACK header inside a body must not be taken for one
+            packet.push_back(i == 0 ? MQTT_PUBACK : (uint8_t)simRandom());
+        }
+    }
+    link.rx.insert(link.rx.end(), packet.begin(), packet.end());
+    passExpected.insert(passExpected.end(), packet.begin(), packet.end());
+}
+
+// PubSubClient's loop(): reads whatever the tap lets through
+void clientRead() {
+    if (link.available() <= 0) {
+        return;
+    }
+    if (simRandom() % 2) {
+        uint8_t buffer[300];
+        int n = link.read(buffer, 1 + simRandom() % sizeof(buffer));
+        if (n > 0) {
+            passRead.insert(passRead.end(), buffer, buffer + n);
+        }
+    } else {
+        int c = link.read();
+        if (c >= 0) {
+            passRead.push_back((uint8_t)c);
+        }
+    }
+}
+
+// The publisher task's send step (mqtt_handler.h), for one QoS 1 lane
+bool sendNext(uint32_t window) {
+    if (lane->inFlight() >= window) {
+        return false;
+    }
+    const OutboxRecord* next = lane->nextToSend();
+    if (next == nullptr) {
+        return false;
+    }
+    OutboxRecord record = *next;
+    const char* topic = (const char*)(next + 1);
+    const uint8_t* payload = (const uint8_t*)topic + record.topicLength;
+    bool resend = record.flags & OUTBOX_SENT;
+    uint16_t packetId = resend ? record.packetId : (++lastPacketId ? lastPacketId : ++lastPacketId);
+    if (!writeQos1Publish(link, topic, record.topicLength - 1, payload, record.payloadLength, packetId, resend)) {
+        return false;
+    }
+    lane->sent(record.sequence, packetId);
+    return true;
+}
+
+bool pushSequence(uint32_t sequence, size_t length) {
+    uint8_t payload[64] = {};
+    memcpy(payload, &sequence, sizeof(sequence));
+    return lane->push("t/x", 4, payload, length, 0);
+}
+
+// PubSubClient read a prefix of its own bytes, nothing added or reordered
+void checkPassthrough() {
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(passExpected.size(), passRead.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(passExpected.data(), passRead.data(), passRead.size());
+}
+
+void reconnect() {
+    checkPassthrough();
+    link.stop();
+    pendingAcks.clear();
+    passExpected.clear();
+    passRead.clear();
+    link.connect("broker.test", 1883);
+    lane->rewind();
+}
+
+uint8_t laneBuffer[4096];
+OutboxLane testLane(laneBuffer, sizeof(laneBuffer), OUTBOX_DROP_NEWEST, 1);
+
+void setUp() {
+    testLane = OutboxLane(laneBuffer, sizeof(laneBuffer), OUTBOX_DROP_NEWEST, 1);
+    lane = &testLane;
+    link.stop();
+    link.connect("broker.test", 1883);
+    link.onPubAck(onPubAck);
+    delivered.clear();
+    pendingAcks.clear();
+    publishHeaders.clear();
+    passExpected.clear();
+    passRead.clear();
+    acksMatched = 0;
+    acksUnmatched = 0;
+    lastPacketId = 0;
+    simState = 1;
+}
+
+void tearDown() {}
+
+void test_unacknowledged_messages_are_resent_with_dup() {
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(pushSequence(i, 8));
+    }
+    while (sendNext(8)) {
+    }
+    brokerReceive(0);
+    TEST_ASSERT_EQUAL_UINT32(3, lane->inFlight());
+
+    // Only the first PUBACK arrives before the link drops
+    pendingAcks.resize(1);
+    brokerSendAcks();
+    TEST_ASSERT_EQUAL_INT(0, link.available());  // Consumed by the tap
+    TEST_ASSERT_EQUAL_UINT32(1, acksMatched);
+    reconnect();
+
+    while (sendNext(8)) {
+    }
+    brokerReceive(0);
+    TEST_ASSERT_EQUAL_UINT32(5, publishHeaders.size());
+    TEST_ASSERT_EQUAL_HEX8(MQTT_PUBLISH_QOS1 | MQTT_PUBLISH_DUP, publishHeaders[3]);
+    TEST_ASSERT_EQUAL_HEX8(MQTT_PUBLISH_QOS1 | MQTT_PUBLISH_DUP, publishHeaders[4]);
+    TEST_ASSERT_EQUAL_UINT16(2, pendingAcks[0].packetId);  // Same ids as the first send
+    TEST_ASSERT_EQUAL_UINT16(3, pendingAcks[1].packetId);
+
+    brokerSendAcks();
+    link.available();
+    TEST_ASSERT_EQUAL_UINT32(0, lane->count());
+    TEST_ASSERT_EQUAL_UINT32(0, acksUnmatched);
+}
+
+void test_split_puback_is_held_back_until_complete() {
+    TEST_ASSERT_TRUE(pushSequence(7, 8));
+    TEST_ASSERT_TRUE(sendNext(8));
+    brokerReceive(0);
+
+    // Half a PUBACK: PubSubClient sees nothing, the lane keeps the message
+    link.rx.insert(link.rx.end(), { MQTT_PUBACK, 2 });
+    TEST_ASSERT_EQUAL_INT(0, link.available());
+    TEST_ASSERT_EQUAL_INT(-1, link.peek());
+    TEST_ASSERT_EQUAL_UINT32(1, lane->inFlight());
+
+    // The rest arrives followed by a PINGRESP, which passes through
+    link.rx.insert(link.rx.end(), { 0x00, 0x01, 0xD0, 0x00 });
+    TEST_ASSERT_EQUAL_INT(2, link.available());
+    TEST_ASSERT_EQUAL_UINT32(0, lane->count());
+    TEST_ASSERT_EQUAL_INT(0xD0, link.read());
+    TEST_ASSERT_EQUAL_INT(0x00, link.read());
+}
+
+void test_every_message_is_delivered_across_link_drops() {
+    // Random interleaving of queueing, sending, delayed PUBACKs, inbound
+    // traffic for PubSubClient and dropped links. Every message must reach
+    // the broker at least once, and PubSubClient must read its own bytes
+    // as sent.
+    const uint32_t MESSAGES = 50000;
+    const uint32_t WINDOW = 8;
+    uint32_t queued = 0;
+    uint32_t drops = 0;
+    uint32_t pubAcksBefore = link.pubAcks();
+    for (uint32_t step = 0; queued < MESSAGES || lane->count() > 0; step++) {
+        TEST_ASSERT_LESS_THAN_UINT32(20000000, step);  // Stuck
+        uint32_t action = simRandom() % 100;
+        if (action < 30) {
+            if (queued < MESSAGES && pushSequence(queued, 4 + simRandom() % 60)) {
+                queued++;
+            }
+        } else if (action < 60) {
+            if (sendNext(WINDOW)) {
+                brokerReceive(3);
+            }
+        } else if (action < 85) {
+            brokerSendAcks();
+            if (simRandom() % 5 == 0) {
+                brokerSendPassthrough();
+            }
+        } else if (action < 99) {
+            clientRead();
+        } else if (simRandom() % 10 == 0) {
+            reconnect();  // PUBACKs and inbound bytes not yet read are lost
+            drops++;
+        }
+    }
+
+    for (uint32_t sequence = 0; sequence < MESSAGES; sequence++) {
+        TEST_ASSERT_TRUE_MESSAGE(delivered.count(sequence) == 1, "message lost");
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(10, drops);
+    TEST_ASSERT_EQUAL_UINT32(0, lane->inFlight());
+    TEST_ASSERT_EQUAL_UINT32(link.pubAcks() - pubAcksBefore, acksMatched + acksUnmatched);
+    checkPassthrough();
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_unacknowledged_messages_are_resent_with_dup);
+    RUN_TEST(test_split_puback_is_held_back_until_complete);
+    RUN_TEST(test_every_message_is_delivered_across_link_drops);
+    return UNITY_END();
+}
@@ -0,0 +1,103 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "gateway_host.h"
+
+// Queued bulk messages, taken off the outbox as the MQTT task would send them
+uint32_t drainBulkOutbox() {
+    uint32_t sent = 0;
+    const OutboxRecord* next;
+    while ((next = mqttOutbox[OUTBOX_BULK].nextToSend()) != nullptr) {
+        mqttOutbox[OUTBOX_BULK].discard(next->sequence);
+        sent++;
+    }
+    return sent;
+}
+
+bool storeReading(int i) {
+    return storeOfflineDetection("E0:7D:EA:00:00:01", 2000 + i % 100, 4500, -60, 1700000000 + i);
+}
+
+int countRecordFiles(int upTo) {
+    int files = 0;
+    for (int i = 0; i < upTo; i++) {
+        files += SPIFFS.exists(String(OFFLINE_DIR) + "/" + String(i) + ".json");
+    }
+    return files;
+}
+
+void setUp() {
+    resetGatewayHost();
+    clearOfflineStorage();
+}
+
+void tearDown() {
+    mqtt_connected = false;
+    fs::hostFsLatencyUs = 0;
+}
+
+void test_stored_records_replay_in_chunks() {
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(storeReading(i));
+    }
+    TEST_ASSERT_EQUAL_INT(5, getOfflineRecordCount());
+    TEST_ASSERT_FALSE(publishOfflineDetections(8) > 0);  // Offline: nothing leaves
+
+    mqtt_connected = true;
+    TEST_ASSERT_FALSE(storeReading(5));  // Online: nothing stored
+    startOfflineReplay();
+    TEST_ASSERT_TRUE(offlineReplayPending);
+    TEST_ASSERT_EQUAL_INT(2, publishOfflineDetections(2));
+    TEST_ASSERT_EQUAL_UINT32(2, drainBulkOutbox());
+    TEST_ASSERT_EQUAL_INT(3, countRecordFiles(5));
+    TEST_ASSERT_EQUAL_INT(3, publishOfflineDetections(8));
+    TEST_ASSERT_EQUAL_UINT32(3, drainBulkOutbox());
+    TEST_ASSERT_FALSE(offlineReplayPending);
+    TEST_ASSERT_EQUAL_INT(0, getOfflineRecordCount());
+    TEST_ASSERT_EQUAL_INT(0, countRecordFiles(5));
+}
+
+void test_store_and_replay_race() {
+    // The tracker task stores while the MQTT task replays, as around a
+    // reconnect. Every stored record must be replayed exactly once: none
+    // lost to an overwritten index, none sent twice, no file left behind.
+    const int READINGS = 600;
+    fs::hostFsLatencyUs = 20;
+    std::atomic<bool> trackerDone{false};
+    std::atomic<uint32_t> stored{0};
+    uint32_t replayed = 0;
+
+    std::thread tracker([&]() {
+        for (int i = 0; i < READINGS; i++) {
+            mqtt_connected = false;  // Each store saw the link down
+            stored += storeReading(i) ? 1 : 0;
+        }
+        trackerDone = true;
+    });
+    while (!trackerDone) {
+        mqtt_connected = true;
+        startOfflineReplay();
+        publishOfflineDetections(OFFLINE_REPLAY_CHUNK);
+        replayed += drainBulkOutbox();
+    }
+    tracker.join();
+
+    mqtt_connected = true;
+    startOfflineReplay();
+    while (offlineReplayPending) {
+        publishOfflineDetections(OFFLINE_REPLAY_CHUNK);
+        replayed += drainBulkOutbox();
+    }
+
+    TEST_ASSERT_GREATER_THAN_UINT32(0, stored.load());
+    TEST_ASSERT_EQUAL_UINT32(stored.load(), replayed);
+    TEST_ASSERT_EQUAL_INT(0, getOfflineRecordCount());
+    TEST_ASSERT_EQUAL_INT(0, countRecordFiles(READINGS));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_stored_records_replay_in_chunks);
+    RUN_TEST(test_store_and_replay_race);
+    return UNITY_END();
+}
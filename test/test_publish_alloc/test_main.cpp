@@ -0,0 +1,114 @@
+#include <unity.h>
+#include "alloc_counter.h"
+#include "gateway_host.h"
+
+const int MESSAGES = 50;
+
+PublishSnapshot makeReading(int device, bool summary) {
+    PublishSnapshot reading = {};
+    reading.mac = 0xE07DEA000000ULL + device;
+    reading.format = BEACON_LOP001;
+    reading.isSensor = true;
+    reading.changed = true;
+    reading.temperatureCenti = 2000 + device;
+    reading.humidityCenti = 4500;
+    reading.rssi = -60 - device % 30;
+    reading.timestampMs = 1700000000000ULL + device;
+    reading.compressionRatioCenti = 250;
+    reading.summary = summary;
+    reading.windowMs = 300000;
+    reading.temperatureStats.reset();
+    reading.humidityStats.reset();
+    reading.rssiStats.reset();
+    for (int i = 0; i < 5; i++) {
+        reading.temperatureStats.add(2000 + i * 7);
+        reading.humidityStats.add(4500 - i * 3);
+        reading.rssiStats.add(-6000 - i * 100);
+    }
+    return reading;
+}
+
+// Encode and queue MESSAGES readings; returns the allocations made doing it
+uint32_t allocationsToPublish(bool summary) {
+    PublishSnapshot readings[MESSAGES];
+    for (int i = 0; i < MESSAGES; i++) {
+        readings[i] = makeReading(i, summary);
+    }
+    AllocationScope scope;
+    for (int i = 0; i < MESSAGES; i++) {
+        TEST_ASSERT_TRUE(publishDeviceData(readings[i]));
+    }
+    flushPublishBatch();
+    return scope.allocations();
+}
+
+void setUp() {
+    resetGatewayHost();
+    publishSink.enabled = false;
+    mqtt_connected = true;
+}
+
+void tearDown() {}
+
+void test_json_encoder_does_not_allocate() {
+    PublishSnapshot reading = makeReading(1, true);
+    uint8_t buffer[BATCH_BYTES_MAX];
+    AllocationScope scope;
+    for (int i = 0; i < MESSAGES; i++) {
+        PayloadWriter out(buffer, sizeof(buffer));
+        writeJsonReading(out, reading, device_id.c_str());
+        writeJsonBatchEntry(out, reading);
+        TEST_ASSERT_FALSE(out.overflowed());
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, scope.allocations());
+}
+
+void test_msgpack_encoder_does_not_allocate() {
+    PublishSnapshot reading = makeReading(1, true);
+    uint8_t buffer[BATCH_BYTES_MAX];
+    AllocationScope scope;
+    for (int i = 0; i < MESSAGES; i++) {
+        PayloadWriter out(buffer, sizeof(buffer));
+        writeMsgPackReading(out, reading);
+        TEST_ASSERT_FALSE(out.overflowed());
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, scope.allocations());
+}
+
+void test_json_enqueue_path_does_not_allocate() {
+    TEST_ASSERT_EQUAL_UINT32(0, allocationsToPublish(false));
+    TEST_ASSERT_EQUAL_UINT32(MESSAGES, getOutboxDepth(OUTBOX_TELEMETRY));
+
+    // What was queued is what the encoder writes
+    uint8_t expected[BATCH_BYTES_MAX];
+    PayloadWriter out(expected, sizeof(expected));
+    writeJsonReading(out, makeReading(0, false), device_id.c_str());
+    const OutboxRecord* record = mqttOutbox[OUTBOX_TELEMETRY].nextToSend();
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_EQUAL_STRING(TOPIC_JSON_DATA, (const char*)(record + 1));
+    TEST_ASSERT_EQUAL(out.length(), record->payloadLength);
+    TEST_ASSERT_EQUAL_MEMORY(expected, (const uint8_t*)(record + 1) + record->topicLength, out.length());
+}
+
+void test_msgpack_enqueue_path_does_not_allocate() {
+    payloadFormat = PAYLOAD_MSGPACK;
+    TEST_ASSERT_EQUAL_UINT32(0, allocationsToPublish(true));
+    TEST_ASSERT_EQUAL_UINT32(MESSAGES, getOutboxDepth(OUTBOX_TELEMETRY));
+}
+
+void test_batch_enqueue_path_does_not_allocate() {
+    batchEnabled = true;
+    TEST_ASSERT_EQUAL_UINT32(0, allocationsToPublish(false));
+    TEST_ASSERT_GREATER_THAN_UINT32(0, getOutboxDepth(OUTBOX_TELEMETRY));
+    TEST_ASSERT_EQUAL_UINT32(MESSAGES, batchReadings);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_json_encoder_does_not_allocate);
+    RUN_TEST(test_msgpack_encoder_does_not_allocate);
+    RUN_TEST(test_json_enqueue_path_does_not_allocate);
+    RUN_TEST(test_msgpack_enqueue_path_does_not_allocate);
+    RUN_TEST(test_batch_enqueue_path_does_not_allocate);
+    return UNITY_END();
+}
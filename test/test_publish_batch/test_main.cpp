@@ -0,0 +1,178 @@
+#include <unity.h>
+#include "bench.h"
+#include "gateway_host.h"
+
+// A minute of a busy site: every sensor reports every REPORT_MS, spread
+// evenly, through publishDeviceData() into the trace-replay sink
+const int SENSORS = 300;
+const uint32_t REPORT_MS = 10000;
+const uint32_t TICK_MS = 100;
+const uint32_t MINUTE_MS = 60000;
+const uint32_t READINGS_PER_MINUTE = SENSORS * (MINUTE_MS / REPORT_MS);
+
+// MQTT PUBLISH framing around the payload: fixed header (1 + 2-byte
+// remaining length), topic length, topic, packet id (QoS 1)
+const uint32_t PUBLISH_FRAMING = 1 + 2 + 2 + 2;
+
+struct MinuteResult {
+    uint32_t messages;
+    uint32_t payloadBytes;
+    uint32_t wireBytes;
+};
+
+PublishSnapshot makeReading(int device, uint32_t nowMs, bool summary) {
+    PublishSnapshot reading = {};
+    reading.mac = 0xE07DEA000000ULL + device;
+    reading.format = BEACON_LOP001;
+    reading.isSensor = true;
+    reading.changed = true;
+    reading.temperatureCenti = 2000 + device % 700;
+    reading.humidityCenti = 4500 + device % 300;
+    reading.rssi = -60 - device % 30;
+    reading.timestampMs = 1700000000000ULL + nowMs;
+    reading.compressionRatioCenti = 250;
+    reading.summary = summary;
+    reading.windowMs = 300000;
+    reading.temperatureStats.reset();
+    reading.humidityStats.reset();
+    reading.rssiStats.reset();
+    for (int i = 0; i < 5; i++) {
+        reading.temperatureStats.add(2000 + i * 7);
+        reading.humidityStats.add(4500 - i * 3);
+        reading.rssiStats.add(-6000 - i * 100);
+    }
+    return reading;
+}
+
+MinuteResult publishOneMinute(PayloadFormat format, bool batched, bool summary) {
+    resetGatewayHost();
+    payloadFormat = format;
+    batchEnabled = batched;
+
+    const uint32_t ticksPerReport = REPORT_MS / TICK_MS;
+    for (uint32_t now = 0; now < MINUTE_MS; now += TICK_MS) {
+        uint32_t slot = (now / TICK_MS) % ticksPerReport;
+        for (int device = slot; device < SENSORS; device += ticksPerReport) {
+            TEST_ASSERT_TRUE(publishDeviceData(makeReading(device, now, summary)));
+        }
+        flushPublishBatchIfDue();
+        hostAdvanceMs(TICK_MS);
+    }
+    flushPublishBatch();
+
+    const char* topic;
+    if (format == PAYLOAD_MSGPACK) {
+        topic = batched ? topicMsgPackBatch : topicMsgPackData;
+    } else {
+        topic = batched ? TOPIC_JSON_BATCH : TOPIC_JSON_DATA;
+    }
+    MinuteResult result;
+    result.messages = publishSink.messages;
+    result.payloadBytes = publishSink.bytes;
+    result.wireBytes = publishSink.bytes + publishSink.messages * (PUBLISH_FRAMING + strlen(topic));
+    if (batched) {
+        TEST_ASSERT_EQUAL_UINT32(READINGS_PER_MINUTE, batchReadings);
+        TEST_ASSERT_EQUAL_UINT32(0, batchReadingsDropped);
+    }
+    return result;
+}
+
+MinuteResult reportMinute(const char* label, PayloadFormat format, bool batched, bool summary) {
+    MinuteResult result = publishOneMinute(format, batched, summary);
+    char name[64];
+    snprintf(name, sizeof(name), "%s, messages", label);
+    benchReport(name, result.messages, "per min");
+    snprintf(name, sizeof(name), "%s, payload", label);
+    benchReport(name, (double)result.payloadBytes / READINGS_PER_MINUTE, "bytes/reading");
+    snprintf(name, sizeof(name), "%s, on the wire", label);
+    benchReport(name, (double)result.wireBytes / READINGS_PER_MINUTE, "bytes/reading");
+    return result;
+}
+
+void setUp() {
+    resetGatewayHost();
+    mqtt_connected = true;
+}
+
+void tearDown() {
+    batchEnabled = false;
+    payloadFormat = PAYLOAD_JSON;
+    publishSink.enabled = false;
+}
+
+void test_single_messages_carry_one_reading_each() {
+    MinuteResult json = reportMinute("json single", PAYLOAD_JSON, false, false);
+    MinuteResult msgpack = reportMinute("msgpack single", PAYLOAD_MSGPACK, false, false);
+    TEST_ASSERT_EQUAL_UINT32(READINGS_PER_MINUTE, json.messages);
+    TEST_ASSERT_EQUAL_UINT32(READINGS_PER_MINUTE, msgpack.messages);
+    TEST_ASSERT_TRUE(msgpack.payloadBytes * 3 < json.payloadBytes);
+}
+
+void test_default_batch_cuts_messages_per_minute() {
+    MinuteResult single = publishOneMinute(PAYLOAD_JSON, false, false);
+    MinuteResult batched = reportMinute("json batch (20/3072/2000ms)", PAYLOAD_JSON, true, false);
+    // 30 readings arrive per second: batches fill to 20 before the 2 s flush
+    TEST_ASSERT_EQUAL_UINT32(READINGS_PER_MINUTE / batchMaxReadings, batched.messages);
+    TEST_ASSERT_TRUE(batched.payloadBytes < single.payloadBytes);
+    TEST_ASSERT_TRUE(batched.wireBytes * 3 < single.wireBytes * 2);
+}
+
+void test_msgpack_batch_is_the_smallest() {
+    MinuteResult json = publishOneMinute(PAYLOAD_JSON, true, false);
+    MinuteResult msgpack = reportMinute("msgpack batch (20/3072/2000ms)", PAYLOAD_MSGPACK, true, false);
+    TEST_ASSERT_EQUAL_UINT32(json.messages, msgpack.messages);
+    TEST_ASSERT_TRUE(msgpack.wireBytes * 3 < json.wireBytes);
+}
+
+void test_largest_batches_stay_within_the_byte_limit() {
+    batchMaxReadings = BATCH_READINGS_MAX;
+    batchMaxBytes = BATCH_BYTES_MAX;
+    MinuteResult json = reportMinute("json batch (100/4000/2000ms)", PAYLOAD_JSON, true, false);
+    MinuteResult msgpack = reportMinute("msgpack batch (100/4000/2000ms)", PAYLOAD_MSGPACK, true, false);
+    // A JSON batch runs out of bytes before readings; 60 arrive per flush period
+    TEST_ASSERT_TRUE(json.payloadBytes / json.messages <= BATCH_BYTES_MAX);
+    TEST_ASSERT_TRUE(json.messages > READINGS_PER_MINUTE / 60);
+    TEST_ASSERT_TRUE(msgpack.messages <= json.messages);
+    batchMaxReadings = 20;
+    batchMaxBytes = 3072;
+}
+
+void test_window_summaries_batch_too() {
+    MinuteResult single = reportMinute("json single, window", PAYLOAD_JSON, false, true);
+    MinuteResult batched = reportMinute("json batch, window", PAYLOAD_JSON, true, true);
+    MinuteResult msgpack = reportMinute("msgpack batch, window", PAYLOAD_MSGPACK, true, true);
+    TEST_ASSERT_TRUE(batched.messages < single.messages);
+    TEST_ASSERT_TRUE(batched.wireBytes < single.wireBytes);
+    TEST_ASSERT_TRUE(msgpack.wireBytes < batched.wireBytes);
+}
+
+void test_slow_site_is_flushed_by_the_deadline() {
+    // 20 sensors every 10 s: 2 readings/s, so batches close on flushMs
+    resetGatewayHost();
+    batchEnabled = true;
+    uint32_t flushes = 0;
+    for (uint32_t now = 0; now < MINUTE_MS; now += TICK_MS) {
+        if (now % 500 == 0) {
+            TEST_ASSERT_TRUE(publishDeviceData(makeReading((now / 500) % 20, now, false)));
+        }
+        uint32_t before = batchMessages;
+        flushPublishBatchIfDue();
+        flushes += batchMessages - before;
+        hostAdvanceMs(TICK_MS);
+    }
+    benchReport("json batch, 2 readings/s, messages", batchMessages, "per min");
+    TEST_ASSERT_EQUAL_UINT32(batchMessages, flushes);
+    // A batch opens on one reading and closes after the one landing on flushMs
+    TEST_ASSERT_UINT32_WITHIN(1, MINUTE_MS / (batchFlushMs + 500), batchMessages);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_messages_carry_one_reading_each);
+    RUN_TEST(test_default_batch_cuts_messages_per_minute);
+    RUN_TEST(test_msgpack_batch_is_the_smallest);
+    RUN_TEST(test_largest_batches_stay_within_the_byte_limit);
+    RUN_TEST(test_window_summaries_batch_too);
+    RUN_TEST(test_slow_site_is_flushed_by_the_deadline);
+    return UNITY_END();
+}
@@ -0,0 +1,257 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "gateway_host.h"
+
+// LOP001 (0x181A service data, no name)
+const uint8_t LOP001_ADVERT[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11 };
+
+const uint32_t PASS_INTERVAL_MS = 5000;  // The tracker task's PUBLISH_INTERVAL
+const uint32_t DRAIN_TICK_MS = 50;       // ... and its DRAIN_INTERVAL
+
+PublishLimiter defaultLimiter(uint32_t nowMs) {
+    PublishLimiter limiter;
+    limiter.reset(nowMs);
+    return limiter;
+}
+
+void setUp() {
+    resetGatewayHost();
+}
+
+void tearDown() {}
+
+void test_bucket_starts_empty_and_refills_at_the_rate() {
+    PublishLimiter limiter = defaultLimiter(0);
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.available(0));
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.available(99));
+    TEST_ASSERT_EQUAL_UINT32(1, limiter.available(100));   // 600/min = one per 100 ms
+    TEST_ASSERT_EQUAL_UINT32(10, limiter.available(1000));
+    limiter.take(10);
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.available(1000));
+}
+
+void test_burst_caps_an_idle_bucket() {
+    PublishLimiter limiter = defaultLimiter(0);
+    TEST_ASSERT_EQUAL_UINT32(PUBLISH_BURST_DEFAULT, limiter.available(3600000));
+    limiter.take(PUBLISH_BURST_DEFAULT + 5);  // Overdrawn: empty, not wrapped
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.available(3600000));
+    TEST_ASSERT_EQUAL_UINT32(1, limiter.available(3600100));
+
+    // Shrinking the burst trims credit already saved
+    TEST_ASSERT_EQUAL_UINT32(PUBLISH_BURST_DEFAULT, limiter.available(7200000));
+    limiter.configure(PUBLISH_RATE_DEFAULT_PER_MIN, 5, 0);
+    TEST_ASSERT_EQUAL_UINT32(5, limiter.available(7200000));
+    limiter.configure(PUBLISH_RATE_DEFAULT_PER_MIN, 0, 0);  // Burst is at least one
+    TEST_ASSERT_EQUAL_UINT32(1, limiter.burst());
+}
+
+void test_refill_is_exact_at_odd_rates() {
+    const uint32_t rates[] = { 1, 7, 59, 61, 997, PUBLISH_RATE_MAX_PER_MIN };
+    for (uint32_t rate : rates) {
+        PublishLimiter limiter;
+        limiter.configure(rate, PUBLISH_BURST_MAX, 0);
+        limiter.reset(0);
+        // Polled in odd steps, a minute still yields exactly `rate` tokens
+        uint32_t sent = 0;
+        for (uint32_t now = 0; now <= 60000; now += 37) {
+            uint32_t tokens = limiter.available(now);
+            limiter.take(tokens);
+            sent += tokens;
+        }
+        sent += limiter.available(60000);
+        TEST_ASSERT_EQUAL_UINT32(rate, sent);
+    }
+}
+
+void test_ms_until_token_is_exact() {
+    const uint32_t rates[] = { 1, 7, 600, 997, PUBLISH_RATE_MAX_PER_MIN };
+    for (uint32_t rate : rates) {
+        for (uint32_t elapsed = 0; elapsed < 200; elapsed += 13) {
+            PublishLimiter limiter;
+            limiter.configure(rate, PUBLISH_BURST_DEFAULT, 0);
+            limiter.reset(1000);
+            uint32_t wait = limiter.msUntilToken(1000 + elapsed);
+            PublishLimiter early = limiter;
+            PublishLimiter due = limiter;
+            if (wait > 0) {
+                TEST_ASSERT_EQUAL_UINT32(0, early.available(1000 + elapsed + wait - 1));
+            }
+            TEST_ASSERT_TRUE(due.available(1000 + elapsed + wait) > 0);
+        }
+    }
+}
+
+void test_unlimited_and_clock_wrap() {
+    PublishLimiter limiter;
+    limiter.configure(0, 1, 0);
+    TEST_ASSERT_EQUAL_UINT32(PublishLimiter::UNLIMITED, limiter.available(0));
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.msUntilToken(0));
+
+    limiter = defaultLimiter(UINT32_MAX - 499);  // millis() wraps after 49.7 days
+    TEST_ASSERT_EQUAL_UINT32(10, limiter.available(500));
+}
+
+void test_jitter_stays_in_range() {
+    publishLimiter.configure(0, 1, PUBLISH_JITTER_DEFAULT_MS);
+    uint32_t lowest = UINT32_MAX, highest = 0;
+    uint64_t total = 0;
+    const int DRAWS = 20000;
+    for (int i = 0; i < DRAWS; i++) {
+        uint32_t jitter = publishJitterMs();
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(PUBLISH_JITTER_DEFAULT_MS, jitter);
+        lowest = jitter < lowest ? jitter : lowest;
+        highest = jitter > highest ? jitter : highest;
+        total += jitter;
+    }
+    // Spread over the whole range, centred on its middle
+    TEST_ASSERT_LESS_THAN_UINT32(20, lowest);
+    TEST_ASSERT_GREATER_THAN_UINT32(PUBLISH_JITTER_DEFAULT_MS - 20, highest);
+    TEST_ASSERT_UINT32_WITHIN(50, PUBLISH_JITTER_DEFAULT_MS / 2, (uint32_t)(total / DRAWS));
+
+    publishLimiter.configure(0, 1, 0);
+    TEST_ASSERT_EQUAL_UINT32(0, publishJitterMs());
+}
+
+void test_boot_backlog_drains_at_the_rate() {
+    // A gateway reboots into 300 sensors that all want publishing at once
+    const int SENSORS = 300;
+    publishLimiter.configure(PUBLISH_RATE_DEFAULT_PER_MIN, PUBLISH_BURST_DEFAULT, PUBLISH_JITTER_DEFAULT_MS);
+    publishLimiter.reset(millis());
+    uint32_t bootMs = millis();
+    for (int i = 0; i < SENSORS; i++) {
+        hostReplayIngest(0xE07DEA200000ULL + i, -60, LOP001_ADVERT, sizeof(LOP001_ADVERT), millis());
+    }
+    while (drainAdvertRing() > 0) {
+    }
+
+    // The tracker task's loop, stepped on a simulated clock
+    uint32_t nextPass = millis() + publishJitterMs();
+    uint32_t perSecond[60] = {};
+    while (millis() - bootMs < 60000) {
+        hostAdvanceMs(DRAIN_TICK_MS);
+        uint32_t now = millis();
+        if ((int32_t)(now - nextPass) >= 0) {
+            uint32_t before = trackerPublishes;
+            bool deferred = publishPendingDevices();
+            perSecond[(now - bootMs) / 1000] += trackerPublishes - before;
+            now = millis();
+            nextPass = now + (deferred ? publishLimiter.msUntilToken(now) : PASS_INTERVAL_MS + publishJitterMs());
+        }
+    }
+
+    // No boot burst: never more than the rate (plus a token of clock slack)
+    for (int second = 0; second < 60; second++) {
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(PUBLISH_RATE_DEFAULT_PER_MIN / 60 + 1, perSecond[second]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(SENSORS, trackerPublishes);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, publishesDeferred);
+}
+
+void test_fleet_rebooted_together_spreads_its_first_passes() {
+    // 200 gateways power up in the same millisecond, each with a backlog.
+    // Fleet-wide messages per 100 ms stay near one per gateway, instead of a
+    // burst-sized spike from every gateway at t=0.
+    const int GATEWAYS = 200;
+    const uint32_t SIM_MS = 20000;
+    PublishLimiter limiters[GATEWAYS];
+    uint32_t nextPass[GATEWAYS];
+    uint32_t backlog[GATEWAYS];
+    uint32_t firstPass[GATEWAYS];
+    for (int g = 0; g < GATEWAYS; g++) {
+        limiters[g].reset(0);
+        backlog[g] = 150;
+        nextPass[g] = esp_random() % (PUBLISH_JITTER_DEFAULT_MS + 1);
+        firstPass[g] = nextPass[g];
+    }
+
+    uint32_t perTick[SIM_MS / 100] = {};
+    for (uint32_t now = 0; now < SIM_MS; now += 10) {
+        for (int g = 0; g < GATEWAYS; g++) {
+            if ((int32_t)(now - nextPass[g]) < 0 || backlog[g] == 0) {
+                continue;
+            }
+            uint32_t tokens = limiters[g].available(now);
+            uint32_t sent = tokens < backlog[g] ? tokens : backlog[g];
+            limiters[g].take(sent);
+            backlog[g] -= sent;
+            perTick[now / 100] += sent;
+            nextPass[g] = now + (backlog[g] > 0 ? limiters[g].msUntilToken(now)
+                                                : PASS_INTERVAL_MS + esp_random() % (PUBLISH_JITTER_DEFAULT_MS + 1));
+        }
+    }
+
+    uint32_t peak = 0;
+    for (uint32_t tick : perTick) {
+        peak = tick > peak ? tick : peak;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(GATEWAYS * 2, peak);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(GATEWAYS / 10, perTick[0]);
+
+    // First passes cover the jitter range: no 100 ms slot holds more than a
+    // small share of the fleet
+    uint32_t slots[PUBLISH_JITTER_DEFAULT_MS / 100 + 1] = {};
+    for (int g = 0; g < GATEWAYS; g++) {
+        slots[firstPass[g] / 100]++;
+    }
+    for (uint32_t slot : slots) {
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(GATEWAYS / 8, slot);
+    }
+    for (int g = 0; g < GATEWAYS; g++) {
+        TEST_ASSERT_EQUAL_UINT32(0, backlog[g]);
+    }
+}
+
+void test_rate_command_is_applied_by_the_tracker_pass() {
+    publishLimiter.configure(PUBLISH_RATE_DEFAULT_PER_MIN, PUBLISH_BURST_DEFAULT, PUBLISH_JITTER_DEFAULT_MS);
+    TEST_ASSERT_TRUE(requestPublishRate(60, 5, 100));
+    // Posted only: the tracker's limiter is untouched until its next pass
+    TEST_ASSERT_EQUAL_UINT32(PUBLISH_RATE_DEFAULT_PER_MIN, publishLimiter.ratePerMin());
+    publishPendingDevices();
+    TEST_ASSERT_EQUAL_UINT32(60, publishLimiter.ratePerMin());
+    TEST_ASSERT_EQUAL_UINT32(5, publishLimiter.burst());
+    TEST_ASSERT_EQUAL_UINT32(100, publishLimiter.jitterMs());
+    TEST_ASSERT_FALSE(publishRatePending.load());
+}
+
+void test_rate_commands_racing_the_tracker_never_reach_a_zero_rate_mid_pass() {
+    // The MQTT task flips the limiter between off and limited while the
+    // tracker loop runs; msUntilToken() divides by the rate
+    publishLimiter.configure(PUBLISH_RATE_DEFAULT_PER_MIN, 1, 0);
+    publishLimiter.reset(millis());
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> requests{0};
+    std::thread mqttTask([&]() {
+        for (uint32_t i = 0; !done.load(); i++) {
+            requestPublishRate(i % 2 ? 0 : 1, 1, 0);
+            requests.fetch_add(1);
+        }
+    });
+    while (requests.load() == 0) {
+        std::this_thread::yield();  // The race only starts once the thread runs
+    }
+    for (int pass = 0; pass < 20000; pass++) {
+        publishPendingDevices();
+        publishLimiter.msUntilToken(millis());
+    }
+    done.store(true);
+    mqttTask.join();
+    publishPendingDevices();
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, publishLimiter.ratePerMin());
+    TEST_ASSERT_FALSE(publishRatePending.load());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_starts_empty_and_refills_at_the_rate);
+    RUN_TEST(test_burst_caps_an_idle_bucket);
+    RUN_TEST(test_refill_is_exact_at_odd_rates);
+    RUN_TEST(test_ms_until_token_is_exact);
+    RUN_TEST(test_unlimited_and_clock_wrap);
+    RUN_TEST(test_jitter_stays_in_range);
+    RUN_TEST(test_boot_backlog_drains_at_the_rate);
+    RUN_TEST(test_fleet_rebooted_together_spreads_its_first_passes);
+    RUN_TEST(test_rate_command_is_applied_by_the_tracker_pass);
+    RUN_TEST(test_rate_commands_racing_the_tracker_never_reach_a_zero_rate_mid_pass);
+    return UNITY_END();
+}
@@ -0,0 +1,124 @@
+#include <unity.h>
+#include "alloc_counter.h"
+#include "gateway_host.h"
+#include "advert_replay.h"
+
+const int REPLAY_DEVICES = 20;
+
+size_t lastReplayLength = 0;
+
+bool recordLength(uint64_t /*mac*/, int8_t /*rssi*/, const uint8_t* /*payload*/, size_t length, uint32_t /*now*/) {
+    lastReplayLength = length;
+    return true;
+}
+
+// LOP001 advert with the name in the scan response: flags, 0x181A service
+// data (temperature, humidity) and the complete local name
+String lop001Line(uint32_t offsetMs, int device, int16_t temperatureCenti) {
+    char line[128];
+    snprintf(line, sizeof(line),
+             "%u,E0:7D:EA:00:%02X:%02X,-60,020106 07161A18%02X%02X1027 07094C4F50303031\n",
+             (unsigned)offsetMs, device >> 8, device & 0xFF,
+             temperatureCenti & 0xFF, (temperatureCenti >> 8) & 0xFF);
+    return String(line);
+}
+
+File writeTrace(const String& contents) {
+    File file = SPIFFS.open("/trace.csv", "w");
+    file.print(contents);
+    file.close();
+    return SPIFFS.open("/trace.csv", "r");
+}
+
+void setUp() {
+    resetGatewayHost();
+    lastReplayLength = 0;
+}
+
+void tearDown() {}
+
+void test_full_payload_as_spaced_hex_fits_a_line() {
+    String payload;
+    for (size_t i = 0; i < REPLAY_PAYLOAD_MAX; i++) {
+        payload += i == 0 ? "AB" : " AB";
+    }
+    File file = writeTrace("4294967295,E0:7D:EA:12:34:56,-100," + payload + "\r\n");
+
+    ReplayResult result = replayTrace(file, false, recordLength);
+
+    TEST_ASSERT_EQUAL_UINT32(1, result.adverts);
+    TEST_ASSERT_EQUAL_UINT32(0, result.rejected);
+    TEST_ASSERT_EQUAL(REPLAY_PAYLOAD_MAX, lastReplayLength);
+}
+
+void test_overlong_line_is_rejected_whole() {
+    String payload;
+    for (size_t i = 0; i < REPLAY_LINE_MAX; i++) {
+        payload += "AB ";
+    }
+    File file = writeTrace("0,E0:7D:EA:12:34:56,-60," + payload + "\n" +
+                           "10,E0:7D:EA:12:34:57,-60,0201060416AAFE00\n");
+
+    ReplayResult result = replayTrace(file, false, recordLength);
+
+    TEST_ASSERT_EQUAL_UINT32(2, result.lines);
+    TEST_ASSERT_EQUAL_UINT32(1, result.rejected);
+    TEST_ASSERT_EQUAL_UINT32(1, result.adverts);
+    TEST_ASSERT_EQUAL(8, lastReplayLength);
+}
+
+void test_replay_reaches_the_tracker_and_sink() {
+    String trace = "# twenty LOP001 sensors, three rounds\n";
+    for (int round = 0; round < 3; round++) {
+        for (int device = 0; device < REPLAY_DEVICES; device++) {
+            trace += lop001Line(round * 30000 + device * 10, device, 2000 + round * 100);
+        }
+    }
+    File file = writeTrace(trace);
+
+    ReplayResult result = replayTrace(file, false, hostReplayIngest);
+    runTrackerPass();
+
+    TEST_ASSERT_EQUAL_UINT32(REPLAY_DEVICES * 3, result.adverts);
+    TEST_ASSERT_EQUAL_UINT32(0, result.rejected);
+    TEST_ASSERT_EQUAL(REPLAY_DEVICES, deviceTable.size());
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(REPLAY_DEVICES, publishSink.messages);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, publishSink.bytes);
+}
+
+void test_steady_state_pipeline_does_not_allocate() {
+    String trace;
+    for (int device = 0; device < REPLAY_DEVICES; device++) {
+        trace += lop001Line(device * 10, device, 2000);
+    }
+    File warmup = writeTrace(trace);
+    replayTrace(warmup, false, hostReplayIngest);
+    runTrackerPass();
+    warmup.close();
+
+    // Same devices again with new readings, once every table entry exists
+    trace = "";
+    for (int device = 0; device < REPLAY_DEVICES; device++) {
+        trace += lop001Line(60000 + device * 10, device, 2500);
+    }
+    File file = writeTrace(trace);
+    hostAdvanceMs(60000);
+    uint32_t sentBefore = publishSink.messages;
+
+    AllocationScope scope;
+    ReplayResult result = replayTrace(file, false, hostReplayIngest);
+    runTrackerPass();
+
+    TEST_ASSERT_EQUAL_UINT32(REPLAY_DEVICES, result.queued);
+    TEST_ASSERT_GREATER_THAN_UINT32(sentBefore, publishSink.messages);
+    TEST_ASSERT_EQUAL_UINT32(0, scope.allocations());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_full_payload_as_spaced_hex_fits_a_line);
+    RUN_TEST(test_overlong_line_is_rejected_whole);
+    RUN_TEST(test_replay_reaches_the_tracker_and_sink);
+    RUN_TEST(test_steady_state_pipeline_does_not_allocate);
+    return UNITY_END();
+}
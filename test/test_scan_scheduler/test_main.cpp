@@ -0,0 +1,183 @@
+#include <unity.h>
+#include <vector>
+#include "scan_scheduler.h"
+
+// Small deterministic generator so the simulations repeat exactly
+uint32_t simState = 1;
+uint32_t simRandom() {
+    simState = simState * 1664525u + 1013904223u;
+    return simState >> 8;
+}
+
+// Learn each device's period from a simulated advert timeline (period plus
+// the 0-10 ms advDelay, one reception in `heardOneIn` events) and feed the
+// results to the scheduler
+void observeMix(ScanScheduler& scheduler, const std::vector<uint32_t>& periods, uint32_t heardOneIn = 1) {
+    scheduler.beginEpoch();
+    for (uint32_t period : periods) {
+        uint32_t learned = 0;
+        uint8_t longGaps = 0;
+        uint32_t lastHeard = 0;
+        uint32_t now = 0;
+        for (int event = 0; event < 200; event++) {
+            now += period + simRandom() % 11;
+            if (simRandom() % heardOneIn != 0) {
+                continue;
+            }
+            if (lastHeard != 0) {
+                learnAdvertPeriod(learned, longGaps, now - lastHeard);
+            }
+            lastHeard = now;
+        }
+        scheduler.observePeriod(learned);
+    }
+}
+
+// Share of horizons in which a device with this period is heard at least
+// once, listening windowMs of every SCAN_INTERVAL_MS at a random phase per event
+float simulatedCapture(uint32_t periodMs, uint16_t windowMs, int horizons) {
+    int captured = 0;
+    uint32_t events = SCAN_CAPTURE_HORIZON_MS / periodMs;
+    for (int h = 0; h < horizons; h++) {
+        bool heard = false;
+        for (uint32_t e = 0; e < events && !heard; e++) {
+            heard = simRandom() % SCAN_INTERVAL_MS < windowMs;
+        }
+        captured += heard;
+    }
+    return (float)captured / horizons;
+}
+
+void setUp() {
+    simState = 1;
+}
+
+void tearDown() {}
+
+void test_period_learning_ignores_repeats_and_missed_adverts() {
+    uint32_t period = 0;
+    uint8_t longGaps = 0;
+    learnAdvertPeriod(period, longGaps, 1000);
+    learnAdvertPeriod(period, longGaps, 5);      // Same event on another channel
+    TEST_ASSERT_EQUAL_UINT32(1000, period);
+    learnAdvertPeriod(period, longGaps, 2000);   // One advert missed
+    learnAdvertPeriod(period, longGaps, 3000);
+    TEST_ASSERT_EQUAL_UINT32(1000, period);
+    learnAdvertPeriod(period, longGaps, 1008);   // Jitter drifts slowly
+    TEST_ASSERT_EQUAL_UINT32(1001, period);
+    learnAdvertPeriod(period, longGaps, 500);    // Faster: converges quickly
+    TEST_ASSERT_EQUAL_UINT32(875, period);
+
+    // A device that really slowed down is re-learned after ADV_LONG_GAP_RESET gaps
+    for (int i = 0; i < ADV_LONG_GAP_RESET - 1; i++) {
+        learnAdvertPeriod(period, longGaps, 5000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(875, period);
+    learnAdvertPeriod(period, longGaps, 5000);
+    TEST_ASSERT_EQUAL_UINT32(5000, period);
+}
+
+void test_period_is_learned_through_jitter_and_loss() {
+    ScanScheduler scheduler;
+    observeMix(scheduler, { 1000 }, 3);  // Only a third of the adverts heard
+    TEST_ASSERT_UINT32_WITHIN(60, 1005, scheduler.slowestPeriodMs());
+}
+
+void test_fast_mix_is_clamped_to_the_minimum_duty() {
+    ScanScheduler scheduler;
+    observeMix(scheduler, { 100, 100, 250, 500, 1000 });
+    TEST_ASSERT_EQUAL_UINT32(5, scheduler.devices());
+    TEST_ASSERT_TRUE(scheduler.decide());
+    TEST_ASSERT_EQUAL_FLOAT(SCAN_DUTY_MIN, scheduler.duty());
+    TEST_ASSERT_EQUAL_UINT16(SCAN_INTERVAL_MS, scheduler.params().intervalMs);
+    TEST_ASSERT_EQUAL_UINT16(10, scheduler.params().windowMs);
+}
+
+void test_slowest_device_sets_the_duty() {
+    ScanScheduler scheduler;
+    observeMix(scheduler, { 100, 1000, 10000 });
+    scheduler.decide();
+    // Six events per minute: 1 - 0.01^(1/6) = 53.6 %
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 0.536, scheduler.duty());
+    TEST_ASSERT_UINT32_WITHIN(2, 54, scheduler.params().windowMs);
+}
+
+void test_slow_or_unknown_mix_is_clamped_to_the_maximum_duty() {
+    ScanScheduler scheduler;
+    observeMix(scheduler, { 1000, 60000 });  // Heard at most once per horizon
+    scheduler.decide();
+    TEST_ASSERT_EQUAL_FLOAT(SCAN_DUTY_MAX, scheduler.duty());
+    TEST_ASSERT_EQUAL_UINT16(90, scheduler.params().windowMs);
+
+    // Nothing learned yet: listen as much as allowed
+    scheduler.beginEpoch();
+    scheduler.observePeriod(0);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.devices());
+    scheduler.decide();
+    TEST_ASSERT_EQUAL_FLOAT(SCAN_DUTY_MAX, scheduler.duty());
+}
+
+void test_chosen_duty_meets_the_capture_target() {
+    const uint32_t periods[] = { 2000, 5000, 10000, 20000 };
+    for (uint32_t period : periods) {
+        ScanScheduler scheduler;
+        scheduler.observePeriod(period);
+        scheduler.decide();
+        uint16_t window = scheduler.params().windowMs;
+        float capture = simulatedCapture(period, window, 20000);
+        char label[48];
+        snprintf(label, sizeof(label), "period %u ms, window %u ms", (unsigned)period, (unsigned)window);
+        TEST_ASSERT_TRUE_MESSAGE(capture >= SCAN_CAPTURE_TARGET - 0.005, label);
+    }
+}
+
+void test_small_changes_do_not_restart_the_scan() {
+    ScanScheduler scheduler;
+    scheduler.beginEpoch();
+    scheduler.observePeriod(10000);
+    TEST_ASSERT_TRUE(scheduler.decide());
+    uint16_t window = scheduler.params().windowMs;
+
+    // A slightly slower device moves the ideal window by less than the hysteresis
+    scheduler.beginEpoch();
+    scheduler.observePeriod(10500);
+    TEST_ASSERT_FALSE(scheduler.decide());
+    TEST_ASSERT_EQUAL_UINT16(window, scheduler.params().windowMs);
+    TEST_ASSERT_TRUE(scheduler.duty() > 0.536);  // The wanted duty is still reported
+
+    // Repeated identical epochs never flap
+    for (int i = 0; i < 10; i++) {
+        scheduler.beginEpoch();
+        scheduler.observePeriod(10000);
+        TEST_ASSERT_FALSE(scheduler.decide());
+    }
+
+    // A real change does
+    scheduler.beginEpoch();
+    scheduler.observePeriod(20000);
+    TEST_ASSERT_TRUE(scheduler.decide());
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(window + SCAN_WINDOW_HYSTERESIS_MS, scheduler.params().windowMs);
+}
+
+void test_device_leaving_lowers_the_duty() {
+    ScanScheduler scheduler;
+    observeMix(scheduler, { 1000, 20000 });
+    scheduler.decide();
+    uint16_t withSlowDevice = scheduler.params().windowMs;
+    observeMix(scheduler, { 1000 });
+    TEST_ASSERT_TRUE(scheduler.decide());
+    TEST_ASSERT_LESS_THAN(withSlowDevice, scheduler.params().windowMs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_period_learning_ignores_repeats_and_missed_adverts);
+    RUN_TEST(test_period_is_learned_through_jitter_and_loss);
+    RUN_TEST(test_fast_mix_is_clamped_to_the_minimum_duty);
+    RUN_TEST(test_slowest_device_sets_the_duty);
+    RUN_TEST(test_slow_or_unknown_mix_is_clamped_to_the_maximum_duty);
+    RUN_TEST(test_chosen_duty_meets_the_capture_target);
+    RUN_TEST(test_small_changes_do_not_restart_the_scan);
+    RUN_TEST(test_device_leaving_lowers_the_duty);
+    return UNITY_END();
+}
@@ -0,0 +1,146 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <mutex>
+#include "bench.h"
+#include "beacon_decoders.h"
+#include "scanner_fake.h"
+
+// What the fake scanner handed to ingest, checked on the test thread
+struct IngestLog {
+    std::mutex lock;
+    uint32_t adverts = 0;
+    uint32_t badAdverts = 0;  // Not a decodable LOP001, or fields out of range
+    uint32_t perDevice[FAKE_SCANNER_DEVICES] = {};
+    int16_t firstTemperature[FAKE_SCANNER_DEVICES] = {};
+};
+
+IngestLog ingestLog;
+
+bool recordAdvert(uint64_t mac, int8_t rssi, const uint8_t* payload, size_t length, uint32_t /*now*/) {
+    std::lock_guard<std::mutex> guard(ingestLog.lock);
+    ingestLog.adverts++;
+    BeaconReading reading;
+    uint64_t device = mac - FAKE_SCANNER_MAC_BASE;
+    if (mac < FAKE_SCANNER_MAC_BASE || device >= FAKE_SCANNER_DEVICES || length > 31 ||
+        !decodeBeacon(payload, length, reading) || reading.format != BEACON_LOP001 ||
+        reading.identity != BEACON_IDENTITY_SHAPE || rssi != -50 - (int)(device % 40)) {
+        ingestLog.badAdverts++;
+        return false;
+    }
+    if (ingestLog.perDevice[device]++ == 0) {
+        ingestLog.firstTemperature[device] = reading.temperatureCenti;
+    }
+    return true;
+}
+
+// Run the scanner for `ms` and return the adverts it delivered
+uint32_t runFor(FakeScanner& scanner, uint32_t ms) {
+    uint32_t before;
+    {
+        std::lock_guard<std::mutex> guard(ingestLog.lock);
+        before = ingestLog.adverts;
+    }
+    TEST_ASSERT_TRUE(scanner.start());
+    TEST_ASSERT_TRUE(scanner.isRunning());
+    delay(ms);
+    scanner.stop();
+    TEST_ASSERT_FALSE(scanner.isRunning());
+    std::lock_guard<std::mutex> guard(ingestLog.lock);
+    return ingestLog.adverts - before;
+}
+
+void setUp() {
+    std::lock_guard<std::mutex> guard(ingestLog.lock);
+    ingestLog.adverts = 0;
+    ingestLog.badAdverts = 0;
+    memset(ingestLog.perDevice, 0, sizeof(ingestLog.perDevice));
+}
+
+void tearDown() {}
+
+void test_adverts_decode_as_lop001_from_the_fake_population() {
+    FakeScanner scanner;
+    TEST_ASSERT_EQUAL_STRING("fake", scanner.name());
+    TEST_ASSERT_TRUE(scanner.begin(recordAdvert));
+    TEST_ASSERT_FALSE(scanner.isRunning());
+
+    // One full round at full duty: every device is heard, in order
+    uint32_t adverts = runFor(scanner, FAKE_SCANNER_PERIOD_MS + FAKE_SCANNER_PERIOD_MS / 5);
+    std::lock_guard<std::mutex> guard(ingestLog.lock);
+    TEST_ASSERT_EQUAL_UINT32(0, ingestLog.badAdverts);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(FAKE_SCANNER_DEVICES, adverts);
+    for (uint32_t device = 0; device < FAKE_SCANNER_DEVICES; device++) {
+        TEST_ASSERT_TRUE(ingestLog.perDevice[device] >= 1);
+        TEST_ASSERT_EQUAL_INT16(2000 + device * 10, ingestLog.firstTemperature[device]);
+    }
+}
+
+void test_rate_follows_the_configured_population_and_period() {
+    FakeScanner scanner;
+    TEST_ASSERT_TRUE(scanner.begin(recordAdvert));
+    ScanParams full = { 100, 100 };
+    scanner.configure(false, full);
+
+    // FAKE_SCANNER_DEVICES per FAKE_SCANNER_PERIOD_MS; host sleeps only overshoot
+    uint32_t adverts = runFor(scanner, FAKE_SCANNER_PERIOD_MS);
+    benchReport("fake scanner, full duty", adverts * 60000.0 / FAKE_SCANNER_PERIOD_MS, "adverts/min");
+    TEST_ASSERT_TRUE(adverts <= FAKE_SCANNER_DEVICES + 1);
+    TEST_ASSERT_TRUE(adverts >= FAKE_SCANNER_DEVICES / 2);
+}
+
+void test_listening_duty_drops_adverts() {
+    FakeScanner scanner;
+    TEST_ASSERT_TRUE(scanner.begin(recordAdvert));
+    ScanParams none = { 100, 0 };
+    scanner.configure(false, none);
+    TEST_ASSERT_EQUAL_UINT32(0, runFor(scanner, FAKE_SCANNER_PERIOD_MS / 2));
+
+    // About a quarter heard over four rounds (fixed draw count, random picks)
+    ScanParams quarter = { 100, 25 };
+    scanner.configure(false, quarter);
+    uint32_t adverts = runFor(scanner, FAKE_SCANNER_PERIOD_MS * 4);
+    TEST_ASSERT_TRUE(adverts > 0);
+    TEST_ASSERT_TRUE(adverts < FAKE_SCANNER_DEVICES * 2);
+    std::lock_guard<std::mutex> guard(ingestLog.lock);
+    TEST_ASSERT_EQUAL_UINT32(0, ingestLog.badAdverts);
+}
+
+void test_stop_waits_for_the_task_and_start_restarts() {
+    FakeScanner scanner;
+    TEST_ASSERT_TRUE(scanner.begin(recordAdvert));
+    for (int cycle = 0; cycle < 5; cycle++) {
+        runFor(scanner, 30);
+        // Stopped means no further adverts arrive
+        uint32_t stoppedAt;
+        {
+            std::lock_guard<std::mutex> guard(ingestLog.lock);
+            stoppedAt = ingestLog.adverts;
+        }
+        delay(60);
+        std::lock_guard<std::mutex> guard(ingestLog.lock);
+        TEST_ASSERT_EQUAL_UINT32(stoppedAt, ingestLog.adverts);
+    }
+    // A second start while running does not spawn a second task (which
+    // would double the rate)
+    uint32_t before;
+    {
+        std::lock_guard<std::mutex> guard(ingestLog.lock);
+        before = ingestLog.adverts;
+    }
+    TEST_ASSERT_TRUE(scanner.start());
+    TEST_ASSERT_TRUE(scanner.start());
+    delay(FAKE_SCANNER_PERIOD_MS / 2);
+    scanner.stop();
+    std::lock_guard<std::mutex> guard(ingestLog.lock);
+    TEST_ASSERT_TRUE(ingestLog.adverts - before <= FAKE_SCANNER_DEVICES / 2 + 1);
+    TEST_ASSERT_EQUAL_UINT32(0, ingestLog.badAdverts);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_adverts_decode_as_lop001_from_the_fake_population);
+    RUN_TEST(test_rate_follows_the_configured_population_and_period);
+    RUN_TEST(test_listening_duty_drops_adverts);
+    RUN_TEST(test_stop_waits_for_the_task_and_start_restarts);
+    return UNITY_END();
+}
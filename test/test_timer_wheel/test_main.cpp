@@ -0,0 +1,277 @@
+#include <unity.h>
+#include <vector>
+#include "gateway_host.h"
+
+const size_t WHEEL_SIZE = 64;
+typedef TimerWheel<WHEEL_SIZE> Wheel;
+
+uint32_t simState = 1;
+uint32_t simRandom() {
+    simState = simState * 1664525u + 1013904223u;
+    return simState >> 8;
+}
+
+// What the wheel should hold: one optional deadline per index
+struct ReferenceTimers {
+    bool scheduled[WHEEL_SIZE];
+    uint32_t expires[WHEEL_SIZE];
+
+    void clear() {
+        memset(scheduled, 0, sizeof(scheduled));
+    }
+
+    void schedule(uint16_t index, uint32_t tick, uint32_t current) {
+        scheduled[index] = true;
+        expires[index] = (int32_t)(tick - current) < 0 ? current : tick;
+    }
+
+    size_t pending() const {
+        size_t count = 0;
+        for (size_t i = 0; i < WHEEL_SIZE; i++) {
+            count += scheduled[i];
+        }
+        return count;
+    }
+};
+
+Wheel wheel;
+ReferenceTimers reference;
+
+// Each fired index with the tick it fired on
+struct Firing {
+    uint16_t index;
+    uint32_t tick;
+};
+std::vector<Firing> fired;
+
+void recordFiring(uint16_t index) {
+    fired.push_back({ index, wheel.currentTick() - 1 });
+}
+
+void assertMatchesReference() {
+    TEST_ASSERT_EQUAL_UINT32(reference.pending(), wheel.pending());
+    for (uint16_t i = 0; i < WHEEL_SIZE; i++) {
+        TEST_ASSERT_EQUAL(reference.scheduled[i], wheel.isScheduled(i));
+    }
+}
+
+// Advance both to `tick`: every reference deadline up to it fires, on its
+// own tick and in tick order, and nothing else does
+void advanceBoth(uint32_t tick) {
+    uint32_t from = wheel.currentTick();
+    fired.clear();
+    wheel.advance(tick, recordFiring);
+
+    size_t due = 0;
+    for (uint16_t i = 0; i < WHEEL_SIZE; i++) {
+        if (reference.scheduled[i] && (int32_t)(reference.expires[i] - tick) <= 0) {
+            due++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(due, fired.size());
+    for (size_t f = 0; f < fired.size(); f++) {
+        const Firing& firing = fired[f];
+        TEST_ASSERT_TRUE(reference.scheduled[firing.index]);
+        TEST_ASSERT_EQUAL_UINT32(reference.expires[firing.index], firing.tick);
+        TEST_ASSERT_TRUE(f == 0 || (int32_t)(firing.tick - fired[f - 1].tick) >= 0);
+        TEST_ASSERT_TRUE((int32_t)(firing.tick - from) >= 0);
+        reference.scheduled[firing.index] = false;
+    }
+    TEST_ASSERT_EQUAL_UINT32(tick + 1, wheel.currentTick());
+    assertMatchesReference();
+}
+
+void setUp() {
+    simState = 1;
+    reference.clear();
+    fired.clear();
+}
+
+void tearDown() {
+    deviceKeepaliveMs = DEVICE_KEEPALIVE_DEFAULT_MS;
+    deviceExpiryMs = DEVICE_EXPIRY_DEFAULT_MS;
+}
+
+const uint32_t SCHEDULE_SPANS[] = { 16, 300, 20000, 1u << 21 };
+const uint32_t ADVANCE_STEPS[] = { 0, 1, 200, 5000 };
+
+void test_random_schedule_cancel_advance_matches_the_reference_across_the_wrap() {
+    // Start a million ticks before uint32 wraps and run well past it
+    const uint32_t START = 0xFFFFFFFFu - (1u << 20);
+    wheel.reset(START);
+    uint32_t advanced = 0;
+    for (int step = 0; step < 20000; step++) {
+        uint16_t index = simRandom() % WHEEL_SIZE;
+        uint32_t current = wheel.currentTick();
+        uint32_t choice = simRandom() % 10;
+        if (choice < 5) {
+            // Mostly near deadlines, some on every coarse level, a few past
+            uint32_t span = SCHEDULE_SPANS[simRandom() % 4];
+            uint32_t tick = current + simRandom() % span - (choice == 0 ? span / 2 : 0);
+            wheel.schedule(index, tick);
+            reference.schedule(index, tick, current);
+        } else if (choice < 7) {
+            wheel.cancel(index);
+            reference.scheduled[index] = false;
+        } else {
+            uint32_t ticks = ADVANCE_STEPS[simRandom() % 4];
+            advanceBoth(current + ticks);
+            advanced += ticks + 1;
+        }
+        assertMatchesReference();
+    }
+    // Drain what is left, far enough to reach the longest deadline
+    advanceBoth(wheel.currentTick() + (1u << 21));
+    TEST_ASSERT_EQUAL_UINT32(0, wheel.pending());
+    TEST_ASSERT_TRUE(advanced > (1u << 21));  // The wrap was crossed
+    TEST_ASSERT_TRUE(wheel.currentTick() < START);
+}
+
+void test_coarse_deadlines_cascade_to_their_exact_tick() {
+    // One deadline on each level and on each level's boundary
+    const uint32_t delays[] = { 1, 255, 256, 257, 300, 16383, 16384, 16390, (1u << 20) - 1, (1u << 20) + 7, 3u << 20 };
+    const size_t COUNT = sizeof(delays) / sizeof(delays[0]);
+    const uint32_t START = 12345;
+    wheel.reset(START);
+    for (uint16_t i = 0; i < COUNT; i++) {
+        wheel.schedule(i, START + delays[i]);
+        reference.schedule(i, START + delays[i], START);
+    }
+    // In uneven steps, so cascades happen mid-advance
+    while (wheel.pending() > 0) {
+        advanceBoth(wheel.currentTick() + 999);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, reference.pending());
+}
+
+void test_deadlines_beyond_the_range_are_clamped() {
+    wheel.reset(0);
+    wheel.schedule(0, Wheel::MAX_DELAY + 1000);
+    fired.clear();
+    wheel.advance(Wheel::MAX_DELAY - 1, recordFiring);
+    TEST_ASSERT_EQUAL_UINT32(0, fired.size());
+    wheel.advance(Wheel::MAX_DELAY, recordFiring);
+    TEST_ASSERT_EQUAL_UINT32(1, fired.size());
+    TEST_ASSERT_EQUAL_UINT32(Wheel::MAX_DELAY, fired[0].tick);
+}
+
+void test_callback_can_cancel_and_reschedule() {
+    wheel.reset(1000);
+    // Five deadlines on one tick, one a coarse slot away
+    const uint16_t SAME_TICK = 5;
+    for (uint16_t i = 0; i < SAME_TICK; i++) {
+        wheel.schedule(i, 1010);
+    }
+    wheel.schedule(SAME_TICK, 1500);
+
+    std::vector<uint16_t> order;
+    wheel.advance(1010, [&](uint16_t index) {
+        order.push_back(index);
+        if (order.size() == 1) {
+            // Cancel the other entries of this tick bar one (whichever runs
+            // next among them), and the coarse one
+            uint16_t survivor = index == 0 ? 1 : 0;
+            for (uint16_t other = 0; other <= SAME_TICK; other++) {
+                if (other != index && other != survivor) {
+                    wheel.cancel(other);
+                }
+            }
+            // Re-file itself on the same slot, one wheel turn later
+            wheel.schedule(index, 1010 + 256);
+        } else {
+            // Due now: fires on the next tick, not again in this one
+            wheel.schedule(index, 1000);
+        }
+    });
+    TEST_ASSERT_EQUAL_UINT32(2, order.size());
+    TEST_ASSERT_EQUAL_UINT32(2, wheel.pending());
+    uint16_t first = order[0];
+    uint16_t second = order[1];
+    TEST_ASSERT_TRUE(wheel.isScheduled(first));
+    TEST_ASSERT_TRUE(wheel.isScheduled(second));
+    TEST_ASSERT_FALSE(wheel.isScheduled(SAME_TICK));
+
+    order.clear();
+    wheel.advance(1011, [&](uint16_t index) { order.push_back(index); });
+    TEST_ASSERT_EQUAL_UINT32(1, order.size());
+    TEST_ASSERT_EQUAL_UINT16(second, order[0]);
+
+    order.clear();
+    wheel.advance(1010 + 255, [&](uint16_t index) { order.push_back(index); });
+    TEST_ASSERT_EQUAL_UINT32(0, order.size());
+    wheel.advance(1010 + 256, [&](uint16_t index) { order.push_back(index); });
+    TEST_ASSERT_EQUAL_UINT32(1, order.size());
+    TEST_ASSERT_EQUAL_UINT16(first, order[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, wheel.pending());
+}
+
+// LOP001 at 20.00 C, the same reading every time
+const uint8_t LOP001_ADVERT[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0xD0, 0x07, 0x94, 0x11 };
+
+void hear(uint64_t mac) {
+    TEST_ASSERT_TRUE(ingestAdvert(mac, -60, LOP001_ADVERT, sizeof(LOP001_ADVERT), millis()));
+}
+
+void test_tracker_keepalive_and_expiry_fire_at_their_own_intervals() {
+    resetGatewayHost();
+    hostAdvanceMs(1000);  // Past boot: a lastPublish of 0 means never published
+    mqtt_connected = true;
+    deviceKeepaliveMs = 2 * 60 * 1000;
+    deviceExpiryMs = 5 * 60 * 1000;
+    const uint64_t QUIET = 0xE07DEA000001ULL;   // Heard once
+    const uint64_t STEADY = 0xE07DEA000002ULL;  // Heard every minute
+
+    hear(QUIET);
+    hear(STEADY);
+    runTrackerPass();
+    TEST_ASSERT_EQUAL_UINT32(1, deviceTable.find(QUIET)->publishes);
+    TEST_ASSERT_EQUAL_UINT32(1, deviceTable.find(STEADY)->publishes);
+
+    // Second by second: the publish count of each device, and when the
+    // quiet one was forgotten
+    uint32_t quietPublishes[450] = {};
+    uint32_t steadyPublishes[450] = {};
+    int forgottenAt = -1;
+    for (int second = 1; second < 450; second++) {
+        hostAdvanceMs(1000);
+        if (second % 60 == 0) {
+            hear(STEADY);
+        }
+        runTrackerPass();
+        TrackedDevice* quiet = deviceTable.find(QUIET);
+        if (quiet == nullptr && forgottenAt < 0) {
+            forgottenAt = second;
+        }
+        quietPublishes[second] = quiet != nullptr ? quiet->publishes : 0;
+        steadyPublishes[second] = deviceTable.find(STEADY)->publishes;
+    }
+
+    // Keepalives every 2 minutes (a tick of slack for the host clock), only
+    // for as long as the device is kept
+    TEST_ASSERT_EQUAL_UINT32(1, quietPublishes[118]);
+    TEST_ASSERT_EQUAL_UINT32(2, quietPublishes[122]);
+    TEST_ASSERT_EQUAL_UINT32(2, quietPublishes[238]);
+    TEST_ASSERT_EQUAL_UINT32(3, quietPublishes[242]);
+    // Expiry 5 minutes after it was last heard, not at a keepalive
+    TEST_ASSERT_INT_WITHIN(2, 300, forgottenAt);
+    TEST_ASSERT_EQUAL_UINT32(3, quietPublishes[forgottenAt - 2]);
+
+    // Hearing the steady device again neither publishes (same reading) nor
+    // moves its keepalive, which follows its last publish
+    TEST_ASSERT_EQUAL_UINT32(1, steadyPublishes[118]);
+    TEST_ASSERT_EQUAL_UINT32(2, steadyPublishes[122]);
+    TEST_ASSERT_EQUAL_UINT32(3, steadyPublishes[242]);
+    TEST_ASSERT_EQUAL_UINT32(3, steadyPublishes[358]);
+    TEST_ASSERT_EQUAL_UINT32(4, steadyPublishes[362]);
+    TEST_ASSERT_NOT_NULL(deviceTable.find(STEADY));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_random_schedule_cancel_advance_matches_the_reference_across_the_wrap);
+    RUN_TEST(test_coarse_deadlines_cascade_to_their_exact_tick);
+    RUN_TEST(test_deadlines_beyond_the_range_are_clamped);
+    RUN_TEST(test_callback_can_cancel_and_reschedule);
+    RUN_TEST(test_tracker_keepalive_and_expiry_fire_at_their_own_intervals);
+    return UNITY_END();
+}
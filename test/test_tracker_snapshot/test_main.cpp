@@ -0,0 +1,214 @@
+#include <unity.h>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "gateway_host.h"
+
+const uint64_t MAC_BASE = 0xE07DEA000000ULL;
+const int DEVICES = 200;
+
+typedef std::vector<uint8_t> FileBytes;
+
+// LOP001 (0x181A service data, no name) with the given temperature
+void ingestLop001(uint64_t mac, int16_t temperatureCenti) {
+    uint8_t advert[] = { 0x02, 0x01, 0x06, 0x07, 0x16, 0x1A, 0x18, 0x00, 0x00, 0x94, 0x11 };
+    advert[7] = (uint8_t)temperatureCenti;
+    advert[8] = (uint8_t)(temperatureCenti >> 8);
+    TEST_ASSERT_TRUE(ingestAdvert(mac, -60, advert, sizeof(advert), millis()));
+    while (drainAdvertRing() > 0) {
+    }
+}
+
+FileBytes readSnapshotFile() {
+    FileBytes bytes;
+    File file = SPIFFS.open(TRACKER_SNAPSHOT_FILE, "r");
+    if (file) {
+        bytes.resize(file.size());
+        file.read(bytes.data(), bytes.size());
+    }
+    return bytes;
+}
+
+void writeSnapshotFile(const FileBytes& bytes) {
+    File file = SPIFFS.open(TRACKER_SNAPSHOT_FILE, "w");
+    file.write(bytes.data(), bytes.size());
+}
+
+// Power-cycle: the table and SPIFFS are wiped, then only the snapshot file
+// comes back, as it would from flash, and the tracker task's boot runs
+void rebootWith(const FileBytes& bytes) {
+    resetGatewayHost();
+    mqtt_connected = true;
+    writeSnapshotFile(bytes);
+    restoreTrackerSnapshot();
+}
+
+// Published sensors at 20.00 C + device/100, saved
+FileBytes savePublishedTable() {
+    for (int device = 0; device < DEVICES; device++) {
+        ingestLop001(MAC_BASE + device, 2000 + device);
+    }
+    runTrackerPass();
+    TEST_ASSERT_EQUAL_UINT32(DEVICES, publishSink.messages);
+    TEST_ASSERT_TRUE(saveTrackerSnapshot());
+    FileBytes bytes = readSnapshotFile();
+    TEST_ASSERT_EQUAL_UINT32(sizeof(SnapshotHeader) + DEVICES * sizeof(SnapshotRecord) + sizeof(SnapshotTrailer),
+                             bytes.size());
+    return bytes;
+}
+
+void setUp() {
+    resetGatewayHost();
+    hostAdvanceMs(1000);  // Past boot: a lastPublish of 0 means never published
+    mqtt_connected = true;
+    enableTrackerSnapshots();
+}
+
+void tearDown() {
+    fs::hostFsLatencyUs = 0;
+}
+
+void test_save_and_restore_round_trip() {
+    FileBytes bytes = savePublishedTable();
+
+    int64_t restoreStart = esp_timer_get_time();
+    rebootWith(bytes);
+    benchReport("restore 200 devices", (double)(esp_timer_get_time() - restoreStart), "us");
+
+    TEST_ASSERT_EQUAL_UINT32(DEVICES, deviceTable.size());
+    for (int device = 0; device < DEVICES; device++) {
+        TrackedDevice* restored = deviceTable.find(MAC_BASE + device);
+        TEST_ASSERT_NOT_NULL(restored);
+        TEST_ASSERT_EQUAL_UINT8(BEACON_LOP001, restored->format);
+        TEST_ASSERT_TRUE(restored->isSensor);
+        TEST_ASSERT_EQUAL_INT16(2000 + device, restored->temperatureCenti);
+        TEST_ASSERT_EQUAL_INT16(2000 + device, restored->lastTemperatureCenti);
+        TEST_ASSERT_EQUAL_UINT32(4500, restored->humidityCenti);
+        TEST_ASSERT_EQUAL_INT16(-60, restored->rssi);
+        TEST_ASSERT_EQUAL_UINT32(1, restored->readings);
+        TEST_ASSERT_EQUAL_UINT32(1, restored->publishes);
+        TEST_ASSERT_TRUE(restored->lastPublish != 0);
+    }
+    TEST_ASSERT_TRUE(SPIFFS.exists(TRACKER_SNAPSHOT_FILE));
+}
+
+void test_warm_restart_does_not_republish() {
+    FileBytes bytes = savePublishedTable();
+    rebootWith(bytes);
+    runTrackerPass();
+    TEST_ASSERT_EQUAL_UINT32(0, publishSink.messages);
+
+    // The same readings again are not changes against the restored baselines
+    for (int device = 0; device < DEVICES; device++) {
+        ingestLop001(MAC_BASE + device, 2000 + device);
+    }
+    runTrackerPass();
+    TEST_ASSERT_EQUAL_UINT32(0, publishSink.messages);
+}
+
+void test_never_published_devices_are_sent_after_restart() {
+    for (int device = 0; device < DEVICES; device++) {
+        ingestLop001(MAC_BASE + device, 2000 + device);
+    }
+    runTrackerPass();
+    // Heard, but the reboot comes before the next publish pass
+    const int LATE = 10;
+    for (int device = DEVICES; device < DEVICES + LATE; device++) {
+        ingestLop001(MAC_BASE + device, 2000 + device);
+    }
+    TEST_ASSERT_TRUE(saveTrackerSnapshot());
+
+    rebootWith(readSnapshotFile());
+    TEST_ASSERT_EQUAL_UINT32(DEVICES + LATE, deviceTable.size());
+    runTrackerPass();
+    TEST_ASSERT_EQUAL_UINT32(LATE, publishSink.messages);
+}
+
+// Rebooting with a damaged file leaves the table empty and drops the file
+void assertColdStart(const FileBytes& bytes) {
+    rebootWith(bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, deviceTable.size());
+    TEST_ASSERT_FALSE(SPIFFS.exists(TRACKER_SNAPSHOT_FILE));
+}
+
+void test_bad_crc_is_rejected() {
+    FileBytes bytes = savePublishedTable();
+    bytes[sizeof(SnapshotHeader) + 5 * sizeof(SnapshotRecord) + 2] ^= 0x01;  // A temperature bit
+    assertColdStart(bytes);
+}
+
+void test_bad_version_is_rejected() {
+    FileBytes bytes = savePublishedTable();
+    SnapshotHeader* header = (SnapshotHeader*)bytes.data();
+    header->version = TRACKER_SNAPSHOT_VERSION + 1;
+    assertColdStart(bytes);
+
+    bytes = savePublishedTable();
+    header = (SnapshotHeader*)bytes.data();
+    header->magic ^= 0xFF;
+    assertColdStart(bytes);
+}
+
+void test_truncated_file_is_rejected() {
+    FileBytes bytes = savePublishedTable();
+    FileBytes torn(bytes.begin(), bytes.end() - sizeof(SnapshotRecord));  // Lost the last record's worth
+    assertColdStart(torn);
+
+    bytes = savePublishedTable();
+    torn.assign(bytes.begin(), bytes.begin() + sizeof(SnapshotHeader) + 3);
+    assertColdStart(torn);
+
+    assertColdStart(FileBytes());
+}
+
+void test_concurrent_saves_leave_a_valid_snapshot() {
+    savePublishedTable();
+    // Slow flash widens the window in which two unserialized saves would
+    // share the batch buffer and the temp file
+    fs::hostFsLatencyUs = 200;
+    const int SAVES = 10;
+    int failures = 0;
+    std::thread other([&]() {
+        for (int i = 0; i < SAVES; i++) {
+            failures += saveTrackerSnapshot() ? 0 : 1;
+        }
+    });
+    int ownFailures = 0;
+    for (int i = 0; i < SAVES; i++) {
+        ownFailures += saveTrackerSnapshot() ? 0 : 1;
+    }
+    other.join();
+    fs::hostFsLatencyUs = 0;
+    TEST_ASSERT_EQUAL_INT(0, failures);
+    TEST_ASSERT_EQUAL_INT(0, ownFailures);
+    TEST_ASSERT_FALSE(SPIFFS.exists(TRACKER_SNAPSHOT_TEMP));
+
+    rebootWith(readSnapshotFile());
+    TEST_ASSERT_EQUAL_UINT32(DEVICES, deviceTable.size());
+}
+
+void test_save_before_the_tracker_starts_is_skipped() {
+    FileBytes bytes = savePublishedTable();
+    // Config mode, or a REBOOT before the tracker task restored the last
+    // snapshot: nothing to save, and the old file is kept
+    SemaphoreHandle_t mutex = trackerSnapshotMutex;
+    trackerSnapshotMutex = NULL;
+    resetGatewayHost();
+    writeSnapshotFile(bytes);
+    TEST_ASSERT_FALSE(saveTrackerSnapshot());
+    trackerSnapshotMutex = mutex;
+    TEST_ASSERT_TRUE(readSnapshotFile() == bytes);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_save_and_restore_round_trip);
+    RUN_TEST(test_warm_restart_does_not_republish);
+    RUN_TEST(test_never_published_devices_are_sent_after_restart);
+    RUN_TEST(test_bad_crc_is_rejected);
+    RUN_TEST(test_bad_version_is_rejected);
+    RUN_TEST(test_truncated_file_is_rejected);
+    RUN_TEST(test_concurrent_saves_leave_a_valid_snapshot);
+    RUN_TEST(test_save_before_the_tracker_starts_is_skipped);
+    return UNITY_END();
+}